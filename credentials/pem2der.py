@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+#
+# Convert PEM credentials to DER and emit them as constexpr byte arrays
+#
+# Each --pem NAME=FILE converts all PEM blocks of FILE (e.g. certificate chain) into
+# concatenated DER. Each --key NAME=FILE converts the one private key block of FILE, skipping
+# EC PARAMETERS as openssl ecparam -genkey writes before it. Both emit:
+#
+#   constexpr unsigned char NAME[] = { ... };
+#
+# in namespace credentials_der of the output header. Encrypted private keys are rejected,
+# as they cannot be parsed without password on target.
+
+import argparse
+import base64
+import os
+import re
+import sys
+
+PEM_BLOCK = re.compile(r"-----BEGIN ([A-Z0-9 ]+)-----(.*?)-----END \1-----", re.S)
+
+# Private key blocks mbedtls_pk_parse_key() takes in DER: PKCS#8, PKCS#1 and SEC1
+KEY_LABELS = ("PRIVATE KEY", "RSA PRIVATE KEY", "EC PRIVATE KEY")
+
+
+def pem_to_der(path, key=False):
+    with open(path, "r") as f:
+        pem = f.read()
+
+    blocks = PEM_BLOCK.findall(pem)
+    if not blocks:
+        raise ValueError("%s: no PEM block" % path)
+
+    for label, body in blocks:
+        if "ENCRYPTED" in label or "Proc-Type: 4,ENCRYPTED" in body:
+            raise ValueError("%s: encrypted %s not supported" % (path, label))
+
+    if key:
+        # DER of concatenated blocks would start with the EC PARAMETERS OID and not parse
+        for label, body in blocks:
+            if label not in KEY_LABELS and label != "EC PARAMETERS":
+                raise ValueError("%s: unexpected %s in private key file" % (path, label))
+        blocks = [block for block in blocks if block[0] in KEY_LABELS]
+        if len(blocks) != 1:
+            raise ValueError("%s: %d private key blocks, need exactly one" % (path, len(blocks)))
+
+    der = b""
+    for label, body in blocks:
+        der += base64.b64decode("".join(body.split()))
+
+    # PEM literal in C carries null terminator
+    return der, len(pem.encode()) + 1
+
+
+def emit_array(name, der):
+    lines = ["constexpr unsigned char %s[] = {" % name]
+    for i in range(0, len(der), 16):
+        lines.append("    " + " ".join("0x%02x," % b for b in der[i:i + 16]))
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--pem", action="append", default=[], metavar="NAME=FILE",
+                        help="PEM file to convert into array NAME")
+    parser.add_argument("--key", action="append", default=[], metavar="NAME=FILE",
+                        help="PEM private key file to convert into array NAME")
+    parser.add_argument("--output", required=True, help="Header to generate")
+    args = parser.parse_args()
+
+    arrays = []
+    specs = [(spec, False) for spec in args.pem] + [(spec, True) for spec in args.key]
+    for spec, key in specs:
+        name, _, path = spec.partition("=")
+        try:
+            der, pem_size = pem_to_der(path, key)
+        except (OSError, ValueError) as e:
+            print("pem2der: %s" % e, file=sys.stderr)
+            return 1
+        arrays.append(emit_array(name, der))
+        print("pem2der: %s: PEM %d bytes -> DER %d bytes (%d bytes flash saved)"
+              % (name, pem_size, len(der), pem_size - len(der)))
+
+    header = "\n".join([
+        "/* Generated by credentials/pem2der.py. Do not edit. */",
+        "",
+        "#ifndef _CREDENTIALS_DER_H_",
+        "#define _CREDENTIALS_DER_H_",
+        "",
+        "namespace credentials_der {",
+        "",
+        "\n\n".join(arrays),
+        "",
+        "}",
+        "",
+        "#endif // _CREDENTIALS_DER_H_",
+        "",
+    ])
+
+    out_dir = os.path.dirname(args.output)
+    if out_dir:
+        os.makedirs(out_dir, exist_ok=True)
+    with open(args.output, "w") as f:
+        f.write(header)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -46,8 +46,26 @@ I2C i2c(I2C_SDA, I2C_SCL);  // Used inside the BME680 Mbed Lib.
 /* MQTT-specific header files */
 #include "MQTTmbed.h"
 #include "MQTTClient.h"
+#include "MQTTSubscriptionManager.h"
+#include "MQTTPipelineNetwork.h"
+#include "MQTTAsyncPublisher.h"
+#include "SPSCQueue.h"
+#include "TelemetryRecord.h"
+#include "TelemetryJournal.h"
+#include "TelemetryBatcher.h"
+#include "ShadowDeltaEngine.h"
+#include "MQTTReconnectEngine.h"
+#include "MQTTBenchmark.h"
 #endif  // End of AWS_IOT_MQTT_TEST
 
+#if AWS_IOT_HTTPS_TEST
+/* HTTPS-specific header files */
+#include "HttpResponseParser.h"
+#include "HttpsConnectionPool.h"
+#include "JsonStreamReader.h"
+#include "SocketEventWaiter.h"
+#endif  // End of AWS_IOT_HTTPS_TEST
+
 #ifdef TARGET_M2354
 #include "lcd_api.h"
 #include "lcdlib.h"
@@ -66,6 +84,21 @@ I2C i2c(I2C_SDA, I2C_SCL);  // Used inside the BME680 Mbed Lib.
 
 namespace {
 
+/* Credentials in DER
+ *
+ * With CMake build, credentials/pem2der.py converts PEM files to DER at build time into
+ * credentials_der.h (see AWS_IOT_ROOT_CA_PEM/AWS_IOT_CLIENT_CERT_PEM/AWS_IOT_CLIENT_KEY_PEM
+ * in CMakeLists.txt). DER is smaller in flash, skips base64 decode on target, and certificates
+ * are referenced in place rather than copied to heap. Otherwise, the PEM strings below are used.
+ */
+#if AWS_IOT_ROOT_CA_DER || AWS_IOT_CLIENT_CERT_KEY_DER
+#include "credentials_der.h"
+#endif
+
+#if AWS_IOT_ROOT_CA_DER
+#define SSL_CA_CERT             credentials_der::root_ca
+#define SSL_CA_CERT_LEN         sizeof(credentials_der::root_ca)
+#else
 /* List of trusted root CA certificates
  * currently only GlobalSign, the CA for os.mbed.com
  *
@@ -92,6 +125,17 @@ const char SSL_CA_CERT_PEM[] = "-----BEGIN CERTIFICATE-----\n"
     "rqXRfboQnoZsG4q5WTP468SQvvG5\n"
     "-----END CERTIFICATE-----\n";
 
+/* PEM length includes null terminator */
+#define SSL_CA_CERT             SSL_CA_CERT_PEM
+#define SSL_CA_CERT_LEN         sizeof(SSL_CA_CERT_PEM)
+#endif
+
+#if AWS_IOT_CLIENT_CERT_KEY_DER
+#define SSL_USER_CERT           credentials_der::client_cert
+#define SSL_USER_CERT_LEN       sizeof(credentials_der::client_cert)
+#define SSL_USER_PRIV_KEY       credentials_der::client_key
+#define SSL_USER_PRIV_KEY_LEN   sizeof(credentials_der::client_key)
+#else
 /* User certificate which has been activated and attached with specific thing and policy */
 const char SSL_USER_CERT_PEM[] = "Input User Cert";
 
@@ -99,6 +143,12 @@ const char SSL_USER_CERT_PEM[] = "Input User Cert";
 /* User private key paired with above */
 const char SSL_USER_PRIV_KEY_PEM[] = "Input User Private Key";
 
+#define SSL_USER_CERT           SSL_USER_CERT_PEM
+#define SSL_USER_CERT_LEN       sizeof(SSL_USER_CERT_PEM)
+#define SSL_USER_PRIV_KEY       SSL_USER_PRIV_KEY_PEM
+#define SSL_USER_PRIV_KEY_LEN   sizeof(SSL_USER_PRIV_KEY_PEM)
+#endif
+
 
 #if AWS_IOT_MQTT_TEST
 
@@ -117,20 +167,31 @@ const char *USER_MQTT_TOPIC_FILTERS[] = {
     "Nuvoton/Mbed/+"
 };
 const char USER_MQTT_TOPIC_PUBLISH_MESSAGE[] = "{ \"message\": \"Hello from Nuvoton Mbed device\" }";
+
+/* Benchmark topic. Not matched by USER_MQTT_TOPIC_FILTERS, so publishes don't echo back. */
+const char BENCHMARK_MQTT_TOPIC[] = "Nuvoton/Mbed/D001/bench";
+
+/* Inbound benchmark topic. Matched by USER_MQTT_TOPIC_FILTERS, so publishes echo back. */
+const char BENCHMARK_INBOUND_MQTT_TOPIC[] = "Nuvoton/Mbed/bench_in";
+#endif
+
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+/* Connection phase timing, published on each MQTT connect. See ConnectionTiming for payload. */
+const char METRICS_MQTT_TOPIC[] = "Nuvoton/Mbed/D001/metrics";
 #endif
 
 /* Update thing shadow */
 const char UPDATETHINGSHADOW_MQTT_TOPIC[] = "$aws/things/" AWS_IOT_MQTT_THINGNAME "/shadow/update";
 const char *UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS[] = {
     "$aws/things/" AWS_IOT_MQTT_THINGNAME "/shadow/update/accepted",
-    "$aws/things/" AWS_IOT_MQTT_THINGNAME "/shadow/update/rejected"
+    "$aws/things/" AWS_IOT_MQTT_THINGNAME "/shadow/update/rejected",
+    "$aws/things/" AWS_IOT_MQTT_THINGNAME "/shadow/update/delta"
 };
 
 #ifndef NVT_DEMO_SENSOR
 const char UPDATETHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE[] = "{ \"state\": { \"reported\": { \"attribute1\": 3, \"attribute2\": \"1\" } } }";
 #else
-//const char UPDATETHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE[] = "{ \"state\": { \"reported\": { \"temperature\": %2.2f } } }";
-const char UPDATETHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE[] = "{ \"state\": { \"reported\": { \"clientName\":\"%s\", \"temperature\": %2.2f, \"humidity\": %2.2f, \"pressure\": %.2f } } }";
+/* Sensor telemetry is published in batches of multiple samples. See TelemetryBatcher for payload. */
 #endif
 
 #ifndef NVT_DEMO_SENSOR
@@ -151,14 +212,21 @@ const char *DELETETHINGSHADOW_MQTT_TOPIC_FILTERS[] = {
 const char DELETETHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE[] = "";
 #endif
 
-/* MQTT user buffer size */
-const int MQTT_USER_BUFFER_SIZE = 600;
-
 /* Configure MAX_MQTT_PACKET_SIZE to meet your application.
  * We may meet unknown MQTT error with MAX_MQTT_PACKET_SIZE too small, but 
  * MQTT lib doesn't tell enough error message. Try to enlarge it. */
 const int MAX_MQTT_PACKET_SIZE = 1000;
 
+#ifdef NVT_DEMO_SENSOR
+/* Upper bound of batched telemetry payload, encoded in place into one MQTT packet after fixed
+ * header 5, topic length 2, topic and packet ID 2, with room for encoder's null terminator */
+const size_t MAX_TELEMETRY_PAYLOAD_SIZE = MAX_MQTT_PACKET_SIZE - 5 - 2 - (sizeof (UPDATETHINGSHADOW_MQTT_TOPIC) - 1) - 2 - 1;
+#endif
+
+/* Maximum number of topic filters subscribed at the same time. Also the number of message
+ * handlers MQTT lib reserves, whose default 5 cannot afford all filters above. */
+const int MAX_MQTT_SUBSCRIPTIONS = MBED_CONF_MY_MQTT_MAX_SUBSCRIPTIONS;
+
 /* Timeout for receiving message with subscribed topic */
 const int MQTT_RECEIVE_MESSAGE_WITH_SUBSCRIBED_TOPIC_TIMEOUT_MS = 5000;
 
@@ -220,15 +288,93 @@ const char DELETETHINGSHADOW_THING_HTTPS_PATH[] = "/things/" AWS_IOT_HTTPS_THING
 const char DELETETHINGSHADOW_THING_HTTPS_REQUEST_METHOD[] = "DELETE";
 const char DELETETHINGSHADOW_THING_HTTPS_REQUEST_MESSAGE_BODY[] = "";
 
-/* HTTPS user buffer size */
+/* Requests of the test, in order */
+struct HttpsRequest {
+    const char *    name;
+    const char *    path;
+    const char *    method;
+    const char *    body;
+    bool            shadow;     /**< Response body is shadow document */
+};
+
+const HttpsRequest HTTPS_REQUESTS[] = {
+    { "Publish to user topic through HTTPS/POST",
+      USER_TOPIC_HTTPS_PATH, USER_TOPIC_HTTPS_REQUEST_METHOD, USER_TOPIC_HTTPS_REQUEST_MESSAGE_BODY, false },
+    { "Update thing shadow by publishing to UpdateThingShadow topic through HTTPS/POST",
+      UPDATETHINGSHADOW_TOPIC_HTTPS_PATH, UPDATETHINGSHADOW_TOPIC_HTTPS_REQUEST_METHOD, UPDATETHINGSHADOW_TOPIC_HTTPS_REQUEST_MESSAGE_BODY, false },
+    { "Get thing shadow by publishing to GetThingShadow topic through HTTPS/POST",
+      GETTHINGSHADOW_TOPIC_HTTPS_PATH, GETTHINGSHADOW_TOPIC_HTTPS_REQUEST_METHOD, GETTHINGSHADOW_TOPIC_HTTPS_REQUEST_MESSAGE_BODY, false },
+    { "Delete thing shadow by publishing to DeleteThingShadow topic through HTTPS/POST",
+      DELETETHINGSHADOW_TOPIC_HTTPS_PATH, DELETETHINGSHADOW_TOPIC_HTTPS_REQUEST_METHOD, DELETETHINGSHADOW_TOPIC_HTTPS_REQUEST_MESSAGE_BODY, false },
+    { "Update thing shadow RESTfully through HTTPS/POST",
+      UPDATETHINGSHADOW_THING_HTTPS_PATH, UPDATETHINGSHADOW_THING_HTTPS_REQUEST_METHOD, UPDATETHINGSHADOW_THING_HTTPS_REQUEST_MESSAGE_BODY, true },
+    { "Get thing shadow RESTfully through HTTPS/GET",
+      GETTHINGSHADOW_THING_HTTPS_PATH, GETTHINGSHADOW_THING_HTTPS_REQUEST_METHOD, GETTHINGSHADOW_THING_HTTPS_REQUEST_MESSAGE_BODY, true },
+    { "Delete thing shadow RESTfully through HTTPS/DELETE",
+      DELETETHINGSHADOW_THING_HTTPS_PATH, DELETETHINGSHADOW_THING_HTTPS_REQUEST_METHOD, DELETETHINGSHADOW_THING_HTTPS_REQUEST_MESSAGE_BODY, true }
+};
+
+/* HTTPS user buffer size, for request and for receiving response. Response body of any
+ * size streams thru it. */
 const int HTTPS_USER_BUFFER_SIZE = 600;
 
-const char *HTTPS_OK_STR = "200 OK";
+/* Requests written ahead of responses on the kept-alive connection. 1 for one by one. */
+const size_t HTTPS_PIPELINE_DEPTH = MBED_CONF_MY_HTTPS_PIPELINE_DEPTH;
+
+/* Time to wait for the socket to take more of the request or give more of the response */
+const std::chrono::milliseconds HTTPS_SOCKET_TIMEOUT(MBED_CONF_MY_HTTPS_SOCKET_TIMEOUT);
 
 #endif  // End of AWS_IOT_HTTPS_TEST
 
 }
 
+#if AWS_IOT_MQTT_TEST || AWS_IOT_HTTPS_TEST
+/* Time to wait for connect_tls() to complete. The handshake thread calls back within
+ * async-connect-timeout, plus the step running at the deadline. */
+const std::chrono::milliseconds TLS_CONNECT_WAIT(MBED_CONF_MY_TLSSOCKET_ASYNC_CONNECT_TIMEOUT * 2);
+
+/**
+ * @brief   Completion of connect_tls()
+ *
+ * Owned by the caller as a member, so that it outlives the socket connecting: a callback
+ * still coming after connect_tls() has given up waiting lands here rather than on a stack
+ * frame gone.
+ */
+struct TLSConnectCompletion {
+    EventFlags      flags;
+    nsapi_error_t   rc;
+
+    void done(nsapi_error_t result) {
+        rc = result;
+        flags.set(1);
+    }
+};
+
+/**
+ * @brief   Connect TLS socket asynchronously on the handshake thread and wait for completion
+ *
+ * TCP connect and handshake crypto run on the handshake thread, so sensor and UI threads
+ * keep running, and handshakes of more than one socket interleave. The caller just sleeps
+ * on event flags, for TLS_CONNECT_WAIT at most.
+ */
+static nsapi_error_t connect_tls(MyTLSSocket *tlssocket, const SocketAddress &sockaddr, TLSConnectCompletion &completion) {
+
+    /* Late completion of a connect given up before */
+    completion.flags.clear(1);
+
+    nsapi_error_t rc = tlssocket->connect_async(sockaddr, callback(&completion, &TLSConnectCompletion::done));
+    if (rc != NSAPI_ERROR_IN_PROGRESS) {
+        return rc;
+    }
+    if (completion.flags.wait_any_for(1, TLS_CONNECT_WAIT) & osFlagsError) {
+        printf("TLS connect not completed in %d ms\n", (int) TLS_CONNECT_WAIT.count());
+        return NSAPI_ERROR_TIMEOUT;
+    }
+
+    return completion.rc;
+}
+#endif
+
 #if AWS_IOT_MQTT_TEST
 
 /**
@@ -237,6 +383,11 @@ const char *HTTPS_OK_STR = "200 OK";
 class AWS_IoT_MQTT_Test {
 
 public:
+    typedef MQTTPipelineNetwork<MyTLSSocket> MyMQTTNetwork;
+    typedef MQTT::Client<MyMQTTNetwork, Countdown, MAX_MQTT_PACKET_SIZE, MAX_MQTT_SUBSCRIPTIONS> MyMQTTClient;
+    typedef MQTTSubscriptionManager<MyMQTTClient, MAX_MQTT_SUBSCRIPTIONS> MyMQTTSubscriptions;
+    typedef MQTTAsyncPublisher<MyTLSSocket, MAX_MQTT_PACKET_SIZE> MyMQTTPublisher;
+
     /**
      * @brief   AWS_IoT_MQTT_Test Constructor
      *
@@ -245,18 +396,76 @@ public:
      * @param[in] net_iface Network interface
      */
     AWS_IoT_MQTT_Test(const char * domain, const uint16_t port, NetworkInterface *net_iface) :
-        _domain(domain), _port(port), _net_iface(net_iface) {
+        _domain(domain), _port(port), _net_iface(net_iface)
+#ifdef NVT_DEMO_SENSOR
+        , _batcher(_client_name, MAX_TELEMETRY_PAYLOAD_SIZE - ShadowDeltaEngine::TOKEN_OVERHEAD)
+        , _shadow_delta(_client_name)
+#endif
+    {
         _tlssocket = new MyTLSSocket;
-        _mqtt_client = new MQTT::Client<MyTLSSocket, Countdown, MAX_MQTT_PACKET_SIZE>(*_tlssocket);
+        _mqtt_network = new MyMQTTNetwork(*_tlssocket);
+        _mqtt_client = new MyMQTTClient(*_mqtt_network);
+        _subscriptions = new MyMQTTSubscriptions(*_mqtt_client);
+        _publisher = new MyMQTTPublisher(*_mqtt_network);
+        _client_name[0] = '\0';
+        _message_body = NULL;
+        _tlssocket_used = false;
+        _mqtt_connected_once = false;
+
+        /* Layers of connection. Reconnect engine brings up those lost only. */
+        _reconnect.attach(MQTTReconnectEngine::LAYER_LINK, callback(this, &AWS_IoT_MQTT_Test::link_up));
+        _reconnect.attach(MQTTReconnectEngine::LAYER_TCP, callback(this, &AWS_IoT_MQTT_Test::tcp_up));
+        _reconnect.attach(MQTTReconnectEngine::LAYER_TLS, callback(this, &AWS_IoT_MQTT_Test::tls_up), callback(this, &AWS_IoT_MQTT_Test::tls_down));
+        _reconnect.attach(MQTTReconnectEngine::LAYER_MQTT, callback(this, &AWS_IoT_MQTT_Test::mqtt_up), callback(this, &AWS_IoT_MQTT_Test::mqtt_down));
+#ifdef NVT_DEMO_SENSOR
+        /* Keep sensor side flowing into journal while reconnecting */
+        _reconnect.attach_idle(callback(this, &AWS_IoT_MQTT_Test::spill_telemetry));
+        _net_thread = NULL;
+        _net_thread_done = false;
+        for (int i = 0; i < MBED_CONF_MY_MQTT_PUBLISH_WINDOW; i ++) {
+            _pending_batches[i].packet_id = 0;
+        }
+        _replay_count = _replay_next = _replay_acked = _replay_failed = 0;
+        _replay_last_seq = 0;
+        _encode_records = NULL;
+        _encode_count = 0;
+        _encode_len = 0;
+#endif
+
+        /* Register topic filters once. They are subscribed once per connection. */
+#ifndef NVT_DEMO_SENSOR
+        _subscriptions->add(USER_MQTT_TOPIC_FILTERS, sizeof (USER_MQTT_TOPIC_FILTERS) / sizeof (USER_MQTT_TOPIC_FILTERS[0]), MQTT::QOS1, message_arrived);
+#endif
+#ifndef NVT_DEMO_SENSOR
+        _subscriptions->add(UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS, sizeof (UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS) / sizeof (UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS[0]), MQTT::QOS1, message_arrived);
+#else
+        /* Acknowledgement of reported state for shadow delta */
+        _subscriptions->add(UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS[0], MQTT::QOS1, callback(this, &AWS_IoT_MQTT_Test::shadow_update_accepted));
+        _subscriptions->add(UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS[1], MQTT::QOS1, callback(this, &AWS_IoT_MQTT_Test::shadow_update_rejected));
+        _subscriptions->add(UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS[2], MQTT::QOS1, callback(this, &AWS_IoT_MQTT_Test::shadow_update_delta));
+#endif
+#ifndef NVT_DEMO_SENSOR
+        _subscriptions->add(GETTHINGSHADOW_MQTT_TOPIC_FILTERS, sizeof (GETTHINGSHADOW_MQTT_TOPIC_FILTERS) / sizeof (GETTHINGSHADOW_MQTT_TOPIC_FILTERS[0]), MQTT::QOS1, message_arrived);
+        _subscriptions->add(DELETETHINGSHADOW_MQTT_TOPIC_FILTERS, sizeof (DELETETHINGSHADOW_MQTT_TOPIC_FILTERS) / sizeof (DELETETHINGSHADOW_MQTT_TOPIC_FILTERS[0]), MQTT::QOS1, message_arrived);
+#endif
     }
 
     /**
      * @brief AWS_IoT_MQTT_Test Destructor
      */
     ~AWS_IoT_MQTT_Test() {
+        delete _publisher;
+        _publisher = NULL;
+
+        delete _subscriptions;
+        _subscriptions = NULL;
+
         delete _mqtt_client;
         _mqtt_client = NULL;
 
+        delete _mqtt_network;
+        _mqtt_network = NULL;
+
         _tlssocket->close();
         delete _tlssocket;
         _tlssocket = NULL;
@@ -266,125 +475,268 @@ public:
      */
     void start_test() {
 
-        int tls_rc;
-        int mqtt_rc;
-        char cClientName[32];
-
-        do {
-            /* Set host name of the remote host, used for certificate checking */
-            _tlssocket->set_hostname(_domain);
-
-            /* Set the certification of Root CA */
-            tls_rc = _tlssocket->set_root_ca_cert(SSL_CA_CERT_PEM);
-            if (tls_rc != NSAPI_ERROR_OK) {
-                printf("TLSSocket::set_root_ca_cert(...) returned %d\n", tls_rc);
+#ifndef NVT_DEMO_SENSOR
+        static const struct {
+            const char *    name;
+            const char *    topic;
+            const char *    message;
+            const char *    lcd_text;
+        } steps[] = {
+            { "user", USER_MQTT_TOPIC, USER_MQTT_TOPIC_PUBLISH_MESSAGE, "USER OK" },
+            { "UpdateThingShadow", UPDATETHINGSHADOW_MQTT_TOPIC, UPDATETHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE, "UPDATE OK" },
+            { "GetThingShadow", GETTHINGSHADOW_MQTT_TOPIC, GETTHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE, "GET OK" },
+            { "DeleteThingShadow", DELETETHINGSHADOW_MQTT_TOPIC, DELETETHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE, "DEL OK" }
+        };
+        size_t step = 0;
+
+        /* On connection lost, reconnect and resume from the failed step */
+        while (step < sizeof (steps) / sizeof (steps[0])) {
+            if (_reconnect.bring_up() != MBED_SUCCESS) {
                 break;
             }
 
-            /* Set client certificate and client private key */
-            tls_rc = _tlssocket->set_client_cert_key(SSL_USER_CERT_PEM, SSL_USER_PRIV_KEY_PEM);
-            if (tls_rc != NSAPI_ERROR_OK) {
-                printf("TLSSocket::set_client_cert_key(...) returned %d\n", tls_rc);
-                break;
+            printf("Publishing %s topic\n", steps[step].name);
+            if (pub_topic(steps[step].topic, steps[step].message, true) < 0) {
+                _reconnect.lost(lost_layer());
+                continue;
             }
+            printf("Publishes %s topic OK\n\n", steps[step].name);
+            lcd_printf(ZONE_MAIN_DIGIT, steps[step].lcd_text);
+            step ++;
+        }
 
-            /* Blocking mode */
-            _tlssocket->set_blocking(true);
+#if MBED_CONF_MY_MQTT_BENCHMARK_MESSAGES
+        if (step == sizeof (steps) / sizeof (steps[0])) {
+            run_benchmark();
+        }
+#endif
 
-            /* Open a network socket on the network stack of the given network interface */
-            printf("Opening network socket on network stack\n");
-            tls_rc = _tlssocket->open(_net_iface);
-            if (tls_rc != NSAPI_ERROR_OK) {
-                printf("Opens network socket on network stack failed: %d\n", tls_rc);
-                break;
-            }
-            printf("Opens network socket on network stack OK\n");
+        /* Test done. No more reconnect. */
+        _reconnect.stop();
+        disconnect();
+#else
+        /* Run network side (TLS/MQTT I/O) in its own thread and sensor side here. They are
+         * decoupled by lock-free telemetry queue so that neither stalls on the other. */
+        _net_thread_done = false;
+        _net_thread = new Thread(osPriorityNormal, MBED_CONF_MY_MQTT_NETWORK_THREAD_STACK_SIZE, NULL, "mqtt_net");
+        _net_thread->start(callback(this, &AWS_IoT_MQTT_Test::network_thread_main));
+
+        sensor_loop();
+
+        /* Test done. Network thread gives up reconnecting, if it is. */
+        _reconnect.stop();
+        _net_thread->join();
+        delete _net_thread;
+        _net_thread = NULL;
+
+        /* Network thread has gone. Journal what it has left in queue. */
+        spill_telemetry();
+#endif
+    }
 
-            /* DNS resolution */
-            printf("DNS resolution for %s...\n", _domain);
-            SocketAddress sockaddr;
-            tls_rc = _net_iface->gethostbyname(_domain, &sockaddr);
-            if (tls_rc != NSAPI_ERROR_OK) {
-                printf("DNS resolution for %s failed with %d\n", _domain, tls_rc);
-                break;
-            }
-            sockaddr.set_port(_port);
-            printf("DNS resolution for %s: %s:%d\n", _domain, sockaddr.get_ip_address(), sockaddr.get_port());
+protected:
 
-            /* Connect to the server */
-            /* Initialize TLS-related stuff */
-            printf("Connecting with %s:%d\n", _domain, _port);
-            tls_rc = _tlssocket->connect(sockaddr);
-            if (tls_rc != NSAPI_ERROR_OK) {
-                printf("Connects with %s:%d failed: %d\n", _domain, _port, tls_rc);
-                break;
-            }
-            printf("Connects with %s:%d OK\n", _domain, _port);
-            
-            /* See the link below for AWS IoT support for MQTT:
-             * http://docs.aws.amazon.com/iot/latest/developerguide/protocols.html */
-
-            /* MQTT connect */
-            /* The message broker does not support persistent sessions (connections made with 
-             * the cleanSession flag set to false. */
-            MQTTPacket_connectData conn_data = MQTTPacket_connectData_initializer;
-            /* AWS IoT message broker implementation is based on MQTT version 3.1.1
-             * 3 = 3.1
-             * 4 = 3.1.1 */
-            conn_data.MQTTVersion = 4;
-            /* Version number of this structure. Must be 0 */
-            conn_data.struct_version = 0;
-
-            /* The message broker uses the client ID to identify each client. The client ID is passed
-             * in from the client to the message broker as part of the MQTT payload. Two clients with
-             * the same client ID are not allowed to be connected concurrently to the message broker.
-             * When a client connects to the message broker using a client ID that another client is using,
-             * a CONNACK message will be sent to both clients and the currently connected client will be
-             * disconnected. */
+    /**
+     * @brief   Link layer: bring up network interface if it has gone down
+     */
+    int link_up() {
+
+        nsapi_connection_status_t status = _net_iface->get_connection_status();
+        if (status == NSAPI_STATUS_GLOBAL_UP || status == NSAPI_STATUS_LOCAL_UP) {
+            return NSAPI_ERROR_OK;
+        }
+
+        printf("Connecting to the network\n");
+        Timer timer;
+        timer.start();
+        nsapi_error_t net_rc = _net_iface->connect();
+        if (net_rc != NSAPI_ERROR_OK && net_rc != NSAPI_ERROR_IS_CONNECTED) {
+            printf("Connecting to the network failed %d!\n", net_rc);
+            return net_rc;
+        }
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+        ConnectionTiming::record(ConnectionTiming::PHASE_LINK, timer.elapsed_time());
+#endif
+        printf("Connected to the network successfully\n");
+
+        return NSAPI_ERROR_OK;
+    }
+
+    /**
+     * @brief   TCP layer: resolve server address
+     */
+    int tcp_up() {
+
+        /* DNS resolution */
+        printf("DNS resolution for %s...\n", _domain);
+        Timer timer;
+        timer.start();
+        nsapi_error_t tls_rc = _net_iface->gethostbyname(_domain, &_sockaddr);
+        if (tls_rc != NSAPI_ERROR_OK) {
+            printf("DNS resolution for %s failed with %d\n", _domain, tls_rc);
+            return tls_rc;
+        }
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+        ConnectionTiming::record(ConnectionTiming::PHASE_DNS, timer.elapsed_time());
+#endif
+        _sockaddr.set_port(_port);
+        printf("DNS resolution for %s: %s:%d\n", _domain, _sockaddr.get_ip_address(), _sockaddr.get_port());
+
+        return NSAPI_ERROR_OK;
+    }
+
+    /**
+     * @brief   TLS layer: connect to the server through TLS at resolved address
+     */
+    int tls_up() {
+
+        int tls_rc;
+
+        /* Socket cannot be reopened after close. Renew it. */
+        if (_tlssocket_used) {
+            delete _tlssocket;
+            _tlssocket = new MyTLSSocket;
+            _mqtt_network->rebind(*_tlssocket);
+        }
+        _tlssocket_used = true;
+
+        /* Set host name of the remote host, used for certificate checking */
+        _tlssocket->set_hostname(_domain);
+
+        /* Set the certification of Root CA */
+        tls_rc = _tlssocket->set_root_ca_cert(SSL_CA_CERT, SSL_CA_CERT_LEN);
+        if (tls_rc != NSAPI_ERROR_OK) {
+            printf("TLSSocket::set_root_ca_cert(...) returned %d\n", tls_rc);
+            return tls_rc;
+        }
+
+        /* Set client certificate and client private key */
+        tls_rc = _tlssocket->set_client_cert_key(SSL_USER_CERT, SSL_USER_CERT_LEN, SSL_USER_PRIV_KEY, SSL_USER_PRIV_KEY_LEN);
+        if (tls_rc != NSAPI_ERROR_OK) {
+            printf("TLSSocket::set_client_cert_key(...) returned %d\n", tls_rc);
+            return tls_rc;
+        }
+
+        /* Open a network socket on the network stack of the given network interface */
+        printf("Opening network socket on network stack\n");
+        tls_rc = _tlssocket->open(_net_iface);
+        if (tls_rc != NSAPI_ERROR_OK) {
+            printf("Opens network socket on network stack failed: %d\n", tls_rc);
+            return tls_rc;
+        }
+        printf("Opens network socket on network stack OK\n");
+
+        /* Connect to the server */
+        /* Initialize TLS-related stuff */
+        printf("Connecting with %s:%d\n", _domain, _port);
+        tls_rc = connect_tls(_tlssocket, _sockaddr, _connect_completion);
+        if (tls_rc != NSAPI_ERROR_OK) {
+            printf("Connects with %s:%d failed: %d\n", _domain, _port, tls_rc);
+            return tls_rc;
+        }
+        printf("Connects with %s:%d OK\n", _domain, _port);
+
+        /* Blocking mode, left non-blocking by asynchronous connect */
+        _tlssocket->set_blocking(true);
+
+#if MBED_CONF_MY_MQTT_WRITE_COMBINE
+        /* Small MQTT packets written back to back go out in one TLS record. MQTT lib reading
+         * for response flushes them. */
+        if (_tlssocket->set_write_combining(true) != NSAPI_ERROR_OK) {
+            printf("TLSSocket write combining not available\n");
+        }
+#endif
+
+        return NSAPI_ERROR_OK;
+    }
+
+    /**
+     * @brief   TLS layer: close TLS connection
+     */
+    void tls_down() {
+
+        _tlssocket->close();
+    }
+
+    /**
+     * @brief   MQTT layer: MQTT connect and subscribe topic filters
+     */
+    int mqtt_up() {
+
+        int mqtt_rc;
+
+        /* See the link below for AWS IoT support for MQTT:
+         * http://docs.aws.amazon.com/iot/latest/developerguide/protocols.html */
+
+        /* MQTT connect */
+        /* The message broker does not support persistent sessions (connections made with 
+         * the cleanSession flag set to false. */
+        MQTTPacket_connectData conn_data = MQTTPacket_connectData_initializer;
+        /* AWS IoT message broker implementation is based on MQTT version 3.1.1
+         * 3 = 3.1
+         * 4 = 3.1.1 */
+        conn_data.MQTTVersion = 4;
+        /* Version number of this structure. Must be 0 */
+        conn_data.struct_version = 0;
+
+        /* The message broker uses the client ID to identify each client. The client ID is passed
+         * in from the client to the message broker as part of the MQTT payload. Two clients with
+         * the same client ID are not allowed to be connected concurrently to the message broker.
+         * When a client connects to the message broker using a client ID that another client is using,
+         * a CONNACK message will be sent to both clients and the currently connected client will be
+         * disconnected. */
 #if defined(AWS_IOT_MQTT_CLIENTNAME)
-            conn_data.clientID.cstring = AWS_IOT_MQTT_CLIENTNAME;
+        conn_data.clientID.cstring = AWS_IOT_MQTT_CLIENTNAME;
 #else
-            char client_id_data[32];
+        char client_id_data[32];
 #if TARGET_M23_NS
-            /* FMC/UID lies in SPE and is inaccessible to NSPE. Use random to generate pseudo-unique instead. */
-            uint32_t rand_words[3];
-            size_t olen;
-            mbedtls_hardware_poll(NULL, (unsigned char *) rand_words, sizeof(rand_words), &olen);
-            snprintf(client_id_data, sizeof(client_id_data), "%08X-%08X-%08X",
-                     (unsigned int)rand_words[0], (unsigned int)rand_words[1],(unsigned int) rand_words[2]);
+        /* FMC/UID lies in SPE and is inaccessible to NSPE. Use random to generate pseudo-unique instead. */
+        uint32_t rand_words[3];
+        size_t olen;
+        mbedtls_hardware_poll(NULL, (unsigned char *) rand_words, sizeof(rand_words), &olen);
+        snprintf(client_id_data, sizeof(client_id_data), "%08X-%08X-%08X",
+                 (unsigned int)rand_words[0], (unsigned int)rand_words[1],(unsigned int) rand_words[2]);
 #else
-            /* Use FMC/UID to generate unique client ID */
-            SYS_UnlockReg();
-            FMC_Open();
-            snprintf(client_id_data, sizeof(client_id_data), "%08X-%08X-%08X",
-                     (unsigned int)FMC_ReadUID(0), (unsigned int)FMC_ReadUID(1), (unsigned int)FMC_ReadUID(2));
-            FMC_Close();
-            SYS_LockReg();
+        /* Use FMC/UID to generate unique client ID */
+        SYS_UnlockReg();
+        FMC_Open();
+        snprintf(client_id_data, sizeof(client_id_data), "%08X-%08X-%08X",
+                 (unsigned int)FMC_ReadUID(0), (unsigned int)FMC_ReadUID(1), (unsigned int)FMC_ReadUID(2));
+        FMC_Close();
+        SYS_LockReg();
 #endif
-            conn_data.clientID.cstring = client_id_data;
+        conn_data.clientID.cstring = client_id_data;
+#endif
+        strncpy(_client_name, conn_data.clientID.cstring, sizeof(_client_name) - 1);
+        printf("Resolved MQTT client ID: %s\n", conn_data.clientID.cstring);
+        /* The message broker does not support persistent sessions (connections made with 
+         * the cleanSession flag set to false. The AWS IoT message broker assumes all sessions 
+         * are clean sessions and messages are not stored across sessions. If an MQTT client 
+         * attempts to connect to the AWS IoT message broker with the cleanSession set to false, 
+         * the client will be disconnected. */
+        conn_data.cleansession = 1;
+        //conn_data.username.cstring = "USERNAME";
+        //conn_data.password.cstring = "PASSWORD";
+
+        MQTT::connackData connack_data;
+
+        /* _tlssocket must connect to the network endpoint before calling this. */
+        printf("MQTT connecting");
+        Timer timer;
+        timer.start();
+        if ((mqtt_rc = _mqtt_client->connect(conn_data, connack_data)) != 0) {
+            printf("\rMQTT connects failed: %d\n", mqtt_rc);
+            return MQTT::FAILURE;
+        }
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+        ConnectionTiming::record(ConnectionTiming::PHASE_MQTT_CONNACK, timer.elapsed_time());
 #endif
-            strncpy(cClientName, conn_data.clientID.cstring, sizeof(cClientName));
-            printf("Resolved MQTT client ID: %s\n", conn_data.clientID.cstring);
-            /* The message broker does not support persistent sessions (connections made with 
-             * the cleanSession flag set to false. The AWS IoT message broker assumes all sessions 
-             * are clean sessions and messages are not stored across sessions. If an MQTT client 
-             * attempts to connect to the AWS IoT message broker with the cleanSession set to false, 
-             * the client will be disconnected. */
-            conn_data.cleansession = 1;
-            //conn_data.username.cstring = "USERNAME";
-            //conn_data.password.cstring = "PASSWORD";
-
-            MQTT::connackData connack_data;
-
-            /* _tlssocket must connect to the network endpoint before calling this. */
-            printf("MQTT connecting");
-            if ((mqtt_rc = _mqtt_client->connect(conn_data, connack_data)) != 0) {
-                printf("\rMQTT connects failed: %d\n", mqtt_rc);
-                break;
-            }
 
-            printf("\rMQTT connects OK\n\n");
-            /* MQTT connects OK set default LCD display. */
+        printf("\rMQTT connects OK\n\n");
+        /* MQTT connects OK set default LCD display. Skip on reconnect for fast resume. */
+        if (! _mqtt_connected_once) {
+            _mqtt_connected_once = true;
+
             char text [8];
 
             LCD_DisableBlink();
@@ -405,201 +757,686 @@ public:
             lcd_printNumberEx(ZONE_TEMP_DIGIT, 00, 2);
             lcd_setSymbol(SYMBOL_TEMP_C, 1);
             lcd_setSymbol(SYMBOL_WIFI, 1);
+        }
 
-#ifndef NVT_DEMO_SENSOR
-            /* Subscribe/publish user topic */
-            printf("Subscribing/publishing user topic\n");
-            if (! sub_pub_topic(USER_MQTT_TOPIC, USER_MQTT_TOPIC_FILTERS, sizeof (USER_MQTT_TOPIC_FILTERS) / sizeof (USER_MQTT_TOPIC_FILTERS[0]), USER_MQTT_TOPIC_PUBLISH_MESSAGE)) {
-                break;
-            }
-            printf("Subscribes/publishes user topic OK\n\n");
-            lcd_printf(ZONE_MAIN_DIGIT, "USER OK");
-            
-            /* Subscribe/publish UpdateThingShadow topic */
-            printf("Subscribing/publishing UpdateThingShadow topic\n");
-            if (! sub_pub_topic(UPDATETHINGSHADOW_MQTT_TOPIC, UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS, sizeof (UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS) / sizeof (UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS[0]), UPDATETHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE)) {
-                break;
-            }
-            printf("Subscribes/publishes UpdateThingShadow topic OK\n\n");
-            lcd_printf(ZONE_MAIN_DIGIT, "UPDATE OK");
-            
-            /* Subscribe/publish GetThingShadow topic */
-            printf("Subscribing/publishing GetThingShadow topic\n");
-            if (! sub_pub_topic(GETTHINGSHADOW_MQTT_TOPIC, GETTHINGSHADOW_MQTT_TOPIC_FILTERS, sizeof (GETTHINGSHADOW_MQTT_TOPIC_FILTERS) / sizeof (GETTHINGSHADOW_MQTT_TOPIC_FILTERS[0]), GETTHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE)) {
-                break;
-            }
-            printf("Subscribes/publishes GetThingShadow topic OK\n\n");
-            lcd_printf(ZONE_MAIN_DIGIT, "GET OK");
-            
-            /* Subscribe/publish DeleteThingShadow topic */
-            printf("Subscribing/publishing DeleteThingShadow topic\n");
-            if (! sub_pub_topic(DELETETHINGSHADOW_MQTT_TOPIC, DELETETHINGSHADOW_MQTT_TOPIC_FILTERS, sizeof (DELETETHINGSHADOW_MQTT_TOPIC_FILTERS) / sizeof (DELETETHINGSHADOW_MQTT_TOPIC_FILTERS[0]), DELETETHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE)) {
-                break;
-            }
-            printf("Subscribes/publishes DeleteThingShadow topic OK\n\n");
-            lcd_printf(ZONE_MAIN_DIGIT, "DEL OK");
+        /* Subscribe all topic filters once for this connection */
+        printf("Subscribing topic filters\n");
+        int sub_failed = _subscriptions->subscribe_all();
+        if (sub_failed) {
+            printf("Subscribes topic filters: %d failed\n\n", sub_failed);
+        } else {
+            printf("Subscribes topic filters OK\n\n");
+        }
+
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+        /* Connection phase timing so far, not waiting for PUBACK */
+        mqtt_rc = _publisher->publish(METRICS_MQTT_TOPIC, callback(&ConnectionTiming::encode_json));
+        if (mqtt_rc < 0) {
+            printf("MQTT publishes connection timing to %s failed: %d\n\n", METRICS_MQTT_TOPIC, mqtt_rc);
+        }
 #endif
-        } while (0);
 
-#ifdef NVT_DEMO_SENSOR
-        char cDataBuffer[ 256 ];
-        char cLcdStr [8];
-        uint32_t pressure, humidity, temperature;
-        do {
-            /* Subscribe/publish UpdateThingShadow topic */
-            printf("Subscribing/publishing UpdateThingShadow topic\n");
-            if (bme680.performReading()) {
-//                ( void ) snprintf(cDataBuffer, sizeof(cDataBuffer) - 1, UPDATETHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE, bme680.getHumidity() );
-                ( void ) snprintf(cDataBuffer, sizeof(cDataBuffer) - 1, UPDATETHINGSHADOW_MQTT_TOPIC_PUBLISH_MESSAGE, cClientName, bme680.getTemperature(), bme680.getHumidity(), bme680.getPressure() );
-                if (! sub_pub_topic(UPDATETHINGSHADOW_MQTT_TOPIC, UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS, sizeof (UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS) / sizeof (UPDATETHINGSHADOW_MQTT_TOPIC_FILTERS[0]), (const char*)cDataBuffer)) {
-                    break;
-                }
-                printf("Subscribes/publishes UpdateThingShadow topic OK\n\n");
-                temperature = bme680.getTemperature();
-                pressure = bme680.getPressure()/100;
-                humidity = bme680.getHumidity();
-                sprintf(cLcdStr, "%4dhPa", (int)pressure);
-                lcd_printf(ZONE_MAIN_DIGIT, cLcdStr);
-                lcd_printNumberEx(ZONE_TEMP_DIGIT,temperature,2);
-                lcd_printNumberEx(ZONE_PPM_DIGIT, humidity, 2);
+        return MQTT::SUCCESS;
+    }
+
+    /**
+     * @brief   MQTT layer: MQTT disconnect and fail publishes in flight
+     */
+    void mqtt_down() {
+
+        int mqtt_rc;
+
+        if (_mqtt_client->isConnected()) {
+            printf("MQTT disconnecting");
+            if ((mqtt_rc = _mqtt_client->disconnect()) != 0) {
+                printf("\rMQTT disconnects failed %d\n\n", mqtt_rc);
             } else {
-                printf("Read Sensor failed \n\n");
-                lcd_printf(ZONE_MAIN_DIGIT, "SENSOR FAIL");
+                printf("\rMQTT disconnects OK\n\n");
             }
-            thread_sleep_for(500);
-            /*  RTC display  */
-            time_t rtctt;
-            char buffer[32];
-            uint32_t u32TimeData, u32TimeHour, u32TimeMinute;
-            rtctt = rtc_read();
-            strftime(buffer, 32, "%H:%M\n", localtime(&rtctt));
-            printf("Time as a custom formatted string = %s", buffer);
+        }
+        _publisher->abort_all();
+        _subscriptions->connection_lost();
+    }
 
-            strftime(buffer, 32, "%H\n", localtime(&rtctt));
-            u32TimeHour = atoi(buffer);
-            strftime(buffer, 32, "%M\n", localtime(&rtctt));
-            u32TimeMinute = atoi(buffer);
-            u32TimeData = ( u32TimeHour *100) + u32TimeMinute ;
-            lcd_printNumber(ZONE_TIME_DIGIT, u32TimeData);
-        } while (1);
-#endif
+    /**
+     * @brief   Layer to bring up again on connection lost
+     *
+     * With link still up, resume from TLS with server address resolved.
+     */
+    MQTTReconnectEngine::Layer lost_layer() {
 
-        printf("MQTT disconnecting");
-        if ((mqtt_rc = _mqtt_client->disconnect()) != 0) {
-            printf("\rMQTT disconnects failed %d\n\n", mqtt_rc);
+        if (_net_iface->get_connection_status() == NSAPI_STATUS_DISCONNECTED) {
+            return MQTTReconnectEngine::LAYER_LINK;
         }
-        printf("\rMQTT disconnects OK\n\n");
 
-        _tlssocket->close();
+        return MQTTReconnectEngine::LAYER_TLS;
     }
 
-protected:
+    /**
+     * @brief   MQTT disconnect and close TLS connection
+     */
+    void disconnect() {
 
+        _reconnect.down(MQTTReconnectEngine::LAYER_TLS);
+    }
+
+#ifdef NVT_DEMO_SENSOR
     /**
-     * @brief   Subscribe/publish specific topic
+     * @brief   Network thread: connect, then drain telemetry queue into publishes and run MQTT lib
+     *
+     * On connection lost, the layers lost are brought up again. Telemetry goes to journal meanwhile.
      */
-    bool sub_pub_topic(const char *topic, const char **topic_filters, size_t topic_filters_size, const char *publish_message_body) {
+    void network_thread_main() {
 
-        bool ret = false;
-        int mqtt_rc;
+        /* Recover telemetry journaled while offline, e.g. before reboot */
+        _journal.init();
 
-        do {
-            const char **topic_filter;
-            const char **topic_filter_end = topic_filters + topic_filters_size;
-
-            for (topic_filter = topic_filters; topic_filter != topic_filter_end; topic_filter ++) {
-                /* AWS IoT does not support publishing and subscribing with QoS 2.
-                 * The AWS IoT message broker does not send a PUBACK or SUBACK when QoS 2 is requested. */
-                printf("MQTT subscribing to %s", *topic_filter);
-                if ((mqtt_rc = _mqtt_client->subscribe(*topic_filter, MQTT::QOS1, message_arrived)) != 0) {
-                    printf("\rMQTT subscribes to %s failed: %d\n", *topic_filter, mqtt_rc);
-                    continue;
+        while (_reconnect.bring_up() == MBED_SUCCESS) {
+            while (_mqtt_client->isConnected()) {
+                if (! replay_journal()) {
+                    break;
+                }
+
+                if (! publish_telemetry()) {
+                    break;
+                }
+
+                /* Receive PUBACKs and messages with subscribed topics (e.g. shadow accepted/rejected) meanwhile */
+                if (_mqtt_client->yield(100) != MQTT::SUCCESS) {
+                    break;
                 }
-                printf("\rMQTT subscribes to %s OK\n", *topic_filter);
+                _publisher->poll();
             }
 
-            /* Clear count of received message with subscribed topic */
-            clear_message_arrive_count();
+            _reconnect.lost(lost_layer());
 
-            MQTT::Message message;
+            /* Nothing of the batch has been consumed. Replay it from start. */
+            _replay_count = _replay_next = _replay_acked = _replay_failed = 0;
+        }
 
-            int _bpos;
+        disconnect();
 
-            _bpos = snprintf(_buffer, sizeof (_buffer) - 1, "%s", publish_message_body);
-            if (_bpos < 0 || ((size_t) _bpos) > (sizeof (_buffer) - 1)) {
-                printf("snprintf failed: %d\n", _bpos);
-                break;
-            }
-            _buffer[_bpos] = 0;
-            /* AWS IoT does not support publishing and subscribing with QoS 2.
-             * The AWS IoT message broker does not send a PUBACK or SUBACK when QoS 2 is requested. */
-            message.qos = MQTT::QOS1;
-            message.retained = false;
-            message.dup = false;
-            message.payload = _buffer;
-            message.payloadlen = strlen(_buffer);
-            /* Print publish message */
-            printf("Message to publish:\n");
-            printf("%s\n", _buffer);
-            printf("MQTT publishing message to %s", topic);
-            if ((mqtt_rc = _mqtt_client->publish(topic, message)) != 0) {
-                printf("\rMQTT publishes message to %s failed: %d\n", topic, mqtt_rc);
-                break;
-            }
-            printf("\rMQTT publishes message to %s OK\n", topic);
+        core_util_atomic_store_bool(&_net_thread_done, true);
+    }
 
-            /* Receive message with subscribed topic */
-            printf("MQTT receives message with subscribed %s...\n", topic);
-            Timer timer;
-            timer.start();
-            while (! _message_arrive_count) {
-                if ((timer.elapsed_time()).count()/1000 >= MQTT_RECEIVE_MESSAGE_WITH_SUBSCRIBED_TOPIC_TIMEOUT_MS) {   
-                    printf("MQTT receives message with subscribed %s TIMEOUT\n", topic);
-                    break;
+    /**
+     * @brief   Batch queued telemetry records and publish batches while publish window allows
+     */
+    bool publish_telemetry() {
+
+        TelemetryRecord record;
+
+        while (! _publisher->window_full()) {
+            /* K samples or T ms, whichever comes first */
+            if (_batcher.ready()) {
+                if (! flush_batch()) {
+                    return false;
                 }
+                continue;
+            }
 
-                _mqtt_client->yield(100);
+            if (! _telemetry_queue.pop(record)) {
+                break;
             }
-            if (_message_arrive_count) {
-                printf("MQTT receives message with subscribed %s OK\n", topic);
+
+            /* Keep order. Journal backlog goes first. */
+            if (! _journal.empty()) {
+                journal_records(&record, 1);
+                continue;
             }
-            printf("\n");
-
-            /* Unsubscribe 
-             * We meet second unsubscribe failed. This is caused by MQTT lib bug. */
-            for (topic_filter = topic_filters; topic_filter != topic_filter_end; topic_filter ++) {
-                printf("MQTT unsubscribing from %s", *topic_filter);
-                if ((mqtt_rc = _mqtt_client->unsubscribe(*topic_filter)) != 0) {
-                    printf("\rMQTT unsubscribes from %s failed: %d\n", *topic_filter, mqtt_rc);
-                    continue;
+
+            if (! _batcher.add(record)) {
+                /* Payload bound reached before K samples. Publish what has batched first. */
+                if (! flush_batch()) {
+                    journal_records(&record, 1);
+                    return false;
                 }
-                printf("\rMQTT unsubscribes from %s OK\n", *topic_filter);
+                _batcher.add(record);
             }
+        }
 
-            ret = true;
+        return true;
+    }
 
-        } while (0);
+    /**
+     * @brief   Publish current batch. On failure, keep it in journal for replay on reconnect.
+     */
+    bool flush_batch() {
+
+        bool ret = publish_batch(_batcher.records(), _batcher.count(), false);
+        if (! ret) {
+            journal_records(_batcher.records(), _batcher.count());
+        }
+        _batcher.clear();
 
         return ret;
     }
 
-protected:
-    MyTLSSocket *                                                           _tlssocket;
-    MQTT::Client<MyTLSSocket, Countdown, MAX_MQTT_PACKET_SIZE> *            _mqtt_client;
+    /**
+     * @brief   Append telemetry records to journal for replay on reconnect
+     *
+     * Records failing to append are lost. They are counted in journal stats and logged.
+     *
+     * @return  Number of records journaled
+     */
+    size_t journal_records(const TelemetryRecord *records, size_t n) {
 
-    const char *_domain;                    /**< Domain name of the MQTT server */
-    const uint16_t _port;                   /**< Port number of the MQTT server */
-    char _buffer[MQTT_USER_BUFFER_SIZE];    /**< User buffer */
-    NetworkInterface *_net_iface;
+        size_t journaled = 0;
+
+        for (size_t i = 0; i < n; i ++) {
+            if (_journal.append(records[i]) == MBED_SUCCESS) {
+                journaled ++;
+            }
+        }
+        if (journaled < n) {
+            printf("Telemetry journal append failed: %d records lost\n", (int) (n - journaled));
+        }
+
+        return journaled;
+    }
+
+    /**
+     * @brief   Replay journaled telemetry records in batches while publish window allows
+     *
+     * A batch is consumed from the journal after all its publishes are acknowledged.
+     * Otherwise, it is left for replay again (at-least-once).
+     */
+    bool replay_journal() {
+
+        if (_replay_next == _replay_count) {
+            if (_replay_acked + _replay_failed < _replay_count) {
+                /* Wait for PUBACKs of current batch */
+                return true;
+            }
+            if (_replay_count && _replay_failed == 0) {
+                /* Head may have moved meanwhile by appends on full journal */
+                _journal.consume_through(_replay_last_seq);
+            }
+            _replay_count = _replay_next = _replay_acked = _replay_failed = 0;
+
+            if (_journal.empty()) {
+                return true;
+            }
+            int n = _journal.peek(_replay_batch, MBED_CONF_MY_MQTT_JOURNAL_REPLAY_BATCH, &_replay_last_seq);
+            if (n <= 0) {
+                return true;
+            }
+            printf("Replaying %d journaled telemetry records (%d pending)\n", n, (int) _journal.pending());
+            _replay_count = n;
+        }
+
+        /* Replay in multi-sample publishes as well */
+        while (_replay_next < _replay_count && ! _publisher->window_full()) {
+            size_t n = _replay_count - _replay_next;
+            if (n > MBED_CONF_MY_MQTT_BATCH_MAX_SAMPLES) {
+                n = MBED_CONF_MY_MQTT_BATCH_MAX_SAMPLES;
+            }
+            n = TelemetryBatcher::fit(_client_name, &_replay_batch[_replay_next], n, MAX_TELEMETRY_PAYLOAD_SIZE - ShadowDeltaEngine::TOKEN_OVERHEAD);
+            if (n == 0 || ! publish_batch(&_replay_batch[_replay_next], n, true)) {
+                return false;
+            }
+            _replay_next += n;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief   Publish telemetry records as one multi-sample shadow update and track it till completion
+     */
+    bool publish_batch(const TelemetryRecord *records, size_t n, bool from_journal) {
+
+        /* Publish UpdateThingShadow topic. Topic filters have subscribed once on connect.
+         * Payload is encoded straight into MQTT packet buffer. */
+        printf("Publishing UpdateThingShadow topic (%d samples)\n", (int) n);
+        _encode_records = records;
+        _encode_count = n;
+        _encode_len = 0;
+        int packet_id = pub_topic(UPDATETHINGSHADOW_MQTT_TOPIC, callback(this, &AWS_IoT_MQTT_Test::encode_batch), false);
+        if (packet_id < 0) {
+            return false;
+        }
+        printf("Publishes UpdateThingShadow topic OK\n\n");
+        TelemetryBatcher::account(n, _encode_len, sizeof (UPDATETHINGSHADOW_MQTT_TOPIC) - 1);
+
+        for (int i = 0; i < MBED_CONF_MY_MQTT_PUBLISH_WINDOW; i ++) {
+            PendingBatch &pending = _pending_batches[i];
+            if (pending.packet_id == 0) {
+                pending.packet_id = packet_id;
+                pending.from_journal = from_journal;
+                pending.count = n;
+                memcpy(pending.records, records, n * sizeof (TelemetryRecord));
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief   Encoder of telemetry records set up in publish_batch()
+     *
+     * Only attributes changed since last acknowledged shadow state are reported.
+     */
+    int encode_batch(char *buf, size_t size) {
+        _encode_len = _shadow_delta.encode(buf, size, _encode_records, _encode_count);
+        return _encode_len;
+    }
+
+    /**
+     * @brief   Handler of UpdateThingShadow accepted
+     */
+    void shadow_update_accepted(const MQTTMessageView &view) {
+        message_arrived(view);
+        _shadow_delta.accepted(view.payload, view.payload_len);
+    }
+
+    /**
+     * @brief   Handler of UpdateThingShadow rejected
+     */
+    void shadow_update_rejected(const MQTTMessageView &view) {
+        message_arrived(view);
+        _shadow_delta.rejected(view.payload, view.payload_len);
+    }
+
+    /**
+     * @brief   Handler of UpdateThingShadow delta
+     *
+     * Sensor attributes are read-only. Desired state differing from reported is just logged.
+     */
+    void shadow_update_delta(const MQTTMessageView &view) {
+        printf("Shadow delta ignored: %.*s\n", (int) view.payload_len, (const char *) view.payload);
+    }
+
+    /**
+     * @brief   Move telemetry records still batched or queued into journal
+     */
+    void spill_telemetry() {
+
+        TelemetryRecord record;
+        int n = 0;
+
+        /* Batched records are older than queued ones */
+        n += journal_records(_batcher.records(), _batcher.count());
+        _batcher.clear();
+
+        while (_telemetry_queue.pop(record)) {
+            if (_journal.append(record) != MBED_SUCCESS) {
+                break;
+            }
+            n ++;
+        }
+
+        if (n) {
+            printf("Journaled %d telemetry records for replay on reconnect\n", n);
+        }
+    }
+
+    /**
+     * @brief   Sensor side: sample BME680 and queue telemetry records for network thread
+     */
+    void sensor_loop() {
+
+        char cLcdStr [8];
+        uint32_t pressure, humidity, temperature;
+
+        while (! core_util_atomic_load_bool(&_net_thread_done)) {
+            if (bme680.performReading()) {
+                TelemetryRecord record;
+                record.timestamp = (uint32_t) time(NULL);
+                record.temperature = bme680.getTemperature();
+                record.humidity = bme680.getHumidity();
+                record.pressure = bme680.getPressure();
+                if (! _telemetry_queue.push(record)) {
+                    printf("Telemetry queue full, %d records dropped\n", (int) _telemetry_queue.dropped());
+                }
+
+                temperature = record.temperature;
+                pressure = record.pressure/100;
+                humidity = record.humidity;
+                sprintf(cLcdStr, "%4dhPa", (int)pressure);
+                lcd_printf(ZONE_MAIN_DIGIT, cLcdStr);
+                lcd_printNumberEx(ZONE_TEMP_DIGIT,temperature,2);
+                lcd_printNumberEx(ZONE_PPM_DIGIT, humidity, 2);
+            } else {
+                printf("Read Sensor failed \n\n");
+                lcd_printf(ZONE_MAIN_DIGIT, "SENSOR FAIL");
+            }
+            thread_sleep_for(500);
+            /*  RTC display  */
+            time_t rtctt;
+            char buffer[32];
+            uint32_t u32TimeData, u32TimeHour, u32TimeMinute;
+            rtctt = rtc_read();
+            strftime(buffer, 32, "%H:%M\n", localtime(&rtctt));
+            printf("Time as a custom formatted string = %s", buffer);
+
+            strftime(buffer, 32, "%H\n", localtime(&rtctt));
+            u32TimeHour = atoi(buffer);
+            strftime(buffer, 32, "%M\n", localtime(&rtctt));
+            u32TimeMinute = atoi(buffer);
+            u32TimeData = ( u32TimeHour *100) + u32TimeMinute ;
+            lcd_printNumber(ZONE_TIME_DIGIT, u32TimeData);
+        }
+    }
+#endif
+
+#if !defined(NVT_DEMO_SENSOR) && MBED_CONF_MY_MQTT_BENCHMARK_MESSAGES
+    /**
+     * @brief   Benchmark publish rate and latency for each configured payload size, then reconnect cost
+     *
+     * Publishes go straight to the publisher/client without per-message logging. Runs with
+     * the same pipelined publish path as telemetry, so results gate regressions of it.
+     */
+    void run_benchmark() {
+
+        static const size_t payload_sizes[] = { MBED_CONF_MY_MQTT_BENCHMARK_PAYLOAD_SIZES };
+        const MQTT::QoS qos = (MBED_CONF_MY_MQTT_BENCHMARK_QOS) ? MQTT::QOS1 : MQTT::QOS0;
+        MQTTBenchmark bench;
+
+        for (size_t i = 0; i < sizeof (payload_sizes) / sizeof (payload_sizes[0]); i ++) {
+            size_t payload_len = payload_sizes[i];
+
+            if (bench.start(payload_len, qos, MBED_CONF_MY_MQTT_BENCHMARK_MESSAGES) != MBED_SUCCESS) {
+                printf("Benchmark: out of memory for latency samples\n");
+                return;
+            }
+
+            printf("Benchmarking %d publishes of %d bytes with QoS%d\n", MBED_CONF_MY_MQTT_BENCHMARK_MESSAGES, (int) payload_len, (int) qos);
+            _benchmark_payload_len = payload_len;
+            if (qos == MQTT::QOS1) {
+                bench.run_qos1(*_publisher, *_mqtt_client, BENCHMARK_MQTT_TOPIC, callback(this, &AWS_IoT_MQTT_Test::encode_benchmark_payload));
+            } else {
+                bench.run_qos0(*_mqtt_client, BENCHMARK_MQTT_TOPIC, callback(this, &AWS_IoT_MQTT_Test::encode_benchmark_payload));
+            }
+
+            MQTTBenchmark::print_report(bench.finish());
+        }
+
+        benchmark_inbound();
+
+        /* Reconnect cost: TLS handshake and MQTT connect/subscribe, with link and address kept */
+        printf("Benchmarking reconnect\n");
+        _reconnect.lost(MQTTReconnectEngine::LAYER_TLS);
+        if (_reconnect.bring_up() == MBED_SUCCESS) {
+            printf("**** reconnect (TLS + MQTT) : %d ms\n\n", (int) MQTTReconnectEngine::stats().last_recover_ms);
+        }
+    }
+
+    /**
+     * @brief   Inbound benchmark: rate of messages received, with read-ahead of MyTLSSocket::read()
+     *
+     * QoS0 publishes to a topic subscribed by USER_MQTT_TOPIC_FILTERS echo back. Rate is over
+     * first to last arrival. read() calls against recv() calls show what read-ahead saves.
+     */
+    void benchmark_inbound() {
+
+        static const size_t payload_sizes[] = { MBED_CONF_MY_MQTT_BENCHMARK_PAYLOAD_SIZES };
+        size_t payload_len = payload_sizes[0];
+        char *payload = new char[payload_len];
+        _benchmark_payload_len = payload_len;
+        encode_benchmark_payload(payload, payload_len);
+
+        MQTT::Message message;
+        message.retained = false;
+        message.dup = false;
+        message.qos = MQTT::QOS0;
+        message.payload = payload;
+        message.payloadlen = payload_len;
+
+        printf("Benchmarking %d inbound messages of %d bytes\n", MBED_CONF_MY_MQTT_BENCHMARK_MESSAGES, (int) payload_len);
+        MyTLSSocket::ReadAheadStats before = MyTLSSocket::read_ahead_stats();
+        clear_message_arrive_count();
+        _inbound_benchmark = true;
+
+        int sent = 0;
+        for (; sent < MBED_CONF_MY_MQTT_BENCHMARK_MESSAGES; sent ++) {
+            if (_mqtt_client->publish(BENCHMARK_INBOUND_MQTT_TOPIC, message) != MQTT::SUCCESS) {
+                break;
+            }
+        }
+
+        Timer timer;
+        timer.start();
+        while (_message_arrive_count < sent &&
+                std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed_time()).count() < MQTT_RECEIVE_MESSAGE_WITH_SUBSCRIBED_TOPIC_TIMEOUT_MS) {
+            if (_mqtt_client->yield(1) != MQTT::SUCCESS) {
+                break;
+            }
+        }
+
+        _inbound_benchmark = false;
+        MyTLSSocket::ReadAheadStats after = MyTLSSocket::read_ahead_stats();
+        delete [] payload;
+
+        uint32_t received = _message_arrive_count;
+        uint32_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(_inbound_last - _inbound_first).count();
+        uint32_t msgs_per_sec_x10 = (received > 1 && elapsed_us) ? (uint32_t) ((uint64_t) (received - 1) * 10000000 / elapsed_us) : 0;
+        printf("** MQTT INBOUND BENCHMARK **\n");
+        printf("**** received       : %d/%d\n", (int) received, sent);
+        printf("**** rate           : %d.%d msgs/s\n", (int) (msgs_per_sec_x10 / 10), (int) (msgs_per_sec_x10 % 10));
+        printf("**** read()/recv()  : %d/%d\n", (int) (after.reads - before.reads), (int) (after.recvs - before.recvs));
+        printf("****************************\n\n");
+    }
+
+    /**
+     * @brief   Encoder of benchmark payload: _benchmark_payload_len printable bytes
+     */
+    int encode_benchmark_payload(char *buf, size_t size) {
+        for (size_t i = 0; i < _benchmark_payload_len && i < size; i ++) {
+            buf[i] = 'A' + (i % 26);
+        }
+        return (int) _benchmark_payload_len;
+    }
+#endif
+
+    /**
+     * @brief   Publish specific topic
+     *
+     * Topic filters have subscribed once per connection by _subscriptions, so no subscribe/unsubscribe here.
+     *
+     * @param[in] wait_message  Wait for message with subscribed topic in response to the publish
+     *
+     * @return  Packet ID of the publish in flight, or negative on failure
+     */
+    int pub_topic(const char *topic, const char *publish_message_body, bool wait_message) {
+
+        /* Print publish message */
+        printf("Message to publish:\n");
+        printf("%s\n", publish_message_body);
+
+        _message_body = publish_message_body;
+        return pub_topic(topic, callback(this, &AWS_IoT_MQTT_Test::encode_message_body), wait_message);
+    }
+
+    /**
+     * @brief   Publish specific topic with payload encoded by encoder straight into MQTT packet buffer
+     *
+     * @param[in] wait_message  Wait for message with subscribed topic in response to the publish
+     *
+     * On connection lost meanwhile, publishes in flight are failed. Waiting for message in vain
+     * fails too; the publish itself stays in flight.
+     *
+     * @return  Packet ID of the publish in flight, or negative on failure
+     */
+    int pub_topic(const char *topic, MyMQTTPublisher::Encoder encoder, bool wait_message) {
+
+        int ret = MQTT::FAILURE;
+        int mqtt_rc;
+
+        do {
+            /* Clear count of received message with subscribed topic */
+            clear_message_arrive_count();
+
+            /* AWS IoT does not support publishing and subscribing with QoS 2.
+             * The AWS IoT message broker does not send a PUBACK or SUBACK when QoS 2 is requested. */
+            printf("MQTT publishing message to %s", topic);
+            /* Publish QoS1 without waiting for PUBACK. Up to MBED_CONF_MY_MQTT_PUBLISH_WINDOW publishes
+             * can be in flight. If all are, run MQTT lib to receive PUBACKs first. */
+            while ((mqtt_rc = _publisher->publish(topic, encoder,
+                                                  callback(this, &AWS_IoT_MQTT_Test::publish_completed))) == MyMQTTPublisher::WINDOW_FULL) {
+                if (_mqtt_client->yield(100) != MQTT::SUCCESS) {
+                    /* Connection lost. No PUBACK will come. */
+                    _publisher->abort_all();
+                    mqtt_rc = MQTT::FAILURE;
+                    break;
+                }
+                _publisher->poll();
+            }
+            if (mqtt_rc < 0) {
+                printf("\rMQTT publishes message to %s failed: %d\n", topic, mqtt_rc);
+                break;
+            }
+            printf("\rMQTT publishes message to %s OK (packet id %d)\n", topic, mqtt_rc);
+
+            if (wait_message) {
+                /* Receive message with subscribed topic */
+                printf("MQTT receives message with subscribed %s...\n", topic);
+                Timer timer;
+                timer.start();
+                while (! _message_arrive_count) {
+                    if ((timer.elapsed_time()).count()/1000 >= MQTT_RECEIVE_MESSAGE_WITH_SUBSCRIBED_TOPIC_TIMEOUT_MS) {   
+                        printf("MQTT receives message with subscribed %s TIMEOUT\n", topic);
+                        break;
+                    }
+
+                    if (_mqtt_client->yield(100) != MQTT::SUCCESS) {
+                        printf("MQTT receives message with subscribed %s failed: connection lost\n", topic);
+                        _publisher->abort_all();
+                        break;
+                    }
+                    _publisher->poll();
+                }
+                if (_message_arrive_count) {
+                    printf("MQTT receives message with subscribed %s OK\n", topic);
+                }
+                printf("\n");
+                if (! _message_arrive_count) {
+                    break;
+                }
+            }
+
+            ret = mqtt_rc;
+
+        } while (0);
+
+        return ret;
+    }
+
+    /**
+     * @brief   Encoder of constant message body
+     */
+    int encode_message_body(char *buf, size_t size) {
+        return snprintf(buf, size, "%s", _message_body);
+    }
+
+    /**
+     * @brief   Completion of asynchronous publish, on PUBACK or out of retries
+     */
+    void publish_completed(unsigned short packet_id, int rc) {
+        if (rc == MQTT::SUCCESS) {
+            printf("MQTT publish (packet id %d) acknowledged\n", packet_id);
+        } else {
+            printf("MQTT publish (packet id %d) failed: %d\n", packet_id, rc);
+        }
+
+#ifdef NVT_DEMO_SENSOR
+        /* Track telemetry records of the publish */
+        for (int i = 0; i < MBED_CONF_MY_MQTT_PUBLISH_WINDOW; i ++) {
+            PendingBatch &pending = _pending_batches[i];
+            if (pending.packet_id != packet_id) {
+                continue;
+            }
+
+            if (pending.from_journal) {
+                if (rc == MQTT::SUCCESS) {
+                    _replay_acked += pending.count;
+                } else {
+                    _replay_failed += pending.count;
+                }
+            } else if (rc != MQTT::SUCCESS) {
+                /* Keep them for replay on reconnect rather than lose them */
+                journal_records(pending.records, pending.count);
+            }
+            pending.packet_id = 0;
+            break;
+        }
+#endif
+    }
+
+protected:
+    MyTLSSocket *                                                           _tlssocket;
+    MyMQTTNetwork *                                                         _mqtt_network;
+    MyMQTTClient *                                                          _mqtt_client;
+    MyMQTTSubscriptions *                                                   _subscriptions;
+    MyMQTTPublisher *                                                       _publisher;
+
+    const char *_domain;                    /**< Domain name of the MQTT server */
+    const uint16_t _port;                   /**< Port number of the MQTT server */
+    NetworkInterface *_net_iface;
+    char _client_name[32];                  /**< Resolved MQTT client ID */
+    const char *_message_body;              /**< Message body being encoded */
+    MQTTReconnectEngine _reconnect;         /**< Brings up link/TCP/TLS/MQTT layers and again on lost */
+    SocketAddress _sockaddr;                /**< Resolved address of the MQTT server */
+    TLSConnectCompletion _connect_completion;   /**< Completion of connect_tls() */
+    bool _tlssocket_used;                   /**< _tlssocket has been opened and must be renewed to reconnect */
+    bool _mqtt_connected_once;
+#if !defined(NVT_DEMO_SENSOR) && MBED_CONF_MY_MQTT_BENCHMARK_MESSAGES
+    size_t _benchmark_payload_len;          /**< Payload length being benchmarked */
+#endif
+
+#ifdef NVT_DEMO_SENSOR
+    Thread *_net_thread;                    /**< Network thread for TLS/MQTT I/O */
+    volatile bool _net_thread_done;         /**< Network thread has terminated */
+    SPSCQueue<TelemetryRecord, MBED_CONF_MY_MQTT_TELEMETRY_QUEUE_DEPTH> _telemetry_queue;  /**< Sensor thread -> network thread */
+    TelemetryJournal _journal;              /**< Telemetry not published, for replay on reconnect */
+
+    TelemetryBatcher _batcher;              /**< Live telemetry records to publish in one batch */
+    ShadowDeltaEngine _shadow_delta;        /**< Reported state acknowledged, to report changes only */
+    const TelemetryRecord *_encode_records; /**< Telemetry records being encoded */
+    size_t _encode_count;
+    int _encode_len;
+
+    /* Telemetry records of publish in flight */
+    struct PendingBatch {
+        unsigned short      packet_id;      /**< 0 for free */
+        bool                from_journal;
+        size_t              count;
+        TelemetryRecord     records[MBED_CONF_MY_MQTT_BATCH_MAX_SAMPLES];
+    };
+    PendingBatch _pending_batches[MBED_CONF_MY_MQTT_PUBLISH_WINDOW];
+
+    /* Journal replay batch */
+    TelemetryRecord _replay_batch[MBED_CONF_MY_MQTT_JOURNAL_REPLAY_BATCH];
+    int _replay_count;                      /**< Records in batch */
+    int _replay_next;                       /**< Next record in batch to publish */
+    int _replay_acked;                      /**< Publishes of batch acknowledged */
+    int _replay_failed;                     /**< Publishes of batch failed */
+    uint32_t _replay_last_seq;              /**< Journal sequence number of last record in batch */
+#endif
 
 private:
     static volatile uint16_t   _message_arrive_count;
+#if !defined(NVT_DEMO_SENSOR) && MBED_CONF_MY_MQTT_BENCHMARK_MESSAGES
+    static bool                         _inbound_benchmark;     /**< Count arrivals only, no print */
+    static HighResClock::time_point     _inbound_first;
+    static HighResClock::time_point     _inbound_last;
+#endif
 
-    static void message_arrived(MQTT::MessageData& md) {
-        MQTT::Message &message = md.message;
-        printf("Message arrived: qos %d, retained %d, dup %d, packetid %d\r\n", message.qos, message.retained, message.dup, message.id);
+    static void message_arrived(const MQTTMessageView &view) {
+#if !defined(NVT_DEMO_SENSOR) && MBED_CONF_MY_MQTT_BENCHMARK_MESSAGES
+        if (_inbound_benchmark) {
+            _inbound_last = HighResClock::now();
+            if (_message_arrive_count == 0) {
+                _inbound_first = _inbound_last;
+            }
+            ++ _message_arrive_count;
+            return;
+        }
+#endif
+        printf("Message arrived: topic %.*s, qos %d, retained %d, dup %d, packetid %d\r\n", (int) view.topic_len, view.topic, view.qos, view.retained, view.dup, view.id);
         printf("Payload:\n");
-        printf("%.*s\n", message.payloadlen, (char*)message.payload);
+        printf("%.*s\n", (int) view.payload_len, (const char *) view.payload);
         ++ _message_arrive_count;
     }
 
@@ -609,6 +1446,11 @@ private:
 };
 
 volatile uint16_t   AWS_IoT_MQTT_Test::_message_arrive_count = 0;
+#if !defined(NVT_DEMO_SENSOR) && MBED_CONF_MY_MQTT_BENCHMARK_MESSAGES
+bool                        AWS_IoT_MQTT_Test::_inbound_benchmark = false;
+HighResClock::time_point    AWS_IoT_MQTT_Test::_inbound_first;
+HighResClock::time_point    AWS_IoT_MQTT_Test::_inbound_last;
+#endif
 
 #endif  // End of AWS_IOT_MQTT_TEST
 
@@ -631,249 +1473,423 @@ public:
      * @param[in] net_iface Network interface
      */
     AWS_IoT_HTTPS_Test(const char * domain, const uint16_t port, NetworkInterface *net_iface) :
-        _domain(domain), _port(port), _net_iface(net_iface) {
-        _tlssocket = new MyTLSSocket;
+        _tlssocket(NULL), _domain(domain), _port(port), _net_iface(net_iface),
+        _resolved(false), _reusable(false),
+        _shadow_request(false), _shadow_body(false), _rx_len(0) {
+        _parser.attach(callback(this, &AWS_IoT_HTTPS_Test::on_status),
+                       callback(this, &AWS_IoT_HTTPS_Test::on_header),
+                       callback(this, &AWS_IoT_HTTPS_Test::on_body));
+        _json.attach(callback(this, &AWS_IoT_HTTPS_Test::on_shadow_value));
     }
     /**
      * @brief AWS_IoT_HTTPS_Test Destructor
      */
     ~AWS_IoT_HTTPS_Test() {
-        _tlssocket->close();
-        delete _tlssocket;
-        _tlssocket = NULL;
+        release_connection();
     }
     /**
      * @brief Start AWS IoT test through HTTPS
      *
-     * @param[in] path  The path of the file to fetch from the HTTPS server
+     * With HTTPS_PIPELINE_DEPTH above 1, requests are written ahead of responses on the
+     * kept-alive connection, up to that many unanswered, and responses are matched in order.
+     * Should the server close the connection or ask to, requests not answered yet go again
+     * one by one on a new connection. A resent publish may be a duplicate, as of QoS 1.
      */
     void start_test() {
 
-        int tls_rc;
+        const size_t count = sizeof (HTTPS_REQUESTS) / sizeof (HTTPS_REQUESTS[0]);
+        size_t done = 0;
+        Timer timer;
+        SocketEventWaiter::Stats waits_start = SocketEventWaiter::stats();
 
         do {
-            /* Set host name of the remote host, used for certificate checking */
-            _tlssocket->set_hostname(_domain);
-
-            /* Set the certification of Root CA */
-            tls_rc = _tlssocket->set_root_ca_cert(SSL_CA_CERT_PEM);
-            if (tls_rc != NSAPI_ERROR_OK) {
-                printf("TLSSocket::set_root_ca_cert(...) returned %d\n", tls_rc);
+            if (connect() != NSAPI_ERROR_OK) {
                 break;
             }
 
-            /* Set client certificate and client private key */
-            tls_rc = _tlssocket->set_client_cert_key(SSL_USER_CERT_PEM, SSL_USER_PRIV_KEY_PEM);
-            if (tls_rc != NSAPI_ERROR_OK) {
-                printf("TLSSocket::set_client_cert_key(...) returned %d\n", tls_rc);
-                break;
+            timer.start();
+
+            if (HTTPS_PIPELINE_DEPTH > 1) {
+                done = run_pipelined(HTTPS_REQUESTS, count);
+                if (done == count) {
+                    break;
+                }
+                printf("HTTPS: Pipelining stopped with %d of %d responses. Going on one by one\n", (int) done, (int) count);
+                _reusable = false;
             }
 
-            /* Open a network socket on the network stack of the given network interface */
-            printf("Opening network socket on network stack\n");
-	    
-            tls_rc = _tlssocket->open(_net_iface);
-            if (tls_rc != NSAPI_ERROR_OK) {
-                printf("Opens network socket on network stack failed: %d\n", tls_rc);
-                break;
+            for (; done < count; done ++) {
+                const HttpsRequest &request = HTTPS_REQUESTS[done];
+
+                /* Server has closed the connection, or will */
+                if (! _reusable) {
+                    if (connect() != NSAPI_ERROR_OK) {
+                        break;
+                    }
+                }
+
+                printf("%s\n", request.name);
+                if (! run_req_resp(request)) {
+                    break;
+                }
+                printf("%s OK\n\n", request.name);
             }
-            printf("Opens network socket on network stack OK\n");
 
-            /* DNS resolution */
+        } while (0);
+
+        printf("HTTPS: %d of %d requests done in %d ms, pipeline depth %d\n",
+               (int) done, (int) count, (int) std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed_time()).count(),
+               (int) HTTPS_PIPELINE_DEPTH);
+
+        const SocketEventWaiter::Stats &waits = SocketEventWaiter::stats();
+        printf("HTTPS: Slept %d ms on %d socket waits\n",
+               (int) (waits.wait_ms_total - waits_start.wait_ms_total), (int) (waits.waits - waits_start.waits));
+
+        /* Keep the connection for the next run or another test, or close it */
+        release_connection();
+    }
+
+protected:
+
+    /**
+     * @brief   Connect to the server, on a pooled connection if one is alive, or else a new socket
+     */
+    nsapi_error_t connect() {
+
+        int tls_rc;
+
+        /* Socket cannot be reopened after close. The last one goes to the pool or is closed. */
+        release_connection();
+        _rx_len = 0;
+
+#if MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE > 0
+        /* Kept alive by the last run, or by another test */
+        _tlssocket = HttpsConnectionPool::get_instance().acquire(_domain, _port);
+        if (_tlssocket) {
+            printf("Reuses connection with %s:%d\n", _domain, _port);
+            _tlssocket->set_blocking(false);
+            _waiter.attach(*_tlssocket);
+            _reusable = true;
+            return NSAPI_ERROR_OK;
+        }
+#endif
+
+        _tlssocket = new MyTLSSocket;
+
+        /* Set host name of the remote host, used for certificate checking */
+        _tlssocket->set_hostname(_domain);
+
+        /* Set the certification of Root CA */
+        tls_rc = _tlssocket->set_root_ca_cert(SSL_CA_CERT, SSL_CA_CERT_LEN);
+        if (tls_rc != NSAPI_ERROR_OK) {
+            printf("TLSSocket::set_root_ca_cert(...) returned %d\n", tls_rc);
+            return tls_rc;
+        }
+
+        /* Set client certificate and client private key */
+        tls_rc = _tlssocket->set_client_cert_key(SSL_USER_CERT, SSL_USER_CERT_LEN, SSL_USER_PRIV_KEY, SSL_USER_PRIV_KEY_LEN);
+        if (tls_rc != NSAPI_ERROR_OK) {
+            printf("TLSSocket::set_client_cert_key(...) returned %d\n", tls_rc);
+            return tls_rc;
+        }
+
+        /* Open a network socket on the network stack of the given network interface */
+        printf("Opening network socket on network stack\n");
+        tls_rc = _tlssocket->open(_net_iface);
+        if (tls_rc != NSAPI_ERROR_OK) {
+            printf("Opens network socket on network stack failed: %d\n", tls_rc);
+            return tls_rc;
+        }
+        printf("Opens network socket on network stack OK\n");
+
+        /* DNS resolution, once */
+        if (! _resolved) {
             printf("DNS resolution for %s...\n", _domain);
-            SocketAddress sockaddr;
-            tls_rc = _net_iface->gethostbyname(_domain, &sockaddr);
+            Timer timer;
+            timer.start();
+            tls_rc = _net_iface->gethostbyname(_domain, &_sockaddr);
             if (tls_rc != NSAPI_ERROR_OK) {
                 printf("DNS resolution for %s failed with %d\n", _domain, tls_rc);
-                break;
+                return tls_rc;
             }
-            sockaddr.set_port(_port);
-            printf("DNS resolution for %s: %s:%d\n", _domain, sockaddr.get_ip_address(), sockaddr.get_port());
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+            ConnectionTiming::record(ConnectionTiming::PHASE_DNS, timer.elapsed_time());
+#endif
+            _sockaddr.set_port(_port);
+            printf("DNS resolution for %s: %s:%d\n", _domain, _sockaddr.get_ip_address(), _sockaddr.get_port());
+            _resolved = true;
+        }
 
-            /* Connect to the server */
-            /* Initialize TLS-related stuff */
-            printf("Connecting with %s:%d\n", _domain, _port);
-            tls_rc = _tlssocket->connect(sockaddr);
-            if (tls_rc != NSAPI_ERROR_OK) {
-                printf("Connects with %s:%d failed: %d\n", _domain, _port, tls_rc);
-                break;
-            }
-            printf("Connects with %s:%d OK\n", _domain, _port);
+        /* Connect to the server */
+        /* Initialize TLS-related stuff */
+        printf("Connecting with %s:%d\n", _domain, _port);
+        tls_rc = connect_tls(_tlssocket, _sockaddr, _connect_completion);
+        if (tls_rc != NSAPI_ERROR_OK) {
+            printf("Connects with %s:%d failed: %d\n", _domain, _port, tls_rc);
+            return tls_rc;
+        }
+        printf("Connects with %s:%d OK\n", _domain, _port);
+
+        /* Non-blocking mode
+         *
+         * Asynchronous connect has left it so. Plain connect() would return NSAPI_ERROR_IN_PROGRESS
+         * in non-blocking mode; connect_tls() drives it to completion thru sigio.
+         * On NSAPI_ERROR_WOULD_BLOCK, send/recv sleep on sigio rather than spin.
+         */
+        _tlssocket->set_blocking(false);
+        _waiter.attach(*_tlssocket);
+        _reusable = true;
+
+        return NSAPI_ERROR_OK;
+    }
 
-            /* Non-blocking mode
-             *
-             * Don't change to non-blocking mode before connect; otherwise, we may meet NSAPI_ERROR_IN_PROGRESS.
-             */
-            _tlssocket->set_blocking(false);
+    /**
+     * @brief   Hand the connection over to the pool if it can carry the next request, or close it
+     */
+    void release_connection() {
 
-            /* Publish to user topic through HTTPS/POST */
-            printf("Publishing to user topic through HTTPS/POST\n");
-            if (! run_req_resp(USER_TOPIC_HTTPS_PATH, USER_TOPIC_HTTPS_REQUEST_METHOD, USER_TOPIC_HTTPS_REQUEST_MESSAGE_BODY)) {
-                break;
-            }
-            printf("Publishes to user topic through HTTPS/POST OK\n\n");
+#if MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE > 0
+        /* Nothing of a response must be left to receive */
+        if (_tlssocket && _reusable && _rx_len == 0) {
+            HttpsConnectionPool::get_instance().release(_domain, _port, _tlssocket);
+            _tlssocket = NULL;
+        }
+#endif
 
-            /* Update thing shadow by publishing to UpdateThingShadow topic through HTTPS/POST */
-            printf("Updating thing shadow by publishing to Update Thing Shadow topic through HTTPS/POST\n");
-            if (! run_req_resp(UPDATETHINGSHADOW_TOPIC_HTTPS_PATH, UPDATETHINGSHADOW_TOPIC_HTTPS_REQUEST_METHOD, UPDATETHINGSHADOW_TOPIC_HTTPS_REQUEST_MESSAGE_BODY)) {
-                break;
-            }
-            printf("Update thing shadow by publishing to Update Thing Shadow topic through HTTPS/POST OK\n\n");
+        /* Destroying closes it */
+        delete _tlssocket;
+        _tlssocket = NULL;
+        _reusable = false;
+    }
 
-            /* Get thing shadow by publishing to GetThingShadow topic through HTTPS/POST */
-            printf("Getting thing shadow by publishing to GetThingShadow topic through HTTPS/POST\n");
-            if (! run_req_resp(GETTHINGSHADOW_TOPIC_HTTPS_PATH, GETTHINGSHADOW_TOPIC_HTTPS_REQUEST_METHOD, GETTHINGSHADOW_TOPIC_HTTPS_REQUEST_MESSAGE_BODY)) {
-                break;
-            }
-            printf("Get thing shadow by publishing to GetThingShadow topic through HTTPS/POST OK\n\n");
+    /**
+     * @brief   Run requests pipelined on the connection
+     *
+     * @return  Number of requests answered, in order
+     */
+    size_t run_pipelined(const HttpsRequest *requests, size_t count) {
 
-            /* Delete thing shadow by publishing to DeleteThingShadow topic through HTTPS/POST */
-            printf("Deleting thing shadow by publishing to DeleteThingShadow topic through HTTPS/POST\n");
-            if (! run_req_resp(DELETETHINGSHADOW_TOPIC_HTTPS_PATH, DELETETHINGSHADOW_TOPIC_HTTPS_REQUEST_METHOD, DELETETHINGSHADOW_TOPIC_HTTPS_REQUEST_MESSAGE_BODY)) {
-                break;
-            }
-            printf("Delete thing shadow by publishing to DeleteThingShadow topic through HTTPS/POST OK\n\n");
+        size_t sent = 0;
+        size_t done = 0;
 
-            /* Update thing shadow RESTfully through HTTPS/POST */
-            printf("Updating thing shadow RESTfully through HTTPS/POST\n");
-            if (! run_req_resp(UPDATETHINGSHADOW_THING_HTTPS_PATH, UPDATETHINGSHADOW_THING_HTTPS_REQUEST_METHOD, UPDATETHINGSHADOW_THING_HTTPS_REQUEST_MESSAGE_BODY)) {
-                break;
+        while (done < count) {
+            /* Keep up to pipeline depth requests unanswered */
+            while (sent < count && (sent - done) < HTTPS_PIPELINE_DEPTH) {
+                printf("%s\n", requests[sent].name);
+                if (! send_req(requests[sent])) {
+                    return done;
+                }
+                sent ++;
             }
-            printf("Update thing shadow RESTfully through HTTPS/POST OK\n\n");
 
-            /* Get thing shadow RESTfully through HTTPS/GET */
-            printf("Getting thing shadow RESTfully through HTTPS/GET\n");
-            if (! run_req_resp(GETTHINGSHADOW_THING_HTTPS_PATH, GETTHINGSHADOW_THING_HTTPS_REQUEST_METHOD, GETTHINGSHADOW_THING_HTTPS_REQUEST_MESSAGE_BODY)) {
+            /* Response to the earliest request unanswered */
+            if (recv_resp(requests[done]) != NSAPI_ERROR_OK) {
                 break;
             }
-            printf("Get thing shadow RESTfully through HTTPS/GET OK\n\n");
+            printf("%s OK\n\n", requests[done].name);
+            done ++;
 
-            /* Delete thing shadow RESTfully through HTTPS/DELETE */
-            printf("Deleting thing shadow RESTfully through HTTPS/DELETE\n");
-            if (! run_req_resp(DELETETHINGSHADOW_THING_HTTPS_PATH, DELETETHINGSHADOW_THING_HTTPS_REQUEST_METHOD, DELETETHINGSHADOW_THING_HTTPS_REQUEST_MESSAGE_BODY)) {
+            /* Server won't answer the rest on this connection */
+            if (! _reusable) {
                 break;
             }
-            printf("Delete thing shadow RESTfully through HTTPS/DELETE OK\n\n");
-            
-        } while (0);
-        
-        /* Close socket */
-        _tlssocket->close();
-    }
+        }
 
-protected:
+        return done;
+    }
 
     /**
      * @brief   Run request/response through HTTPS
      */
-    bool run_req_resp(const char *https_path, const char *https_request_method, const char *https_request_message_body) {
+    bool run_req_resp(const HttpsRequest &request) {
+
+        if (! send_req(request)) {
+            return false;
+        }
 
-        bool ret = false;
+        int tls_rc = recv_resp(request);
+        if (tls_rc != NSAPI_ERROR_OK) {
+            print_mbedtls_error("_tlssocket->read", tls_rc);
+            return false;
+        }
 
-        do {
-            int tls_rc;
-            bool _got200 = false;
+        return true;
+    }
 
-            int _bpos;
+    /**
+     * @brief   Send request through HTTPS
+     *
+     * Formatted into its own buffer, so as not to overwrite the next response received along
+     * with the last one.
+     */
+    bool send_req(const HttpsRequest &request) {
 
-            /* Fill the request buffer */
-            _bpos = snprintf(_buffer, sizeof(_buffer) - 1,
-                            "%s %s HTTP/1.1\r\n" "Host: %s\r\n" "Content-Length: %d\r\n" "\r\n" "%s",
-                            https_request_method, https_path, AWS_IOT_HTTPS_SERVER_NAME, strlen(https_request_message_body), https_request_message_body);
-            if (_bpos < 0 || ((size_t) _bpos) > (sizeof (_buffer) - 1)) {
-                printf("snprintf failed: %d\n", _bpos);
-                break;
+        int tls_rc;
+        int _bpos;
+
+        /* Fill the request buffer */
+        _bpos = snprintf(_req_buffer, sizeof(_req_buffer) - 1,
+                        "%s %s HTTP/1.1\r\n" "Host: %s\r\n" "Content-Length: %d\r\n" "\r\n" "%s",
+                        request.method, request.path, AWS_IOT_HTTPS_SERVER_NAME, (int) strlen(request.body), request.body);
+        if (_bpos < 0 || ((size_t) _bpos) > (sizeof (_req_buffer) - 1)) {
+            printf("snprintf failed: %d\n", _bpos);
+            return false;
+        }
+        _req_buffer[_bpos] = 0;
+        /* Print request message */
+        printf("HTTPS: Request message:\n");
+        printf("%s\n", _req_buffer);
+
+        int offset = 0;
+        Kernel::Clock::time_point deadline = Kernel::Clock::now() + HTTPS_SOCKET_TIMEOUT;
+        while (offset < _bpos) {
+            tls_rc = _tlssocket->send((const unsigned char *) _req_buffer + offset, _bpos - offset);
+            if (tls_rc > 0) {
+                offset += tls_rc;
+                deadline = Kernel::Clock::now() + HTTPS_SOCKET_TIMEOUT;
+            } else if (tls_rc == 0 || tls_rc == NSAPI_ERROR_WOULD_BLOCK) {
+                /* Sleep till the socket can take more. Nothing taken counts as full, not as
+                 * sent, so it can't spin past the deadline. */
+                tls_rc = _waiter.wait(deadline);
             }
-            _buffer[_bpos] = 0;
-            /* Print request message */
-            printf("HTTPS: Request message:\n");
-            printf("%s\n", _buffer);
-
-            int offset = 0;
-            do {
-                tls_rc = _tlssocket->send((const unsigned char *) _buffer + offset, _bpos - offset);
-                if (tls_rc > 0) {
-                    offset += tls_rc;
-                }
-            } while (offset < _bpos && 
-                    (tls_rc > 0 || tls_rc == NSAPI_ERROR_WOULD_BLOCK));
-            if (tls_rc < 0 &&
-                tls_rc != NSAPI_ERROR_WOULD_BLOCK) {
+            if (tls_rc < 0) {
                 print_mbedtls_error("_tlssocket->send", tls_rc);
-                break;
+                /* Request cut short */
+                _reusable = false;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief   Receive response through HTTPS
+     *
+     * Bytes are fed to the response parser as they are received into the user buffer, and
+     * body runs go out to on_body() as they are parsed. So a response of any length streams
+     * thru the user buffer rather than being collected in it. Bytes received past the end of
+     * the response, i.e. of the next pipelined response, are kept at the head of the user
+     * buffer for the next call. _reusable tells whether the connection can carry the next
+     * request. Between receipts, the thread sleeps on sigio, for up to HTTPS_SOCKET_TIMEOUT.
+     *
+     * @return  NSAPI_ERROR_OK on response received, NSAPI_ERROR_NO_CONNECTION on the server
+     *          closing the connection before end of response, NSAPI_ERROR_PARAMETER on
+     *          malformed response, NSAPI_ERROR_TIMEOUT on nothing received in time, or error
+     */
+    int recv_resp(const HttpsRequest &request) {
+
+        size_t len = _rx_len;       /* Received and not fed yet, at head of user buffer */
+        size_t received = 0;
+        Kernel::Clock::time_point deadline = Kernel::Clock::now() + HTTPS_SOCKET_TIMEOUT;
+
+        _reusable = false;
+        _rx_len = 0;
+        _parser.reset();
+        _json.reset();
+        _shadow_request = request.shadow;
+        _shadow_body = false;
+
+        printf("HTTPS: Received message:\n");
+
+        while (true) {
+            if (len) {
+                int consumed = _parser.feed(_buffer, len);
+                if (consumed < 0) {
+                    printf("\nHTTPS: Malformed response: %s\n", _parser.error());
+                    return NSAPI_ERROR_PARAMETER;
+                }
+                received += consumed;
+                if (_parser.done()) {
+                    /* Keep what's received of the next response */
+                    _rx_len = len - consumed;
+                    memmove(_buffer, _buffer + consumed, _rx_len);
+                    break;
+                }
+                len = 0;
             }
 
             /* Read data out of the socket */
-            offset = 0;
-            size_t content_length = 0;
-            size_t offset_end = 0;
-            char *line_beg = _buffer;
-            char *line_end = NULL;
-            do {
-                tls_rc = _tlssocket->recv((unsigned char *) _buffer + offset, sizeof(_buffer) - offset - 1);
-                if (tls_rc > 0) {
-                    offset += tls_rc;
+            int tls_rc = _tlssocket->recv((unsigned char *) _buffer, sizeof(_buffer));
+            if (tls_rc > 0) {
+                len = tls_rc;
+                deadline = Kernel::Clock::now() + HTTPS_SOCKET_TIMEOUT;
+            } else if (tls_rc == NSAPI_ERROR_WOULD_BLOCK) {
+                /* Sleep till more is received */
+                tls_rc = _waiter.wait(deadline);
+                if (tls_rc != NSAPI_ERROR_OK) {
+                    printf("\nHTTPS: Nothing received in %d ms\n", (int) HTTPS_SOCKET_TIMEOUT.count());
+                    return tls_rc;
                 }
-                
-                /* Make it null-terminated */
-                _buffer[offset] = 0;
-
-                /* Scan response message
-                 *             
-                 * 1. A status line which includes the status code and reason message (e.g., HTTP/1.1 200 OK)
-                 * 2. Response header fields (e.g., Content-Type: text/html)
-                 * 3. An empty line (\r\n)
-                 * 4. An optional message body
-                 */
-                if (! offset_end) {
-                    line_end = strstr(line_beg, "\r\n");
-                    if (line_end) {
-                        /* Scan status line */
-                        if (! _got200) {
-                            _got200 = strstr(line_beg, HTTPS_OK_STR) != NULL;
-                        }
-            
-                        /* Scan response header fields for Content-Length 
-                         * 
-                         * NOTE: Assume chunked transfer (Transfer-Encoding: chunked) is not used
-                         * NOTE: Assume response field name are in lower case
-                         */
-                        if (content_length == 0) {
-                            sscanf(line_beg, "content-length:%d", &content_length);
-                        }
-                    
-                        /* An empty line indicates end of response header fields */
-                        if (line_beg == line_end) {
-                            offset_end = line_end - _buffer + 2 + content_length;
-                        }
-                    
-                        /* Go to next line */
-                        line_beg = line_end + 2;
-                        line_end = NULL;
-                    }
+            } else if (tls_rc == 0) {
+                /* Body may be delimited by connection close */
+                if (_parser.finish() != 0) {
+                    return NSAPI_ERROR_NO_CONNECTION;
                 }
-            } while ((offset_end == 0 || offset < offset_end) &&
-                    (tls_rc > 0 || tls_rc == NSAPI_ERROR_WOULD_BLOCK));
-            if (tls_rc < 0 && 
-                tls_rc != NSAPI_ERROR_WOULD_BLOCK) {
-                print_mbedtls_error("_tlssocket->read", tls_rc);
                 break;
+            } else {
+                return tls_rc;
             }
-            _bpos = offset;
+        }
 
-            _buffer[_bpos] = 0;
+        _reusable = _parser.keep_alive();
 
-            /* Print status messages */
-            printf("HTTPS: Received %d chars from server\n", _bpos);
-            printf("HTTPS: Received 200 OK status ... %s\n", _got200 ? "[OK]" : "[FAIL]");
-            printf("HTTPS: Received message:\n");
-            printf("%s\n", _buffer);
+        if (_shadow_body && _json.error() == NULL && _json.finish() != 0) {
+            printf("HTTPS: Shadow document malformed: %s\n", _json.error());
+        }
 
-            ret = true;
+        /* Print status messages */
+        printf("\nHTTPS: Received %d chars from server\n", (int) received);
+        printf("HTTPS: Received 200 OK status ... %s\n", (_parser.status() == 200) ? "[OK]" : "[FAIL]");
 
-        } while (0);
+        return NSAPI_ERROR_OK;
+    }
 
-        return ret;
+    /**
+     * @brief   Response parser: status line
+     */
+    void on_status(int status) {
+
+        printf("HTTP status %d\n", status);
+
+        /* Shadow document goes thru JSON reader rather than to console as is */
+        _shadow_body = _shadow_request && status == 200;
+    }
+
+    /**
+     * @brief   Response parser: header field
+     */
+    void on_header(const char *name, const char *value) {
+
+        printf("%s: %s\n", name, value);
+    }
+
+    /**
+     * @brief   Response parser: run of body, as decrypted
+     */
+    void on_body(const char *data, size_t len) {
+
+        if (! _shadow_body) {
+            fwrite(data, 1, len, stdout);
+            return;
+        }
+
+        if (_json.error() == NULL && _json.feed(data, len) < 0) {
+            printf("HTTPS: Shadow document malformed: %s\n", _json.error());
+        }
+    }
+
+    /**
+     * @brief   JSON reader: value of shadow document
+     */
+    void on_shadow_value(const char *path, const char *value, bool string) {
+
+        /* Timestamps of each attribute are left out */
+        if (strncmp(path, "metadata.", 9) == 0) {
+            return;
+        }
+
+        printf(string ? "HTTPS: Shadow %s = \"%s\"\n" : "HTTPS: Shadow %s = %s\n", path, value);
     }
 
 protected:
@@ -881,8 +1897,19 @@ protected:
 
     const char *_domain;                    /**< Domain name of the HTTPS server */
     const uint16_t _port;                   /**< Port number of the HTTPS server */
-    char _buffer[HTTPS_USER_BUFFER_SIZE];   /**< User buffer */
+    char _buffer[HTTPS_USER_BUFFER_SIZE];   /**< User buffer for receiving response */
+    char _req_buffer[HTTPS_USER_BUFFER_SIZE];   /**< User buffer for request */
     NetworkInterface *_net_iface;
+    SocketAddress _sockaddr;                /**< Resolved address of the HTTPS server */
+    TLSConnectCompletion _connect_completion;   /**< Completion of connect_tls() */
+    bool _resolved;
+    bool _reusable;                         /**< Connection can carry the next request */
+    HttpResponseParser _parser;
+    JsonStreamReader _json;                 /**< Reads shadow document as received */
+    bool _shadow_request;                   /**< Response body to be shadow document */
+    bool _shadow_body;                      /**< Body of this response goes to JSON reader */
+    size_t _rx_len;                         /**< Bytes of the next response received along with the last one */
+    SocketEventWaiter _waiter;              /**< Sleeps on sigio of _tlssocket */
 };
 
 #endif  // End of AWS_IOT_HTTPS_TEST
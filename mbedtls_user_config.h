@@ -37,14 +37,98 @@
 #define MBEDTLS_MPI_MAX_SIZE        256
 #endif
 
+/* Handshake crypto, by my-tlssocket.tls-crypto-profile */
+#if MBED_CONF_MY_TLSSOCKET_TLS_CRYPTO_PROFILE == 1
+/* Fast handshake: ECDHE-ECDSA with P-256 only
+ *
+ * The server must present an ECDSA certificate, i.e. trust Amazon Root CA 3 (ECC) rather
+ * than Amazon Root CA 1 (RSA). Client certificate/key should be ECC P-256 too. RSA is kept
+ * for verifying RSA-signed certificates and an RSA client key, but not for key exchange.
+ */
+#define MBEDTLS_SSL_CIPHERSUITES                            \
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,        \
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256
+
+#undef MBEDTLS_ECP_DP_SECP192R1_ENABLED
+#undef MBEDTLS_ECP_DP_SECP224R1_ENABLED
+#undef MBEDTLS_ECP_DP_SECP384R1_ENABLED
+#undef MBEDTLS_ECP_DP_SECP521R1_ENABLED
+#undef MBEDTLS_ECP_DP_SECP192K1_ENABLED
+#undef MBEDTLS_ECP_DP_SECP224K1_ENABLED
+#undef MBEDTLS_ECP_DP_SECP256K1_ENABLED
+#undef MBEDTLS_ECP_DP_BP256R1_ENABLED
+#undef MBEDTLS_ECP_DP_BP384R1_ENABLED
+#undef MBEDTLS_ECP_DP_BP512R1_ENABLED
+#undef MBEDTLS_ECP_DP_CURVE25519_ENABLED
+#undef MBEDTLS_ECP_DP_CURVE448_ENABLED
+
+/* NIST P-256 fast reduction */
+#if !defined(MBEDTLS_ECP_NIST_OPTIM)
+#define MBEDTLS_ECP_NIST_OPTIM
+#endif
+
+/* Comb precomputed for the generator (ECDSA sign, ECDHE key generation) with window one
+ * wider than for other points, i.e. 5 for P-256: 16 points, about 2 KB heap per group */
+#undef MBEDTLS_ECP_FIXED_POINT_OPTIM
+#define MBEDTLS_ECP_FIXED_POINT_OPTIM   1
+#undef MBEDTLS_ECP_WINDOW_SIZE
+#define MBEDTLS_ECP_WINDOW_SIZE         5
+
+/* Sliding window for modular exponentiation, e.g. RSA client key: 2^(4-1) temporaries of
+ * MBEDTLS_MPI_MAX_SIZE, i.e. 2 KB for RSA-2048, for about 1/3 fewer multiplications */
+#define MBEDTLS_MPI_WINDOW_SIZE     4
+#else
+/* Default: RSA-friendly, smallest RAM */
 #define MBEDTLS_MPI_WINDOW_SIZE     1
+#endif
 
 #if defined(TARGET_STM32F439xI) && defined(MBEDTLS_CONFIG_HW_SUPPORT)
 #undef MBEDTLS_AES_ALT
 #endif /* TARGET_STM32F439xI && MBEDTLS_CONFIG_HW_SUPPORT */
 
+/* TLS record buffer sizing, by my-tlssocket.tls-memory-profile
+ *
+ * Each TLS connection allocates one IN and one OUT record buffer, of content length
+ * plus record overhead. IN must hold the largest handshake message from the server
+ * (certificate chain). OUT only has to hold our client certificate message and our
+ * largest write. Larger writes are split into more records.
+ *
+ * With MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH, the buffers are shrunk after handshake to the
+ * negotiated max fragment length (my-tlssocket.tls-max-frag-len).
+ *
+ * Mbed TLS refuses a max fragment length above the smaller of IN and OUT content length, and
+ * then sends no max_fragment_length extension. So with tls-max-frag-len 4 (4096), OUT is
+ * kept at 4096 rather than 2048.
+ */
+#if MBED_CONF_MY_TLSSOCKET_TLS_MEMORY_PROFILE == 2
+/* Lean */
+#define MBEDTLS_SSL_IN_CONTENT_LEN      4096
+#if MBED_CONF_MY_TLSSOCKET_TLS_MAX_FRAG_LEN == 4
+#define MBEDTLS_SSL_OUT_CONTENT_LEN     4096
+#else
+#define MBEDTLS_SSL_OUT_CONTENT_LEN     2048
+#endif
+#define MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
+#elif MBED_CONF_MY_TLSSOCKET_TLS_MEMORY_PROFILE == 1
+/* Balanced */
+#define MBEDTLS_SSL_IN_CONTENT_LEN      8192
+#if MBED_CONF_MY_TLSSOCKET_TLS_MAX_FRAG_LEN == 4
+#define MBEDTLS_SSL_OUT_CONTENT_LEN     4096
+#else
+#define MBEDTLS_SSL_OUT_CONTENT_LEN     2048
+#endif
+#define MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
+#else
+/* Legacy */
+
 /* Maximum length (in bytes) of incoming plaintext fragments */
 #define MBEDTLS_SSL_IN_CONTENT_LEN      8192 
 
 /* Maximum length (in bytes) of outgoing plaintext fragments */
 #define MBEDTLS_SSL_OUT_CONTENT_LEN     8192 
+#endif
+
+/* Route Mbed TLS heap thru TLSHeapTracker, see my-tlssocket.tls-heap-tracking */
+#if MBED_CONF_MY_TLSSOCKET_TLS_HEAP_TRACKING
+#define MBEDTLS_PLATFORM_MEMORY
+#endif
@@ -0,0 +1,401 @@
+#include "mbed.h"
+#include "HttpResponseParser.h"
+#include <algorithm>
+#include <ctype.h>
+#include <strings.h>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+#if MBED_CONF_MY_HTTPS_PARSER_BENCHMARK
+extern "C" {
+    MBED_USED void print_http_parser_benchmark(void);
+}
+#endif
+
+namespace {
+
+/* Whether comma-separated list has token, case-insensitively */
+bool has_token(const char *list, const char *token)
+{
+    size_t token_len = strlen(token);
+
+    while (*list) {
+        while (*list == ' ' || *list == '\t' || *list == ',') {
+            list ++;
+        }
+        const char *end = list;
+        while (*end && *end != ',' && *end != ' ' && *end != '\t' && *end != ';') {
+            end ++;
+        }
+        if ((size_t) (end - list) == token_len && strncasecmp(list, token, token_len) == 0) {
+            return true;
+        }
+        /* Skip parameters, if any */
+        while (*end && *end != ',') {
+            end ++;
+        }
+        list = end;
+    }
+
+    return false;
+}
+
+}
+
+HttpResponseParser::HttpResponseParser()
+{
+    reset();
+}
+
+void HttpResponseParser::attach(StatusHandler status, HeaderHandler header, BodyHandler body)
+{
+    _status_handler = status;
+    _header_handler = header;
+    _body_handler = body;
+}
+
+void HttpResponseParser::reset(bool head)
+{
+    _state = STATE_STATUS_LINE;
+    _head = head;
+    _keep_alive = true;
+    _chunked = false;
+    _has_length = false;
+    _status = 0;
+    _remaining = 0;
+    _error = NULL;
+    _line_len = 0;
+}
+
+int HttpResponseParser::feed(const char *data, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+        switch (_state) {
+            case STATE_DONE:
+                return (int) pos;
+
+            case STATE_ERROR:
+                return -1;
+
+            case STATE_BODY_LENGTH:
+            case STATE_CHUNK_DATA: {
+                size_t run = len - pos;
+                if (run > _remaining) {
+                    run = _remaining;
+                }
+                if (_body_handler) {
+                    _body_handler(data + pos, run);
+                }
+                pos += run;
+                _remaining -= run;
+                if (_remaining == 0) {
+                    _state = (_state == STATE_BODY_LENGTH) ? STATE_DONE : STATE_CHUNK_DATA_END;
+                }
+                break;
+            }
+
+            case STATE_BODY_CLOSE:
+                if (_body_handler) {
+                    _body_handler(data + pos, len - pos);
+                }
+                pos = len;
+                break;
+
+            case STATE_CHUNK_DATA_END:
+            case STATE_CHUNK_DATA_LF: {
+                /* CRLF after chunk, or bare LF */
+                char c = data[pos ++];
+                if (c == '\n') {
+                    _state = STATE_CHUNK_SIZE_LINE;
+                } else if (c == '\r' && _state == STATE_CHUNK_DATA_END) {
+                    _state = STATE_CHUNK_DATA_LF;
+                } else {
+                    return fail("chunk not followed by CRLF");
+                }
+                break;
+            }
+
+            default: {
+                /* Line states. CR before LF is stripped in on_line(). */
+                char c = data[pos ++];
+                if (c == '\n') {
+                    if (on_line() < 0) {
+                        return -1;
+                    }
+                    _line_len = 0;
+                } else if (_line_len < sizeof (_line) - 1) {
+                    _line[_line_len ++] = c;
+                } else {
+                    return fail("header line too long");
+                }
+                break;
+            }
+        }
+    }
+
+    return (int) pos;
+}
+
+int HttpResponseParser::finish()
+{
+    if (_state == STATE_BODY_CLOSE) {
+        _state = STATE_DONE;
+    }
+
+    return (_state == STATE_DONE) ? 0 : fail("connection closed before end of response");
+}
+
+int HttpResponseParser::on_line()
+{
+    if (_line_len && _line[_line_len - 1] == '\r') {
+        _line_len --;
+    }
+    _line[_line_len] = 0;
+
+    switch (_state) {
+        case STATE_STATUS_LINE:
+            /* Empty lines before status line are tolerated */
+            return _line_len ? on_status_line() : 0;
+
+        case STATE_HEADER_LINE:
+            return _line_len ? on_header_line() : on_headers_done();
+
+        case STATE_CHUNK_SIZE_LINE:
+            return on_chunk_size_line();
+
+        case STATE_TRAILER_LINE:
+            /* Trailer fields are skipped */
+            if (_line_len == 0) {
+                _state = STATE_DONE;
+            }
+            return 0;
+
+        default:
+            return fail("unexpected line");
+    }
+}
+
+int HttpResponseParser::on_status_line()
+{
+    /* HTTP/1.x SP 3DIGIT SP reason */
+    if (_line_len < 12 || strncmp(_line, "HTTP/1.", 7) != 0 || ! isdigit((unsigned char) _line[7]) ||
+        _line[8] != ' ' || ! isdigit((unsigned char) _line[9]) || ! isdigit((unsigned char) _line[10]) ||
+        ! isdigit((unsigned char) _line[11]) || (_line[12] != ' ' && _line[12] != 0)) {
+        return fail("malformed status line");
+    }
+
+    /* HTTP/1.0 closes by default */
+    _keep_alive = (_line[7] != '0');
+    _status = (_line[9] - '0') * 100 + (_line[10] - '0') * 10 + (_line[11] - '0');
+    _state = STATE_HEADER_LINE;
+
+    /* Interim response is skipped */
+    if (_status >= 200 && _status_handler) {
+        _status_handler(_status);
+    }
+
+    return 0;
+}
+
+int HttpResponseParser::on_header_line()
+{
+    char *colon = strchr(_line, ':');
+    if (colon == NULL || colon == _line) {
+        return fail("malformed header line");
+    }
+
+    *colon = 0;
+    const char *name = _line;
+    char *value = colon + 1;
+    while (*value == ' ' || *value == '\t') {
+        value ++;
+    }
+    char *end = _line + _line_len;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+        end --;
+    }
+    *end = 0;
+
+    if (strcasecmp(name, "content-length") == 0) {
+        uint32_t length = 0;
+        const char *p = value;
+        if (! isdigit((unsigned char) *p)) {
+            return fail("malformed content-length");
+        }
+        for (; isdigit((unsigned char) *p); p ++) {
+            if (length > (UINT32_MAX - 9) / 10) {
+                return fail("content-length too large");
+            }
+            length = length * 10 + (*p - '0');
+        }
+        if (*p) {
+            return fail("malformed content-length");
+        }
+        _remaining = length;
+        _has_length = true;
+    } else if (strcasecmp(name, "transfer-encoding") == 0) {
+        _chunked = has_token(value, "chunked");
+    } else if (strcasecmp(name, "connection") == 0) {
+        if (has_token(value, "close")) {
+            _keep_alive = false;
+        } else if (has_token(value, "keep-alive")) {
+            _keep_alive = true;
+        }
+    }
+
+    if (_status >= 200 && _header_handler) {
+        _header_handler(name, value);
+    }
+
+    return 0;
+}
+
+int HttpResponseParser::on_headers_done()
+{
+    /* Final response follows interim one */
+    if (_status < 200) {
+        reset(_head);
+        return 0;
+    }
+
+    if (_head || _status == 204 || _status == 304) {
+        _state = STATE_DONE;
+    } else if (_chunked) {
+        /* Content-Length is ignored with chunked */
+        _state = STATE_CHUNK_SIZE_LINE;
+    } else if (_has_length) {
+        _state = _remaining ? STATE_BODY_LENGTH : STATE_DONE;
+    } else {
+        _state = STATE_BODY_CLOSE;
+        _keep_alive = false;
+    }
+
+    return 0;
+}
+
+int HttpResponseParser::on_chunk_size_line()
+{
+    uint32_t size = 0;
+    const char *p = _line;
+
+    if (! isxdigit((unsigned char) *p)) {
+        return fail("malformed chunk size");
+    }
+    for (; isxdigit((unsigned char) *p); p ++) {
+        if (size > (UINT32_MAX >> 4)) {
+            return fail("chunk size too large");
+        }
+        size = (size << 4) | (isdigit((unsigned char) *p) ? (*p - '0') : ((tolower((unsigned char) *p) - 'a') + 10));
+    }
+    /* Chunk extensions are skipped */
+    if (*p && *p != ';' && *p != ' ' && *p != '\t') {
+        return fail("malformed chunk size");
+    }
+
+    _remaining = size;
+    _state = size ? STATE_CHUNK_DATA : STATE_TRAILER_LINE;
+
+    return 0;
+}
+
+int HttpResponseParser::fail(const char *reason)
+{
+    _state = STATE_ERROR;
+    _error = reason;
+
+    return -1;
+}
+
+#if MBED_CONF_MY_HTTPS_PARSER_BENCHMARK
+
+namespace {
+
+/* 64 bytes of shadow document */
+#define BENCHMARK_JSON_64   "{\"state\":{\"reported\":{\"temperature\":25.50,\"humidity\":48.25}}}, \n"
+#define BENCHMARK_JSON_256  BENCHMARK_JSON_64 BENCHMARK_JSON_64 BENCHMARK_JSON_64 BENCHMARK_JSON_64
+
+static_assert(sizeof (BENCHMARK_JSON_256) - 1 == 0x100, "Benchmark chunk doesn't match its size line");
+
+/* Typical REST API response, 1 KB body in chunks */
+const char BENCHMARK_RESPONSE[] =
+    "HTTP/1.1 200 OK\r\n"
+    "content-type: application/json\r\n"
+    "Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n"
+    "x-amzn-RequestId: 01234567-89ab-cdef-0123-456789abcdef\r\n"
+    "Connection: keep-alive\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "100\r\n" BENCHMARK_JSON_256 "\r\n"
+    "100\r\n" BENCHMARK_JSON_256 "\r\n"
+    "100\r\n" BENCHMARK_JSON_256 "\r\n"
+    "100;ext=1\r\n" BENCHMARK_JSON_256 "\r\n"
+    "0\r\n"
+    "\r\n";
+
+/* Pieces as recv() might return, odd-sized to split lines */
+const size_t BENCHMARK_PIECE = 61;
+
+struct BenchmarkSink {
+    uint32_t    body_bytes;
+
+    void body(const char *data, size_t len)
+    {
+        body_bytes += len;
+    }
+};
+
+}
+
+uint32_t HttpResponseParser::benchmark(uint32_t duration_ms)
+{
+    HttpResponseParser parser;
+    BenchmarkSink sink = { 0 };
+    uint64_t bytes = 0;
+
+    parser.attach(nullptr, nullptr, callback(&sink, &BenchmarkSink::body));
+
+    HighResClock::time_point start = HighResClock::now();
+    HighResClock::time_point deadline = start + std::chrono::milliseconds(duration_ms);
+    HighResClock::time_point now;
+
+    do {
+        parser.reset();
+        for (size_t pos = 0; pos < sizeof (BENCHMARK_RESPONSE) - 1; ) {
+            size_t piece = std::min(BENCHMARK_PIECE, sizeof (BENCHMARK_RESPONSE) - 1 - pos);
+            int consumed = parser.feed(BENCHMARK_RESPONSE + pos, piece);
+            if (consumed <= 0) {
+                return 0;
+            }
+            pos += consumed;
+        }
+        if (! parser.done() || sink.body_bytes != 0x400) {
+            return 0;
+        }
+        sink.body_bytes = 0;
+        bytes += sizeof (BENCHMARK_RESPONSE) - 1;
+        now = HighResClock::now();
+    } while (now < deadline);
+
+    uint64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+
+    /* Bytes per ms, i.e. kB/s */
+    return elapsed_us ? (uint32_t) (bytes * 1000 / elapsed_us) : 0;
+}
+
+void print_http_parser_benchmark(void)
+{
+    uint32_t kbps = HttpResponseParser::benchmark(500);
+
+    printf("** HTTP PARSER BENCHMARK **\n");
+    printf("**** response         : %d bytes, 1 KB body chunked, fed in %d-byte pieces\n",
+           (int) (sizeof (BENCHMARK_RESPONSE) - 1), (int) BENCHMARK_PIECE);
+    printf("**** throughput       : %" PRIu32 ".%" PRIu32 " MB/s\n", kbps / 1000, (kbps % 1000) / 100);
+    printf("***************************\n\n");
+}
+
+#endif  // MBED_CONF_MY_HTTPS_PARSER_BENCHMARK
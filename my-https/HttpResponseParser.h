@@ -0,0 +1,147 @@
+#ifndef _HTTP_RESPONSE_PARSER_H_
+#define _HTTP_RESPONSE_PARSER_H_
+
+#include "mbed.h"
+
+/* HttpResponseParser = resumable HTTP/1.1 response parser, fed bytes as they are received
+ *
+ * Bytes are fed in pieces of any size, e.g. as recv() returns them, and each byte is examined
+ * once. Status line, header lines and chunk size lines are collected byte by byte into a
+ * line buffer and handled when complete; body bytes pass through in runs. Nothing consumed
+ * is scanned again on the next feed().
+ *
+ * Events are reported through callbacks while feeding:
+ *
+ *   status     status code, on status line
+ *   header     name and value of each header field, value with surrounding spaces trimmed
+ *   body       each run of body, with chunked transfer coding removed
+ *
+ * Header names match case-insensitively. Body length is taken from, in order:
+ *
+ *   no body            HEAD request, 1xx, 204 and 304
+ *   chunked            Transfer-Encoding: chunked. Chunk extensions and trailers are skipped.
+ *   Content-Length
+ *   connection close   otherwise, ended by finish()
+ *
+ * Interim 1xx responses are skipped; the final response follows. Lines must fit in
+ * max-header-line bytes with their CR and a terminator; a longer line fails the response
+ * rather than be reported truncated.
+ *
+ * NOTE: Not thread-safe. Feed it from the thread reading the socket.
+ */
+class HttpResponseParser
+{
+public:
+    typedef mbed::Callback<void(int status)> StatusHandler;
+    typedef mbed::Callback<void(const char *name, const char *value)> HeaderHandler;
+    typedef mbed::Callback<void(const char *data, size_t len)> BodyHandler;
+
+    HttpResponseParser();
+
+    /**
+     * Attach event handlers. Strings passed to them are valid only during the call.
+     */
+    void attach(StatusHandler status, HeaderHandler header, BodyHandler body);
+
+    /**
+     * Get ready for the next response
+     *
+     * @param[in] head  Response to HEAD request, without body
+     */
+    void reset(bool head = false);
+
+    /**
+     * Parse bytes received
+     *
+     * Parsing stops at end of response. The bytes left belong to the next, pipelined response.
+     *
+     * @return  Bytes consumed, or -1 on malformed response with error() telling why
+     */
+    int feed(const char *data, size_t len);
+
+    /**
+     * Server has closed the connection. Ends body delimited by connection close.
+     *
+     * @return  0 if response is complete, or -1
+     */
+    int finish();
+
+    /**
+     * End of response reached
+     */
+    bool done() const
+    {
+        return _state == STATE_DONE;
+    }
+
+    int status() const
+    {
+        return _status;
+    }
+
+    /**
+     * Connection can carry the next response, by HTTP version and Connection header
+     */
+    bool keep_alive() const
+    {
+        return _keep_alive;
+    }
+
+    /**
+     * Reason of last -1 return, or NULL
+     */
+    const char *error() const
+    {
+        return _error;
+    }
+
+#if MBED_CONF_MY_HTTPS_PARSER_BENCHMARK
+    /**
+     * Parse throughput of canned chunked response fed in small pieces, in kB/s
+     */
+    static uint32_t benchmark(uint32_t duration_ms);
+#endif
+
+private:
+    enum State {
+        STATE_STATUS_LINE = 0,
+        STATE_HEADER_LINE,
+        STATE_BODY_LENGTH,          /**< Content-Length body, _remaining left */
+        STATE_BODY_CLOSE,           /**< Body until connection close */
+        STATE_CHUNK_SIZE_LINE,
+        STATE_CHUNK_DATA,           /**< Chunk, _remaining left */
+        STATE_CHUNK_DATA_END,       /**< CRLF after chunk */
+        STATE_CHUNK_DATA_LF,        /**< LF after CR after chunk */
+        STATE_TRAILER_LINE,
+        STATE_DONE,
+        STATE_ERROR
+    };
+
+    /**
+     * Handle line complete in line buffer
+     */
+    int on_line();
+    int on_status_line();
+    int on_header_line();
+    int on_headers_done();
+    int on_chunk_size_line();
+
+    int fail(const char *reason);
+
+    StatusHandler   _status_handler;
+    HeaderHandler   _header_handler;
+    BodyHandler     _body_handler;
+
+    State           _state;
+    bool            _head;
+    bool            _keep_alive;
+    bool            _chunked;
+    bool            _has_length;
+    int             _status;
+    uint32_t        _remaining;
+    const char *    _error;
+    size_t          _line_len;
+    char            _line[MBED_CONF_MY_HTTPS_MAX_HEADER_LINE];
+};
+
+#endif // _HTTP_RESPONSE_PARSER_H_
@@ -0,0 +1,207 @@
+#include "mbed.h"
+#include "HttpsConnectionPool.h"
+
+#if MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE > 0
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+extern "C" {
+    MBED_USED void print_https_connection_pool_stats(void);
+}
+
+namespace {
+
+const std::chrono::milliseconds IDLE_TIMEOUT(MBED_CONF_MY_HTTPS_CONNECTION_POOL_IDLE_TIMEOUT);
+
+}
+
+HttpsConnectionPool::Stats HttpsConnectionPool::_stats;
+
+HttpsConnectionPool &HttpsConnectionPool::get_instance()
+{
+    static HttpsConnectionPool pool;
+    return pool;
+}
+
+HttpsConnectionPool::HttpsConnectionPool() :
+    _evict_event(0)
+{
+    for (int i = 0; i < MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE; i ++) {
+        _entries[i].socket = NULL;
+        _entries[i].hostname = NULL;
+        _entries[i].port = 0;
+    }
+}
+
+MyTLSSocket *HttpsConnectionPool::acquire(const char *hostname, uint16_t port)
+{
+    MyTLSSocket *socket = NULL;
+
+    _mutex.lock();
+
+    _stats.acquires ++;
+
+    /* Not to hand out one due for eviction */
+    evict_idle();
+
+    while (socket == NULL) {
+        /* Most recently released first */
+        Entry *found = NULL;
+        for (int i = 0; i < MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE; i ++) {
+            Entry &entry = _entries[i];
+            if (entry.socket && entry.port == port && strcmp(entry.hostname, hostname) == 0 &&
+                (found == NULL || entry.released > found->released)) {
+                found = &entry;
+            }
+        }
+        if (found == NULL) {
+            break;
+        }
+
+        if (alive(found->socket)) {
+            socket = found->socket;
+            found->socket = NULL;
+            _stats.hits ++;
+        } else {
+            _stats.dead ++;
+            drop(found);
+        }
+    }
+
+    _mutex.unlock();
+
+    return socket;
+}
+
+void HttpsConnectionPool::release(const char *hostname, uint16_t port, MyTLSSocket *socket)
+{
+    /* Handler of the last owner may be gone */
+    socket->sigio(nullptr);
+
+    _mutex.lock();
+
+    _stats.released ++;
+
+    Entry *slot = NULL;
+    for (int i = 0; i < MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE; i ++) {
+        if (_entries[i].socket == NULL) {
+            slot = &_entries[i];
+            break;
+        }
+    }
+
+    /* Full. Make room by closing the one idle longest. */
+    if (slot == NULL) {
+        slot = &_entries[0];
+        for (int i = 1; i < MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE; i ++) {
+            if (_entries[i].released < slot->released) {
+                slot = &_entries[i];
+            }
+        }
+        _stats.evicted_full ++;
+        drop(slot);
+    }
+
+    slot->socket = socket;
+    slot->hostname = hostname;
+    slot->port = port;
+    slot->released = Kernel::Clock::now();
+
+    schedule_evict();
+
+    _mutex.unlock();
+}
+
+bool HttpsConnectionPool::alive(MyTLSSocket *socket)
+{
+    unsigned char byte;
+
+    socket->set_blocking(false);
+
+    return socket->recv(&byte, 1) == NSAPI_ERROR_WOULD_BLOCK;
+}
+
+void HttpsConnectionPool::drop(Entry *entry)
+{
+    /* Closes it too */
+    delete entry->socket;
+    entry->socket = NULL;
+}
+
+void HttpsConnectionPool::evict_idle()
+{
+    Kernel::Clock::time_point now = Kernel::Clock::now();
+
+    for (int i = 0; i < MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE; i ++) {
+        Entry &entry = _entries[i];
+        if (entry.socket && (now - entry.released) >= IDLE_TIMEOUT) {
+            _stats.evicted_idle ++;
+            drop(&entry);
+        }
+    }
+}
+
+void HttpsConnectionPool::schedule_evict()
+{
+    if (_evict_event) {
+        return;
+    }
+
+    Entry *oldest = NULL;
+    for (int i = 0; i < MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE; i ++) {
+        Entry &entry = _entries[i];
+        if (entry.socket && (oldest == NULL || entry.released < oldest->released)) {
+            oldest = &entry;
+        }
+    }
+    if (oldest == NULL) {
+        return;
+    }
+
+    /* Close on handshake thread, sized for TLS. Without it, on next acquire() at the latest. */
+    events::EventQueue *queue = MyTLSSocket::handshake_queue();
+    if (queue == NULL) {
+        return;
+    }
+
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(oldest->released + IDLE_TIMEOUT - Kernel::Clock::now());
+    if (delay.count() < 0) {
+        delay = std::chrono::milliseconds(0);
+    }
+    _evict_event = queue->call_in(delay, callback(this, &HttpsConnectionPool::evict_event));
+}
+
+void HttpsConnectionPool::evict_event()
+{
+    _mutex.lock();
+
+    _evict_event = 0;
+    evict_idle();
+    schedule_evict();
+
+    _mutex.unlock();
+}
+
+void HttpsConnectionPool::print_stats()
+{
+    Stats stats = _stats;
+    uint32_t hit_rate = stats.acquires ? (stats.hits * 100 / stats.acquires) : 0;
+
+    printf("** HTTPS CONNECTION POOL STATS **\n");
+    printf("**** acquires         : %" PRIu32 ", hits %" PRIu32 " (%" PRIu32 "%%)\n", stats.acquires, stats.hits, hit_rate);
+    printf("**** handshakes saved : %" PRIu32 "\n", stats.hits);
+    printf("**** dead on acquire  : %" PRIu32 "\n", stats.dead);
+    printf("**** released         : %" PRIu32 "\n", stats.released);
+    printf("**** evicted idle/full: %" PRIu32 "/%" PRIu32 "\n", stats.evicted_idle, stats.evicted_full);
+    printf("*********************************\n\n");
+}
+
+void print_https_connection_pool_stats(void)
+{
+    HttpsConnectionPool::print_stats();
+}
+
+#endif  // MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE > 0
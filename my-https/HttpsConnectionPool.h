@@ -0,0 +1,91 @@
+#ifndef _HTTPS_CONNECTION_POOL_H_
+#define _HTTPS_CONNECTION_POOL_H_
+
+#include "mbed.h"
+#include "MyTLSSocket.h"
+
+#if MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE > 0
+
+/* HttpsConnectionPool = process-wide pool of kept-alive HTTPS connections, to skip connect and handshake
+ *
+ * Even resumed, a TLS handshake costs round trips, and a full one seconds of CPU. A connection
+ * that can carry the next request, i.e. response read to the end and the server not asking
+ * to close, is released to the pool instead of closed. The next acquire() for the same server
+ * (host name and port), by the same or another user, takes it back connected.
+ *
+ * Pooled connections are closed after connection-pool-idle-timeout ms, on the handshake thread,
+ * before the server times them out first. A connection may still have been closed by the
+ * server meanwhile, so acquire() probes it with a non-blocking recv(): nothing to read means
+ * alive; end of stream, close_notify, data unasked for, or error mean dead. A silently dropped
+ * connection isn't detected until the request on it times out.
+ *
+ * With the pool full, release() closes the connection idle longest to make room.
+ */
+class HttpsConnectionPool
+{
+public:
+    struct Stats {
+        uint32_t    acquires;
+        uint32_t    hits;               /**< Pooled connection alive and reused, i.e. connect and handshake avoided */
+        uint32_t    dead;               /**< Pooled connections found closed by the server on acquire */
+        uint32_t    released;
+        uint32_t    evicted_idle;       /**< Closed on idle timeout */
+        uint32_t    evicted_full;       /**< Closed to make room */
+    };
+
+    static HttpsConnectionPool &get_instance();
+
+    /**
+     * Take out a live connection to host:port
+     *
+     * @return  Connected socket, now owned by the caller, or NULL for none: connect a new one
+     */
+    MyTLSSocket *acquire(const char *hostname, uint16_t port);
+
+    /**
+     * Hand over a connection to host:port that can carry the next request
+     *
+     * sigio of the socket is detached; attach again after acquire(). hostname must stay
+     * valid for the lifetime of the socket, as for MyTLSSocket::set_hostname().
+     */
+    void release(const char *hostname, uint16_t port, MyTLSSocket *socket);
+
+    static const Stats &stats()
+    {
+        return _stats;
+    }
+
+    static void print_stats();
+
+private:
+    HttpsConnectionPool();
+
+    struct Entry {
+        MyTLSSocket *               socket;     /**< NULL for free */
+        const char *                hostname;
+        uint16_t                    port;
+        Kernel::Clock::time_point   released;
+    };
+
+    /* Non-blocking recv() finds nothing to read */
+    static bool alive(MyTLSSocket *socket);
+
+    void drop(Entry *entry);
+
+    /* Close connections idle too long, and schedule the next run. Mutex held. */
+    void evict_idle();
+    void schedule_evict();
+
+    /* Eviction on handshake thread */
+    void evict_event();
+
+    PlatformMutex       _mutex;
+    Entry               _entries[MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE];
+    int                 _evict_event;   /**< Eviction posted, 0 for none */
+
+    static Stats        _stats;
+};
+
+#endif  // MBED_CONF_MY_HTTPS_CONNECTION_POOL_SIZE > 0
+
+#endif // _HTTPS_CONNECTION_POOL_H_
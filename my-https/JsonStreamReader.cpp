@@ -0,0 +1,320 @@
+#include "mbed.h"
+#include "JsonStreamReader.h"
+#include <ctype.h>
+
+JsonStreamReader::JsonStreamReader()
+{
+    reset();
+}
+
+void JsonStreamReader::attach(ValueHandler value)
+{
+    _value_handler = value;
+}
+
+void JsonStreamReader::reset()
+{
+    _state = STATE_VALUE;
+    _in_key = false;
+    _value_cut = false;
+    _depth = 0;
+    _unicode_digits = 0;
+    _unicode = 0;
+    _path_len = 0;
+    _value_len = 0;
+    _error = NULL;
+    _path[0] = 0;
+}
+
+int JsonStreamReader::feed(const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i ++) {
+        if (step(data[i]) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int JsonStreamReader::finish()
+{
+    /* Top-level number ends with input */
+    if (_state == STATE_SCALAR && _depth == 0) {
+        if (emit_scalar(false) < 0) {
+            return -1;
+        }
+        _state = STATE_DONE;
+    }
+
+    return (_state == STATE_DONE) ? 0 : fail("incomplete document");
+}
+
+int JsonStreamReader::step(char c)
+{
+    bool space = (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+
+    switch (_state) {
+        case STATE_VALUE:
+            return space ? 0 : start_value(c);
+
+        case STATE_VALUE_OR_END:
+            if (space) {
+                return 0;
+            }
+            return (c == ']') ? end_container(true) : start_value(c);
+
+        case STATE_KEY:
+        case STATE_KEY_OR_END:
+            if (space) {
+                return 0;
+            }
+            if (c == '"') {
+                _in_key = true;
+                _value_cut = false;
+                _value_len = 0;
+                _state = STATE_STRING;
+                return 0;
+            }
+            if (c == '}' && _state == STATE_KEY_OR_END) {
+                return end_container(false);
+            }
+            return fail("member name expected");
+
+        case STATE_COLON:
+            if (space) {
+                return 0;
+            }
+            if (c != ':') {
+                return fail("':' expected");
+            }
+            _state = STATE_VALUE;
+            return set_member_path();
+
+        case STATE_AFTER_VALUE:
+            if (space) {
+                return 0;
+            }
+            if (c == ',') {
+                Level &level = _levels[_depth - 1];
+                if (level.array) {
+                    level.index ++;
+                    _state = STATE_VALUE;
+                    return set_element_path();
+                }
+                _state = STATE_KEY;
+                return 0;
+            }
+            if (c == '}' || c == ']') {
+                return end_container(c == ']');
+            }
+            return fail("',' or end of container expected");
+
+        case STATE_STRING:
+            if (c == '"') {
+                if (_in_key) {
+                    if (_value_cut) {
+                        return fail("member name too long");
+                    }
+                    _value[_value_len] = 0;
+                    _state = STATE_COLON;
+                    return 0;
+                }
+                if (emit_scalar(true) < 0) {
+                    return -1;
+                }
+                return value_done();
+            }
+            if (c == '\\') {
+                _state = STATE_STRING_ESCAPE;
+                return 0;
+            }
+            if ((unsigned char) c < 0x20) {
+                return fail("control character in string");
+            }
+            append_value(c);
+            return 0;
+
+        case STATE_STRING_ESCAPE:
+            _state = STATE_STRING;
+            switch (c) {
+                case '"':
+                case '\\':
+                case '/':
+                    append_value(c);
+                    return 0;
+                case 'b':
+                    append_value('\b');
+                    return 0;
+                case 'f':
+                    append_value('\f');
+                    return 0;
+                case 'n':
+                    append_value('\n');
+                    return 0;
+                case 'r':
+                    append_value('\r');
+                    return 0;
+                case 't':
+                    append_value('\t');
+                    return 0;
+                case 'u':
+                    _unicode = 0;
+                    _unicode_digits = 0;
+                    _state = STATE_STRING_UNICODE;
+                    return 0;
+                default:
+                    return fail("invalid escape");
+            }
+
+        case STATE_STRING_UNICODE:
+            if (! isxdigit((unsigned char) c)) {
+                return fail("invalid \\u escape");
+            }
+            _unicode = (_unicode << 4) | (isdigit((unsigned char) c) ? (c - '0') : (tolower((unsigned char) c) - 'a' + 10));
+            if (++ _unicode_digits == 4) {
+                append_value(_unicode < 0x80 ? (char) _unicode : '?');
+                _state = STATE_STRING;
+            }
+            return 0;
+
+        case STATE_SCALAR:
+            if (isalnum((unsigned char) c) || c == '-' || c == '+' || c == '.') {
+                append_value(c);
+                return 0;
+            }
+            if (emit_scalar(false) < 0 || value_done() < 0) {
+                return -1;
+            }
+            /* Character ending the scalar belongs to what follows */
+            return step(c);
+
+        case STATE_DONE:
+            return space ? 0 : fail("data after document");
+
+        default:
+            return -1;
+    }
+}
+
+int JsonStreamReader::start_value(char c)
+{
+    if (c == '{' || c == '[') {
+        if (_depth >= MBED_CONF_MY_HTTPS_JSON_MAX_DEPTH) {
+            return fail("nested too deep");
+        }
+        Level &level = _levels[_depth ++];
+        level.array = (c == '[');
+        level.path_len = _path_len;
+        level.index = 0;
+        if (level.array) {
+            _state = STATE_VALUE_OR_END;
+            return set_element_path();
+        }
+        _state = STATE_KEY_OR_END;
+        return 0;
+    }
+
+    _value_cut = false;
+    _value_len = 0;
+
+    if (c == '"') {
+        _in_key = false;
+        _state = STATE_STRING;
+        return 0;
+    }
+    if (c == '-' || isdigit((unsigned char) c) || c == 't' || c == 'f' || c == 'n') {
+        append_value(c);
+        _state = STATE_SCALAR;
+        return 0;
+    }
+
+    return fail("value expected");
+}
+
+int JsonStreamReader::end_container(bool array)
+{
+    if (_depth == 0 || _levels[_depth - 1].array != array) {
+        return fail("mismatched end of container");
+    }
+
+    _path_len = _levels[-- _depth].path_len;
+    _path[_path_len] = 0;
+
+    return value_done();
+}
+
+int JsonStreamReader::value_done()
+{
+    _state = _depth ? STATE_AFTER_VALUE : STATE_DONE;
+
+    return 0;
+}
+
+int JsonStreamReader::set_element_path()
+{
+    const Level &level = _levels[_depth - 1];
+    size_t base = level.path_len;
+
+    int n = snprintf(_path + base, sizeof (_path) - base, "[%lu]", (unsigned long) level.index);
+    if (n < 0 || base + n >= sizeof (_path)) {
+        return fail("path too long");
+    }
+    _path_len = base + n;
+
+    return 0;
+}
+
+int JsonStreamReader::set_member_path()
+{
+    size_t base = _levels[_depth - 1].path_len;
+    size_t len = base + (base ? 1 : 0) + _value_len;
+
+    if (len >= sizeof (_path)) {
+        return fail("path too long");
+    }
+    if (base) {
+        _path[base ++] = '.';
+    }
+    memcpy(_path + base, _value, _value_len);
+    _path_len = len;
+    _path[_path_len] = 0;
+
+    return 0;
+}
+
+void JsonStreamReader::append_value(char c)
+{
+    if (_value_len < sizeof (_value) - 1) {
+        _value[_value_len ++] = c;
+    } else {
+        _value_cut = true;
+    }
+}
+
+int JsonStreamReader::emit_scalar(bool string)
+{
+    _value[_value_len] = 0;
+
+    if (! string) {
+        /* Literal must be spelled out in full. Numbers are passed as is. */
+        if (isalpha((unsigned char) _value[0]) && strcmp(_value, "true") != 0 &&
+            strcmp(_value, "false") != 0 && strcmp(_value, "null") != 0) {
+            return fail("invalid literal");
+        }
+    }
+
+    if (_value_handler) {
+        _value_handler(_path, _value, string);
+    }
+
+    return 0;
+}
+
+int JsonStreamReader::fail(const char *reason)
+{
+    _state = STATE_ERROR;
+    _error = reason;
+
+    return -1;
+}
@@ -0,0 +1,124 @@
+#ifndef _JSON_STREAM_READER_H_
+#define _JSON_STREAM_READER_H_
+
+#include "mbed.h"
+
+/* JsonStreamReader = incremental JSON reader, fed a document in pieces with constant memory
+ *
+ * Bytes are fed in pieces of any size, e.g. as HTTP body runs are received, and each byte
+ * is examined once. Nothing of the document is kept but the path to the current value and
+ * the current scalar, so documents of any size can be read with fixed buffers:
+ *
+ *   path       json-max-path bytes, e.g. state.reported.samples[2].t
+ *   scalar     json-max-value bytes. Longer strings and numbers are cut, longer member
+ *              names fail the document.
+ *   nesting    json-max-depth objects/arrays
+ *
+ * Each scalar (string, number, true, false, null) is reported with its path: object members
+ * by name after '.', array elements by index in []. Strings are unescaped; \u escapes outside
+ * ASCII are reported as '?'. Empty objects and arrays report nothing.
+ *
+ * NOTE: Not thread-safe. Feed it from the thread reading the document.
+ */
+class JsonStreamReader
+{
+public:
+    /**
+     * Scalar with path, both null-terminated and valid only during the call
+     *
+     * @param[in] string    Value is a string, rather than number or literal
+     */
+    typedef mbed::Callback<void(const char *path, const char *value, bool string)> ValueHandler;
+
+    JsonStreamReader();
+
+    void attach(ValueHandler value);
+
+    /**
+     * Get ready for the next document
+     */
+    void reset();
+
+    /**
+     * Parse bytes of the document
+     *
+     * @return  0, or -1 on malformed document or limits exceeded, with error() telling why
+     */
+    int feed(const char *data, size_t len);
+
+    /**
+     * End of input. Ends top-level number.
+     *
+     * @return  0 if one complete document has been read, or -1
+     */
+    int finish();
+
+    bool done() const
+    {
+        return _state == STATE_DONE;
+    }
+
+    const char *error() const
+    {
+        return _error;
+    }
+
+private:
+    enum State {
+        STATE_VALUE = 0,            /**< Value expected */
+        STATE_VALUE_OR_END,         /**< First element or ] */
+        STATE_KEY,                  /**< Member name expected */
+        STATE_KEY_OR_END,           /**< First member name or } */
+        STATE_COLON,
+        STATE_AFTER_VALUE,          /**< , or end of container */
+        STATE_STRING,               /**< In string, value or member name */
+        STATE_STRING_ESCAPE,
+        STATE_STRING_UNICODE,       /**< In \uXXXX */
+        STATE_SCALAR,               /**< In number or literal */
+        STATE_DONE,
+        STATE_ERROR
+    };
+
+    struct Level {
+        bool        array;
+        uint16_t    path_len;       /**< Path length of container itself */
+        uint32_t    index;          /**< Element index, arrays only */
+    };
+
+    int step(char c);
+
+    /* Start value in STATE_VALUE or STATE_VALUE_OR_END */
+    int start_value(char c);
+
+    /* Container ends with } or ] */
+    int end_container(bool array);
+
+    /* Container or scalar has ended */
+    int value_done();
+
+    /* Set path of element/member at current level */
+    int set_element_path();
+    int set_member_path();
+
+    void append_value(char c);
+    int emit_scalar(bool string);
+
+    int fail(const char *reason);
+
+    ValueHandler    _value_handler;
+
+    State           _state;
+    bool            _in_key;        /**< STATE_STRING* is of member name */
+    bool            _value_cut;     /**< Scalar or member name longer than buffer */
+    uint8_t         _depth;
+    uint8_t         _unicode_digits;
+    uint16_t        _unicode;
+    uint16_t        _path_len;
+    uint16_t        _value_len;
+    const char *    _error;
+    Level           _levels[MBED_CONF_MY_HTTPS_JSON_MAX_DEPTH];
+    char            _path[MBED_CONF_MY_HTTPS_JSON_MAX_PATH];
+    char            _value[MBED_CONF_MY_HTTPS_JSON_MAX_VALUE];
+};
+
+#endif // _JSON_STREAM_READER_H_
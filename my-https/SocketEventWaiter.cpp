@@ -0,0 +1,83 @@
+#include "mbed.h"
+#include "SocketEventWaiter.h"
+
+#if MBED_CPU_STATS_ENABLED
+#include "mbed_stats.h"
+#endif
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+extern "C" {
+    MBED_USED void print_socket_wait_stats(void);
+}
+
+SocketEventWaiter::Stats SocketEventWaiter::_stats;
+
+void SocketEventWaiter::attach(Socket &socket)
+{
+    _flags.clear(FLAG_SIGIO);
+    socket.sigio(callback(this, &SocketEventWaiter::on_sigio));
+}
+
+nsapi_error_t SocketEventWaiter::wait(Kernel::Clock::time_point deadline)
+{
+    Kernel::Clock::time_point start = Kernel::Clock::now();
+    if (start >= deadline) {
+        _stats.timeouts ++;
+        return NSAPI_ERROR_TIMEOUT;
+    }
+
+#if MBED_CPU_STATS_ENABLED
+    mbed_stats_cpu_t cpu_start;
+    mbed_stats_cpu_get(&cpu_start);
+#endif
+
+    uint32_t flags = _flags.wait_any_until(FLAG_SIGIO, deadline);
+
+    _stats.waits ++;
+    _stats.wait_ms_total += std::chrono::duration_cast<std::chrono::milliseconds>(Kernel::Clock::now() - start).count();
+#if MBED_CPU_STATS_ENABLED
+    mbed_stats_cpu_t cpu_end;
+    mbed_stats_cpu_get(&cpu_end);
+    /* Idle time in us */
+    _stats.idle_ms_total += (uint32_t) ((cpu_end.idle_time - cpu_start.idle_time) / 1000);
+#endif
+
+    if (flags & osFlagsError) {
+        _stats.timeouts ++;
+        return NSAPI_ERROR_TIMEOUT;
+    }
+
+    return NSAPI_ERROR_OK;
+}
+
+void SocketEventWaiter::on_sigio()
+{
+    _flags.set(FLAG_SIGIO);
+}
+
+void SocketEventWaiter::print_stats()
+{
+    Stats stats = _stats;
+
+    printf("** SOCKET WAIT STATS **\n");
+    printf("**** waits            : %" PRIu32 "\n", stats.waits);
+    printf("**** timeouts         : %" PRIu32 "\n", stats.timeouts);
+    printf("**** blocked          : %" PRIu32 " ms\n", stats.wait_ms_total);
+#if MBED_CPU_STATS_ENABLED
+    /* Busy is of other threads, e.g. network stack, not of the waiting one */
+    uint32_t busy_ms = (stats.wait_ms_total > stats.idle_ms_total) ? (stats.wait_ms_total - stats.idle_ms_total) : 0;
+    printf("**** CPU idle/busy    : %" PRIu32 "/%" PRIu32 " ms while blocked\n", stats.idle_ms_total, busy_ms);
+#else
+    printf("**** CPU idle/busy    : n/a, enable platform.cpu-stats-enabled\n");
+#endif
+    printf("***********************\n\n");
+}
+
+void print_socket_wait_stats(void)
+{
+    SocketEventWaiter::print_stats();
+}
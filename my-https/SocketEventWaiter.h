@@ -0,0 +1,62 @@
+#ifndef _SOCKET_EVENT_WAITER_H_
+#define _SOCKET_EVENT_WAITER_H_
+
+#include "mbed.h"
+
+/* SocketEventWaiter = sleep on sigio of non-blocking socket instead of spinning on NSAPI_ERROR_WOULD_BLOCK
+ *
+ * On NSAPI_ERROR_WOULD_BLOCK, the caller waits on event flags set by sigio of the socket, up
+ * to a deadline, and then tries send/recv again. The thread sleeps meanwhile, so the idle
+ * thread can put the MCU to sleep. An event arriving between NSAPI_ERROR_WOULD_BLOCK and
+ * wait() is not lost: its flag stays set and wait() returns at once.
+ *
+ * sigio of TLSSocketWrapper is called on events of its transport once the handshake has
+ * started, so attach it after connect. Events are spurious now and then, e.g. for data of
+ * an incomplete TLS record; wait() is just called again on NSAPI_ERROR_WOULD_BLOCK.
+ *
+ * Time blocked in wait() and, with platform.cpu-stats-enabled, CPU idle time over it are
+ * counted process-wide, to measure what sleeping instead of spinning saves.
+ */
+class SocketEventWaiter
+{
+public:
+    struct Stats {
+        uint32_t    waits;
+        uint32_t    timeouts;
+        uint32_t    wait_ms_total;      /**< Time blocked in wait() */
+        uint32_t    idle_ms_total;      /**< CPU idle while blocked, i.e. no thread ran */
+    };
+
+    /**
+     * Route sigio of socket to this waiter
+     *
+     * The socket must not call back after the waiter is gone; destroy or detach it first.
+     */
+    void attach(Socket &socket);
+
+    /**
+     * Block until socket event or deadline
+     *
+     * @return  NSAPI_ERROR_OK on event, or NSAPI_ERROR_TIMEOUT on deadline reached
+     */
+    nsapi_error_t wait(Kernel::Clock::time_point deadline);
+
+    static const Stats &stats()
+    {
+        return _stats;
+    }
+
+    static void print_stats();
+
+private:
+    static const uint32_t FLAG_SIGIO = 1;
+
+    /* sigio, maybe in interrupt context */
+    void on_sigio();
+
+    EventFlags      _flags;
+
+    static Stats    _stats;
+};
+
+#endif // _SOCKET_EVENT_WAITER_H_
@@ -0,0 +1,316 @@
+#ifndef _MQTT_ASYNC_PUBLISHER_H_
+#define _MQTT_ASYNC_PUBLISHER_H_
+
+#include "mbed.h"
+#include "MQTTClient.h"
+#include "MQTTPacket.h"
+#include "MQTTPipelineNetwork.h"
+
+/* MQTTAsyncPublisher = pipelined QoS1 publish on top of MQTT::Client
+ *
+ * MQTT::Client::publish() blocks until PUBACK, capping throughput at one message per
+ * round trip. This publisher serializes PUBLISH packets into its own slots and sends them
+ * immediately, keeping up to WINDOW packet IDs outstanding. PUBACKs are picked up from the
+ * inbound stream by MQTTPipelineNetwork (in any order) while the application runs
+ * MQTT::Client::yield(). poll() re-sends timed-out publishes with DUP flag set.
+ * Completion is reported through callback with MQTT::SUCCESS or MQTT::FAILURE.
+ *
+ * With publish(topic, encoder), payload is encoded by the application straight into the
+ * slot after space reserved for fixed header, topic and packet ID. The fixed header is
+ * filled in backwards once payload length is known, so no intermediate payload buffer
+ * or copy is needed.
+ *
+ * NOTE: Not thread-safe. Call publish()/poll() from the thread running MQTT::Client::yield().
+ * NOTE: MQTT::Client::publish() with QoS1 doesn't check PUBACK packet ID. Don't use it while
+ *       publishes are in flight here.
+ * NOTE: Packet IDs are allocated from upper half (0x8000~0xFFFF) to avoid clash with those
+ *       allocated by MQTT::Client for SUBSCRIBE/UNSUBSCRIBE.
+ */
+template<class Network, int MAX_PACKET_SIZE, int WINDOW = MBED_CONF_MY_MQTT_PUBLISH_WINDOW>
+class MQTTAsyncPublisher
+{
+public:
+    typedef mbed::Callback<void(unsigned short packet_id, int rc)> Completion;
+
+    /* Encode payload into buf. Return payload length as snprintf does, i.e. payload has been
+     * truncated if not less than size, or negative on failure. */
+    typedef mbed::Callback<int(char *buf, size_t size)> Encoder;
+
+    /* Returned from publish() when all slots are in flight. Run yield()/poll() and retry. */
+    static const int WINDOW_FULL = -3;
+
+    MQTTAsyncPublisher(MQTTPipelineNetwork<Network> &network, unsigned int write_timeout_ms = 30000) :
+        _network(network),
+        _write_timeout_ms(write_timeout_ms),
+        _next_packet_id(PACKET_ID_FIRST),
+        _in_flight(0),
+        _retransmit_count(0)
+    {
+        for (int i = 0; i < WINDOW; i ++) {
+            _slots[i].packet_id = 0;
+        }
+        _network.attach_puback(mbed::callback(this, &MQTTAsyncPublisher::on_puback));
+    }
+
+    ~MQTTAsyncPublisher()
+    {
+        _network.attach_puback(nullptr);
+    }
+
+    /**
+     * Publish QoS1 message without waiting for PUBACK
+     *
+     * @return  Packet ID (> 0) on sent, WINDOW_FULL if no free slot, or MQTT::FAILURE/BUFFER_OVERFLOW
+     */
+    int publish(const char *topic, const void *payload, size_t payload_len, Completion done = nullptr)
+    {
+        Slot *slot = alloc_slot();
+        if (slot == NULL) {
+            return WINDOW_FULL;
+        }
+
+        unsigned short packet_id = next_packet_id();
+        MQTTString topic_name = MQTTString_initializer;
+        topic_name.cstring = (char *) topic;
+
+        int len = MQTTSerialize_publish(slot->buf, sizeof (slot->buf), 0, MQTT::QOS1, 0, packet_id,
+                                        topic_name, (unsigned char *) payload, payload_len);
+        if (len <= 0) {
+            return MQTT::BUFFER_OVERFLOW;
+        }
+
+        return start(slot, packet_id, slot->buf, len, done);
+    }
+
+    /**
+     * Publish QoS1 message with payload encoded in place by encoder, without waiting for PUBACK
+     *
+     * @return  Packet ID (> 0) on sent, WINDOW_FULL if no free slot, or MQTT::FAILURE/BUFFER_OVERFLOW
+     */
+    int publish(const char *topic, Encoder encode, Completion done = nullptr)
+    {
+        Slot *slot = alloc_slot();
+        if (slot == NULL) {
+            return WINDOW_FULL;
+        }
+
+        /* Variable header: topic length, topic, packet ID */
+        size_t topic_len = strlen(topic);
+        if (FIXED_HEADER_MAX + 2 + topic_len + 2 >= sizeof (slot->buf)) {
+            return MQTT::BUFFER_OVERFLOW;
+        }
+        unsigned short packet_id = next_packet_id();
+        unsigned char *var_header = slot->buf + FIXED_HEADER_MAX;
+        unsigned char *ptr = var_header;
+        *ptr ++ = (unsigned char) (topic_len >> 8);
+        *ptr ++ = (unsigned char) topic_len;
+        memcpy(ptr, topic, topic_len);
+        ptr += topic_len;
+        *ptr ++ = (unsigned char) (packet_id >> 8);
+        *ptr ++ = (unsigned char) packet_id;
+
+        /* Payload */
+        size_t payload_size = slot->buf + sizeof (slot->buf) - ptr;
+        int payload_len = encode((char *) ptr, payload_size);
+        if (payload_len < 0) {
+            return MQTT::FAILURE;
+        }
+        if ((size_t) payload_len >= payload_size) {
+            return MQTT::BUFFER_OVERFLOW;
+        }
+
+        /* Fixed header right before variable header */
+        int rem_len = (ptr - var_header) + payload_len;
+        unsigned char rem_len_buf[4];
+        int rem_len_bytes = MQTTPacket_encode(rem_len_buf, rem_len);
+        unsigned char *pkt = var_header - rem_len_bytes - 1;
+        pkt[0] = (PUBLISH << 4) | (MQTT::QOS1 << 1);
+        memcpy(pkt + 1, rem_len_buf, rem_len_bytes);
+
+        return start(slot, packet_id, pkt, var_header - pkt + rem_len, done);
+    }
+
+    /**
+     * Re-send timed-out publishes with DUP flag set and fail those out of retries
+     *
+     * @return  Number of publishes still in flight
+     */
+    int poll()
+    {
+        Kernel::Clock::time_point now = Kernel::Clock::now();
+
+        for (int i = 0; i < WINDOW; i ++) {
+            Slot &slot = _slots[i];
+            if (slot.packet_id == 0 || (now - slot.sent_at) < RETRY_TIMEOUT) {
+                continue;
+            }
+
+            if (slot.retries >= MBED_CONF_MY_MQTT_PUBLISH_MAX_RETRIES) {
+                complete(slot, MQTT::FAILURE);
+                continue;
+            }
+
+            /* Set DUP flag in fixed header */
+            slot.pkt[0] |= 0x08;
+            slot.retries ++;
+            _retransmit_count ++;
+            if (send(slot.pkt, slot.len) != MQTT::SUCCESS) {
+                complete(slot, MQTT::FAILURE);
+                continue;
+            }
+            slot.sent_at = now;
+        }
+
+        return _in_flight;
+    }
+
+    /**
+     * Complete all in-flight publishes with rc, e.g. on connection lost
+     */
+    void abort_all(int rc = MQTT::FAILURE)
+    {
+        for (int i = 0; i < WINDOW; i ++) {
+            if (_slots[i].packet_id) {
+                complete(_slots[i], rc);
+            }
+        }
+    }
+
+    int in_flight() const
+    {
+        return _in_flight;
+    }
+
+    bool window_full() const
+    {
+        return _in_flight >= WINDOW;
+    }
+
+    uint32_t retransmit_count() const
+    {
+        return _retransmit_count;
+    }
+
+protected:
+    struct Slot {
+        unsigned short              packet_id;      /**< 0 for free slot */
+        int                         retries;
+        Kernel::Clock::time_point   sent_at;
+        Completion                  done;
+        unsigned char *             pkt;            /**< Start of packet in buf */
+        int                         len;
+        unsigned char               buf[MAX_PACKET_SIZE];
+    };
+
+    Slot *alloc_slot()
+    {
+        for (int i = 0; i < WINDOW; i ++) {
+            if (_slots[i].packet_id == 0) {
+                return &_slots[i];
+            }
+        }
+
+        return NULL;
+    }
+
+    int start(Slot *slot, unsigned short packet_id, unsigned char *pkt, int len, Completion done)
+    {
+        if (send(pkt, len) != MQTT::SUCCESS) {
+            return MQTT::FAILURE;
+        }
+
+        slot->packet_id = packet_id;
+        slot->retries = 0;
+        slot->sent_at = Kernel::Clock::now();
+        slot->done = done;
+        slot->pkt = pkt;
+        slot->len = len;
+        _in_flight ++;
+
+        return packet_id;
+    }
+
+    int send(const unsigned char *pkt, int len)
+    {
+        int sent = 0;
+        Timer timer;
+        timer.start();
+
+        while (sent < len) {
+            if (std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed_time()).count() >= _write_timeout_ms) {
+                return MQTT::FAILURE;
+            }
+            int rc = _network.write((unsigned char *) pkt + sent, len - sent, _write_timeout_ms);
+            if (rc < 0) {
+                return MQTT::FAILURE;
+            }
+            sent += rc;
+        }
+
+        return MQTT::SUCCESS;
+    }
+
+    unsigned short next_packet_id()
+    {
+        unsigned short packet_id;
+        bool in_use;
+
+        do {
+            packet_id = _next_packet_id;
+            _next_packet_id = (_next_packet_id == PACKET_ID_LAST) ? PACKET_ID_FIRST : (_next_packet_id + 1);
+
+            in_use = false;
+            for (int i = 0; i < WINDOW; i ++) {
+                if (_slots[i].packet_id == packet_id) {
+                    in_use = true;
+                    break;
+                }
+            }
+        } while (in_use);
+
+        return packet_id;
+    }
+
+    void complete(Slot &slot, int rc)
+    {
+        unsigned short packet_id = slot.packet_id;
+        Completion done = slot.done;
+
+        slot.packet_id = 0;
+        slot.done = nullptr;
+        _in_flight --;
+
+        if (done) {
+            done(packet_id, rc);
+        }
+    }
+
+    void on_puback(unsigned short packet_id)
+    {
+        for (int i = 0; i < WINDOW; i ++) {
+            if (_slots[i].packet_id == packet_id) {
+                complete(_slots[i], MQTT::SUCCESS);
+                return;
+            }
+        }
+    }
+
+    /* Fixed header: packet type/flags 1 + remaining length up to 4 */
+    static const size_t FIXED_HEADER_MAX = 5;
+
+    static const unsigned short PACKET_ID_FIRST = 0x8000;
+    static const unsigned short PACKET_ID_LAST = 0xFFFF;
+    static constexpr std::chrono::milliseconds RETRY_TIMEOUT{MBED_CONF_MY_MQTT_PUBLISH_RETRY_TIMEOUT_MS};
+
+    MQTTPipelineNetwork<Network> &  _network;
+    unsigned int                    _write_timeout_ms;
+    unsigned short                  _next_packet_id;
+    int                             _in_flight;
+    uint32_t                        _retransmit_count;
+    Slot                            _slots[WINDOW];
+};
+
+template<class Network, int MAX_PACKET_SIZE, int WINDOW>
+constexpr std::chrono::milliseconds MQTTAsyncPublisher<Network, MAX_PACKET_SIZE, WINDOW>::RETRY_TIMEOUT;
+
+#endif // _MQTT_ASYNC_PUBLISHER_H_
@@ -0,0 +1,154 @@
+#include "mbed.h"
+#include "MQTTBenchmark.h"
+#include <algorithm>
+#include <new>
+
+#if (MBED_HEAP_STATS_ENABLED)
+#include "mbed_stats.h"
+#endif
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+MQTTBenchmark::MQTTBenchmark() :
+    _latency_us(NULL),
+    _latency_size(0),
+    _latency_count(0),
+    _messages(0)
+{
+    memset(&_report, 0x00, sizeof (_report));
+    for (int i = 0; i < MBED_CONF_MY_MQTT_PUBLISH_WINDOW; i ++) {
+        _in_flight[i].packet_id = 0;
+    }
+}
+
+MQTTBenchmark::~MQTTBenchmark()
+{
+    delete [] _latency_us;
+}
+
+int MQTTBenchmark::start(size_t payload_len, MQTT::QoS qos, size_t messages)
+{
+    if (_latency_size < messages) {
+        delete [] _latency_us;
+        _latency_size = 0;
+        _latency_us = new (std::nothrow) uint32_t[messages];
+        if (_latency_us == NULL) {
+            return MBED_ERROR_ENOMEM;
+        }
+        _latency_size = messages;
+    }
+    _latency_count = 0;
+    _messages = messages;
+
+    memset(&_report, 0x00, sizeof (_report));
+    _report.payload_len = payload_len;
+    _report.qos = qos;
+    for (int i = 0; i < MBED_CONF_MY_MQTT_PUBLISH_WINDOW; i ++) {
+        _in_flight[i].packet_id = 0;
+    }
+
+    sample_heap();
+    _started_at = _last_at = HighResClock::now();
+
+    return MBED_SUCCESS;
+}
+
+void MQTTBenchmark::sent(unsigned short packet_id)
+{
+    _report.sent ++;
+
+    for (int i = 0; i < MBED_CONF_MY_MQTT_PUBLISH_WINDOW; i ++) {
+        if (_in_flight[i].packet_id == 0) {
+            _in_flight[i].packet_id = packet_id;
+            _in_flight[i].sent_at = HighResClock::now();
+            return;
+        }
+    }
+}
+
+void MQTTBenchmark::completed(unsigned short packet_id, int rc)
+{
+    for (int i = 0; i < MBED_CONF_MY_MQTT_PUBLISH_WINDOW; i ++) {
+        InFlight &in_flight = _in_flight[i];
+        if (in_flight.packet_id != packet_id) {
+            continue;
+        }
+
+        in_flight.packet_id = 0;
+        _last_at = HighResClock::now();
+        record(std::chrono::duration_cast<std::chrono::microseconds>(_last_at - in_flight.sent_at).count(), rc);
+        return;
+    }
+}
+
+void MQTTBenchmark::sample(std::chrono::microseconds latency, int rc)
+{
+    _report.sent ++;
+    _last_at = HighResClock::now();
+    record(latency.count(), rc);
+}
+
+void MQTTBenchmark::record(uint32_t latency_us, int rc)
+{
+    if (rc != MQTT::SUCCESS) {
+        _report.failed ++;
+        return;
+    }
+
+    _report.acked ++;
+    if (_latency_count < _latency_size) {
+        _latency_us[_latency_count ++] = latency_us;
+    }
+    sample_heap();
+}
+
+void MQTTBenchmark::sample_heap()
+{
+#if (MBED_HEAP_STATS_ENABLED)
+    mbed_stats_heap_t heap_stats;
+    mbed_stats_heap_get(&heap_stats);
+    if (heap_stats.current_size > _report.heap_peak) {
+        _report.heap_peak = heap_stats.current_size;
+    }
+    _report.heap_peak_boot = heap_stats.max_size;
+#endif
+}
+
+const MQTTBenchmark::Report &MQTTBenchmark::finish()
+{
+    sample_heap();
+
+    _report.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(_last_at - _started_at).count();
+    if (_report.elapsed_ms) {
+        _report.msgs_per_sec_x10 = (uint32_t) ((uint64_t) _report.acked * 10000 / _report.elapsed_ms);
+    }
+
+    /* Nearest-rank percentiles */
+    if (_latency_count) {
+        std::sort(_latency_us, _latency_us + _latency_count);
+        _report.p50_us = _latency_us[(_latency_count * 50 + 99) / 100 - 1];
+        _report.p99_us = _latency_us[(_latency_count * 99 + 99) / 100 - 1];
+        _report.max_us = _latency_us[_latency_count - 1];
+    }
+
+    return _report;
+}
+
+void MQTTBenchmark::print_report(const Report &report)
+{
+    printf("** MQTT BENCHMARK **\n");
+    printf("**** payload/QoS     : %d bytes, QoS%d\n", (int) report.payload_len, report.qos);
+    printf("**** publishes       : %" PRIu32 " sent, %" PRIu32 " completed, %" PRIu32 " failed\n",
+           report.sent, report.acked, report.failed);
+    printf("**** elapsed         : %" PRIu32 " ms\n", report.elapsed_ms);
+    printf("**** rate            : %" PRIu32 ".%" PRIu32 " msgs/s\n", report.msgs_per_sec_x10 / 10, report.msgs_per_sec_x10 % 10);
+    printf("**** latency         : p50 %" PRIu32 " us, p99 %" PRIu32 " us, max %" PRIu32 " us (%s)\n",
+           report.p50_us, report.p99_us, report.max_us, report.qos ? "publish to PUBACK" : "publish call");
+#if (MBED_HEAP_STATS_ENABLED)
+    printf("**** heap peak       : %" PRIu32 " (since boot %" PRIu32 ")\n", report.heap_peak, report.heap_peak_boot);
+#endif
+    printf("********************\n\n");
+}
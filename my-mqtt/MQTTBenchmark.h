@@ -0,0 +1,181 @@
+#ifndef _MQTT_BENCHMARK_H_
+#define _MQTT_BENCHMARK_H_
+
+#include "mbed.h"
+#include "MQTTClient.h"
+
+/* MQTTBenchmark = publish rate and latency recorder for one benchmark run
+ *
+ * One run publishes a fixed number of messages of one payload size and QoS. Latency is
+ * measured per message:
+ *
+ *   QoS1   publish sent to PUBACK received (sent() to completed())
+ *   QoS0   publish call to return (sample())
+ *
+ * Timestamps come from HighResClock, as Kernel::Clock ticks in ms only.
+ *
+ * finish() reports msgs/s over the run, p50/p99/max latency and heap peak. Heap is sampled
+ * on each completion, in addition to max_size of mbed heap stats which is the peak since boot.
+ *
+ * run_qos1()/run_qos0() drive a run through the publish path of the application, on target
+ * and on host alike.
+ *
+ * NOTE: Not thread-safe. Call it from the thread running MQTT::Client::yield().
+ */
+class MQTTBenchmark
+{
+public:
+    struct Report {
+        size_t      payload_len;
+        int         qos;
+        uint32_t    sent;               /**< Publishes sent */
+        uint32_t    acked;              /**< Publishes completed successfully */
+        uint32_t    failed;             /**< Publishes failed, e.g. out of retries */
+        uint32_t    elapsed_ms;         /**< First publish to last completion */
+        uint32_t    msgs_per_sec_x10;   /**< Completed publishes per second, in 0.1 */
+        uint32_t    p50_us;
+        uint32_t    p99_us;
+        uint32_t    max_us;
+        uint32_t    heap_peak;          /**< Heap in use at most during run, 0 without heap stats */
+        uint32_t    heap_peak_boot;     /**< Heap in use at most since boot, 0 without heap stats */
+    };
+
+    /* Encode payload of one publish into buf, as MQTTAsyncPublisher::Encoder */
+    typedef mbed::Callback<int(char *buf, size_t size)> Encoder;
+
+    MQTTBenchmark();
+    ~MQTTBenchmark();
+
+    /**
+     * Start run of messages publishes with payload_len and qos
+     *
+     * @return  MBED_SUCCESS, or MBED_ERROR_ENOMEM for latency samples
+     */
+    int start(size_t payload_len, MQTT::QoS qos, size_t messages);
+
+    /**
+     * QoS1 run: keep publish window of publisher full and measure publish-to-PUBACK latency
+     *
+     * PUBACKs are picked up by short yield() of client. The window is drained at the end,
+     * up to all retries.
+     */
+    template<class Publisher, class Client>
+    void run_qos1(Publisher &publisher, Client &client, const char *topic, Encoder encode)
+    {
+        int mqtt_rc;
+
+        for (size_t n = 0; n < _messages; n ++) {
+            while ((mqtt_rc = publisher.publish(topic, encode, mbed::callback(this, &MQTTBenchmark::completed))) == Publisher::WINDOW_FULL) {
+                if (client.yield(1) != MQTT::SUCCESS) {
+                    break;
+                }
+                publisher.poll();
+            }
+            if (mqtt_rc < 0) {
+                printf("Benchmark publish failed: %d\n", mqtt_rc);
+                break;
+            }
+            sent(mqtt_rc);
+        }
+
+        /* Drain publish window, up to all retries */
+        Timer timer;
+        timer.start();
+        while (outstanding() && publisher.in_flight()) {
+            if (std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed_time()).count() >=
+                    MBED_CONF_MY_MQTT_PUBLISH_RETRY_TIMEOUT_MS * (MBED_CONF_MY_MQTT_PUBLISH_MAX_RETRIES + 1)) {
+                break;
+            }
+            if (client.yield(1) != MQTT::SUCCESS) {
+                break;
+            }
+            publisher.poll();
+        }
+    }
+
+    /**
+     * QoS0 run: measure latency of publish call of client, i.e. serialize and send
+     */
+    template<class Client>
+    void run_qos0(Client &client, const char *topic, Encoder encode)
+    {
+        char *payload = new char[_report.payload_len];
+        encode(payload, _report.payload_len);
+
+        MQTT::Message message;
+        message.retained = false;
+        message.dup = false;
+        message.qos = MQTT::QOS0;
+        message.payload = payload;
+        message.payloadlen = _report.payload_len;
+
+        Timer timer;
+        timer.start();
+        for (size_t n = 0; n < _messages; n ++) {
+            timer.reset();
+            int mqtt_rc = client.publish(topic, message);
+            sample(timer.elapsed_time(), mqtt_rc);
+            if (mqtt_rc != MQTT::SUCCESS) {
+                printf("Benchmark publish failed: %d\n", mqtt_rc);
+                break;
+            }
+        }
+
+        delete [] payload;
+    }
+
+    /**
+     * QoS1: publish with packet_id has been sent
+     */
+    void sent(unsigned short packet_id);
+
+    /**
+     * QoS1: publish with packet_id has completed, on PUBACK or out of retries
+     */
+    void completed(unsigned short packet_id, int rc);
+
+    /**
+     * QoS0: publish has completed with latency
+     */
+    void sample(std::chrono::microseconds latency, int rc);
+
+    /**
+     * Publishes sent but not completed yet
+     */
+    size_t outstanding() const
+    {
+        return _report.sent - _report.acked - _report.failed;
+    }
+
+    /**
+     * End run and calculate report
+     */
+    const Report &finish();
+
+    const Report &report() const
+    {
+        return _report;
+    }
+
+    static void print_report(const Report &report);
+
+private:
+    struct InFlight {
+        unsigned short              packet_id;      /**< 0 for free */
+        HighResClock::time_point    sent_at;
+    };
+
+    void record(uint32_t latency_us, int rc);
+    void sample_heap();
+
+    Report                      _report;
+    uint32_t *                  _latency_us;        /**< Latency samples of successful publishes */
+    size_t                      _latency_size;
+    size_t                      _latency_count;
+    size_t                      _messages;          /**< Publishes of run */
+    HighResClock::time_point    _started_at;
+    HighResClock::time_point    _last_at;           /**< Last completion */
+    InFlight                    _in_flight[MBED_CONF_MY_MQTT_PUBLISH_WINDOW];
+};
+
+#endif // _MQTT_BENCHMARK_H_
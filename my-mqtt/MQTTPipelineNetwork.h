@@ -0,0 +1,147 @@
+#ifndef _MQTT_PIPELINE_NETWORK_H_
+#define _MQTT_PIPELINE_NETWORK_H_
+
+#include "mbed.h"
+#include "MQTTPacket.h"
+
+/* MQTTPipelineNetwork = Network for MQTT::Client + inbound PUBACK notification
+ *
+ * MQTT::Client consumes PUBACK itself and doesn't tell which packet ID is acknowledged.
+ * This adapter passes read/write through to the underlying network (e.g. MyTLSSocket)
+ * and tracks MQTT packet boundaries in the inbound byte stream, so that acknowledgements
+ * of publishes sent outside the client (MQTTAsyncPublisher) can be matched out of order.
+ */
+template<class Network>
+class MQTTPipelineNetwork
+{
+public:
+    typedef mbed::Callback<void(unsigned short packet_id)> AckHandler;
+
+    MQTTPipelineNetwork(Network &network) :
+        _network(&network)
+    {
+        reset();
+    }
+
+    /**
+     * Timed recv for MQTT lib
+     */
+    int read(unsigned char* buffer, int len, int timeout)
+    {
+        int rc = _network->read(buffer, len, timeout);
+        if (rc > 0) {
+            feed(buffer, rc);
+        }
+        return rc;
+    }
+
+    /**
+     * Timed send for MQTT lib
+     */
+    int write(unsigned char* buffer, int len, int timeout)
+    {
+        return _network->write(buffer, len, timeout);
+    }
+
+    /**
+     * Attach handler called on each inbound PUBACK
+     */
+    void attach_puback(AckHandler handler)
+    {
+        _puback_handler = handler;
+    }
+
+    /**
+     * Reset inbound packet tracking for a new connection
+     */
+    void reset()
+    {
+        _state = STATE_FIXED_HEADER;
+        _packet_type = 0;
+        _rem_len = 0;
+        _rem_len_mul = 1;
+        _body_pos = 0;
+        _packet_id = 0;
+    }
+
+    /**
+     * Switch to another underlying network, e.g. socket renewed on reconnect
+     */
+    void rebind(Network &network)
+    {
+        _network = &network;
+        reset();
+    }
+
+    Network &network()
+    {
+        return *_network;
+    }
+
+private:
+    enum State {
+        STATE_FIXED_HEADER,
+        STATE_REMAINING_LENGTH,
+        STATE_BODY
+    };
+
+    void feed(const unsigned char *data, int len)
+    {
+        for (int i = 0; i < len; i ++) {
+            unsigned char c = data[i];
+
+            switch (_state) {
+                case STATE_FIXED_HEADER:
+                    _packet_type = c >> 4;
+                    _rem_len = 0;
+                    _rem_len_mul = 1;
+                    _body_pos = 0;
+                    _packet_id = 0;
+                    _state = STATE_REMAINING_LENGTH;
+                    break;
+
+                case STATE_REMAINING_LENGTH:
+                    _rem_len += (c & 0x7F) * _rem_len_mul;
+                    _rem_len_mul *= 128;
+                    if ((c & 0x80) == 0) {
+                        if (_rem_len == 0) {
+                            packet_end();
+                        } else {
+                            _state = STATE_BODY;
+                        }
+                    }
+                    break;
+
+                case STATE_BODY:
+                    /* Packet ID of PUBACK is in the first two bytes of variable header */
+                    if (_body_pos < 2) {
+                        _packet_id = (_packet_id << 8) | c;
+                    }
+                    if (++ _body_pos >= _rem_len) {
+                        packet_end();
+                    }
+                    break;
+            }
+        }
+    }
+
+    void packet_end()
+    {
+        if (_packet_type == PUBACK && _rem_len >= 2 && _puback_handler) {
+            _puback_handler(_packet_id);
+        }
+        _state = STATE_FIXED_HEADER;
+    }
+
+    Network *           _network;
+    AckHandler          _puback_handler;
+
+    State               _state;
+    unsigned char       _packet_type;
+    uint32_t            _rem_len;
+    uint32_t            _rem_len_mul;
+    uint32_t            _body_pos;
+    unsigned short      _packet_id;
+};
+
+#endif // _MQTT_PIPELINE_NETWORK_H_
@@ -0,0 +1,232 @@
+#include "mbed.h"
+#include "MQTTReconnectEngine.h"
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+/* Slice of backoff wait, between which idle handler runs */
+#define RECONNECT_IDLE_SLICE_MS     100
+
+extern "C" {
+    MBED_USED void print_mqtt_reconnect_stats(void);
+}
+
+MQTTReconnectEngine::Stats MQTTReconnectEngine::_stats;
+
+MQTTReconnectEngine::MQTTReconnectEngine() :
+    _down_from(LAYER_LINK),
+    _retries(0),
+    _lost(false),
+    _seed(0),
+    _stop(false)
+{
+    for (int i = 0; i < LAYER_NUM; i ++) {
+        _failures[i] = 0;
+    }
+}
+
+void MQTTReconnectEngine::attach(Layer layer, UpHandler up, DownHandler down)
+{
+    _up[layer] = up;
+    _down[layer] = down;
+}
+
+void MQTTReconnectEngine::attach_idle(IdleHandler idle)
+{
+    _idle = idle;
+}
+
+int MQTTReconnectEngine::bring_up()
+{
+    bool backoff = false;
+
+    while (_down_from < LAYER_NUM) {
+        if (core_util_atomic_load_bool(&_stop)) {
+            return MBED_ERROR_OPERATION_ABORTED;
+        }
+
+        /* First attempt after loss goes immediately. Back off on retry after failure. */
+        if (backoff) {
+            backoff = false;
+            wait_backoff();
+            if (core_util_atomic_load_bool(&_stop)) {
+                return MBED_ERROR_OPERATION_ABORTED;
+            }
+        }
+
+        int layer = _down_from;
+        _stats.attempts[layer] ++;
+        int rc = _up[layer] ? _up[layer]() : 0;
+        if (rc >= 0 && _down_from == layer) {
+            _failures[layer] = 0;
+            _down_from = layer + 1;
+            continue;
+        }
+
+        /* Clean up what the handler has left */
+        if (_down[layer]) {
+            _down[layer]();
+        }
+
+        printf("Reconnect: %s layer failed: %d\n", layer_name((Layer) layer), rc);
+        _stats.failures[layer] ++;
+        _retries ++;
+        backoff = true;
+
+        /* The handler may have reported the layer below broken already */
+        if (_down_from < layer) {
+            _failures[layer] = 0;
+            continue;
+        }
+
+        /* Escalate layer failing repeatedly, e.g. stale server address */
+        if (++ _failures[layer] >= MBED_CONF_MY_MQTT_RECONNECT_ESCALATE_AFTER && layer > LAYER_LINK) {
+            _failures[layer] = 0;
+            _stats.escalations ++;
+            printf("Reconnect: escalating to %s layer\n", layer_name((Layer) (layer - 1)));
+            down((Layer) (layer - 1));
+        }
+    }
+
+    _retries = 0;
+
+    if (_lost) {
+        uint32_t recover_ms = std::chrono::duration_cast<std::chrono::milliseconds>(Kernel::Clock::now() - _lost_at).count();
+
+        _lost = false;
+        _stats.recoveries ++;
+        _stats.last_recover_ms = recover_ms;
+        _stats.total_recover_ms += recover_ms;
+        if (recover_ms > _stats.max_recover_ms) {
+            _stats.max_recover_ms = recover_ms;
+        }
+        printf("Reconnect: recovered in %" PRIu32 " ms\n", recover_ms);
+    }
+
+    return MBED_SUCCESS;
+}
+
+void MQTTReconnectEngine::lost(Layer layer)
+{
+    if (is_up()) {
+        _lost = true;
+        _lost_at = Kernel::Clock::now();
+        _stats.losses ++;
+        printf("Reconnect: connection lost at %s layer\n", layer_name(layer));
+    }
+
+    down(layer);
+}
+
+void MQTTReconnectEngine::down(Layer layer)
+{
+    /* Tear down top first */
+    for (int i = _down_from - 1; i >= (int) layer; i --) {
+        if (_down[i]) {
+            _down[i]();
+        }
+    }
+
+    if ((int) layer < _down_from) {
+        _down_from = layer;
+    }
+}
+
+void MQTTReconnectEngine::stop()
+{
+    core_util_atomic_store_bool(&_stop, true);
+}
+
+const char *MQTTReconnectEngine::layer_name(Layer layer)
+{
+    switch (layer) {
+        case LAYER_LINK:
+            return "LINK";
+
+        case LAYER_TCP:
+            return "TCP";
+
+        case LAYER_TLS:
+            return "TLS";
+
+        case LAYER_MQTT:
+            return "MQTT";
+
+        default:
+            return "?";
+    }
+}
+
+void MQTTReconnectEngine::wait_backoff()
+{
+    /* Exponential backoff, capped, with "equal jitter": half fixed, half random */
+    uint32_t shift = (_retries > 16) ? 16 : (_retries - 1);
+    uint64_t backoff_ms = (uint64_t) MBED_CONF_MY_MQTT_RECONNECT_BACKOFF_BASE_MS << shift;
+    if (backoff_ms > MBED_CONF_MY_MQTT_RECONNECT_BACKOFF_MAX_MS) {
+        backoff_ms = MBED_CONF_MY_MQTT_RECONNECT_BACKOFF_MAX_MS;
+    }
+    uint32_t delay_ms = (uint32_t) (backoff_ms / 2) + jitter((uint32_t) (backoff_ms / 2));
+
+    printf("Reconnect: retry %s layer in %" PRIu32 " ms\n", layer_name((Layer) _down_from), delay_ms);
+
+    Timer timer;
+    timer.start();
+    while (! core_util_atomic_load_bool(&_stop)) {
+        uint32_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed_time()).count();
+        if (elapsed_ms >= delay_ms) {
+            break;
+        }
+
+        if (_idle) {
+            _idle();
+        }
+
+        uint32_t slice_ms = delay_ms - elapsed_ms;
+        if (slice_ms > RECONNECT_IDLE_SLICE_MS) {
+            slice_ms = RECONNECT_IDLE_SLICE_MS;
+        }
+        ThisThread::sleep_for(std::chrono::milliseconds(slice_ms));
+    }
+}
+
+uint32_t MQTTReconnectEngine::jitter(uint32_t range)
+{
+    /* Seed on first use. Time of first failure differs across devices with network timing. */
+    if (_seed == 0) {
+        _seed = (uint32_t) Kernel::Clock::now().time_since_epoch().count() ^ (uint32_t) time(NULL) ^ 0x9E3779B9;
+        if (_seed == 0) {
+            _seed = 1;
+        }
+    }
+
+    /* xorshift32 */
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+
+    return range ? (_seed % (range + 1)) : 0;
+}
+
+void MQTTReconnectEngine::print_stats()
+{
+    printf("** MQTT RECONNECT STATS **\n");
+    printf("**** losses           : %" PRIu32 "\n", _stats.losses);
+    printf("**** recoveries       : %" PRIu32 "\n", _stats.recoveries);
+    for (int i = 0; i < LAYER_NUM; i ++) {
+        printf("**** %-4s attempts    : %" PRIu32 " (%" PRIu32 " failed)\n", layer_name((Layer) i),
+               _stats.attempts[i], _stats.failures[i]);
+    }
+    printf("**** escalations      : %" PRIu32 "\n", _stats.escalations);
+    printf("**** time to recover  : last %" PRIu32 " ms, avg %" PRIu32 " ms, max %" PRIu32 " ms\n",
+           _stats.last_recover_ms,
+           _stats.recoveries ? (_stats.total_recover_ms / _stats.recoveries) : 0,
+           _stats.max_recover_ms);
+    printf("**************************\n\n");
+}
+
+void print_mqtt_reconnect_stats(void)
+{
+    MQTTReconnectEngine::print_stats();
+}
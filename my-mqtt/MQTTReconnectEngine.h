@@ -0,0 +1,124 @@
+#ifndef _MQTT_RECONNECT_ENGINE_H_
+#define _MQTT_RECONNECT_ENGINE_H_
+
+#include "mbed.h"
+
+/* MQTTReconnectEngine = layered reconnect state machine with jittered exponential backoff
+ *
+ * Connection is modeled as a stack of layers, each brought up by its own handler:
+ *
+ *   LINK   network interface (Ethernet/WiFi/cellular) up
+ *   TCP    server address resolved, transport endpoint ready
+ *   TLS    socket connected and TLS handshake done
+ *   MQTT   MQTT connected and topic filters subscribed
+ *
+ * On connection lost or handler failure at some layer, only that layer and those above are
+ * torn down (top first) and brought up again. The first attempt after loss goes immediately
+ * (fast resume). Subsequent attempts back off exponentially with jitter, so that a fleet
+ * doesn't reconnect in lock step. A layer which keeps failing escalates to
+ * the layer below, e.g. repeated TLS failure re-resolves the server address.
+ *
+ * While waiting for backoff, the idle handler is run periodically, e.g. to keep telemetry
+ * flowing into the offline journal.
+ *
+ * NOTE: Not thread-safe except stop(). Run it in the thread doing network I/O.
+ */
+class MQTTReconnectEngine
+{
+public:
+    enum Layer {
+        LAYER_LINK = 0,
+        LAYER_TCP,
+        LAYER_TLS,
+        LAYER_MQTT,
+        LAYER_NUM
+    };
+
+    /* Bring up layer. Return 0 on success or negative on failure. */
+    typedef mbed::Callback<int()> UpHandler;
+    /* Tear down layer, which may have broken already */
+    typedef mbed::Callback<void()> DownHandler;
+    typedef mbed::Callback<void()> IdleHandler;
+
+    struct Stats {
+        uint32_t    losses;                 /**< Connections lost after up */
+        uint32_t    recoveries;             /**< Connections brought up again after loss */
+        uint32_t    attempts[LAYER_NUM];    /**< Bring-up attempts per layer */
+        uint32_t    failures[LAYER_NUM];    /**< Bring-up failures per layer */
+        uint32_t    escalations;            /**< Failing layers escalated to the layer below */
+        uint32_t    last_recover_ms;        /**< Time to recover of the last loss */
+        uint32_t    max_recover_ms;         /**< Worst time to recover */
+        uint32_t    total_recover_ms;       /**< Sum of time to recover, for average */
+    };
+
+    MQTTReconnectEngine();
+
+    /**
+     * Attach up/down handlers of one layer. Layers without handlers are always up.
+     */
+    void attach(Layer layer, UpHandler up, DownHandler down = nullptr);
+
+    /**
+     * Attach handler run periodically while waiting for backoff
+     */
+    void attach_idle(IdleHandler idle);
+
+    /**
+     * Bring up all layers which are down, retrying with backoff until all are up
+     *
+     * @return  MBED_SUCCESS, or MBED_ERROR_OPERATION_ABORTED on stop()
+     */
+    int bring_up();
+
+    /**
+     * Report connection lost at layer. The layer and those above are torn down.
+     */
+    void lost(Layer layer);
+
+    /**
+     * Tear down the layer and those above without counting it as loss, e.g. on shutdown
+     */
+    void down(Layer layer);
+
+    /**
+     * Request bring_up() to give up. Callable from other threads.
+     */
+    void stop();
+
+    bool is_up() const
+    {
+        return _down_from == LAYER_NUM;
+    }
+
+    static const char *layer_name(Layer layer);
+
+    /**
+     * Accumulated statistics of all engines
+     */
+    static const Stats &stats()
+    {
+        return _stats;
+    }
+
+    static void print_stats();
+
+private:
+    void wait_backoff();
+    uint32_t jitter(uint32_t range);
+
+    UpHandler                   _up[LAYER_NUM];
+    DownHandler                 _down[LAYER_NUM];
+    IdleHandler                 _idle;
+
+    int                         _down_from;         /**< Lowest layer which is down. LAYER_NUM for all up. */
+    int                         _failures[LAYER_NUM];   /**< Consecutive failures per layer, for escalation */
+    uint32_t                    _retries;           /**< Consecutive failures since last up, for backoff */
+    bool                        _lost;              /**< Recovering from loss, not initial connect */
+    Kernel::Clock::time_point   _lost_at;
+    uint32_t                    _seed;
+    bool                        _stop;
+
+    static Stats                _stats;
+};
+
+#endif // _MQTT_RECONNECT_ENGINE_H_
@@ -0,0 +1,180 @@
+#ifndef _MQTT_SUBSCRIPTION_MANAGER_H_
+#define _MQTT_SUBSCRIPTION_MANAGER_H_
+
+#include "mbed.h"
+#include "MQTTClient.h"
+#include "MQTTTopicDispatcher.h"
+
+/* MQTTSubscriptionManager = long-lived subscriptions for MQTT::Client
+ *
+ * Topic filters and their handlers are registered once. subscribe_all() subscribes all
+ * of them right after MQTT connect, so the telemetry loop only needs to publish. Messages
+ * are routed back to the handler of the matching filter through MQTTTopicDispatcher, as
+ * zero-copy MQTTMessageView.
+ *
+ * Only Client::subscribe() is used, so any client with the same signature (e.g. a stub
+ * talking to a local broker stand-in on Linux) can be plugged in.
+ *
+ * NOTE: The Client stores handlers as plain function pointers. We register one static
+ *       trampoline and so support one manager instance per Client type alive at a time,
+ *       i.e. one per process for one Client type. Constructing a second one while the
+ *       first is alive asserts. Destroy the first, or instantiate for another Client type.
+ */
+template<class Client, int MAX_SUBSCRIPTIONS = MBED_CONF_MY_MQTT_MAX_SUBSCRIPTIONS>
+class MQTTSubscriptionManager
+{
+public:
+    typedef MQTTTopicDispatcher<MAX_SUBSCRIPTIONS> Dispatcher;
+    typedef typename Dispatcher::Handler Handler;
+
+    MQTTSubscriptionManager(Client &client) :
+        _client(client), _count(0)
+    {
+        MBED_ASSERT(_instance == NULL);
+        _instance = this;
+    }
+
+    ~MQTTSubscriptionManager()
+    {
+        if (_instance == this) {
+            _instance = NULL;
+        }
+    }
+
+    /**
+     * Register topic filter and its handler
+     *
+     * The topic filter string must stay valid for the lifetime of the manager.
+     */
+    int add(const char *topic_filter, MQTT::QoS qos, Handler handler)
+    {
+        if (_count >= MAX_SUBSCRIPTIONS) {
+            return MQTT::FAILURE;
+        }
+
+        int rc = _dispatcher.add(topic_filter, handler);
+        if (rc != MQTT::SUCCESS) {
+            printf("MQTT topic filter %s not routable: out of dispatcher nodes\n", topic_filter);
+            return rc;
+        }
+
+        _subs[_count].topic_filter = topic_filter;
+        _subs[_count].qos = qos;
+        _subs[_count].active = false;
+        _count ++;
+
+        return MQTT::SUCCESS;
+    }
+
+    /**
+     * Register a table of topic filters sharing one handler
+     */
+    int add(const char **topic_filters, size_t topic_filters_size, MQTT::QoS qos, Handler handler)
+    {
+        for (size_t i = 0; i < topic_filters_size; i ++) {
+            int rc = add(topic_filters[i], qos, handler);
+            if (rc != MQTT::SUCCESS) {
+                return rc;
+            }
+        }
+
+        return MQTT::SUCCESS;
+    }
+
+    /**
+     * Subscribe all registered topic filters not yet subscribed on this connection
+     *
+     * @return  Number of topic filters failing to subscribe
+     */
+    int subscribe_all()
+    {
+        int failed = 0;
+
+        for (int i = 0; i < _count; i ++) {
+            Subscription &sub = _subs[i];
+            if (sub.active) {
+                continue;
+            }
+
+            /* AWS IoT does not support publishing and subscribing with QoS 2.
+             * The AWS IoT message broker does not send a PUBACK or SUBACK when QoS 2 is requested. */
+            printf("MQTT subscribing to %s", sub.topic_filter);
+            int mqtt_rc = _client.subscribe(sub.topic_filter, sub.qos, message_arrived);
+            if (mqtt_rc != 0) {
+                printf("\rMQTT subscribes to %s failed: %d\n", sub.topic_filter, mqtt_rc);
+                failed ++;
+                continue;
+            }
+            printf("\rMQTT subscribes to %s OK\n", sub.topic_filter);
+            sub.active = true;
+        }
+
+        return failed;
+    }
+
+    /**
+     * Mark all subscriptions inactive
+     *
+     * The broker drops subscriptions together with the connection (clean session).
+     * Call this on disconnect so that subscribe_all() will re-subscribe on the next one.
+     */
+    void connection_lost()
+    {
+        for (int i = 0; i < _count; i ++) {
+            _subs[i].active = false;
+        }
+    }
+
+    /**
+     * Number of topic filters subscribed on this connection
+     */
+    int active_count() const
+    {
+        int active = 0;
+
+        for (int i = 0; i < _count; i ++) {
+            if (_subs[i].active) {
+                active ++;
+            }
+        }
+
+        return active;
+    }
+
+    /**
+     * Dispatcher routing messages of registered topic filters
+     */
+    const Dispatcher &dispatcher() const
+    {
+        return _dispatcher;
+    }
+
+private:
+    struct Subscription {
+        const char *    topic_filter;
+        MQTT::QoS       qos;
+        bool            active;
+    };
+
+    static void message_arrived(MQTT::MessageData &md)
+    {
+        MQTTSubscriptionManager *mgr = _instance;
+        if (mgr == NULL) {
+            return;
+        }
+
+        mgr->_dispatcher.dispatch(md);
+    }
+
+    Client &                                _client;
+    Subscription                            _subs[MAX_SUBSCRIPTIONS];
+    int                                     _count;
+    Dispatcher                              _dispatcher;
+
+    static MQTTSubscriptionManager *        _instance;
+};
+
+template<class Client, int MAX_SUBSCRIPTIONS>
+MQTTSubscriptionManager<Client, MAX_SUBSCRIPTIONS> *MQTTSubscriptionManager<Client, MAX_SUBSCRIPTIONS>::_instance = NULL;
+
+#endif // _MQTT_SUBSCRIPTION_MANAGER_H_
@@ -0,0 +1,260 @@
+#ifndef _MQTT_TOPIC_DISPATCHER_H_
+#define _MQTT_TOPIC_DISPATCHER_H_
+
+#include "mbed.h"
+#include "MQTTClient.h"
+
+/* MQTTMessageView = zero-copy view of an inbound message
+ *
+ * Topic and payload point into the MQTT client's read buffer. They are valid only
+ * during the handler call. Copy out what must outlive it.
+ */
+struct MQTTMessageView {
+    const char *        topic;
+    size_t              topic_len;
+    const void *        payload;
+    size_t              payload_len;
+    MQTT::QoS           qos;
+    bool                retained;
+    bool                dup;
+    unsigned short      id;
+};
+
+/* MQTTTopicDispatcher = route inbound messages to handlers by topic filter
+ *
+ * Topic filters are compiled into a trie of topic levels when registered, so routing walks
+ * the topic name once, level by level, rather than matching it against every filter.
+ * Literal levels share trie nodes, e.g. all "$aws/things/<thing>/shadow/..." filters share
+ * one path down to "shadow". '+' and '#' wildcards are trie nodes of their own.
+ *
+ * Where filters overlap, the most specific one wins: literal level over '+' over '#'.
+ * Topics starting with '$' don't match wildcards at the first level (MQTT 3.1.1 4.7.2).
+ *
+ * The trie lives in fixed-size pools. Filter strings must stay valid for the lifetime
+ * of the dispatcher, because trie nodes point into them.
+ */
+template<int MAX_FILTERS, int MAX_NODES = MBED_CONF_MY_MQTT_DISPATCHER_MAX_NODES>
+class MQTTTopicDispatcher
+{
+public:
+    typedef mbed::Callback<void(const MQTTMessageView &)> Handler;
+
+    MQTTTopicDispatcher() :
+        _node_count(1),
+        _handler_count(0),
+        _unmatched(0)
+    {
+        /* Root */
+        _nodes[0].segment = NULL;
+        _nodes[0].segment_len = 0;
+        _nodes[0].first_child = NO_NODE;
+        _nodes[0].next_sibling = NO_NODE;
+        _nodes[0].handler = NO_HANDLER;
+    }
+
+    /**
+     * Compile topic filter into trie and attach handler
+     *
+     * @return  MQTT::SUCCESS, or MQTT::FAILURE if out of pool
+     */
+    int add(const char *topic_filter, Handler handler)
+    {
+        if (_handler_count >= MAX_FILTERS) {
+            return MQTT::FAILURE;
+        }
+
+        int node = 0;
+        const char *seg = topic_filter;
+        const char *filter_end = topic_filter + strlen(topic_filter);
+
+        while (true) {
+            const char *seg_end = level_end(seg, filter_end);
+            int child = find_child(node, seg, seg_end - seg);
+            if (child == NO_NODE) {
+                child = new_child(node, seg, seg_end - seg);
+                if (child == NO_NODE) {
+                    return MQTT::FAILURE;
+                }
+            }
+            node = child;
+
+            if (seg_end == filter_end) {
+                break;
+            }
+            seg = seg_end + 1;
+        }
+
+        _handlers[_handler_count] = handler;
+        _nodes[node].handler = _handler_count ++;
+
+        return MQTT::SUCCESS;
+    }
+
+    /**
+     * Route message to the handler of the most specific matching filter
+     *
+     * @return  true if routed
+     */
+    bool dispatch(const MQTTMessageView &view)
+    {
+        int handler = match(0, view.topic, view.topic + view.topic_len, true);
+        if (handler == NO_HANDLER || ! _handlers[handler]) {
+            _unmatched ++;
+            return false;
+        }
+
+        _handlers[handler](view);
+        return true;
+    }
+
+    /**
+     * Route message from MQTT::Client as zero-copy view
+     */
+    bool dispatch(MQTT::MessageData &md)
+    {
+        MQTTMessageView view;
+
+        view.topic = md.topicName.lenstring.data;
+        view.topic_len = md.topicName.lenstring.len;
+        view.payload = md.message.payload;
+        view.payload_len = md.message.payloadlen;
+        view.qos = md.message.qos;
+        view.retained = md.message.retained;
+        view.dup = md.message.dup;
+        view.id = md.message.id;
+
+        return dispatch(view);
+    }
+
+    /**
+     * Number of trie nodes in use, for sizing dispatcher-max-nodes
+     */
+    int node_count() const
+    {
+        return _node_count;
+    }
+
+    /**
+     * Number of messages matching no filter
+     */
+    uint32_t unmatched() const
+    {
+        return _unmatched;
+    }
+
+private:
+    static const int16_t NO_NODE = -1;
+    static const int16_t NO_HANDLER = -1;
+
+    struct Node {
+        const char *    segment;        /**< Topic level, pointing into topic filter */
+        uint16_t        segment_len;
+        int16_t         first_child;
+        int16_t         next_sibling;
+        int16_t         handler;        /**< Handler of filter ending here */
+    };
+
+    static const char *level_end(const char *level, const char *end)
+    {
+        while (level < end && *level != '/') {
+            level ++;
+        }
+        return level;
+    }
+
+    bool is_segment(int node, char wildcard) const
+    {
+        return _nodes[node].segment_len == 1 && _nodes[node].segment[0] == wildcard;
+    }
+
+    int find_child(int node, const char *seg, size_t seg_len) const
+    {
+        for (int child = _nodes[node].first_child; child != NO_NODE; child = _nodes[child].next_sibling) {
+            if (_nodes[child].segment_len == seg_len && memcmp(_nodes[child].segment, seg, seg_len) == 0) {
+                return child;
+            }
+        }
+        return NO_NODE;
+    }
+
+    int new_child(int node, const char *seg, size_t seg_len)
+    {
+        if (_node_count >= MAX_NODES) {
+            return NO_NODE;
+        }
+
+        int child = _node_count ++;
+        _nodes[child].segment = seg;
+        _nodes[child].segment_len = seg_len;
+        _nodes[child].first_child = NO_NODE;
+        _nodes[child].next_sibling = _nodes[node].first_child;
+        _nodes[child].handler = NO_HANDLER;
+        _nodes[node].first_child = child;
+
+        return child;
+    }
+
+    /**
+     * Match topic levels from level on against children of node
+     *
+     * @return  Handler index, or NO_HANDLER
+     */
+    int match(int node, const char *level, const char *end, bool first_level) const
+    {
+        const char *seg_end = level_end(level, end);
+        size_t seg_len = seg_end - level;
+        bool wildcards = ! (first_level && seg_len && level[0] == '$');
+        int literal = NO_NODE;
+        int plus = NO_NODE;
+        int hash = NO_NODE;
+
+        for (int child = _nodes[node].first_child; child != NO_NODE; child = _nodes[child].next_sibling) {
+            if (is_segment(child, '#')) {
+                hash = child;
+            } else if (is_segment(child, '+')) {
+                plus = child;
+            } else if (_nodes[child].segment_len == seg_len && memcmp(_nodes[child].segment, level, seg_len) == 0) {
+                literal = child;
+            }
+        }
+
+        int candidates[2] = { literal, wildcards ? plus : NO_NODE };
+        for (int i = 0; i < 2; i ++) {
+            int child = candidates[i];
+            if (child == NO_NODE) {
+                continue;
+            }
+
+            int handler;
+            if (seg_end == end) {
+                /* Last level. "a/#" also matches "a". */
+                handler = _nodes[child].handler;
+                if (handler == NO_HANDLER) {
+                    int hash_child = find_child(child, "#", 1);
+                    if (hash_child != NO_NODE) {
+                        handler = _nodes[hash_child].handler;
+                    }
+                }
+            } else {
+                handler = match(child, seg_end + 1, end, false);
+            }
+            if (handler != NO_HANDLER) {
+                return handler;
+            }
+        }
+
+        if (wildcards && hash != NO_NODE) {
+            return _nodes[hash].handler;
+        }
+
+        return NO_HANDLER;
+    }
+
+    Node                _nodes[MAX_NODES];
+    int                 _node_count;
+    Handler             _handlers[MAX_FILTERS];
+    int                 _handler_count;
+    uint32_t            _unmatched;
+};
+
+#endif // _MQTT_TOPIC_DISPATCHER_H_
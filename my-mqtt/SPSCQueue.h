@@ -0,0 +1,103 @@
+#ifndef _SPSC_QUEUE_H_
+#define _SPSC_QUEUE_H_
+
+#include "mbed.h"
+#include "platform/mbed_atomic.h"
+
+/* SPSCQueue = lock-free single-producer/single-consumer ring buffer
+ *
+ * One thread (or ISR) pushes and one other thread pops. Neither side ever blocks or takes
+ * a lock, so e.g. sensor sampling never stalls on TLS I/O of the network thread.
+ * Head/tail are free-running 32-bit counters. The producer publishes an item by
+ * store-release of tail after writing the slot and the consumer releases the slot by
+ * store-release of head after reading it.
+ *
+ * N must be power of 2.
+ */
+template<typename T, uint32_t N>
+class SPSCQueue
+{
+    MBED_STATIC_ASSERT(N >= 2 && (N & (N - 1)) == 0, "SPSCQueue depth must be power of 2");
+
+public:
+    SPSCQueue() :
+        _head(0), _tail(0), _dropped(0)
+    {
+    }
+
+    /**
+     * Push one item (producer side only)
+     *
+     * @return  false if queue is full. The item is dropped and counted.
+     */
+    bool push(const T &item)
+    {
+        uint32_t tail = core_util_atomic_load_explicit_u32(&_tail, mbed_memory_order_relaxed);
+        uint32_t head = core_util_atomic_load_explicit_u32(&_head, mbed_memory_order_acquire);
+
+        if (tail - head >= N) {
+            _dropped ++;
+            return false;
+        }
+
+        _items[tail & (N - 1)] = item;
+        core_util_atomic_store_explicit_u32(&_tail, tail + 1, mbed_memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * Pop one item (consumer side only)
+     *
+     * @return  false if queue is empty
+     */
+    bool pop(T &item)
+    {
+        uint32_t head = core_util_atomic_load_explicit_u32(&_head, mbed_memory_order_relaxed);
+        uint32_t tail = core_util_atomic_load_explicit_u32(&_tail, mbed_memory_order_acquire);
+
+        if (head == tail) {
+            return false;
+        }
+
+        item = _items[head & (N - 1)];
+        core_util_atomic_store_explicit_u32(&_head, head + 1, mbed_memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * Number of queued items (exact from either side only at the moment of call)
+     */
+    uint32_t size() const
+    {
+        return core_util_atomic_load_explicit_u32(&_tail, mbed_memory_order_acquire) -
+               core_util_atomic_load_explicit_u32(&_head, mbed_memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    static uint32_t capacity()
+    {
+        return N;
+    }
+
+    /**
+     * Number of items dropped on full queue (read from producer side)
+     */
+    uint32_t dropped() const
+    {
+        return _dropped;
+    }
+
+private:
+    volatile uint32_t   _head;      /**< Written by consumer only */
+    volatile uint32_t   _tail;      /**< Written by producer only */
+    uint32_t            _dropped;   /**< Written by producer only */
+    T                   _items[N];
+};
+
+#endif // _SPSC_QUEUE_H_
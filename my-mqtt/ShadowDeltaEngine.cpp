@@ -0,0 +1,258 @@
+#include "mbed.h"
+#include "ShadowDeltaEngine.h"
+#include "TelemetryBatcher.h"
+#include <math.h>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+extern "C" {
+    MBED_USED void print_shadow_delta_stats(void);
+}
+
+ShadowDeltaEngine::Stats ShadowDeltaEngine::_stats;
+
+ShadowDeltaEngine::ShadowDeltaEngine(const char *client_name) :
+    _client_name(client_name),
+    _acked_fields(0),
+    _acked_temperature(0),
+    _acked_humidity(0),
+    _acked_pressure(0),
+    _pending_next(0),
+    _next_order(0)
+{
+    _acked_client_name[0] = '\0';
+    for (int i = 0; i < FIELD_NUM; i ++) {
+        _acked_order[i] = 0;
+    }
+    for (size_t i = 0; i < sizeof (_pending) / sizeof (_pending[0]); i ++) {
+        _pending[i].token = 0;
+    }
+
+    /* Not to match acknowledgement of updates before reboot */
+    _next_token = (uint32_t) Kernel::Clock::now().time_since_epoch().count() ^ (uint32_t) time(NULL);
+}
+
+bool ShadowDeltaEngine::moved(float value, float acked, float tolerance)
+{
+    return fabsf(value - acked) > tolerance;
+}
+
+int ShadowDeltaEngine::encode(char *buf, size_t size, const TelemetryRecord *records, size_t n)
+{
+    size_t pos = 0;
+
+    if (n == 0) {
+        return -1;
+    }
+
+    /* Diff latest sample against reported state last acknowledged */
+    const TelemetryRecord &last = records[n - 1];
+    uint8_t fields = 0;
+    if (! (_acked_fields & FIELD_CLIENT_NAME) || strcmp(_client_name, _acked_client_name)) {
+        fields |= FIELD_CLIENT_NAME;
+    }
+    if (! (_acked_fields & FIELD_TEMPERATURE) ||
+            moved(last.temperature, _acked_temperature, MBED_CONF_MY_MQTT_SHADOW_TOLERANCE_TEMPERATURE)) {
+        fields |= FIELD_TEMPERATURE;
+    }
+    if (! (_acked_fields & FIELD_HUMIDITY) ||
+            moved(last.humidity, _acked_humidity, MBED_CONF_MY_MQTT_SHADOW_TOLERANCE_HUMIDITY)) {
+        fields |= FIELD_HUMIDITY;
+    }
+    if (! (_acked_fields & FIELD_PRESSURE) ||
+            moved(last.pressure, _acked_pressure, MBED_CONF_MY_MQTT_SHADOW_TOLERANCE_PRESSURE)) {
+        fields |= FIELD_PRESSURE;
+    }
+
+    if (! TelemetryBatcher::append(buf, size, pos, "{\"state\":{\"reported\":{")) {
+        return -1;
+    }
+    if ((fields & FIELD_CLIENT_NAME) &&
+            ! TelemetryBatcher::append(buf, size, pos, "\"clientName\":\"%s\",", _client_name)) {
+        return -1;
+    }
+    if ((fields & FIELD_TEMPERATURE) &&
+            ! TelemetryBatcher::append(buf, size, pos, "\"temperature\":%.2f,", last.temperature)) {
+        return -1;
+    }
+    if ((fields & FIELD_HUMIDITY) &&
+            ! TelemetryBatcher::append(buf, size, pos, "\"humidity\":%.2f,", last.humidity)) {
+        return -1;
+    }
+    if ((fields & FIELD_PRESSURE) &&
+            ! TelemetryBatcher::append(buf, size, pos, "\"pressure\":%.2f,", last.pressure)) {
+        return -1;
+    }
+
+    int len = TelemetryBatcher::encode_samples(buf ? (buf + pos) : NULL, (buf && pos < size) ? (size - pos) : 0, records, n);
+    if (len < 0) {
+        return -1;
+    }
+    pos += len;
+
+    /* Just calculating length. Token is fixed-width. */
+    if (buf == NULL) {
+        return (int) pos + sizeof ("}},\"clientToken\":\"00000000\"}") - 1;
+    }
+
+    if (++ _next_token == 0) {
+        _next_token = 1;
+    }
+    if (! TelemetryBatcher::append(buf, size, pos, "}},\"clientToken\":\"%08" PRIx32 "\"}", _next_token)) {
+        return -1;
+    }
+
+    /* Track until acknowledged */
+    Pending &pending = _pending[_pending_next];
+    _pending_next = (_pending_next + 1) % (sizeof (_pending) / sizeof (_pending[0]));
+    pending.token = _next_token;
+    pending.order = _next_order ++;
+    pending.fields = fields;
+    pending.temperature = last.temperature;
+    pending.humidity = last.humidity;
+    pending.pressure = last.pressure;
+
+    int reported = 0;
+    for (uint8_t i = fields; i; i >>= 1) {
+        reported += (i & 1);
+    }
+    _stats.updates ++;
+    _stats.fields_reported += reported;
+    _stats.fields_suppressed += 4 - reported;
+
+    return (int) pos;
+}
+
+bool ShadowDeltaEngine::parse_token(const void *payload, size_t payload_len, uint32_t *token)
+{
+    static const char key[] = "\"clientToken\"";
+    const char *data = (const char *) payload;
+    const char *end = data + payload_len;
+
+    for (const char *p = data; p + sizeof (key) - 1 <= end; p ++) {
+        if (memcmp(p, key, sizeof (key) - 1)) {
+            continue;
+        }
+
+        /* Skip to opening quote of value */
+        p += sizeof (key) - 1;
+        while (p < end && (*p == ' ' || *p == ':')) {
+            p ++;
+        }
+        if (p >= end || *p != '"') {
+            return false;
+        }
+        p ++;
+
+        uint32_t value = 0;
+        int digits = 0;
+        for (; p < end && *p != '"'; p ++, digits ++) {
+            char c = *p;
+            if (c >= '0' && c <= '9') {
+                value = (value << 4) | (c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                value = (value << 4) | (c - 'a' + 10);
+            } else {
+                return false;
+            }
+        }
+        if (p >= end || digits != 8) {
+            return false;
+        }
+
+        *token = value;
+        return true;
+    }
+
+    return false;
+}
+
+ShadowDeltaEngine::Pending *ShadowDeltaEngine::find_pending(const void *payload, size_t payload_len)
+{
+    uint32_t token;
+
+    if (! parse_token(payload, payload_len, &token) || token == 0) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < sizeof (_pending) / sizeof (_pending[0]); i ++) {
+        if (_pending[i].token == token) {
+            return &_pending[i];
+        }
+    }
+
+    return NULL;
+}
+
+void ShadowDeltaEngine::accepted(const void *payload, size_t payload_len)
+{
+    Pending *pending = find_pending(payload, payload_len);
+    if (pending == NULL) {
+        return;
+    }
+
+    /* Skip attributes a newer update has set in cache already. Wrap-safe comparison. */
+    uint8_t fields = 0;
+    for (int i = 0; i < FIELD_NUM; i ++) {
+        uint8_t field = 1 << i;
+        if (! (pending->fields & field)) {
+            continue;
+        }
+        if ((_acked_fields & field) && (int32_t) (pending->order - _acked_order[i]) < 0) {
+            _stats.stale ++;
+            continue;
+        }
+        fields |= field;
+        _acked_order[i] = pending->order;
+    }
+
+    if (fields & FIELD_CLIENT_NAME) {
+        strncpy(_acked_client_name, _client_name, sizeof (_acked_client_name) - 1);
+        _acked_client_name[sizeof (_acked_client_name) - 1] = '\0';
+    }
+    if (fields & FIELD_TEMPERATURE) {
+        _acked_temperature = pending->temperature;
+    }
+    if (fields & FIELD_HUMIDITY) {
+        _acked_humidity = pending->humidity;
+    }
+    if (fields & FIELD_PRESSURE) {
+        _acked_pressure = pending->pressure;
+    }
+    _acked_fields |= fields;
+
+    pending->token = 0;
+    _stats.accepted ++;
+}
+
+void ShadowDeltaEngine::rejected(const void *payload, size_t payload_len)
+{
+    Pending *pending = find_pending(payload, payload_len);
+    if (pending == NULL) {
+        return;
+    }
+
+    /* Cache unchanged. The attributes will be reported again. */
+    pending->token = 0;
+    _stats.rejected ++;
+}
+
+void ShadowDeltaEngine::print_stats()
+{
+    printf("** SHADOW DELTA STATS **\n");
+    printf("**** updates           : %" PRIu32 "\n", _stats.updates);
+    printf("**** fields reported   : %" PRIu32 "\n", _stats.fields_reported);
+    printf("**** fields suppressed : %" PRIu32 "\n", _stats.fields_suppressed);
+    printf("**** accepted          : %" PRIu32 "\n", _stats.accepted);
+    printf("**** stale fields      : %" PRIu32 "\n", _stats.stale);
+    printf("**** rejected          : %" PRIu32 "\n", _stats.rejected);
+    printf("************************\n\n");
+}
+
+void print_shadow_delta_stats(void)
+{
+    ShadowDeltaEngine::print_stats();
+}
@@ -0,0 +1,118 @@
+#ifndef _SHADOW_DELTA_ENGINE_H_
+#define _SHADOW_DELTA_ENGINE_H_
+
+#include "mbed.h"
+#include "TelemetryRecord.h"
+
+/* ShadowDeltaEngine = report only changed shadow attributes
+ *
+ * The engine caches reported state last acknowledged by the shadow service. Each update
+ * is diffed against it, and only attributes which have moved beyond their tolerance
+ * (shadow-tolerance-*) are put into "reported", together with the batched samples.
+ *
+ * Each update carries a clientToken. The shadow service echoes it in
+ * $aws/things/<thing>/shadow/update/accepted or /rejected. Attributes of an accepted
+ * update are merged into the cache. Attributes of a rejected or lost update stay
+ * different from the cache, so they are reported again by the next update.
+ *
+ * With more than one update in flight, acknowledgements may arrive out of order, e.g. after
+ * a DUP re-send. Updates are numbered in encode order, and each cached attribute keeps the
+ * number of the update it came from. An attribute of an accepted update older than that
+ * is stale and is not merged, so the cache never goes back to an older value.
+ *
+ * NOTE: Not thread-safe. Call it from the thread running MQTT::Client::yield().
+ */
+class ShadowDeltaEngine
+{
+public:
+    enum Field {
+        FIELD_CLIENT_NAME   = (1 << 0),
+        FIELD_TEMPERATURE   = (1 << 1),
+        FIELD_HUMIDITY      = (1 << 2),
+        FIELD_PRESSURE      = (1 << 3)
+    };
+
+    /* What encode() may add to TelemetryBatcher::encode(): ,"clientToken":"xxxxxxxx" */
+    static const size_t TOKEN_OVERHEAD = 25;
+
+    struct Stats {
+        uint32_t    updates;            /**< Updates encoded */
+        uint32_t    fields_reported;    /**< Attributes put into updates */
+        uint32_t    fields_suppressed;  /**< Attributes left out, unchanged within tolerance */
+        uint32_t    accepted;           /**< Updates acknowledged through /update/accepted */
+        uint32_t    stale;              /**< Attributes of accepted updates not merged, a newer update of them accepted first */
+        uint32_t    rejected;           /**< Updates rejected through /update/rejected */
+    };
+
+    /**
+     * @param[in] client_name   MQTT client ID to report, resolved on connect
+     */
+    ShadowDeltaEngine(const char *client_name);
+
+    /**
+     * Encode shadow update with attributes changed in the latest record, plus all records
+     * as samples (see TelemetryBatcher), and track it by clientToken until acknowledged
+     *
+     * @param[out] buf  Buffer for payload. NULL to calculate length only, without tracking.
+     * @return  Payload length excluding null terminator, or negative on encode failure.
+     *          Payload has been truncated if not less than size.
+     */
+    int encode(char *buf, size_t size, const TelemetryRecord *records, size_t n);
+
+    /**
+     * Handle message on /update/accepted
+     */
+    void accepted(const void *payload, size_t payload_len);
+
+    /**
+     * Handle message on /update/rejected
+     */
+    void rejected(const void *payload, size_t payload_len);
+
+    /**
+     * Accumulated statistics of all engines
+     */
+    static const Stats &stats()
+    {
+        return _stats;
+    }
+
+    static void print_stats();
+
+private:
+    static const int FIELD_NUM = 4;
+
+    struct Pending {
+        uint32_t    token;              /**< 0 for free */
+        uint32_t    order;              /**< Encode order of the update */
+        uint8_t     fields;
+        float       temperature;
+        float       humidity;
+        float       pressure;
+    };
+
+    Pending *find_pending(const void *payload, size_t payload_len);
+
+    static bool parse_token(const void *payload, size_t payload_len, uint32_t *token);
+    static bool moved(float value, float acked, float tolerance);
+
+    const char *        _client_name;
+
+    /* Reported state last acknowledged */
+    uint8_t             _acked_fields;
+    char                _acked_client_name[32];
+    float               _acked_temperature;
+    float               _acked_humidity;
+    float               _acked_pressure;
+    uint32_t            _acked_order[FIELD_NUM];    /**< Encode order of update each attribute came from, by bit of Field */
+
+    /* Updates waiting for acknowledgement, overwritten oldest first */
+    Pending             _pending[MBED_CONF_MY_MQTT_PUBLISH_WINDOW * 2];
+    int                 _pending_next;
+    uint32_t            _next_token;
+    uint32_t            _next_order;
+
+    static Stats        _stats;
+};
+
+#endif // _SHADOW_DELTA_ENGINE_H_
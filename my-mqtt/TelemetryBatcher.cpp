@@ -0,0 +1,191 @@
+#include "mbed.h"
+#include "TelemetryBatcher.h"
+#include <stdarg.h>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+/* TLS record overhead per publish with AES-GCM: header 5 + explicit nonce 8 + tag 16 */
+#define TLS_RECORD_OVERHEAD     29
+
+extern "C" {
+    MBED_USED void print_telemetry_batcher_stats(void);
+}
+
+TelemetryBatcher::Stats TelemetryBatcher::_stats;
+
+static const std::chrono::milliseconds BATCH_MAX_DELAY{MBED_CONF_MY_MQTT_BATCH_MAX_DELAY_MS};
+
+TelemetryBatcher::TelemetryBatcher(const char *client_name, size_t max_payload) :
+    _client_name(client_name),
+    _max_payload(max_payload),
+    _count(0)
+{
+}
+
+bool TelemetryBatcher::add(const TelemetryRecord &record)
+{
+    if (_count >= MBED_CONF_MY_MQTT_BATCH_MAX_SAMPLES) {
+        return false;
+    }
+
+    _records[_count] = record;
+    int len = encode(NULL, 0, _client_name, _records, _count + 1);
+    if (len < 0 || (size_t) len > _max_payload) {
+        return false;
+    }
+
+    if (_count == 0) {
+        _first_at = Kernel::Clock::now();
+    }
+    _count ++;
+
+    return true;
+}
+
+bool TelemetryBatcher::ready() const
+{
+    if (_count >= MBED_CONF_MY_MQTT_BATCH_MAX_SAMPLES) {
+        return true;
+    }
+
+    return _count && (Kernel::Clock::now() - _first_at) >= BATCH_MAX_DELAY;
+}
+
+bool TelemetryBatcher::append(char *buf, size_t size, size_t &pos, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf(buf ? (buf + pos) : NULL, (buf && pos < size) ? (size - pos) : 0, fmt, args);
+    va_end(args);
+
+    if (len < 0) {
+        return false;
+    }
+    pos += len;
+
+    return true;
+}
+
+int TelemetryBatcher::encode(char *buf, size_t size, const char *client_name, const TelemetryRecord *records, size_t n)
+{
+    size_t pos = 0;
+
+    if (n == 0) {
+        return -1;
+    }
+
+    /* Latest sample as plain fields */
+    const TelemetryRecord &last = records[n - 1];
+    if (! append(buf, size, pos, "{\"state\":{\"reported\":{\"clientName\":\"%s\",\"temperature\":%.2f,\"humidity\":%.2f,\"pressure\":%.2f,",
+                 client_name, last.temperature, last.humidity, last.pressure)) {
+        return -1;
+    }
+
+    int len = encode_samples(buf ? (buf + pos) : NULL, (buf && pos < size) ? (size - pos) : 0, records, n);
+    if (len < 0) {
+        return -1;
+    }
+    pos += len;
+
+    if (! append(buf, size, pos, "}}}")) {
+        return -1;
+    }
+
+    return (int) pos;
+}
+
+int TelemetryBatcher::encode_samples(char *buf, size_t size, const TelemetryRecord *records, size_t n)
+{
+    size_t pos = 0;
+
+    if (n == 0) {
+        return -1;
+    }
+
+    /* All samples in columns */
+    if (! append(buf, size, pos, "\"samples\":{\"t0\":%" PRIu32 ",\"dt\":[", records[0].timestamp)) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; i ++) {
+        if (! append(buf, size, pos, i ? ",%" PRIu32 : "%" PRIu32, records[i].timestamp - records[0].timestamp)) {
+            return -1;
+        }
+    }
+    if (! append(buf, size, pos, "],\"temperature\":[")) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; i ++) {
+        if (! append(buf, size, pos, i ? ",%.2f" : "%.2f", records[i].temperature)) {
+            return -1;
+        }
+    }
+    if (! append(buf, size, pos, "],\"humidity\":[")) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; i ++) {
+        if (! append(buf, size, pos, i ? ",%.2f" : "%.2f", records[i].humidity)) {
+            return -1;
+        }
+    }
+    if (! append(buf, size, pos, "],\"pressure\":[")) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; i ++) {
+        if (! append(buf, size, pos, i ? ",%.2f" : "%.2f", records[i].pressure)) {
+            return -1;
+        }
+    }
+    if (! append(buf, size, pos, "]}")) {
+        return -1;
+    }
+
+    return (int) pos;
+}
+
+size_t TelemetryBatcher::fit(const char *client_name, const TelemetryRecord *records, size_t n, size_t max_payload)
+{
+    while (n) {
+        int len = encode(NULL, 0, client_name, records, n);
+        if (len >= 0 && (size_t) len <= max_payload) {
+            break;
+        }
+        n --;
+    }
+
+    return n;
+}
+
+void TelemetryBatcher::account(size_t samples, size_t payload_len, size_t topic_len)
+{
+    /* PUBLISH QoS1: topic length 2 + topic + packet ID 2 + payload */
+    size_t rem_len = 2 + topic_len + 2 + payload_len;
+    size_t rem_len_bytes = (rem_len < 128) ? 1 : (rem_len < 16384) ? 2 : (rem_len < 2097152) ? 3 : 4;
+
+    _stats.samples += samples;
+    _stats.publishes ++;
+    _stats.payload_bytes += payload_len;
+    _stats.wire_bytes += 1 + rem_len_bytes + rem_len + TLS_RECORD_OVERHEAD;
+}
+
+void TelemetryBatcher::print_stats()
+{
+    printf("** TELEMETRY BATCHER STATS **\n");
+    printf("**** max samples/batch : %d\n", MBED_CONF_MY_MQTT_BATCH_MAX_SAMPLES);
+    printf("**** samples           : %" PRIu32 "\n", _stats.samples);
+    printf("**** publishes         : %" PRIu32 " (%" PRIu32 " samples per publish)\n", _stats.publishes,
+           _stats.publishes ? (_stats.samples / _stats.publishes) : 0);
+    printf("**** payload bytes     : %" PRIu32 " (%" PRIu32 " per sample)\n", _stats.payload_bytes,
+           _stats.samples ? (_stats.payload_bytes / _stats.samples) : 0);
+    printf("**** wire bytes (est.) : %" PRIu32 " (%" PRIu32 " per sample)\n", _stats.wire_bytes,
+           _stats.samples ? (_stats.wire_bytes / _stats.samples) : 0);
+    printf("*****************************\n\n");
+}
+
+void print_telemetry_batcher_stats(void)
+{
+    TelemetryBatcher::print_stats();
+}
@@ -0,0 +1,118 @@
+#ifndef _TELEMETRY_BATCHER_H_
+#define _TELEMETRY_BATCHER_H_
+
+#include "mbed.h"
+#include "TelemetryRecord.h"
+
+/* TelemetryBatcher = accumulate telemetry records into one multi-sample shadow update
+ *
+ * Publishing one record per message pays full MQTT header, topic and TLS record overhead
+ * per sample. Records are accumulated until K samples (batch-max-samples) or T ms
+ * (batch-max-delay-ms) since the first one, whichever comes first, and encoded into one
+ * compact columnar payload:
+ *
+ *   { "state": { "reported": { "clientName": "...", <latest sample>,
+ *     "samples": { "t0": <first timestamp>, "dt": [ ... ],
+ *                  "temperature": [ ... ], "humidity": [ ... ], "pressure": [ ... ] } } } }
+ *
+ * Latest sample is reported as plain fields for shadow readers. Timestamps are delta-coded
+ * against t0. Batch size is further bounded by max_payload, derived from MAX_MQTT_PACKET_SIZE.
+ */
+class TelemetryBatcher
+{
+public:
+    struct Stats {
+        uint32_t    samples;            /**< Samples published */
+        uint32_t    publishes;          /**< Batched publishes */
+        uint32_t    payload_bytes;      /**< MQTT payload bytes */
+        uint32_t    wire_bytes;         /**< Estimated bytes on the wire: payload + MQTT + TLS record overhead */
+    };
+
+    /**
+     * @param[in] client_name   MQTT client ID to report, resolved on connect
+     * @param[in] max_payload   Upper bound of encoded payload length
+     */
+    TelemetryBatcher(const char *client_name, size_t max_payload);
+
+    /**
+     * Add one record to current batch
+     *
+     * @return  false if batch is full by count or payload bound. Flush and add again.
+     */
+    bool add(const TelemetryRecord &record);
+
+    /**
+     * Batch has K samples or the first one has waited for T ms
+     */
+    bool ready() const;
+
+    const TelemetryRecord *records() const
+    {
+        return _records;
+    }
+
+    size_t count() const
+    {
+        return _count;
+    }
+
+    bool empty() const
+    {
+        return _count == 0;
+    }
+
+    void clear()
+    {
+        _count = 0;
+    }
+
+    /**
+     * Encode records into columnar payload
+     *
+     * @param[out] buf  Buffer for payload. NULL to calculate length only.
+     * @return  Payload length excluding null terminator, or negative on encode failure.
+     *          Payload has been truncated if not less than size.
+     */
+    static int encode(char *buf, size_t size, const char *client_name, const TelemetryRecord *records, size_t n);
+
+    /**
+     * Encode just the "samples" member of payload, with the same conventions as encode()
+     */
+    static int encode_samples(char *buf, size_t size, const TelemetryRecord *records, size_t n);
+
+    /**
+     * snprintf at pos of buf and advance pos, or just advance pos with NULL buf
+     */
+    static bool append(char *buf, size_t size, size_t &pos, const char *fmt, ...);
+
+    /**
+     * Number of leading records which fit in max_payload when encoded
+     */
+    static size_t fit(const char *client_name, const TelemetryRecord *records, size_t n, size_t max_payload);
+
+    /**
+     * Account one batched publish for bytes-per-sample statistics
+     */
+    static void account(size_t samples, size_t payload_len, size_t topic_len);
+
+    /**
+     * Accumulated statistics of all batchers
+     */
+    static const Stats &stats()
+    {
+        return _stats;
+    }
+
+    static void print_stats();
+
+private:
+    const char *                _client_name;
+    size_t                      _max_payload;
+    Kernel::Clock::time_point   _first_at;          /**< Time the first record of batch was added */
+    size_t                      _count;
+    TelemetryRecord             _records[MBED_CONF_MY_MQTT_BATCH_MAX_SAMPLES];
+
+    static Stats                _stats;
+};
+
+#endif // _TELEMETRY_BATCHER_H_
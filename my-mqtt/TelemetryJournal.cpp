@@ -0,0 +1,262 @@
+#include "mbed.h"
+#include "TelemetryJournal.h"
+
+#if DEVICE_FLASH
+#include "KVMap.h"
+#endif
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+/* Key for consumed position */
+#define JOURNAL_KEY_HEAD        "tj_head"
+
+/* Key prefix for record slots */
+#define JOURNAL_KEY_SLOT_FMT    "tj_%04" PRIx32
+
+extern "C" {
+    MBED_USED void print_telemetry_journal_stats(void);
+}
+
+TelemetryJournal::Stats TelemetryJournal::_stats;
+
+#if DEVICE_FLASH
+TelemetryJournal::TelemetryJournal(mbed::KVStore *kvstore) :
+    _kvstore(kvstore),
+    _initialized(false),
+    _head_seq(0),
+    _tail_seq(0)
+{
+}
+#else
+TelemetryJournal::TelemetryJournal() :
+    _initialized(false),
+    _head_seq(0),
+    _tail_seq(0)
+{
+}
+#endif
+
+void TelemetryJournal::slot_key(char *key, size_t key_size, uint32_t seq)
+{
+    snprintf(key, key_size, JOURNAL_KEY_SLOT_FMT, (uint32_t) (seq % MBED_CONF_MY_MQTT_JOURNAL_CAPACITY));
+}
+
+int TelemetryJournal::init()
+{
+#if DEVICE_FLASH
+    if (_kvstore == NULL) {
+        /* Internal storage has initialized in provision() */
+        _kvstore = mbed::KVMap::get_instance().get_internal_kv_instance(NULL);
+        if (_kvstore == NULL) {
+            printf("Telemetry journal: kvstore internal storage unavailable\n");
+            return MBED_ERROR_ITEM_NOT_FOUND;
+        }
+    }
+
+    /* Consumed position */
+    uint32_t head_seq = 0;
+    size_t actual_size = 0;
+    int kv_status = _kvstore->get(JOURNAL_KEY_HEAD, &head_seq, sizeof(head_seq), &actual_size);
+    if (kv_status == MBED_ERROR_ITEM_NOT_FOUND) {
+        head_seq = 0;
+    } else if (kv_status != MBED_SUCCESS || actual_size != sizeof(head_seq)) {
+        printf("Telemetry journal: get \'%s\' failed: %d\n", JOURNAL_KEY_HEAD, kv_status);
+        return kv_status;
+    }
+
+    /* Scan slots for the newest record not consumed yet */
+    uint32_t tail_seq = head_seq;
+    for (uint32_t i = 0; i < MBED_CONF_MY_MQTT_JOURNAL_CAPACITY; i ++) {
+        char key[16];
+        Entry entry;
+
+        slot_key(key, sizeof(key), i);
+        kv_status = _kvstore->get(key, &entry, sizeof(entry), &actual_size);
+        if (kv_status != MBED_SUCCESS || actual_size != sizeof(entry)) {
+            continue;
+        }
+        /* Wrap-safe comparison of sequence numbers */
+        if ((int32_t) (entry.seq - head_seq) >= 0 && (int32_t) (entry.seq + 1 - tail_seq) > 0) {
+            tail_seq = entry.seq + 1;
+        }
+    }
+
+    /* Oldest records have been overwritten if more than capacity */
+    if (tail_seq - head_seq > MBED_CONF_MY_MQTT_JOURNAL_CAPACITY) {
+        head_seq = tail_seq - MBED_CONF_MY_MQTT_JOURNAL_CAPACITY;
+    }
+
+    _head_seq = head_seq;
+    _tail_seq = tail_seq;
+    _initialized = true;
+
+    printf("Telemetry journal: %" PRIu32 " records pending\n", pending());
+
+    return MBED_SUCCESS;
+#else
+    return MBED_ERROR_UNSUPPORTED;
+#endif
+}
+
+int TelemetryJournal::append(const TelemetryRecord &record)
+{
+#if DEVICE_FLASH
+    if (! _initialized) {
+        _stats.append_failed ++;
+        return MBED_ERROR_NOT_READY;
+    }
+
+    Timer timer;
+    timer.start();
+
+    char key[16];
+    Entry entry;
+    entry.seq = _tail_seq;
+    entry.record = record;
+
+    slot_key(key, sizeof(key), entry.seq);
+    int kv_status = _kvstore->set(key, &entry, sizeof(entry), 0);
+    if (kv_status != MBED_SUCCESS) {
+        printf("Telemetry journal: set \'%s\' failed: %d\n", key, kv_status);
+        _stats.append_failed ++;
+        return kv_status;
+    }
+
+    _tail_seq ++;
+    if (pending() > MBED_CONF_MY_MQTT_JOURNAL_CAPACITY) {
+        _head_seq = _tail_seq - MBED_CONF_MY_MQTT_JOURNAL_CAPACITY;
+        _stats.overwritten ++;
+    }
+
+    _stats.appended ++;
+    _stats.bytes_written += strlen(key) + sizeof(entry);
+    _stats.append_us += std::chrono::duration_cast<std::chrono::microseconds>(timer.elapsed_time()).count();
+
+    return MBED_SUCCESS;
+#else
+    (void) record;
+    _stats.append_failed ++;
+    return MBED_ERROR_UNSUPPORTED;
+#endif
+}
+
+int TelemetryJournal::peek(TelemetryRecord *records, size_t max, uint32_t *last_seq)
+{
+#if DEVICE_FLASH
+    if (! _initialized) {
+        return MBED_ERROR_NOT_READY;
+    }
+
+    Timer timer;
+    timer.start();
+
+    size_t n = 0;
+    uint32_t seq = _head_seq;
+    while (n < max && seq != _tail_seq) {
+        char key[16];
+        Entry entry;
+        size_t actual_size = 0;
+
+        slot_key(key, sizeof(key), seq);
+        int kv_status = _kvstore->get(key, &entry, sizeof(entry), &actual_size);
+        if (kv_status != MBED_SUCCESS || actual_size != sizeof(entry)) {
+            printf("Telemetry journal: get \'%s\' failed: %d\n", key, kv_status);
+            return (n > 0) ? (int) n : kv_status;
+        }
+        if (entry.seq != seq) {
+            /* Stale slot, e.g. lost by power failure during append. Skip it.
+             * Past records read already, consume_through() skips it. */
+            seq ++;
+            if (n == 0) {
+                _head_seq = seq;
+            }
+            continue;
+        }
+
+        records[n ++] = entry.record;
+        if (last_seq) {
+            *last_seq = seq;
+        }
+        seq ++;
+    }
+
+    _stats.replayed += n;
+    _stats.replay_us += std::chrono::duration_cast<std::chrono::microseconds>(timer.elapsed_time()).count();
+
+    return (int) n;
+#else
+    return MBED_ERROR_UNSUPPORTED;
+#endif
+}
+
+int TelemetryJournal::consume(size_t n)
+{
+    if (n == 0) {
+        return MBED_SUCCESS;
+    }
+
+    return consume_through(_head_seq + (uint32_t) n - 1);
+}
+
+int TelemetryJournal::consume_through(uint32_t last_seq)
+{
+#if DEVICE_FLASH
+    if (! _initialized) {
+        return MBED_ERROR_NOT_READY;
+    }
+
+    /* Wrap-safe distance from head. Behind head: overwritten or consumed already. */
+    int32_t n = (int32_t) (last_seq + 1 - _head_seq);
+    if (n <= 0) {
+        return MBED_SUCCESS;
+    }
+    if ((uint32_t) n > pending()) {
+        n = pending();
+    }
+    if (n == 0) {
+        return MBED_SUCCESS;
+    }
+
+    /* Persist consumed position only. Consumed slots are left to be overwritten. */
+    uint32_t head_seq = _head_seq + n;
+    int kv_status = _kvstore->set(JOURNAL_KEY_HEAD, &head_seq, sizeof(head_seq), 0);
+    if (kv_status != MBED_SUCCESS) {
+        printf("Telemetry journal: set \'%s\' failed: %d\n", JOURNAL_KEY_HEAD, kv_status);
+        return kv_status;
+    }
+
+    _head_seq = head_seq;
+    _stats.consumed += n;
+    _stats.bytes_written += strlen(JOURNAL_KEY_HEAD) + sizeof(head_seq);
+
+    return MBED_SUCCESS;
+#else
+    (void) last_seq;
+    return MBED_ERROR_UNSUPPORTED;
+#endif
+}
+
+void TelemetryJournal::print_stats()
+{
+    printf("** TELEMETRY JOURNAL STATS **\n");
+    printf("**** appended      : %" PRIu32 "\n", _stats.appended);
+    printf("**** overwritten   : %" PRIu32 "\n", _stats.overwritten);
+    printf("**** append failed : %" PRIu32 "\n", _stats.append_failed);
+    printf("**** replayed      : %" PRIu32 "\n", _stats.replayed);
+    printf("**** consumed      : %" PRIu32 "\n", _stats.consumed);
+    printf("**** bytes written : %" PRIu32 " (%" PRIu32 " per record)\n", _stats.bytes_written,
+           _stats.appended ? (_stats.bytes_written / _stats.appended) : 0);
+    printf("**** append rate   : %" PRIu32 " records/s\n",
+           _stats.append_us ? (uint32_t) ((uint64_t) _stats.appended * 1000000 / _stats.append_us) : 0);
+    printf("**** replay rate   : %" PRIu32 " records/s\n",
+           _stats.replay_us ? (uint32_t) ((uint64_t) _stats.replayed * 1000000 / _stats.replay_us) : 0);
+    printf("*****************************\n\n");
+}
+
+void print_telemetry_journal_stats(void)
+{
+    TelemetryJournal::print_stats();
+}
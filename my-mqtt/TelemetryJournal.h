@@ -0,0 +1,138 @@
+#ifndef _TELEMETRY_JOURNAL_H_
+#define _TELEMETRY_JOURNAL_H_
+
+#include "mbed.h"
+#include "TelemetryRecord.h"
+
+#if DEVICE_FLASH
+#include "KVStore.h"
+#endif
+
+/* TelemetryJournal = offline store-and-forward journal of telemetry records
+ *
+ * Telemetry which cannot be published (link down, publish failed) is appended here and
+ * replayed in batches on reconnect. The journal is a circular array of kvstore keys:
+ *
+ * 1. Record of sequence number seq goes to key "tj_<seq % capacity>", together with seq.
+ *    On overflow, the oldest records are overwritten.
+ * 2. Consumed position is kept in key "tj_head" and written once per replayed batch,
+ *    not per record.
+ * 3. No other index is persisted. On init, head/tail are recovered by scanning seq of
+ *    all slots, so append costs exactly one kvstore write.
+ *
+ * With TDBStore underneath (log-structured and wear-leveled by itself), this keeps flash
+ * writes at one record per append plus one small record per batch.
+ *
+ * By default the journal sits on the kvstore internal storage initialized by provision().
+ * Any other KVStore (e.g. TDBStore on a file-backed block device) can be passed in for
+ * measuring append/replay throughput.
+ */
+class TelemetryJournal
+{
+public:
+    struct Stats {
+        uint32_t    appended;           /**< Records appended */
+        uint32_t    overwritten;        /**< Records lost by overflow */
+        uint32_t    append_failed;      /**< Records lost by append failure, e.g. kvstore full or no flash */
+        uint32_t    replayed;           /**< Records read back in batches */
+        uint32_t    consumed;           /**< Records committed as replayed */
+        uint32_t    bytes_written;      /**< Bytes written to kvstore, keys + values */
+        uint32_t    append_us;          /**< Time spent on append */
+        uint32_t    replay_us;          /**< Time spent on reading back batches */
+    };
+
+#if DEVICE_FLASH
+    /**
+     * @param[in] kvstore   KVStore to sit on. NULL for kvstore internal storage.
+     */
+    TelemetryJournal(mbed::KVStore *kvstore = NULL);
+#else
+    TelemetryJournal();
+#endif
+
+    /**
+     * Recover journal position from kvstore
+     *
+     * @return  MBED_SUCCESS, or MBED_ERROR_UNSUPPORTED on targets without flash
+     */
+    int init();
+
+    /**
+     * Append one record
+     *
+     * On full journal, the oldest pending record is overwritten and head moves on, so
+     * appending while a peeked batch is in flight shifts what consume(n) would commit.
+     * Commit a peeked batch with consume_through() instead.
+     */
+    int append(const TelemetryRecord &record);
+
+    /**
+     * Read up to max oldest pending records into caller's buffer without consuming them
+     *
+     * RAM use for replay is bounded by caller's buffer, regardless of journal size.
+     *
+     * @param[out] last_seq Sequence number of the last record read, for consume_through(). NULL if not needed.
+     * @return  Number of records read, or negative error code
+     */
+    int peek(TelemetryRecord *records, size_t max, uint32_t *last_seq = NULL);
+
+    /**
+     * Commit n oldest pending records as replayed
+     */
+    int consume(size_t n);
+
+    /**
+     * Commit pending records up to and including last_seq as replayed
+     *
+     * Clamped to current head: records overwritten since peek() are not committed twice,
+     * and records appended since are not skipped.
+     */
+    int consume_through(uint32_t last_seq);
+
+    /**
+     * Number of pending records
+     */
+    uint32_t pending() const
+    {
+        return _tail_seq - _head_seq;
+    }
+
+    bool empty() const
+    {
+        return pending() == 0;
+    }
+
+    static uint32_t capacity()
+    {
+        return MBED_CONF_MY_MQTT_JOURNAL_CAPACITY;
+    }
+
+    /**
+     * Accumulated statistics of all journals
+     */
+    static const Stats &stats()
+    {
+        return _stats;
+    }
+
+    static void print_stats();
+
+private:
+    struct Entry {
+        uint32_t            seq;
+        TelemetryRecord     record;
+    };
+
+    static void slot_key(char *key, size_t key_size, uint32_t seq);
+
+#if DEVICE_FLASH
+    mbed::KVStore *     _kvstore;
+#endif
+    bool                _initialized;
+    uint32_t            _head_seq;      /**< Sequence number of oldest pending record */
+    uint32_t            _tail_seq;      /**< Sequence number of next record to append */
+
+    static Stats        _stats;
+};
+
+#endif // _TELEMETRY_JOURNAL_H_
@@ -0,0 +1,18 @@
+#ifndef _TELEMETRY_RECORD_H_
+#define _TELEMETRY_RECORD_H_
+
+#include <stdint.h>
+
+/* One sensor sample, passed from sensor side to MQTT network side
+ *
+ * Kept raw (not JSON-formatted) so that the producer never spends time on formatting
+ * and the record stays small and fixed-size for queueing.
+ */
+struct TelemetryRecord {
+    uint32_t    timestamp;      /**< RTC time in seconds */
+    float       temperature;    /**< Temperature in degC */
+    float       humidity;       /**< Relative humidity in % */
+    float       pressure;       /**< Pressure in Pa */
+};
+
+#endif // _TELEMETRY_RECORD_H_
@@ -0,0 +1,197 @@
+#include "mbed.h"
+#include "ConnectionTiming.h"
+
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+#include <stdarg.h>
+
+extern "C" {
+    MBED_USED void print_connection_timing_stats(void);
+}
+
+namespace {
+
+/* Names of phases, also keys in metrics JSON */
+const char *const PHASE_NAMES[] = {
+    "link",
+    "dns",
+    "socket_open",
+    "tcp_connect",
+    /* mbedtls_ssl_states */
+    "tls_hello_request",
+    "tls_client_hello",
+    "tls_server_hello",
+    "tls_server_certificate",
+    "tls_server_key_exchange",
+    "tls_certificate_request",
+    "tls_server_hello_done",
+    "tls_client_certificate",
+    "tls_client_key_exchange",
+    "tls_certificate_verify",
+    "tls_client_change_cipher_spec",
+    "tls_client_finished",
+    "tls_server_change_cipher_spec",
+    "tls_server_finished",
+    "tls_flush_buffers",
+    "tls_handshake_wrapup",
+    "tls_handshake",
+    "mqtt_connack"
+};
+
+/* snprintf() at len of buf, advancing len as if not truncated */
+int append(char *buf, size_t size, size_t &len, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(buf + (len < size ? len : size), len < size ? size - len : 0, format, args);
+    va_end(args);
+
+    if (n > 0) {
+        len += n;
+    }
+
+    return n;
+}
+
+static_assert(sizeof (PHASE_NAMES) / sizeof (PHASE_NAMES[0]) == ConnectionTiming::PHASE_COUNT,
+              "PHASE_NAMES doesn't match ConnectionTiming::Phase");
+
+}
+
+ConnectionTiming::PhaseStats ConnectionTiming::_phases[PHASE_COUNT];
+
+void ConnectionTiming::record(Phase phase, uint32_t ms)
+{
+    if (phase < 0 || phase >= PHASE_COUNT) {
+        return;
+    }
+
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && ms >= (1UL << bucket)) {
+        bucket ++;
+    }
+
+    CriticalSectionLock lock;
+
+    PhaseStats &stats = _phases[phase];
+    stats.count ++;
+    stats.total_ms += ms;
+    stats.last_ms = ms;
+    if (ms > stats.max_ms) {
+        stats.max_ms = ms;
+    }
+    if (stats.buckets[bucket] != UINT16_MAX) {
+        stats.buckets[bucket] ++;
+    }
+}
+
+const char *ConnectionTiming::phase_name(Phase phase)
+{
+    return (phase >= 0 && phase < PHASE_COUNT) ? PHASE_NAMES[phase] : "?";
+}
+
+ConnectionTiming::PhaseStats ConnectionTiming::phase_stats(Phase phase)
+{
+    CriticalSectionLock lock;
+
+    return _phases[phase];
+}
+
+uint32_t ConnectionTiming::percentile(const PhaseStats &stats, int pct)
+{
+    uint32_t total = 0;
+    for (int i = 0; i < BUCKETS; i ++) {
+        total += stats.buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    /* Nearest rank */
+    uint32_t rank = (total * pct + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint32_t seen = 0;
+    for (int i = 0; i < BUCKETS - 1; i ++) {
+        seen += stats.buckets[i];
+        if (seen >= rank) {
+            uint32_t upper = 1UL << i;
+            return upper < stats.max_ms ? upper : stats.max_ms;
+        }
+    }
+
+    return stats.max_ms;
+}
+
+int ConnectionTiming::encode_json(char *buf, size_t size)
+{
+    size_t len = 0;
+    bool first = true;
+
+    /* Phases but TLS states by name. Unrecorded ones are omitted. */
+    if (append(buf, size, len, "{\"phases\":{") < 0) {
+        return -1;
+    }
+    for (int i = 0; i < PHASE_COUNT; i ++) {
+        if (i >= PHASE_TLS_STATE_FIRST && i <= PHASE_TLS_STATE_LAST) {
+            continue;
+        }
+        PhaseStats stats = phase_stats((Phase) i);
+        if (stats.count == 0) {
+            continue;
+        }
+        if (append(buf, size, len, "%s\"%s\":[%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "]",
+                   first ? "" : ",", PHASE_NAMES[i], stats.count,
+                   percentile(stats, 50), percentile(stats, 90), stats.max_ms) < 0) {
+            return -1;
+        }
+        first = false;
+    }
+
+    /* TLS states by index, for compactness */
+    if (append(buf, size, len, "},\"tls_states\":[") < 0) {
+        return -1;
+    }
+    for (int i = PHASE_TLS_STATE_FIRST; i <= PHASE_TLS_STATE_LAST; i ++) {
+        PhaseStats stats = phase_stats((Phase) i);
+        if (append(buf, size, len, "%s[%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "]",
+                   i == PHASE_TLS_STATE_FIRST ? "" : ",", stats.count,
+                   percentile(stats, 50), percentile(stats, 90), stats.max_ms) < 0) {
+            return -1;
+        }
+    }
+    if (append(buf, size, len, "]}") < 0) {
+        return -1;
+    }
+
+    return (int) len;
+}
+
+void ConnectionTiming::print_stats()
+{
+    printf("** CONNECTION TIMING STATS **\n");
+    for (int i = 0; i < PHASE_COUNT; i ++) {
+        PhaseStats stats = phase_stats((Phase) i);
+        if (stats.count == 0) {
+            continue;
+        }
+        printf("**** %s: count %" PRIu32 ", avg/p50/p90/max %" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 " ms\n",
+               PHASE_NAMES[i], stats.count, stats.total_ms / stats.count,
+               percentile(stats, 50), percentile(stats, 90), stats.max_ms);
+    }
+    printf("*****************************\n\n");
+}
+
+void print_connection_timing_stats(void)
+{
+    ConnectionTiming::print_stats();
+}
+
+#endif  // MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
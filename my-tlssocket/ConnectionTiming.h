@@ -0,0 +1,98 @@
+#ifndef _CONNECTION_TIMING_H_
+#define _CONNECTION_TIMING_H_
+
+#include "mbed.h"
+#include "mbedtls/ssl.h"
+
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+
+/* ConnectionTiming = process-wide histograms of connection phase durations
+ *
+ * Each phase of bringing up a connection is timed by whoever runs it and recorded here:
+ *
+ *   link, DNS, MQTT CONNACK    by the application
+ *   socket open, TCP connect   by MyTLSSocket
+ *   TLS handshake states       by MyTLSSocket, from SSL context state sampled on each send/recv
+ *
+ * Per phase, durations go into a fixed-size log2 histogram in ms: bucket i counts durations
+ * below 2^i ms, the last bucket the rest. Percentiles are reported as bucket upper bound.
+ *
+ * A TLS state is charged with the time from its first send/recv until the next state's,
+ * i.e. its network wait plus processing of the message(s) received, e.g. certificate chain
+ * verification under tls_server_certificate.
+ */
+class ConnectionTiming
+{
+public:
+    enum Phase {
+        PHASE_LINK = 0,             /**< Network interface connect */
+        PHASE_DNS,
+        PHASE_SOCKET_OPEN,
+        PHASE_TCP_CONNECT,
+        PHASE_TLS_STATE_FIRST,      /**< mbedtls_ssl_states from here */
+        PHASE_TLS_STATE_LAST = PHASE_TLS_STATE_FIRST + MBEDTLS_SSL_HANDSHAKE_WRAPUP,
+        PHASE_TLS_HANDSHAKE,        /**< Whole handshake */
+        PHASE_MQTT_CONNACK,         /**< MQTT CONNECT sent to CONNACK received */
+        PHASE_COUNT
+    };
+
+    static const int BUCKETS = 16;
+
+    struct PhaseStats {
+        uint32_t    count;
+        uint32_t    total_ms;
+        uint32_t    last_ms;
+        uint32_t    max_ms;
+        uint16_t    buckets[BUCKETS];   /**< Saturating counts */
+    };
+
+    /**
+     * Record duration of phase
+     */
+    static void record(Phase phase, uint32_t ms);
+
+    static void record(Phase phase, std::chrono::microseconds elapsed)
+    {
+        record(phase, (uint32_t) std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+    }
+
+    /**
+     * Phase of TLS handshake state
+     */
+    static Phase tls_state_phase(int state)
+    {
+        return (Phase) (PHASE_TLS_STATE_FIRST + state);
+    }
+
+    static const char *phase_name(Phase phase);
+
+    /**
+     * Copy of phase stats, consistent against concurrent record()
+     */
+    static PhaseStats phase_stats(Phase phase);
+
+    /**
+     * Percentile (0~100) of phase, as upper bound of the bucket it falls in
+     */
+    static uint32_t percentile(const PhaseStats &stats, int pct);
+
+    /**
+     * Encode phases recorded so far as JSON for metrics topic
+     *
+     * {"phases":{"<name>":[count,p50,p90,max],...},"tls_states":[[count,p50,p90,max],...]} in ms
+     *
+     * "tls_states" is indexed by mbedtls_ssl_states, to fit in one MQTT packet.
+     *
+     * @return  Length as snprintf(), i.e. truncated if not less than size
+     */
+    static int encode_json(char *buf, size_t size);
+
+    static void print_stats();
+
+private:
+    static PhaseStats   _phases[PHASE_COUNT];
+};
+
+#endif  // MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+
+#endif // _CONNECTION_TIMING_H_
@@ -1,31 +1,634 @@
 #include "mbed.h"
 #include "MyTLSSocket.h"
 
-MyTLSSocket::MyTLSSocket()
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+extern "C" {
+    MBED_USED void print_tls_handshake_stats(void);
+    MBED_USED void print_tls_read_ahead_stats(void);
+    MBED_USED void print_tls_write_combine_stats(void);
+}
+
+using namespace std::chrono_literals;
+
+namespace {
+
+/* Poll of connect_async(), in case sigio event is missed */
+const auto ASYNC_POLL_PERIOD = 500ms;
+
+/* Events posted per connect_async(): one step and one poll. Also idle eviction of HttpsConnectionPool. */
+const int HANDSHAKE_QUEUE_EVENTS = 8;
+
+}
+
+MyTLSSocket::HandshakeStats MyTLSSocket::_handshake_stats;
+MyTLSSocket::ReadAheadStats MyTLSSocket::_read_ahead_stats;
+MyTLSSocket::WriteCombineStats MyTLSSocket::_write_combine_stats;
+
+MyTLSSocket::MyTLSSocket() :
+    TLSSocketWrapper(&_tcp_socket),
+    _tcp_socket(*this),
+    _hostname(NULL),
+    _connect_pending(false),
+    _handshake_pending(false),
+    _handshake_started(false),
+    _async_queue(NULL),
+    _async_poll_id(0),
+    _async_step_id(0),
+    _async_step_posted(false)
+    , _port(0)
+    , _session_offered(false)
+#if MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+    , _cert_pinned(false)
+    , _cert_checked(false)
+#endif
+#if MBED_CONF_MY_TLSSOCKET_TLS_READ_AHEAD_SIZE > 0
+    , _read_ahead_pos(0)
+    , _read_ahead_len(0)
+#endif
+#if MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE > 0
+    , _combine_buf(NULL)
+    , _combine_len(0)
+    , _combine_timeout(0)
+#endif
 {
     /* TLSSocket prints debug message thru mbed-trace. We override it and print thru STDIO. */
+#if MBED_CONF_MY_TLSSOCKET_TLS_DEBUG_LEVEL > 0 || MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+    mbedtls_ssl_conf_verify(get_ssl_config(), verify, this);
+#endif
 #if MBED_CONF_MY_TLSSOCKET_TLS_DEBUG_LEVEL > 0
-    mbedtls_ssl_conf_verify(get_ssl_config(), my_verify, this);
     mbedtls_ssl_conf_dbg(get_ssl_config(), my_debug, this);
     mbedtls_debug_set_threshold(MBED_CONF_MY_TLSSOCKET_TLS_DEBUG_LEVEL);
 #endif
 
     /* Enable RFC 6066 max_fragment_length extension in SSL */
 #if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH) && (MBED_CONF_MY_TLSSOCKET_TLS_MAX_FRAG_LEN > 0)
-    mbedtls_ssl_conf_max_frag_len(get_ssl_config(), MBED_CONF_MY_TLSSOCKET_TLS_MAX_FRAG_LEN);
+    /* Refused above the smaller of IN and OUT content length, see mbedtls_user_config.h */
+    int ret = mbedtls_ssl_conf_max_frag_len(get_ssl_config(), MBED_CONF_MY_TLSSOCKET_TLS_MAX_FRAG_LEN);
+    if (ret != 0) {
+        printf("TLS max fragment length %d refused with %d: IN/OUT content %d/%d. Extension not sent.\n",
+               MBED_CONF_MY_TLSSOCKET_TLS_MAX_FRAG_LEN, ret, MBEDTLS_SSL_IN_CONTENT_LEN, MBEDTLS_SSL_OUT_CONTENT_LEN);
+    }
 #endif
 }
 
 MyTLSSocket::~MyTLSSocket()
 {
+    /* Destroyed with connect_async() pending. Don't call back. */
+    if (_async_queue) {
+        _async_callback = nullptr;
+        async_done(NSAPI_ERROR_NO_SOCKET);
+    }
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_HEAP_TRACKING && defined(MBEDTLS_PLATFORM_MEMORY)
+    /* Destroyed with connect in progress */
+    if (_connect_pending) {
+        TLSHeapTracker::end(_heap_session, false);
+    }
+#endif
+
+    /* Transport is our member. Close it before it is destroyed, as TLSSocket does. */
+    close();
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE > 0
+    delete [] _combine_buf;
+#endif
+}
+
+nsapi_error_t MyTLSSocket::close()
+{
+#if MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE > 0
+    /* E.g. MQTT DISCONNECT */
+    if (_combine_len) {
+        flush(_combine_timeout);
+        _combine_len = 0;
+    }
+#endif
+
+    return TLSSocketWrapper::close();
+}
+
+nsapi_error_t MyTLSSocket::open(NetworkStack *stack)
+{
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+    auto start = HighResClock::now();
+    nsapi_error_t rc = _tcp_socket.open(stack);
+    if (rc == NSAPI_ERROR_OK) {
+        ConnectionTiming::record(ConnectionTiming::PHASE_SOCKET_OPEN,
+                                 std::chrono::duration_cast<std::chrono::microseconds>(HighResClock::now() - start));
+    }
+    return rc;
+#else
+    return _tcp_socket.open(stack);
+#endif
+}
+
+void MyTLSSocket::set_hostname(const char *hostname)
+{
+    _hostname = hostname;
+    TLSSocketWrapper::set_hostname(hostname);
+}
+
+nsapi_error_t MyTLSSocket::set_root_ca_cert(const void *root_ca, size_t len)
+{
+    TLSCredentialStore &store = TLSCredentialStore::get_instance();
+
+    int ret = store.set_root_ca_cert(root_ca, len);
+    if (ret != 0) {
+        print_mbedtls_error("mbedtls_x509_crt_parse", ret);
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    /* Referenced, not owned by TLSSocketWrapper */
+    set_ca_chain(store.ca_chain());
+
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t MyTLSSocket::set_root_ca_cert(const char *root_ca_pem)
+{
+    return set_root_ca_cert(root_ca_pem, strlen(root_ca_pem) + 1);
+}
+
+nsapi_error_t MyTLSSocket::set_client_cert_key(const void *client_cert, size_t client_cert_len,
+                                               const void *client_private_key, size_t client_private_key_len)
+{
+    TLSCredentialStore &store = TLSCredentialStore::get_instance();
+
+    int ret = store.set_client_cert_key(client_cert, client_cert_len, client_private_key, client_private_key_len);
+    if (ret != 0) {
+        print_mbedtls_error("mbedtls_x509_crt_parse/mbedtls_pk_parse_key", ret);
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    /* Referenced, not owned by TLSSocketWrapper */
+    set_own_cert(store.client_cert());
+    ret = mbedtls_ssl_conf_own_cert(get_ssl_config(), store.client_cert(), store.client_key());
+    if (ret != 0) {
+        print_mbedtls_error("mbedtls_ssl_conf_own_cert", ret);
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t MyTLSSocket::set_client_cert_key(const char *client_cert_pem, const char *client_private_key_pem)
+{
+    return set_client_cert_key(client_cert_pem, strlen(client_cert_pem) + 1,
+                               client_private_key_pem, strlen(client_private_key_pem) + 1);
+}
+
+nsapi_error_t MyTLSSocket::connect(const SocketAddress &address)
+{
+    /* First call of possibly non-blocking connect */
+    if (! _connect_pending) {
+        _connect_pending = true;
+        _handshake_pending = true;
+        _handshake_started = false;
+        _session_offered = false;
+        _port = address.get_port();
+#if MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE > 0
+        _connect_at = Kernel::Clock::now();
+#endif
+#if MBED_CONF_MY_TLSSOCKET_TLS_HEAP_TRACKING && defined(MBEDTLS_PLATFORM_MEMORY)
+        TLSHeapTracker::begin(_heap_session);
+#endif
+    }
+
+    auto call_at = HighResClock::now();
+    nsapi_error_t rc = TLSSocketWrapper::connect(address);
+
+    /* Non-blocking handshake runs in pieces. Count time in them only, not waits between. */
+    if (_handshake_started) {
+        auto now = HighResClock::now();
+        _handshake_busy += std::chrono::duration_cast<std::chrono::microseconds>(now - (_handshake_at > call_at ? _handshake_at : call_at));
+    }
+
+    if (rc == NSAPI_ERROR_IN_PROGRESS || rc == NSAPI_ERROR_ALREADY || rc == NSAPI_ERROR_WOULD_BLOCK) {
+        return rc;
+    }
+
+    _connect_pending = false;
+    _handshake_pending = false;
+
+    /* Non-blocking handshake completes with NSAPI_ERROR_IS_CONNECTED on later call */
+    bool connected = (rc == NSAPI_ERROR_OK || rc == NSAPI_ERROR_IS_CONNECTED) && _handshake_started;
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+    /* Resumed handshake has no chain to check, but offered session may have been refused */
+    if (connected && _cert_checked) {
+        uint32_t cert_ms = 0;
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+        cert_ms = _tls_state_us[MBEDTLS_SSL_SERVER_CERTIFICATE] / 1000;
+#endif
+        TLSCertPinning::get_instance().handshake_done(_hostname, _port, _cert_pinned, _cert_fingerprint, cert_ms);
+    }
+    _cert_pinned = false;
+    _cert_checked = false;
+#endif
+
+    if (connected) {
+        handshake_done();
+    }
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_HEAP_TRACKING && defined(MBEDTLS_PLATFORM_MEMORY)
+    TLSHeapTracker::end(_heap_session, connected);
+    if (connected) {
+        const TLSHeapTracker::Stats &heap_stats = TLSHeapTracker::stats();
+        printf("TLS heap: handshake peak %" PRIu32 ", steady %" PRIu32 " bytes\n",
+               heap_stats.handshake_peak_last, heap_stats.steady_last);
+    }
+#endif
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE > 0
+    if (connected) {
+        uint32_t handshake_ms = std::chrono::duration_cast<std::chrono::milliseconds>(Kernel::Clock::now() - _connect_at).count();
+        TLSSessionCache::get_instance().handshake_done(_hostname, _port, get_ssl_context(), _session_offered, handshake_ms);
+    } else if (rc != NSAPI_ERROR_IS_CONNECTED) {
+        TLSSessionCache::get_instance().handshake_failed(_hostname, _port);
+    }
+#endif
+
+    return rc;
+}
+
+nsapi_error_t MyTLSSocket::connect_async(const SocketAddress &address, ConnectCallback done, events::EventQueue *queue)
+{
+    if (_async_queue) {
+        return NSAPI_ERROR_ALREADY;
+    }
+    if (queue == NULL) {
+        queue = handshake_queue();
+        if (queue == NULL) {
+            return NSAPI_ERROR_NO_MEMORY;
+        }
+    }
+
+    _async_callback = done;
+    _async_address = address;
+    _async_deadline = Kernel::Clock::now() + std::chrono::milliseconds(MBED_CONF_MY_TLSSOCKET_ASYNC_CONNECT_TIMEOUT);
+    _async_step_id = 0;
+    _async_step_posted = false;
+
+    _async_poll_id = queue->call_every(ASYNC_POLL_PERIOD, callback(this, &MyTLSSocket::async_event));
+    if (_async_poll_id == 0) {
+        _async_callback = nullptr;
+        return NSAPI_ERROR_NO_MEMORY;
+    }
+    _async_queue = queue;
+
+    /* Transport is non-blocking for TCP connect too. Its events come to us until
+     * TLSSocketWrapper attaches its own on handshake start, and then thru socket sigio. */
+    set_blocking(false);
+    _tcp_socket.set_blocking(false);
+    sigio(callback(this, &MyTLSSocket::async_event));
+    _tcp_socket.TCPSocket::sigio(callback(this, &MyTLSSocket::async_event));
+
+    /* First step on queue too, so done is always called there */
+    async_event();
+
+    return NSAPI_ERROR_IN_PROGRESS;
+}
+
+events::EventQueue *MyTLSSocket::handshake_queue()
+{
+    static events::EventQueue queue(HANDSHAKE_QUEUE_EVENTS * EVENTS_EVENT_SIZE);
+    static Thread thread(osPriorityNormal, MBED_CONF_MY_TLSSOCKET_HANDSHAKE_THREAD_STACK_SIZE, NULL, "tls_handshake");
+    static bool started = (thread.start(callback(&queue, &events::EventQueue::dispatch_forever)) == osOK);
+
+    return started ? &queue : NULL;
+}
+
+void MyTLSSocket::async_event()
+{
+    CriticalSectionLock lock;
+
+    /* Coalesce events until step runs */
+    if (_async_queue == NULL || _async_step_posted) {
+        return;
+    }
+
+    _async_step_id = _async_queue->call(callback(this, &MyTLSSocket::async_step));
+    _async_step_posted = (_async_step_id != 0);
+}
+
+void MyTLSSocket::async_step()
+{
+    {
+        CriticalSectionLock lock;
+
+        if (_async_queue == NULL) {
+            return;
+        }
+        _async_step_id = 0;
+        _async_step_posted = false;
+    }
+
+    nsapi_error_t rc = connect(_async_address);
+
+    if (rc == NSAPI_ERROR_IN_PROGRESS || rc == NSAPI_ERROR_ALREADY || rc == NSAPI_ERROR_WOULD_BLOCK) {
+        if (Kernel::Clock::now() < _async_deadline) {
+            return;
+        }
+        rc = NSAPI_ERROR_TIMEOUT;
+    } else if (rc == NSAPI_ERROR_IS_CONNECTED) {
+        rc = NSAPI_ERROR_OK;
+    }
+
+    async_done(rc);
+}
+
+void MyTLSSocket::async_done(nsapi_error_t rc)
+{
+    events::EventQueue *queue;
+    int poll_id, step_id;
+
+    /* Detach before cancel, so nothing is posted after */
+    sigio(nullptr);
+    if (! _handshake_started) {
+        _tcp_socket.TCPSocket::sigio(nullptr);
+    }
+    {
+        CriticalSectionLock lock;
+
+        queue = _async_queue;
+        poll_id = _async_poll_id;
+        step_id = _async_step_id;
+        _async_queue = NULL;
+        _async_poll_id = _async_step_id = 0;
+        _async_step_posted = false;
+    }
+    queue->cancel(poll_id);
+    if (step_id) {
+        queue->cancel(step_id);
+    }
+
+    ConnectCallback done = _async_callback;
+    _async_callback = nullptr;
+    if (done) {
+        done(rc);
+    }
+}
+
+void MyTLSSocket::handshake_starting()
+{
+    if (! _handshake_pending) {
+        return;
+    }
+    _handshake_pending = false;
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE > 0
+    _session_offered = TLSSessionCache::get_instance().offer(_hostname, _port, get_ssl_context());
+#endif
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+    /* Chain pinned: withhold root CA from this handshake, so the chain isn't built up to it,
+     * and verify() compares it with pin instead. Offered session may be refused, so this
+     * goes for offered session too. */
+    _cert_checked = false;
+    _cert_pinned = TLSCertPinning::get_instance().pinned(_hostname, _port);
+#if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
+    if (_cert_pinned) {
+        /* Empty, as by mbedtls_x509_crt_init() */
+        static mbedtls_x509_crt no_ca;
+        mbedtls_ssl_set_hs_ca_chain(get_ssl_context(), &no_ca, NULL);
+    }
+#endif
+#endif
+
+    _handshake_started = true;
+    _handshake_busy = std::chrono::microseconds::zero();
+    _handshake_io = std::chrono::microseconds::zero();
+    _handshake_at = HighResClock::now();
+
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+    memset(_tls_state_us, 0, sizeof (_tls_state_us));
+    _tls_states_seen = 0;
+    _tls_state = -1;
+    sample_tls_state(_handshake_at);
+#endif
+}
+
+HighResClock::time_point MyTLSSocket::handshake_io_start()
+{
+    auto now = HighResClock::now();
+
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+    sample_tls_state(now);
+#endif
+
+    return now;
+}
+
+void MyTLSSocket::handshake_io_done(HighResClock::time_point start)
+{
+    auto now = HighResClock::now();
+
+    _handshake_io += std::chrono::duration_cast<std::chrono::microseconds>(now - start);
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+    sample_tls_state(now);
+#endif
+}
+
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+void MyTLSSocket::sample_tls_state(HighResClock::time_point now)
+{
+    /* Charge time since last sample to state then */
+    if (_tls_state >= 0 && _tls_state <= MBEDTLS_SSL_HANDSHAKE_WRAPUP) {
+        _tls_state_us[_tls_state] += std::chrono::duration_cast<std::chrono::microseconds>(now - _tls_state_at).count();
+        _tls_states_seen |= 1UL << _tls_state;
+    }
+
+    _tls_state = get_ssl_context()->state;
+    _tls_state_at = now;
+}
+#endif
+
+void MyTLSSocket::handshake_done()
+{
+    auto now = HighResClock::now();
+    auto elapsed = now - _handshake_at;
+    uint32_t handshake_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+    uint32_t crypto_ms = std::chrono::duration_cast<std::chrono::milliseconds>(_handshake_busy - _handshake_io).count();
+
+    _handshake_stats.handshakes ++;
+    _handshake_stats.handshake_ms_total += handshake_ms;
+    _handshake_stats.crypto_ms_total += crypto_ms;
+    _handshake_stats.crypto_ms_last = crypto_ms;
+    if (crypto_ms > _handshake_stats.crypto_ms_max) {
+        _handshake_stats.crypto_ms_max = crypto_ms;
+    }
+
+    const char *kind = "";
+#if MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE > 0
+    kind = _session_offered ? " (resumption offered)" : " (full)";
+#endif
+    printf("TLS handshake%s: %" PRIu32 " ms, %" PRIu32 " ms out of network I/O\n", kind, handshake_ms, crypto_ms);
+
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+    sample_tls_state(now);
+    for (int state = 0; state <= MBEDTLS_SSL_HANDSHAKE_WRAPUP; state ++) {
+        if (_tls_states_seen & (1UL << state)) {
+            ConnectionTiming::record(ConnectionTiming::tls_state_phase(state), _tls_state_us[state] / 1000);
+        }
+    }
+    ConnectionTiming::record(ConnectionTiming::PHASE_TLS_HANDSHAKE, handshake_ms);
+#endif
+}
+
+void MyTLSSocket::print_handshake_stats()
+{
+    const HandshakeStats &stats = _handshake_stats;
+    uint32_t handshake_avg = stats.handshakes ? (stats.handshake_ms_total / stats.handshakes) : 0;
+    uint32_t crypto_avg = stats.handshakes ? (stats.crypto_ms_total / stats.handshakes) : 0;
+
+    printf("** TLS HANDSHAKE STATS **\n");
+    printf("**** crypto profile : %d (%s)\n", MBED_CONF_MY_TLSSOCKET_TLS_CRYPTO_PROFILE,
+           MBED_CONF_MY_TLSSOCKET_TLS_CRYPTO_PROFILE == 1 ? "ECDHE-ECDSA P-256" : "default");
+    printf("**** handshakes     : %" PRIu32 "\n", stats.handshakes);
+    printf("**** elapsed        : avg %" PRIu32 " ms\n", handshake_avg);
+    printf("**** out of I/O     : avg %" PRIu32 " ms, last %" PRIu32 " ms, max %" PRIu32 " ms\n",
+           crypto_avg, stats.crypto_ms_last, stats.crypto_ms_max);
+    printf("*************************\n\n");
+}
+
+void MyTLSSocket::Transport::sigio(mbed::Callback<void()> func)
+{
+    /* Attached by TLSSocketWrapper::start_handshake() between mbedtls_ssl_setup() and handshake */
+    if (func) {
+        _owner.handshake_starting();
+    }
+
+    TCPSocket::sigio(func);
+}
+
+nsapi_error_t MyTLSSocket::Transport::connect(const SocketAddress &address)
+{
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+    if (! _connect_in_progress) {
+        _connect_at = HighResClock::now();
+    }
+#endif
+
+    nsapi_error_t rc = TCPSocket::connect(address);
+
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+    if (rc == NSAPI_ERROR_IN_PROGRESS || rc == NSAPI_ERROR_ALREADY || rc == NSAPI_ERROR_WOULD_BLOCK) {
+        _connect_in_progress = true;
+        return rc;
+    }
+
+    /* Non-blocking connect completes with NSAPI_ERROR_IS_CONNECTED */
+    if (rc == NSAPI_ERROR_OK || (rc == NSAPI_ERROR_IS_CONNECTED && _connect_in_progress)) {
+        ConnectionTiming::record(ConnectionTiming::PHASE_TCP_CONNECT,
+                                 std::chrono::duration_cast<std::chrono::microseconds>(HighResClock::now() - _connect_at));
+    }
+    _connect_in_progress = false;
+#endif
+
+    return rc;
+}
+
+nsapi_size_or_error_t MyTLSSocket::Transport::send(const void *data, nsapi_size_t size)
+{
+    if (! _owner.handshake_timing()) {
+        return TCPSocket::send(data, size);
+    }
+
+    auto start = _owner.handshake_io_start();
+    nsapi_size_or_error_t rc = TCPSocket::send(data, size);
+    _owner.handshake_io_done(start);
+
+    return rc;
+}
+
+nsapi_size_or_error_t MyTLSSocket::Transport::recv(void *data, nsapi_size_t size)
+{
+    if (! _owner.handshake_timing()) {
+        return TCPSocket::recv(data, size);
+    }
+
+    auto start = _owner.handshake_io_start();
+    nsapi_size_or_error_t rc = TCPSocket::recv(data, size);
+    _owner.handshake_io_done(start);
+
+    return rc;
 }
 
 int MyTLSSocket::read(unsigned char* buffer, int len, int timeout)
 {
+#if MBED_CONF_MY_TLSSOCKET_TLS_READ_AHEAD_SIZE > 0
+    core_util_atomic_incr_u32(&_read_ahead_stats.reads, 1);
+
+    int n = read_buffered(buffer, len);
+    if (n == len) {
+#if MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE > 0
+        if (flush_due() && flush(timeout) < 0) {
+            return -1;
+        }
+#endif
+        core_util_atomic_incr_u32(&_read_ahead_stats.reads_buffered, 1);
+        core_util_atomic_incr_u32(&_read_ahead_stats.bytes, n);
+        return n;
+    }
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE > 0
+    /* About to wait for input, maybe response to what is held */
+    if (_combine_len && flush(timeout) < 0) {
+        return -1;
+    }
+#endif
+
+    /* Rest within timeout. A record may come in pieces. */
+    auto deadline = Kernel::Clock::now() + std::chrono::milliseconds(timeout);
+    while (n < len) {
+        auto now = Kernel::Clock::now();
+        set_timeout(now < deadline ? std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() : 0);
+
+        int rc;
+        if (len - n >= (int) sizeof (_read_ahead)) {
+            /* No gain of buffering. Straight to caller. */
+            rc = recv(buffer + n, len - n);
+        } else {
+            rc = recv(_read_ahead, sizeof (_read_ahead));
+            if (rc > 0) {
+                _read_ahead_pos = 0;
+                _read_ahead_len = rc;
+                rc = read_buffered(buffer + n, len - n);
+            }
+        }
+        core_util_atomic_incr_u32(&_read_ahead_stats.recvs, 1);
+
+        if (rc > 0) {
+            n += rc;
+        } else if (rc == 0 || rc == NSAPI_ERROR_WOULD_BLOCK) {
+            break;
+        } else {
+            printf("TLSSocket recv(%d) failed with %d\n", len - n, rc);
+            return -1;
+        }
+    }
+
+    core_util_atomic_incr_u32(&_read_ahead_stats.bytes, n);
+    return n;
+#else
+#if MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE > 0
+    /* About to wait for input, maybe response to what is held */
+    if (_combine_len && flush(timeout) < 0) {
+        return -1;
+    }
+#endif
+
     set_timeout(timeout);
 
+    core_util_atomic_incr_u32(&_read_ahead_stats.reads, 1);
+    core_util_atomic_incr_u32(&_read_ahead_stats.recvs, 1);
     int rc = recv(buffer, len);
     if (rc >= 0) {
+        core_util_atomic_incr_u32(&_read_ahead_stats.bytes, rc);
         return rc;
     } else if (rc == NSAPI_ERROR_WOULD_BLOCK) {
         return 0;
@@ -33,10 +636,132 @@ int MyTLSSocket::read(unsigned char* buffer, int len, int timeout)
         printf("TLSSocket recv(%d) failed with %d\n", len, rc);
         return -1;
     }
+#endif
+}
+
+nsapi_error_t MyTLSSocket::set_write_combining(bool enable)
+{
+#if MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE > 0
+    if (enable) {
+        if (_combine_buf == NULL) {
+            _combine_buf = new (std::nothrow) unsigned char[MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE];
+            if (_combine_buf == NULL) {
+                return NSAPI_ERROR_NO_MEMORY;
+            }
+            _combine_len = 0;
+        }
+    } else if (_combine_buf) {
+        int rc = flush(_combine_timeout);
+        delete [] _combine_buf;
+        _combine_buf = NULL;
+        _combine_len = 0;
+        if (rc < 0) {
+            return NSAPI_ERROR_NO_CONNECTION;
+        }
+    }
+
+    return NSAPI_ERROR_OK;
+#else
+    return enable ? NSAPI_ERROR_UNSUPPORTED : NSAPI_ERROR_OK;
+#endif
+}
+
+int MyTLSSocket::flush(int timeout)
+{
+#if MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE > 0
+    if (_combine_len == 0) {
+        return 0;
+    }
+
+    set_timeout(timeout);
+
+    int sent = 0;
+    while (sent < _combine_len) {
+        int rc = send(_combine_buf + sent, _combine_len - sent);
+        if (rc <= 0) {
+            printf("TLSSocket send(%d) of held writes failed with %d\n", _combine_len - sent, rc);
+            _combine_len = 0;
+            return -1;
+        }
+        sent += rc;
+    }
+
+    core_util_atomic_incr_u32(&_write_combine_stats.flushes, 1);
+    core_util_atomic_incr_u32(&_write_combine_stats.flush_bytes, sent);
+    _combine_len = 0;
+#endif
+
+    return 0;
+}
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_READ_AHEAD_SIZE > 0
+int MyTLSSocket::read_buffered(unsigned char *buffer, int len)
+{
+    int n = _read_ahead_len - _read_ahead_pos;
+    if (n > len) {
+        n = len;
+    }
+    if (n > 0) {
+        memcpy(buffer, _read_ahead + _read_ahead_pos, n);
+        _read_ahead_pos += n;
+    }
+
+    return n;
+}
+#endif
+
+void MyTLSSocket::print_read_ahead_stats()
+{
+    ReadAheadStats stats = _read_ahead_stats;
+
+    printf("** TLS READ-AHEAD STATS **\n");
+    printf("**** buffer size    : %d\n", MBED_CONF_MY_TLSSOCKET_TLS_READ_AHEAD_SIZE);
+    printf("**** reads          : %" PRIu32 ", %" PRIu32 " from buffer only\n", stats.reads, stats.reads_buffered);
+    printf("**** recvs          : %" PRIu32 ", saved %" PRIu32 "\n", stats.recvs,
+           stats.reads > stats.recvs ? stats.reads - stats.recvs : 0);
+    printf("**** bytes          : %" PRIu32 "\n", stats.bytes);
+    printf("**************************\n\n");
+}
+
+void MyTLSSocket::print_write_combine_stats()
+{
+    WriteCombineStats stats = _write_combine_stats;
+
+    printf("** TLS WRITE-COMBINE STATS **\n");
+    printf("**** buffer/delay   : %d bytes/%d ms\n", MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE, MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_DELAY);
+    printf("**** writes         : %" PRIu32 ", %" PRIu32 " held\n", stats.writes, stats.writes_held);
+    printf("**** records        : %" PRIu32 " of %" PRIu32 " bytes, saved %" PRIu32 "\n", stats.flushes, stats.flush_bytes,
+           stats.writes_held > stats.flushes ? stats.writes_held - stats.flushes : 0);
+    printf("*****************************\n\n");
 }
 
 int MyTLSSocket::write(unsigned char* buffer, int len, int timeout)
 {
+#if MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE > 0
+    if (_combine_buf) {
+        core_util_atomic_incr_u32(&_write_combine_stats.writes, 1);
+
+        /* Oldest held too long, or no room */
+        if (flush_due() || (_combine_len && _combine_len + len > MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE)) {
+            if (flush(timeout) < 0) {
+                return -1;
+            }
+        }
+
+        /* Hold if fits. Otherwise, it goes on its own. */
+        if (len < MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE) {
+            if (_combine_len == 0) {
+                _combine_at = Kernel::Clock::now();
+            }
+            memcpy(_combine_buf + _combine_len, buffer, len);
+            _combine_len += len;
+            _combine_timeout = timeout;
+            core_util_atomic_incr_u32(&_write_combine_stats.writes_held, 1);
+            return len;
+        }
+    }
+#endif
+
     set_timeout(timeout);
 
     int rc = send(buffer, len);
@@ -50,6 +775,48 @@ int MyTLSSocket::write(unsigned char* buffer, int len, int timeout)
     }
 }
 
+#if MBED_CONF_MY_TLSSOCKET_TLS_DEBUG_LEVEL > 0 || MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+int MyTLSSocket::verify(void *data, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
+{
+    int ret = 0;
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+    ret = static_cast<MyTLSSocket *>(data)->verify_pin(crt, depth, flags);
+#endif
+#if MBED_CONF_MY_TLSSOCKET_TLS_DEBUG_LEVEL > 0
+    /* Flags as left to Mbed TLS */
+    my_verify(data, crt, depth, flags);
+#endif
+
+    return ret;
+}
+#endif
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+int MyTLSSocket::verify_pin(const mbedtls_x509_crt *crt, int depth, uint32_t *flags)
+{
+    /* Root CA withheld for pinned chain. Only the pin at depth 0 can pass it then. */
+    if (_cert_pinned) {
+        *flags &= ~MBEDTLS_X509_BADCERT_NOT_TRUSTED;
+    }
+    if (depth != 0) {
+        return 0;
+    }
+
+    /* Leaf heads the chain as the server has sent it, whether or not built up to root CA */
+    if (TLSCertPinning::fingerprint(crt, _cert_fingerprint) != 0) {
+        return _cert_pinned ? MBEDTLS_ERR_X509_CERT_VERIFY_FAILED : 0;
+    }
+    if (_cert_pinned && ! TLSCertPinning::get_instance().match(_hostname, _port, _cert_fingerprint)) {
+        printf("TLS server certificate chain doesn't match pinned one\n");
+        return MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+    }
+    _cert_checked = true;
+
+    return 0;
+}
+#endif
+
 #if MBED_CONF_MY_TLSSOCKET_TLS_DEBUG_LEVEL > 0
 void MyTLSSocket::my_debug(void *ctx, int level, const char *file, int line,
                            const char *str)
@@ -69,23 +836,46 @@ void MyTLSSocket::my_debug(void *ctx, int level, const char *file, int line,
 
 int MyTLSSocket::my_verify(void *data, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
 {
-    const uint32_t buf_size = 1024;
-    char *buf = new char[buf_size];
-    MyTLSSocket *tlssocket = static_cast<MyTLSSocket *>(data);
+    /* Static rather than on heap per certificate. Shared by handshakes on other threads. */
+    static char buf[1024];
+    static SingletonPtr<PlatformMutex> buf_mutex;
+
+    buf_mutex->lock();
 
     printf("\nVerifying certificate at depth %d:\n", depth);
-    mbedtls_x509_crt_info(buf, buf_size - 1, "  ", crt);
+#if MBED_CONF_MY_TLSSOCKET_TLS_DEBUG_LEVEL >= 3
+    mbedtls_x509_crt_info(buf, sizeof (buf) - 1, "  ", crt);
     printf("%s", buf);
+#else
+    /* Full dump at debug level 3 and above */
+    mbedtls_x509_dn_gets(buf, sizeof (buf), &crt->subject);
+    printf("  subject name      : %s\n", buf);
+#endif
 
     if (*flags == 0) {
         printf("No verification issue for this certificate\n");
     } else {
-        mbedtls_x509_crt_verify_info(buf, buf_size, "  ! ", *flags);
+        mbedtls_x509_crt_verify_info(buf, sizeof (buf), "  ! ", *flags);
         printf("%s\n", buf);
     }
 
-    delete[] buf;
+    buf_mutex->unlock();
 
     return 0;
 }
 #endif
+
+void print_tls_handshake_stats(void)
+{
+    MyTLSSocket::print_handshake_stats();
+}
+
+void print_tls_read_ahead_stats(void)
+{
+    MyTLSSocket::print_read_ahead_stats();
+}
+
+void print_tls_write_combine_stats(void)
+{
+    MyTLSSocket::print_write_combine_stats();
+}
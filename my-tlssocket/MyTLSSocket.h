@@ -2,31 +2,345 @@
 #define _MY_TLS_SOCKET_H_
 
 #include "mbed.h"
-#include "TLSSocket.h"
+#include "TCPSocket.h"
+#include "TLSSocketWrapper.h"
 #include "mbedtls_utils.h"
+#include "TLSSessionCache.h"
+#include "TLSCredentialStore.h"
+#include "TLSCertPinning.h"
+#include "TLSHeapTracker.h"
+#include "ConnectionTiming.h"
 
 #if MBED_CONF_MY_TLSSOCKET_TLS_DEBUG_LEVEL > 0
 #include "mbedtls/debug.h"
 #endif
 
-/* MyTLSSocket = TLSSocket + MQTT lib required timed read/write + debug thru console */
-class MyTLSSocket : public TLSSocket
+/* MyTLSSocket = TLSSocket + MQTT lib required timed read/write + debug thru console
+ *               + TLS session resumption through TLSSessionCache
+ *               + credentials parsed once and shared through TLSCredentialStore
+ *               + per-session Mbed TLS heap through TLSHeapTracker
+ *               + handshake time split into network I/O and the rest (crypto)
+ *               + socket open, TCP connect and TLS handshake state timing into ConnectionTiming
+ *               + asynchronous connect driven by sigio on an event queue
+ *               + read-ahead of decrypted data for small reads of MQTT lib
+ *               + opt-in combining of small writes of MQTT lib into one TLS record
+ *               + server certificate chain pinned after verification through TLSCertPinning
+ *
+ * Like TLSSocket, it owns its TCP transport, but of our own type. TLSSocketWrapper attaches
+ * sigio() of the transport right after SSL context setup and before handshake. This is where
+ * a cached session is offered.
+ */
+class MyTLSSocket : public TLSSocketWrapper
 {
 public:
     MyTLSSocket();
     ~MyTLSSocket();
 
+    /**
+     * Open TCP transport on network stack, as TLSSocket::open()
+     */
+    nsapi_error_t open(NetworkStack *stack);
+
+    template <typename S>
+    nsapi_error_t open(S *stack)
+    {
+        return open(nsapi_create_stack(stack));
+    }
+
+    /**
+     * Set host name of the remote host, for certificate checking and as key of cached session
+     *
+     * The host name string must stay valid for the lifetime of the socket.
+     */
+    void set_hostname(const char *hostname);
+
+    /**
+     * Reference root CA chain parsed once in TLSCredentialStore, instead of parsing own copy
+     */
+    nsapi_error_t set_root_ca_cert(const void *root_ca, size_t len);
+    nsapi_error_t set_root_ca_cert(const char *root_ca_pem);
+
+    /**
+     * Reference client certificate/key parsed once in TLSCredentialStore, instead of parsing own copy
+     */
+    nsapi_error_t set_client_cert_key(const void *client_cert, size_t client_cert_len,
+                                      const void *client_private_key, size_t client_private_key_len);
+    nsapi_error_t set_client_cert_key(const char *client_cert_pem, const char *client_private_key_pem);
+
+    /**
+     * Connect and handshake, resuming cached session of host name and port if any
+     */
+    nsapi_error_t connect(const SocketAddress &address) override;
+
+    /**
+     * Completion of connect_async(), with NSAPI_ERROR_OK or error
+     */
+    typedef mbed::Callback<void(nsapi_error_t)> ConnectCallback;
+
+    /**
+     * Connect and handshake without blocking the caller
+     *
+     * Socket and its transport are switched to non-blocking mode, and connect() is run again
+     * on the event queue on each sigio event until it completes or async-connect-timeout
+     * elapses. A slow poll backs up sigio events the network stack may miss. done is called
+     * on the event queue then. The socket is left in non-blocking mode; set the mode wanted
+     * on completion.
+     *
+     * Each step only runs until the next network wait, so many sockets can handshake at the
+     * same time on one queue. Without queue, the one of handshake thread is used.
+     *
+     * Destroy the socket with connect_async() pending only on the event queue thread, or
+     * a step already dispatching may run on it.
+     *
+     * @return  NSAPI_ERROR_IN_PROGRESS if started and done to be called, otherwise error
+     */
+    nsapi_error_t connect_async(const SocketAddress &address, ConnectCallback done, events::EventQueue *queue = NULL);
+
+    bool connect_async_pending() const
+    {
+        return _async_queue != NULL;
+    }
+
+    /**
+     * Event queue of handshake thread, created on first use
+     *
+     * Thread runs at normal priority, as the MQTT network thread does. Below it, a handshake
+     * would starve while that thread yields for MQTT, and connect would time out. At the
+     * same priority, handshake crypto gets its round-robin slices besides sensor and UI.
+     */
+    static events::EventQueue *handshake_queue();
+
+    /**
+     * Print handshake timing, to compare tls-crypto-profile
+     */
+    static void print_handshake_stats();
+
+    struct ReadAheadStats {
+        uint32_t    reads;                  /**< read() calls */
+        uint32_t    reads_buffered;         /**< read() calls served from read-ahead buffer without recv() */
+        uint32_t    recvs;                  /**< recv() calls by read() */
+        uint32_t    bytes;                  /**< Bytes returned by read() */
+    };
+
+    static ReadAheadStats read_ahead_stats()
+    {
+        return _read_ahead_stats;
+    }
+
+    static void print_read_ahead_stats();
+
+    struct WriteCombineStats {
+        uint32_t    writes;                 /**< write() calls with write combining on */
+        uint32_t    writes_held;            /**< write() calls held for combining */
+        uint32_t    flushes;                /**< send() calls of held writes, i.e. TLS records */
+        uint32_t    flush_bytes;
+    };
+
+    static void print_write_combine_stats();
+
     /**
      * Timed recv for MQTT lib
+     *
+     * With tls-read-ahead-size, reads shorter than the read-ahead buffer fill it with one recv()
+     * and are then served from it, e.g. MQTT fixed header and remaining length read byte by byte.
+     * Reads until len or timeout. Don't mix with recv() on the same socket, which bypasses it.
      */
     int read(unsigned char* buffer, int len, int timeout);
 
     /**
      * Timed send for MQTT lib
+     *
+     * With write combining on, writes are held while they fit in tls-write-combine-size, and
+     * go out together in one send(), i.e. one TLS record, on the first of:
+     *
+     *   flush(), or close()
+     *   read() having to wait for input, e.g. for the response to what is held
+     *   read() or write() with the oldest held for tls-write-combine-delay
+     *   write() not fitting in what is left
+     *
+     * Held writes count as sent. An error sending them is returned by the call flushing them.
      */
     int write(unsigned char* buffer, int len, int timeout);
+
+    /**
+     * Turn write combining on or off. Turning off flushes held writes.
+     *
+     * @return  NSAPI_ERROR_OK, NSAPI_ERROR_NO_MEMORY, or NSAPI_ERROR_UNSUPPORTED if compiled out
+     */
+    nsapi_error_t set_write_combining(bool enable);
+
+    /**
+     * Send writes held by write combining
+     *
+     * @return  0 on success, -1 on failure
+     */
+    int flush(int timeout);
+
+    /**
+     * Flush held writes before close
+     */
+    nsapi_error_t close() override;
     
 protected:
+    /* TCP transport calling back on sigio() attached by TLSSocketWrapper */
+    class Transport : public TCPSocket
+    {
+    public:
+        Transport(MyTLSSocket &owner) : _owner(owner)
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+            , _connect_in_progress(false)
+#endif
+        {
+        }
+
+        void sigio(mbed::Callback<void()> func) override;
+
+        /* Timed for ConnectionTiming */
+        nsapi_error_t connect(const SocketAddress &address) override;
+
+        /* Timed to tell network I/O from crypto in handshake */
+        nsapi_size_or_error_t send(const void *data, nsapi_size_t size) override;
+        nsapi_size_or_error_t recv(void *data, nsapi_size_t size) override;
+
+    private:
+        MyTLSSocket &   _owner;
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+        bool                        _connect_in_progress;
+        HighResClock::time_point    _connect_at;
+#endif
+    };
+
+    /**
+     * Run connect() of connect_async() once more, and complete it if done
+     */
+    void async_step();
+
+    /**
+     * Event from socket or transport during connect_async(). Called in network stack context.
+     */
+    void async_event();
+
+    /**
+     * Stop connect_async() and call back done with result
+     */
+    void async_done(nsapi_error_t rc);
+
+    /**
+     * SSL context has set up. Offer cached session before handshake.
+     */
+    void handshake_starting();
+
+    /**
+     * Handshake has completed. Account its time.
+     */
+    void handshake_done();
+
+    /**
+     * Transport send/recv during handshake
+     */
+    HighResClock::time_point handshake_io_start();
+    void handshake_io_done(HighResClock::time_point start);
+
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+    /**
+     * Charge time to TLS handshake state since last sample, and sample current state
+     */
+    void sample_tls_state(HighResClock::time_point now);
+#endif
+
+    bool handshake_timing() const
+    {
+        return _connect_pending && _handshake_started;
+    }
+
+    struct HandshakeStats {
+        uint32_t    handshakes;             /**< Handshakes completed, full or resumed */
+        uint32_t    handshake_ms_total;     /**< Sum of handshake time */
+        uint32_t    crypto_ms_total;        /**< Sum of handshake time out of network I/O, i.e. mostly crypto */
+        uint32_t    crypto_ms_last;
+        uint32_t    crypto_ms_max;
+    };
+
+    Transport                   _tcp_socket;
+    const char *                _hostname;
+    bool                        _connect_pending;   /**< connect() in progress, e.g. non-blocking */
+    bool                        _handshake_pending; /**< Handshake not started yet for this connect */
+    bool                        _handshake_started;
+    HighResClock::time_point    _handshake_at;
+    std::chrono::microseconds   _handshake_busy;    /**< Time in connect() calls since handshake start */
+    std::chrono::microseconds   _handshake_io;      /**< Time blocked in send/recv during handshake */
+    events::EventQueue *        _async_queue;       /**< Event queue of connect_async() pending */
+    ConnectCallback             _async_callback;
+    SocketAddress               _async_address;
+    Kernel::Clock::time_point   _async_deadline;
+    int                         _async_poll_id;
+    int                         _async_step_id;
+    bool                        _async_step_posted; /**< Step posted but not run yet, to coalesce events */
+#if MBED_CONF_MY_TLSSOCKET_CONNECTION_TIMING
+    uint32_t                    _tls_state_us[MBEDTLS_SSL_HANDSHAKE_WRAPUP + 1];
+    uint32_t                    _tls_states_seen;   /**< Bit mask of states charged */
+    int                         _tls_state;         /**< State at last sample, -1 for none */
+    HighResClock::time_point    _tls_state_at;
+#endif
+    uint16_t                    _port;
+    bool                        _session_offered;   /**< Cached session offered. Always false without cache. */
+#if MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE > 0
+    Kernel::Clock::time_point   _connect_at;
+#endif
+#if MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+    bool                        _cert_pinned;       /**< Root CA withheld, chain compared with pin instead */
+    bool                        _cert_checked;      /**< Chain fingerprinted at depth 0, i.e. not resumed */
+    unsigned char               _cert_fingerprint[TLSCertPinning::FINGERPRINT_SIZE];
+#endif
+#if MBED_CONF_MY_TLSSOCKET_TLS_HEAP_TRACKING && defined(MBEDTLS_PLATFORM_MEMORY)
+    TLSHeapTracker::Session     _heap_session;
+#endif
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_READ_AHEAD_SIZE > 0
+    /**
+     * Copy out of read-ahead buffer
+     */
+    int read_buffered(unsigned char *buffer, int len);
+
+    unsigned char               _read_ahead[MBED_CONF_MY_TLSSOCKET_TLS_READ_AHEAD_SIZE];
+    uint16_t                    _read_ahead_pos;
+    uint16_t                    _read_ahead_len;
+#endif
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_SIZE > 0
+    /**
+     * Held writes due to go out, by tls-write-combine-delay
+     */
+    bool flush_due() const
+    {
+        return _combine_len && (Kernel::Clock::now() - _combine_at) >= std::chrono::milliseconds(MBED_CONF_MY_TLSSOCKET_TLS_WRITE_COMBINE_DELAY);
+    }
+
+    unsigned char *             _combine_buf;       /**< Held writes. NULL with write combining off. */
+    uint16_t                    _combine_len;
+    Kernel::Clock::time_point   _combine_at;        /**< Oldest held */
+    int                         _combine_timeout;   /**< Timeout of last held write, for flush on close */
+#endif
+
+    static HandshakeStats       _handshake_stats;
+    static ReadAheadStats       _read_ahead_stats;
+    static WriteCombineStats    _write_combine_stats;
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_DEBUG_LEVEL > 0 || MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+    /**
+     * Certificate verification callback for Mbed TLS, for each cert in the chain from the top
+     * Checks pin, then prints with debug on
+     */
+    static int verify(void *data, mbedtls_x509_crt *crt, int depth, uint32_t *flags);
+#endif
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+    /**
+     * Fingerprint chain at depth 0, and fail verification there if it doesn't match pin
+     */
+    int verify_pin(const mbedtls_x509_crt *crt, int depth, uint32_t *flags);
+#endif
+
 #if MBED_CONF_MY_TLSSOCKET_TLS_DEBUG_LEVEL > 0
     /**
      * Debug callback for Mbed TLS
@@ -36,8 +350,7 @@ protected:
                          const char *str);
 
     /**
-     * Certificate verification callback for Mbed TLS
-     * Here we only use it to display information on each cert in the chain
+     * Display information on each cert in the chain
      */
     static int my_verify(void *data, mbedtls_x509_crt *crt, int depth, uint32_t *flags);
 #endif
@@ -0,0 +1,176 @@
+#include "mbed.h"
+#include "TLSCertPinning.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/x509_crt.h"
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+extern "C" {
+    MBED_USED void print_tls_cert_pinning_stats(void);
+}
+
+TLSCertPinning::Stats TLSCertPinning::_stats;
+
+TLSCertPinning &TLSCertPinning::get_instance()
+{
+    static TLSCertPinning pinning;
+    return pinning;
+}
+
+TLSCertPinning::TLSCertPinning() :
+    _clock(0)
+{
+    for (int i = 0; i < MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS; i ++) {
+        _entries[i].hostname[0] = '\0';
+        _entries[i].port = 0;
+        _entries[i].used = 0;
+    }
+}
+
+int TLSCertPinning::fingerprint(const mbedtls_x509_crt *chain, unsigned char fingerprint[FINGERPRINT_SIZE])
+{
+    if (chain == NULL || chain->raw.p == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    mbedtls_sha256_context sha256;
+    int ret;
+
+    mbedtls_sha256_init(&sha256);
+    do {
+        if ((ret = mbedtls_sha256_starts_ret(&sha256, 0)) != 0) {
+            break;
+        }
+        for (const mbedtls_x509_crt *crt = chain; crt; crt = crt->next) {
+            if ((ret = mbedtls_sha256_update_ret(&sha256, crt->raw.p, crt->raw.len)) != 0) {
+                break;
+            }
+        }
+        if (ret != 0) {
+            break;
+        }
+        ret = mbedtls_sha256_finish_ret(&sha256, fingerprint);
+    } while (0);
+    mbedtls_sha256_free(&sha256);
+
+    return ret;
+}
+
+TLSCertPinning::Entry *TLSCertPinning::find(const char *hostname, uint16_t port)
+{
+    if (hostname == NULL || hostname[0] == '\0') {
+        return NULL;
+    }
+
+    for (int i = 0; i < MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS; i ++) {
+        if (_entries[i].port == port && strcmp(_entries[i].hostname, hostname) == 0) {
+            return &_entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+TLSCertPinning::Entry *TLSCertPinning::alloc(const char *hostname, uint16_t port)
+{
+    if (hostname == NULL || hostname[0] == '\0' || strlen(hostname) > HOSTNAME_MAX) {
+        return NULL;
+    }
+
+    Entry *victim = &_entries[0];
+
+    for (int i = 0; i < MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS; i ++) {
+        if (_entries[i].hostname[0] == '\0') {
+            victim = &_entries[i];
+            break;
+        }
+        if (_entries[i].used < victim->used) {
+            victim = &_entries[i];
+        }
+    }
+
+    strcpy(victim->hostname, hostname);
+    victim->port = port;
+    victim->used = ++ _clock;
+
+    return victim;
+}
+
+bool TLSCertPinning::pinned(const char *hostname, uint16_t port)
+{
+    _mutex.lock();
+    bool ret = (find(hostname, port) != NULL);
+    _mutex.unlock();
+
+    return ret;
+}
+
+bool TLSCertPinning::match(const char *hostname, uint16_t port, const unsigned char fingerprint[FINGERPRINT_SIZE])
+{
+    _mutex.lock();
+
+    Entry *entry = find(hostname, port);
+    bool matched = (entry && memcmp(entry->fingerprint, fingerprint, FINGERPRINT_SIZE) == 0);
+    if (matched) {
+        entry->used = ++ _clock;
+    } else {
+        /* Verify in full next time */
+        if (entry) {
+            entry->hostname[0] = '\0';
+        }
+        _stats.mismatches ++;
+    }
+
+    _mutex.unlock();
+
+    return matched;
+}
+
+void TLSCertPinning::handshake_done(const char *hostname, uint16_t port, bool pinned, const unsigned char *fingerprint, uint32_t cert_ms)
+{
+    _mutex.lock();
+
+    if (pinned) {
+        _stats.pinned ++;
+        _stats.pinned_ms_total += cert_ms;
+    } else {
+        /* Verified by Mbed TLS with authmode required */
+        _stats.verified ++;
+        _stats.verified_ms_total += cert_ms;
+        if (fingerprint) {
+            Entry *entry = find(hostname, port);
+            if (entry == NULL) {
+                entry = alloc(hostname, port);
+            }
+            if (entry) {
+                memcpy(entry->fingerprint, fingerprint, FINGERPRINT_SIZE);
+            }
+        }
+    }
+
+    _mutex.unlock();
+}
+
+void TLSCertPinning::print_stats()
+{
+    uint32_t verified_avg = _stats.verified ? (_stats.verified_ms_total / _stats.verified) : 0;
+    uint32_t pinned_avg = _stats.pinned ? (_stats.pinned_ms_total / _stats.pinned) : 0;
+
+    printf("** TLS CERT PINNING STATS **\n");
+    printf("**** verified         : %" PRIu32 ", server certificate avg %" PRIu32 " ms\n", _stats.verified, verified_avg);
+    printf("**** pinned           : %" PRIu32 ", server certificate avg %" PRIu32 " ms\n", _stats.pinned, pinned_avg);
+    printf("**** mismatches       : %" PRIu32 "\n", _stats.mismatches);
+    printf("****************************\n\n");
+}
+
+void print_tls_cert_pinning_stats(void)
+{
+    TLSCertPinning::print_stats();
+}
+
+#endif  // MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
@@ -0,0 +1,102 @@
+#ifndef _TLS_CERT_PINNING_H_
+#define _TLS_CERT_PINNING_H_
+
+#include "mbed.h"
+#include "mbedtls/ssl.h"
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+
+/* TLSCertPinning = process-wide pins of server certificate chains, to skip chain verification
+ *
+ * Verifying the server certificate chain builds the chain up to the root CA and checks each
+ * signature, i.e. public-key operations on every full handshake. After one full handshake
+ * has verified the chain, its SHA-256 fingerprint (over DER of each certificate the server
+ * has sent) is pinned per server (host name and port). The next full handshake with it
+ * withholds the root CA, so the chain isn't built up to it, and the verify callback compares
+ * the chain with the pin at depth 0 instead. A mismatch fails verification right there,
+ * before Finished. Other checks of Mbed TLS (validity, host name, key usage, signatures
+ * within the chain sent) still apply, and the server proves possession of the pinned key by
+ * signing the key exchange.
+ *
+ * On mismatch, e.g. server certificate renewed, the pin is dropped, so the next handshake
+ * verifies the chain in full again. Resumed handshakes carry no certificate and are not
+ * pinned or checked.
+ */
+class TLSCertPinning
+{
+public:
+    static const int FINGERPRINT_SIZE = 32;
+
+    struct Stats {
+        uint32_t    verified;           /**< Full handshakes with chain verified, then pinned */
+        uint32_t    pinned;             /**< Full handshakes with chain matching pin */
+        uint32_t    mismatches;         /**< Handshakes failed for chain not matching pin */
+        uint32_t    verified_ms_total;  /**< Sum of server certificate state time with chain verified */
+        uint32_t    pinned_ms_total;    /**< Sum of server certificate state time with pin matched */
+    };
+
+    static TLSCertPinning &get_instance();
+
+    /**
+     * Whether chain of host:port is pinned, i.e. the next full handshake can skip chain verification
+     */
+    bool pinned(const char *hostname, uint16_t port);
+
+    /**
+     * SHA-256 over DER of each certificate of chain, from the leaf as the server has sent it
+     *
+     * @return  0 on success, or mbedtls error code
+     */
+    static int fingerprint(const mbedtls_x509_crt *chain, unsigned char fingerprint[FINGERPRINT_SIZE]);
+
+    /**
+     * Compare chain fingerprint with pin of host:port, from verify callback at depth 0
+     *
+     * On mismatch, the pin is dropped.
+     *
+     * @return  true if pinned and matching
+     */
+    bool match(const char *hostname, uint16_t port, const unsigned char fingerprint[FINGERPRINT_SIZE]);
+
+    /**
+     * Account full handshake done, and pin fingerprint of chain verified in full
+     *
+     * @param[in] pinned        Chain matched pin instead of verified in full
+     * @param[in] fingerprint   Chain fingerprint, or NULL if not taken
+     * @param[in] cert_ms       Time in server certificate state, 0 if unknown
+     */
+    void handshake_done(const char *hostname, uint16_t port, bool pinned, const unsigned char *fingerprint, uint32_t cert_ms);
+
+    static const Stats &stats()
+    {
+        return _stats;
+    }
+
+    static void print_stats();
+
+private:
+    TLSCertPinning();
+
+    /* Longest host name pinned. Longer ones are verified in full each time. */
+    static const size_t HOSTNAME_MAX = 63;
+
+    struct Entry {
+        char            hostname[HOSTNAME_MAX + 1];     /**< Empty for free */
+        uint16_t        port;
+        uint32_t        used;           /**< Last use, for LRU replacement */
+        unsigned char   fingerprint[FINGERPRINT_SIZE];
+    };
+
+    Entry *find(const char *hostname, uint16_t port);
+    Entry *alloc(const char *hostname, uint16_t port);
+
+    PlatformMutex       _mutex;
+    Entry               _entries[MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS];
+    uint32_t            _clock;
+
+    static Stats        _stats;
+};
+
+#endif  // MBED_CONF_MY_TLSSOCKET_TLS_CERT_PINS > 0
+
+#endif // _TLS_CERT_PINNING_H_
@@ -0,0 +1,164 @@
+#include "mbed.h"
+#include "TLSCredentialStore.h"
+#include "mbedtls/asn1.h"
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+extern "C" {
+    MBED_USED void print_tls_credential_stats(void);
+}
+
+TLSCredentialStore::Stats TLSCredentialStore::_stats;
+
+TLSCredentialStore &TLSCredentialStore::get_instance()
+{
+    static TLSCredentialStore store;
+    return store;
+}
+
+TLSCredentialStore::TLSCredentialStore() :
+    _ca_src(NULL),
+    _cert_src(NULL),
+    _key_src(NULL)
+{
+    mbedtls_x509_crt_init(&_ca_chain);
+    mbedtls_x509_crt_init(&_client_cert);
+    mbedtls_pk_init(&_client_key);
+}
+
+int TLSCredentialStore::parse_crt(mbedtls_x509_crt *chain, const void *buf, size_t len)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(buf);
+    const unsigned char *end = p + len;
+
+    /* PEM, null-terminated */
+    if (len && p[len - 1] == '\0') {
+        return mbedtls_x509_crt_parse(chain, p, len);
+    }
+
+    /* DER, possibly concatenated chain. Certificates are referenced in place (e.g. flash)
+     * instead of copied to heap. The source must stay valid for lifetime of the chain. */
+    while (p < end) {
+        const unsigned char *crt_start = p;
+        size_t crt_len = 0;
+
+        int ret = mbedtls_asn1_get_tag(const_cast<unsigned char **>(&p), end, &crt_len,
+                                       MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE);
+        if (ret != 0) {
+            return MBEDTLS_ERR_X509_INVALID_FORMAT + ret;
+        }
+        crt_len += p - crt_start;
+
+        ret = mbedtls_x509_crt_parse_der_nocopy(chain, crt_start, crt_len);
+        if (ret != 0) {
+            return ret;
+        }
+
+        _stats.der_in_place += crt_len;
+        p = crt_start + crt_len;
+    }
+
+    return 0;
+}
+
+int TLSCredentialStore::set_root_ca_cert(const void *root_ca, size_t len)
+{
+    int ret = 0;
+
+    _mutex.lock();
+
+    do {
+        if (root_ca == _ca_src) {
+            _stats.reuses ++;
+            break;
+        }
+
+        Timer timer;
+        timer.start();
+
+        mbedtls_x509_crt_free(&_ca_chain);
+        mbedtls_x509_crt_init(&_ca_chain);
+        _ca_src = NULL;
+
+        ret = parse_crt(&_ca_chain, root_ca, len);
+        if (ret != 0) {
+            mbedtls_x509_crt_free(&_ca_chain);
+            mbedtls_x509_crt_init(&_ca_chain);
+            break;
+        }
+        _ca_src = root_ca;
+
+        _stats.parses ++;
+        _stats.parse_ms += std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed_time()).count();
+    } while (0);
+
+    _mutex.unlock();
+
+    return ret;
+}
+
+int TLSCredentialStore::set_client_cert_key(const void *client_cert, size_t client_cert_len,
+                                            const void *client_private_key, size_t client_private_key_len)
+{
+    int ret = 0;
+
+    _mutex.lock();
+
+    do {
+        if (client_cert == _cert_src && client_private_key == _key_src) {
+            _stats.reuses ++;
+            break;
+        }
+
+        Timer timer;
+        timer.start();
+
+        mbedtls_x509_crt_free(&_client_cert);
+        mbedtls_x509_crt_init(&_client_cert);
+        mbedtls_pk_free(&_client_key);
+        mbedtls_pk_init(&_client_key);
+        _cert_src = _key_src = NULL;
+
+        ret = parse_crt(&_client_cert, client_cert, client_cert_len);
+        if (ret != 0) {
+            break;
+        }
+        ret = mbedtls_pk_parse_key(&_client_key, static_cast<const unsigned char *>(client_private_key), client_private_key_len, NULL, 0);
+        if (ret != 0) {
+            break;
+        }
+        _cert_src = client_cert;
+        _key_src = client_private_key;
+
+        _stats.parses ++;
+        _stats.parse_ms += std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed_time()).count();
+    } while (0);
+
+    if (ret != 0) {
+        mbedtls_x509_crt_free(&_client_cert);
+        mbedtls_x509_crt_init(&_client_cert);
+        mbedtls_pk_free(&_client_key);
+        mbedtls_pk_init(&_client_key);
+    }
+
+    _mutex.unlock();
+
+    return ret;
+}
+
+void TLSCredentialStore::print_stats()
+{
+    printf("** TLS CREDENTIAL STORE STATS **\n");
+    printf("**** parses       : %" PRIu32 " (%" PRIu32 " ms)\n", _stats.parses, _stats.parse_ms);
+    printf("**** reuses       : %" PRIu32 "\n", _stats.reuses);
+    printf("**** DER in place : %" PRIu32 " bytes\n", _stats.der_in_place);
+    printf("********************************\n\n");
+}
+
+void print_tls_credential_stats(void)
+{
+    TLSCredentialStore::print_stats();
+}
@@ -0,0 +1,104 @@
+#ifndef _TLS_CREDENTIAL_STORE_H_
+#define _TLS_CREDENTIAL_STORE_H_
+
+#include "mbed.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+/* TLSCredentialStore = process-wide, parse-once store of TLS credentials
+ *
+ * TLSSocketWrapper::set_root_ca_cert()/set_client_cert_key() parse base64 PEM into
+ * per-socket mbedtls_x509_crt/mbedtls_pk_context, on every socket construction, and
+ * each parsed chain costs several KB heap. Here the root CA chain and client certificate/key
+ * are parsed on first use only, and all MyTLSSocket instances reference the same objects.
+ *
+ * Credentials are identified by address of the source blob (e.g. PEM string literal), so
+ * setting the same blob again is a no-op. Setting another one replaces the parsed objects.
+ * Do that only while no socket references them.
+ *
+ * Certificates in DER (not null-terminated, e.g. embedded by credentials/pem2der.py at build
+ * time) skip base64 decode and are referenced in place rather than copied to heap, so the
+ * blob must stay valid, e.g. be const data in flash.
+ *
+ * NOTE: Parsed objects are read-only to certificate verification, but private key operations
+ *       may update blinding state in RSA context. Don't handshake from multiple threads at the
+ *       same time with RSA key unless MBEDTLS_THREADING_C is enabled.
+ */
+class TLSCredentialStore
+{
+public:
+    struct Stats {
+        uint32_t    parses;             /**< Credentials parsed */
+        uint32_t    reuses;             /**< Credentials referenced without parse */
+        uint32_t    parse_ms;           /**< Time spent on parse */
+        uint32_t    der_in_place;       /**< DER certificate bytes referenced in place, not copied */
+    };
+
+    static TLSCredentialStore &get_instance();
+
+    /**
+     * Parse root CA chain in PEM (null-terminated) or DER unless parsed already
+     *
+     * @return  0 on success, or mbedtls error code
+     */
+    int set_root_ca_cert(const void *root_ca, size_t len);
+
+    /**
+     * Parse client certificate and private key in PEM (null-terminated) or DER unless parsed already
+     *
+     * @return  0 on success, or mbedtls error code
+     */
+    int set_client_cert_key(const void *client_cert, size_t client_cert_len,
+                            const void *client_private_key, size_t client_private_key_len);
+
+    /**
+     * Parsed root CA chain, or NULL if not set
+     */
+    mbedtls_x509_crt *ca_chain()
+    {
+        return _ca_src ? &_ca_chain : NULL;
+    }
+
+    /**
+     * Parsed client certificate, or NULL if not set
+     */
+    mbedtls_x509_crt *client_cert()
+    {
+        return _key_src ? &_client_cert : NULL;
+    }
+
+    /**
+     * Parsed client private key, or NULL if not set
+     */
+    mbedtls_pk_context *client_key()
+    {
+        return _key_src ? &_client_key : NULL;
+    }
+
+    static const Stats &stats()
+    {
+        return _stats;
+    }
+
+    static void print_stats();
+
+private:
+    TLSCredentialStore();
+
+    /* Parse PEM (null-terminated) or DER certificate chain */
+    static int parse_crt(mbedtls_x509_crt *chain, const void *buf, size_t len);
+
+    PlatformMutex           _mutex;
+
+    const void *            _ca_src;        /**< Source of _ca_chain. NULL for not set. */
+    mbedtls_x509_crt        _ca_chain;
+
+    const void *            _cert_src;      /**< Source of _client_cert */
+    const void *            _key_src;       /**< Source of _client_key. NULL for not set. */
+    mbedtls_x509_crt        _client_cert;
+    mbedtls_pk_context      _client_key;
+
+    static Stats            _stats;
+};
+
+#endif // _TLS_CREDENTIAL_STORE_H_
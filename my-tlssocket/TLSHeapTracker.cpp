@@ -0,0 +1,172 @@
+#include "mbed.h"
+#include "TLSHeapTracker.h"
+#include "mbedtls/ssl.h"
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_HEAP_TRACKING && defined(MBEDTLS_PLATFORM_MEMORY)
+
+#include <cstddef>
+#include <cstdint>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+extern "C" {
+    MBED_USED void install_tls_heap_tracker(void);
+    MBED_USED void print_tls_heap_stats(void);
+}
+
+namespace {
+
+/* Prefix of each block. Keeps the block aligned as by calloc(). */
+struct alignas(std::max_align_t) BlockHeader {
+    size_t      size;
+};
+
+}
+
+TLSHeapTracker::Session *TLSHeapTracker::_sessions = NULL;
+TLSHeapTracker::Stats TLSHeapTracker::_stats;
+
+void TLSHeapTracker::install()
+{
+    mbedtls_platform_set_calloc_free(TLSHeapTracker::calloc, TLSHeapTracker::free);
+}
+
+void *TLSHeapTracker::calloc(size_t n, size_t size)
+{
+    if (size && n > (SIZE_MAX - sizeof(BlockHeader)) / size) {
+        return NULL;
+    }
+
+    BlockHeader *header = static_cast<BlockHeader *>(::calloc(1, sizeof(BlockHeader) + n * size));
+
+    CriticalSectionLock lock;
+
+    if (header == NULL) {
+        _stats.failures ++;
+        return NULL;
+    }
+
+    header->size = n * size;
+    account_alloc(header->size);
+
+    return header + 1;
+}
+
+void TLSHeapTracker::free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    BlockHeader *header = static_cast<BlockHeader *>(ptr) - 1;
+
+    {
+        CriticalSectionLock lock;
+        _stats.in_use -= header->size;
+    }
+
+    ::free(header);
+}
+
+void TLSHeapTracker::account_alloc(uint32_t size)
+{
+    _stats.allocs ++;
+    _stats.in_use += size;
+    if (_stats.in_use > _stats.peak) {
+        _stats.peak = _stats.in_use;
+    }
+
+    for (Session *session = _sessions; session; session = session->next) {
+        session->allocs ++;
+        if (_stats.in_use > session->peak) {
+            session->peak = _stats.in_use;
+        }
+    }
+}
+
+void TLSHeapTracker::begin(Session &session)
+{
+    CriticalSectionLock lock;
+
+    session.base = session.peak = _stats.in_use;
+    session.allocs = 0;
+    session.next = _sessions;
+    _sessions = &session;
+}
+
+void TLSHeapTracker::end(Session &session, bool handshake_done)
+{
+    CriticalSectionLock lock;
+
+    Session **link = &_sessions;
+    while (*link && *link != &session) {
+        link = &(*link)->next;
+    }
+    if (*link == NULL) {
+        return;
+    }
+    *link = session.next;
+
+    if (! handshake_done) {
+        return;
+    }
+
+    /* Freed below base by others meanwhile */
+    uint32_t handshake_peak = session.peak > session.base ? session.peak - session.base : 0;
+    uint32_t steady = _stats.in_use > session.base ? _stats.in_use - session.base : 0;
+
+    _stats.sessions ++;
+    _stats.handshake_peak_last = handshake_peak;
+    _stats.steady_last = steady;
+    if (handshake_peak > _stats.handshake_peak_max) {
+        _stats.handshake_peak_max = handshake_peak;
+    }
+    if (steady > _stats.steady_max) {
+        _stats.steady_max = steady;
+    }
+    _stats.handshake_allocs_last = session.allocs;
+    if (session.allocs > _stats.handshake_allocs_max) {
+        _stats.handshake_allocs_max = session.allocs;
+    }
+}
+
+void TLSHeapTracker::print_stats()
+{
+    Stats stats;
+    {
+        CriticalSectionLock lock;
+        stats = _stats;
+    }
+
+    printf("** TLS HEAP STATS **\n");
+    printf("**** profile        : %d (IN %d/OUT %d%s)\n", MBED_CONF_MY_TLSSOCKET_TLS_MEMORY_PROFILE,
+           MBEDTLS_SSL_IN_CONTENT_LEN, MBEDTLS_SSL_OUT_CONTENT_LEN,
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+           ", variable"
+#else
+           ""
+#endif
+          );
+    printf("**** in use/peak    : %" PRIu32 "/%" PRIu32 "\n", stats.in_use, stats.peak);
+    printf("**** allocs/failures: %" PRIu32 "/%" PRIu32 "\n", stats.allocs, stats.failures);
+    printf("**** sessions       : %" PRIu32 "\n", stats.sessions);
+    printf("**** handshake peak : last %" PRIu32 ", max %" PRIu32 "\n", stats.handshake_peak_last, stats.handshake_peak_max);
+    printf("**** steady         : last %" PRIu32 ", max %" PRIu32 "\n", stats.steady_last, stats.steady_max);
+    printf("**** churn          : last %" PRIu32 ", max %" PRIu32 " blocks\n", stats.handshake_allocs_last, stats.handshake_allocs_max);
+    printf("********************\n\n");
+}
+
+void install_tls_heap_tracker(void)
+{
+    TLSHeapTracker::install();
+}
+
+void print_tls_heap_stats(void)
+{
+    TLSHeapTracker::print_stats();
+}
+
+#endif  // MBED_CONF_MY_TLSSOCKET_TLS_HEAP_TRACKING && MBEDTLS_PLATFORM_MEMORY
@@ -0,0 +1,80 @@
+#ifndef _TLS_HEAP_TRACKER_H_
+#define _TLS_HEAP_TRACKER_H_
+
+#include "mbed.h"
+#include "mbedtls/platform.h"
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_HEAP_TRACKING && defined(MBEDTLS_PLATFORM_MEMORY)
+
+/* TLSHeapTracker = accounting of heap allocated by Mbed TLS, per TLS session
+ *
+ * With MBEDTLS_PLATFORM_MEMORY, mbedtls_calloc()/mbedtls_free() are routed here. Each block
+ * is prefixed with its size, so bytes in use by Mbed TLS are known at any time. This is
+ * installed from mbed_main() before anything allocates thru Mbed TLS, because a block
+ * allocated before cannot be freed here.
+ *
+ * A Session is a window over one connect: handshake peak is the largest rise of bytes in
+ * use since begin(), and steady is the rise at end(), i.e. what the connection holds after
+ * handshake, with record buffers shrunk (MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH). Heap is not
+ * attributed to threads, so sessions handshaking at the same time count each other's.
+ */
+class TLSHeapTracker
+{
+public:
+    struct Stats {
+        uint32_t    allocs;                 /**< Blocks allocated */
+        uint32_t    failures;               /**< Allocations failed */
+        uint32_t    in_use;                 /**< Bytes in use */
+        uint32_t    peak;                   /**< Bytes in use at most since install */
+        uint32_t    sessions;               /**< Sessions ended with handshake done */
+        uint32_t    handshake_peak_last;
+        uint32_t    handshake_peak_max;
+        uint32_t    steady_last;
+        uint32_t    steady_max;
+        uint32_t    handshake_allocs_last;  /**< Blocks allocated during session, i.e. heap churn */
+        uint32_t    handshake_allocs_max;
+    };
+
+    struct Session {
+        uint32_t    base;                   /**< Bytes in use at begin() */
+        uint32_t    peak;                   /**< Bytes in use at most since begin() */
+        uint32_t    allocs;                 /**< Blocks allocated since begin() */
+        Session *   next;
+    };
+
+    /**
+     * Route Mbed TLS heap here
+     */
+    static void install();
+
+    /**
+     * Start accounting for session, e.g. on connect
+     */
+    static void begin(Session &session);
+
+    /**
+     * Stop accounting for session, and record it if handshake has done
+     */
+    static void end(Session &session, bool handshake_done);
+
+    static const Stats &stats()
+    {
+        return _stats;
+    }
+
+    static void print_stats();
+
+private:
+    static void *calloc(size_t n, size_t size);
+    static void free(void *ptr);
+
+    /* Update bytes in use and peaks of active sessions. Called in critical section. */
+    static void account_alloc(uint32_t size);
+
+    static Session *    _sessions;              /**< Active sessions */
+    static Stats        _stats;
+};
+
+#endif  // MBED_CONF_MY_TLSSOCKET_TLS_HEAP_TRACKING && MBEDTLS_PLATFORM_MEMORY
+
+#endif // _TLS_HEAP_TRACKER_H_
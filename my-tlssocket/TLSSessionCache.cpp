@@ -0,0 +1,303 @@
+#include "mbed.h"
+#include "TLSSessionCache.h"
+#include "mbedtls/platform_util.h"
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE > 0
+
+#if DEVICE_FLASH && MBED_CONF_MY_TLSSOCKET_TLS_SESSION_PERSIST
+#include "kvstore_global_api.h"
+#endif
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+#define STR_EXPAND(tok)         #tok
+#define STR(tok)                STR_EXPAND(tok)
+
+/* Key of session for host:port in default kvstore */
+#define SESSION_KEY_FMT         "/" STR(MBED_CONF_STORAGE_DEFAULT_KV) "/tlss_%08" PRIx32
+
+extern "C" {
+    MBED_USED void print_tls_session_stats(void);
+}
+
+TLSSessionCache::Stats TLSSessionCache::_stats;
+
+TLSSessionCache &TLSSessionCache::get_instance()
+{
+    static TLSSessionCache cache;
+    return cache;
+}
+
+TLSSessionCache::TLSSessionCache() :
+    _clock(0)
+{
+    for (int i = 0; i < MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE; i ++) {
+        _entries[i].key = 0;
+        _entries[i].used = 0;
+        mbedtls_ssl_session_init(&_entries[i].session);
+    }
+}
+
+uint32_t TLSSessionCache::make_key(const char *hostname, uint16_t port)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261UL;
+
+    for (const char *p = hostname ? hostname : ""; *p; p ++) {
+        hash = (hash ^ (uint8_t) *p) * 16777619UL;
+    }
+    hash = (hash ^ (uint8_t) (port >> 8)) * 16777619UL;
+    hash = (hash ^ (uint8_t) port) * 16777619UL;
+
+    /* 0 for free entry */
+    return hash ? hash : 1;
+}
+
+TLSSessionCache::Entry *TLSSessionCache::find(uint32_t key)
+{
+    for (int i = 0; i < MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE; i ++) {
+        if (_entries[i].key == key) {
+            return &_entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+TLSSessionCache::Entry *TLSSessionCache::alloc(uint32_t key)
+{
+    Entry *victim = &_entries[0];
+
+    for (int i = 0; i < MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE; i ++) {
+        if (_entries[i].key == 0) {
+            victim = &_entries[i];
+            break;
+        }
+        if (_entries[i].used < victim->used) {
+            victim = &_entries[i];
+        }
+    }
+
+    drop(victim);
+    victim->key = key;
+    victim->used = ++ _clock;
+
+    return victim;
+}
+
+void TLSSessionCache::drop(Entry *entry)
+{
+    mbedtls_ssl_session_free(&entry->session);
+    mbedtls_ssl_session_init(&entry->session);
+    entry->key = 0;
+}
+
+bool TLSSessionCache::offer(const char *hostname, uint16_t port, mbedtls_ssl_context *ssl)
+{
+    uint32_t key = make_key(hostname, port);
+    bool offered = false;
+
+    _mutex.lock();
+
+    Entry *entry = find(key);
+#if DEVICE_FLASH && MBED_CONF_MY_TLSSOCKET_TLS_SESSION_PERSIST
+    if (entry == NULL) {
+        mbedtls_ssl_session session;
+        mbedtls_ssl_session_init(&session);
+        if (restore(key, &session)) {
+            /* Take over ownership of session */
+            entry = alloc(key);
+            entry->session = session;
+        }
+    }
+#endif
+
+    if (entry) {
+        entry->used = ++ _clock;
+        int ret = mbedtls_ssl_set_session(ssl, &entry->session);
+        if (ret == 0) {
+            offered = true;
+            _stats.offered ++;
+        } else {
+            printf("TLS session cache: mbedtls_ssl_set_session() failed: -0x%04X\n", -ret);
+        }
+    }
+
+    _mutex.unlock();
+
+    return offered;
+}
+
+void TLSSessionCache::handshake_done(const char *hostname, uint16_t port, mbedtls_ssl_context *ssl, bool offered, uint32_t handshake_ms)
+{
+    uint32_t key = make_key(hostname, port);
+
+    _mutex.lock();
+
+    Entry *entry = find(key);
+
+    /* Same master secret as offered: abbreviated handshake */
+    bool resumed = offered && entry && ssl->session &&
+                   memcmp(ssl->session->master, entry->session.master, sizeof (entry->session.master)) == 0;
+    if (resumed) {
+        _stats.hits ++;
+        _stats.resumed_ms_total += handshake_ms;
+    } else {
+        _stats.misses ++;
+        _stats.full_ms_total += handshake_ms;
+    }
+
+    /* Cache the session, with new ticket if server has issued one */
+    if (entry == NULL) {
+        entry = alloc(key);
+    }
+    int ret = mbedtls_ssl_get_session(ssl, &entry->session);
+    if (ret != 0) {
+        printf("TLS session cache: mbedtls_ssl_get_session() failed: -0x%04X\n", -ret);
+        drop(entry);
+#if DEVICE_FLASH && MBED_CONF_MY_TLSSOCKET_TLS_SESSION_PERSIST
+    } else if (! resumed) {
+        /* New session. Resumed one is saved already. */
+        save(entry);
+#endif
+    }
+
+    _mutex.unlock();
+}
+
+void TLSSessionCache::handshake_failed(const char *hostname, uint16_t port)
+{
+    uint32_t key = make_key(hostname, port);
+
+    _mutex.lock();
+
+    _stats.failures ++;
+    Entry *entry = find(key);
+    if (entry) {
+        drop(entry);
+    }
+#if DEVICE_FLASH && MBED_CONF_MY_TLSSOCKET_TLS_SESSION_PERSIST
+    erase(key);
+#endif
+
+    _mutex.unlock();
+}
+
+#if DEVICE_FLASH && MBED_CONF_MY_TLSSOCKET_TLS_SESSION_PERSIST
+bool TLSSessionCache::restore(uint32_t key, mbedtls_ssl_session *session)
+{
+    char kv_key[48];
+    kv_info_t kv_info;
+
+    snprintf(kv_key, sizeof(kv_key), SESSION_KEY_FMT, key);
+    if (kv_get_info(kv_key, &kv_info) != MBED_SUCCESS) {
+        return false;
+    }
+
+    unsigned char *buf = new unsigned char[kv_info.size];
+    size_t actual_size = 0;
+    bool ret = false;
+
+    do {
+        int kv_status = kv_get(kv_key, buf, kv_info.size, &actual_size);
+        if (kv_status != MBED_SUCCESS) {
+            printf("TLS session cache: get \'%s\' failed: %d\n", kv_key, kv_status);
+            break;
+        }
+
+        /* Rejects session saved by other Mbed TLS version or configuration */
+        if (mbedtls_ssl_session_load(session, buf, actual_size) != 0) {
+            mbedtls_ssl_session_free(session);
+            kv_remove(kv_key);
+            break;
+        }
+
+        _stats.restored ++;
+        ret = true;
+    } while (0);
+
+    /* Master secret */
+    mbedtls_platform_zeroize(buf, kv_info.size);
+    delete [] buf;
+
+    return ret;
+}
+
+void TLSSessionCache::save(const Entry *entry)
+{
+    static bool unsealable = false;
+    char kv_key[48];
+    size_t len = 0;
+
+    if (unsealable) {
+        return;
+    }
+
+    /* Serialized length first */
+    if (mbedtls_ssl_session_save(&entry->session, NULL, 0, &len) != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+        return;
+    }
+
+    unsigned char *buf = new unsigned char[len];
+
+    do {
+        if (mbedtls_ssl_session_save(&entry->session, buf, len, &len) != 0) {
+            break;
+        }
+
+        snprintf(kv_key, sizeof(kv_key), SESSION_KEY_FMT, entry->key);
+        int kv_status = kv_set(kv_key, buf, len, KV_REQUIRE_CONFIDENTIALITY_FLAG);
+        if (kv_status == MBED_ERROR_INVALID_ARGUMENT) {
+            printf("TLS session cache: kvstore cannot seal sessions. Kept in RAM only.\n");
+            unsealable = true;
+            break;
+        } else if (kv_status != MBED_SUCCESS) {
+            printf("TLS session cache: set \'%s\' failed: %d\n", kv_key, kv_status);
+            break;
+        }
+
+        _stats.saved ++;
+    } while (0);
+
+    mbedtls_platform_zeroize(buf, len);
+    delete [] buf;
+}
+
+void TLSSessionCache::erase(uint32_t key)
+{
+    char kv_key[48];
+
+    snprintf(kv_key, sizeof(kv_key), SESSION_KEY_FMT, key);
+    kv_remove(kv_key);
+}
+#endif
+
+void TLSSessionCache::print_stats()
+{
+    uint32_t full_avg = _stats.misses ? (_stats.full_ms_total / _stats.misses) : 0;
+    uint32_t resumed_avg = _stats.hits ? (_stats.resumed_ms_total / _stats.hits) : 0;
+
+    printf("** TLS SESSION CACHE STATS **\n");
+    printf("**** offered          : %" PRIu32 "\n", _stats.offered);
+    printf("**** hits             : %" PRIu32 "\n", _stats.hits);
+    printf("**** misses           : %" PRIu32 "\n", _stats.misses);
+    printf("**** failures         : %" PRIu32 "\n", _stats.failures);
+    printf("**** full handshake   : avg %" PRIu32 " ms\n", full_avg);
+    printf("**** resumed          : avg %" PRIu32 " ms", resumed_avg);
+    if (_stats.hits && _stats.misses) {
+        printf(" (%" PRId32 " ms saved)", (int32_t) (full_avg - resumed_avg));
+    }
+    printf("\n");
+    printf("**** restored/saved   : %" PRIu32 "/%" PRIu32 "\n", _stats.restored, _stats.saved);
+    printf("*****************************\n\n");
+}
+
+void print_tls_session_stats(void)
+{
+    TLSSessionCache::print_stats();
+}
+
+#endif  // MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE > 0
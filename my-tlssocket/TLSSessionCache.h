@@ -0,0 +1,102 @@
+#ifndef _TLS_SESSION_CACHE_H_
+#define _TLS_SESSION_CACHE_H_
+
+#include "mbed.h"
+#include "mbedtls/ssl.h"
+
+#if MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE > 0
+
+/* TLSSessionCache = process-wide cache of TLS sessions for resumption
+ *
+ * A full handshake with client-certificate auth costs seconds of CPU and several round
+ * trips. After one, the negotiated session is cached per server (host name and port) and
+ * offered on the next connect to it, by session ID or session ticket, whichever the
+ * server has issued. If the server accepts, the handshake is abbreviated: no certificate
+ * exchange, no public-key operations.
+ *
+ * Resumption is detected by the master secret of the new session being equal to the one
+ * offered. This works for both session ID and ticket, where the client makes up a random
+ * session ID.
+ *
+ * With tls-session-persist, sessions are also saved in kvstore with confidentiality
+ * required (SecureStore), so they survive reboot. Session state includes the master
+ * secret, so it is never saved in a store which cannot seal it. Such store rejects the
+ * flag and the session is kept in RAM only.
+ *
+ * Each cached session holds a copy of the server certificate (MBEDTLS_SSL_KEEP_PEER_CERTIFICATE),
+ * i.e. roughly 1~2 KB heap per entry.
+ */
+class TLSSessionCache
+{
+public:
+    struct Stats {
+        uint32_t    offered;            /**< Cached sessions offered on connect */
+        uint32_t    hits;               /**< Sessions resumed */
+        uint32_t    misses;             /**< Full handshakes, none cached or offered one refused */
+        uint32_t    failures;           /**< Handshakes failed. Cached session dropped. */
+        uint32_t    full_ms_total;      /**< Sum of full handshake time */
+        uint32_t    resumed_ms_total;   /**< Sum of abbreviated handshake time */
+        uint32_t    restored;           /**< Sessions restored from kvstore */
+        uint32_t    saved;              /**< Sessions saved to kvstore */
+    };
+
+    static TLSSessionCache &get_instance();
+
+    /**
+     * Offer cached session of host:port to SSL context set up but not handshaking yet
+     *
+     * @return  true if offered
+     */
+    bool offer(const char *hostname, uint16_t port, mbedtls_ssl_context *ssl);
+
+    /**
+     * Cache session of SSL context after handshake and account hit/miss
+     *
+     * @param[in] offered       offer() has returned true for this handshake
+     * @param[in] handshake_ms  Time of connect, i.e. TCP connect and handshake
+     */
+    void handshake_done(const char *hostname, uint16_t port, mbedtls_ssl_context *ssl, bool offered, uint32_t handshake_ms);
+
+    /**
+     * Drop cached session of host:port after handshake failure, in case it is the cause
+     */
+    void handshake_failed(const char *hostname, uint16_t port);
+
+    static const Stats &stats()
+    {
+        return _stats;
+    }
+
+    static void print_stats();
+
+private:
+    TLSSessionCache();
+
+    struct Entry {
+        uint32_t                key;        /**< Hash of host:port. 0 for free. */
+        uint32_t                used;       /**< Last use, for LRU replacement */
+        mbedtls_ssl_session     session;
+    };
+
+    static uint32_t make_key(const char *hostname, uint16_t port);
+
+    Entry *find(uint32_t key);
+    Entry *alloc(uint32_t key);
+    void drop(Entry *entry);
+
+#if DEVICE_FLASH && MBED_CONF_MY_TLSSOCKET_TLS_SESSION_PERSIST
+    bool restore(uint32_t key, mbedtls_ssl_session *session);
+    void save(const Entry *entry);
+    void erase(uint32_t key);
+#endif
+
+    PlatformMutex       _mutex;
+    Entry               _entries[MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE];
+    uint32_t            _clock;
+
+    static Stats        _stats;
+};
+
+#endif  // MBED_CONF_MY_TLSSOCKET_TLS_SESSION_CACHE_SIZE > 0
+
+#endif // _TLS_SESSION_CACHE_H_
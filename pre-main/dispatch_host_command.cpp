@@ -30,6 +30,21 @@ extern "C" {
     MBED_USED void dispatch_host_command(int);
     MBED_WEAK void print_heap_stats(void);
     MBED_WEAK void print_stack_statistics(void);
+    MBED_WEAK void print_telemetry_journal_stats(void);
+    MBED_WEAK void print_mqtt_reconnect_stats(void);
+    MBED_WEAK void print_telemetry_batcher_stats(void);
+    MBED_WEAK void print_shadow_delta_stats(void);
+    MBED_WEAK void print_tls_session_stats(void);
+    MBED_WEAK void print_tls_credential_stats(void);
+    MBED_WEAK void print_tls_heap_stats(void);
+    MBED_WEAK void print_tls_handshake_stats(void);
+    MBED_WEAK void print_connection_timing_stats(void);
+    MBED_WEAK void print_tls_read_ahead_stats(void);
+    MBED_WEAK void print_tls_write_combine_stats(void);
+    MBED_WEAK void print_tls_cert_pinning_stats(void);
+    MBED_WEAK void print_http_parser_benchmark(void);
+    MBED_WEAK void print_socket_wait_stats(void);
+    MBED_WEAK void print_https_connection_pool_stats(void);
 }
 
 void dispatch_host_command(int c)
@@ -42,5 +57,95 @@ void dispatch_host_command(int c)
         case 's':
             print_stack_statistics();
             break;
+
+        case 'j':
+            if (print_telemetry_journal_stats) {
+                print_telemetry_journal_stats();
+            }
+            break;
+
+        case 'r':
+            if (print_mqtt_reconnect_stats) {
+                print_mqtt_reconnect_stats();
+            }
+            break;
+
+        case 'b':
+            if (print_telemetry_batcher_stats) {
+                print_telemetry_batcher_stats();
+            }
+            break;
+
+        case 'd':
+            if (print_shadow_delta_stats) {
+                print_shadow_delta_stats();
+            }
+            break;
+
+        case 't':
+            if (print_tls_session_stats) {
+                print_tls_session_stats();
+            }
+            break;
+
+        case 'k':
+            if (print_tls_credential_stats) {
+                print_tls_credential_stats();
+            }
+            break;
+
+        case 'm':
+            if (print_tls_heap_stats) {
+                print_tls_heap_stats();
+            }
+            break;
+
+        case 'p':
+            if (print_tls_handshake_stats) {
+                print_tls_handshake_stats();
+            }
+            break;
+
+        case 'c':
+            if (print_connection_timing_stats) {
+                print_connection_timing_stats();
+            }
+            break;
+
+        case 'a':
+            if (print_tls_read_ahead_stats) {
+                print_tls_read_ahead_stats();
+            }
+            break;
+
+        case 'w':
+            if (print_tls_write_combine_stats) {
+                print_tls_write_combine_stats();
+            }
+            break;
+
+        case 'v':
+            if (print_tls_cert_pinning_stats) {
+                print_tls_cert_pinning_stats();
+            }
+            break;
+
+        case 'x':
+            if (print_http_parser_benchmark) {
+                print_http_parser_benchmark();
+            }
+            break;
+
+        case 'n':
+            if (print_socket_wait_stats) {
+                print_socket_wait_stats();
+            }
+            break;
+
+        case 'o':
+            if (print_https_connection_pool_stats) {
+                print_https_connection_pool_stats();
+            }
+            break;
     }
 }
@@ -23,8 +23,9 @@
  * In Mbed OS boot sequence, mbed_main(), designed for user application override, is run
  * before main(). We use it to run the following tasks:
  *
- * 1. Simulate provision process for development
- * 2. Set up event queue for dispatching host command
+ * 1. Route Mbed TLS heap thru tracker, before anything allocates thru Mbed TLS
+ * 2. Simulate provision process for development
+ * 3. Set up event queue for dispatching host command
  *
  * WARNING: For mass production, remove this file.
  */
@@ -34,12 +35,16 @@
 
 extern "C" {
     MBED_USED void mbed_main(void);
+    MBED_WEAK void install_tls_heap_tracker(void);
     MBED_WEAK void provision(void);
     MBED_WEAK void pump_host_command(void);
 }
 
 void mbed_main(void)
 {
+    if (install_tls_heap_tracker) {
+        install_tls_heap_tracker();
+    }
     provision();
     /* Spare memory if event queue is unnecessary */
     if (pump_host_command) {
@@ -0,0 +1,70 @@
+/* Bytes on the wire per telemetry sample, by batch size
+ *
+ * Encodes batches of 1..batch-max-samples samples as TelemetryBatcher does for the
+ * UpdateThingShadow publish, and accounts MQTT PUBLISH and TLS record overhead the same way
+ * as on target (host command b). Larger batches must cost fewer bytes per sample.
+ */
+
+#include "mbed.h"
+#include "TelemetryBatcher.h"
+#include "host_test.h"
+
+namespace {
+
+const char CLIENT_NAME[] = "002E0051-013B87F3-00000021";
+const char TOPIC[] = "$aws/things/Nuvoton-Mbed-D001/shadow/update";
+
+/* As MAX_TELEMETRY_PAYLOAD_SIZE of main.cpp with MAX_MQTT_PACKET_SIZE 1000, less clientToken */
+const size_t MAX_PAYLOAD = 1000 - 5 - 2 - (sizeof (TOPIC) - 1) - 2 - 1 - 32;
+
+/* Sensor samples every 500 ms with readings drifting a little */
+void make_samples(TelemetryRecord *records, size_t n)
+{
+    for (size_t i = 0; i < n; i ++) {
+        records[i].timestamp = 1630637720 + (uint32_t) (i / 2);
+        records[i].temperature = 27.31f + 0.02f * i;
+        records[i].humidity = 48.75f - 0.05f * i;
+        records[i].pressure = 100712.25f + 1.5f * i;
+    }
+}
+
+void test_wire_bytes_per_sample()
+{
+    TelemetryRecord records[MBED_CONF_MY_MQTT_BATCH_MAX_SAMPLES];
+    uint32_t last_per_sample = UINT32_MAX;
+
+    make_samples(records, MBED_CONF_MY_MQTT_BATCH_MAX_SAMPLES);
+
+    printf("batch  payload  wire  wire/sample\n");
+    for (size_t n = 1; n <= MBED_CONF_MY_MQTT_BATCH_MAX_SAMPLES; n ++) {
+        if (TelemetryBatcher::fit(CLIENT_NAME, records, n, MAX_PAYLOAD) < n) {
+            printf("%5u  exceeds payload bound %u\n", (unsigned) n, (unsigned) MAX_PAYLOAD);
+            break;
+        }
+
+        char payload[1000];
+        int len = TelemetryBatcher::encode(payload, sizeof (payload), CLIENT_NAME, records, n);
+        HOST_TEST_ASSERT(len > 0 && (size_t) len < sizeof (payload));
+
+        /* One publish of the batch alone */
+        TelemetryBatcher::Stats before = TelemetryBatcher::stats();
+        TelemetryBatcher::account(n, len, sizeof (TOPIC) - 1);
+        uint32_t wire = TelemetryBatcher::stats().wire_bytes - before.wire_bytes;
+        uint32_t per_sample = wire / n;
+
+        printf("%5u  %7d  %4u  %11u\n", (unsigned) n, len, (unsigned) wire, (unsigned) per_sample);
+
+        HOST_TEST_ASSERT(per_sample < last_per_sample);
+        last_per_sample = per_sample;
+    }
+    printf("\n");
+}
+
+}
+
+int main()
+{
+    HOST_TEST_RUN(test_wire_bytes_per_sample);
+
+    return 0;
+}
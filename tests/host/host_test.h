@@ -0,0 +1,37 @@
+#ifndef _HOST_TEST_H_
+#define _HOST_TEST_H_
+
+/* Host test helpers
+ *
+ * A failed check prints where and aborts, so ctest reports the test failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HOST_TEST_ASSERT(expr)                                                      \
+    do {                                                                            \
+        if (! (expr)) {                                                             \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr);        \
+            abort();                                                                \
+        }                                                                           \
+    } while (0)
+
+#define HOST_TEST_ASSERT_EQUAL(expected, actual)                                    \
+    do {                                                                            \
+        long long e_ = (long long) (expected);                                      \
+        long long a_ = (long long) (actual);                                        \
+        if (e_ != a_) {                                                             \
+            printf("%s:%d: check failed: %s == %s (%lld != %lld)\n",                \
+                   __FILE__, __LINE__, #expected, #actual, e_, a_);                 \
+            abort();                                                                \
+        }                                                                           \
+    } while (0)
+
+#define HOST_TEST_RUN(test)                                                         \
+    do {                                                                            \
+        printf("Running %s\n", #test);                                              \
+        test();                                                                     \
+    } while (0)
+
+#endif // _HOST_TEST_H_
@@ -0,0 +1,114 @@
+/* HTTP response parser: line and chunk framing, and throughput
+ *
+ * Checks that a line longer than max-header-line fails the response rather than be cut, and
+ * that a chunk is followed by exactly one optional CR before LF, fed at once and byte by byte.
+ * Then reports parse throughput of the canned chunked response fed in small pieces, as host
+ * command 'x' does on target with my-https.parser-benchmark.
+ */
+
+#include "mbed.h"
+#include "HttpResponseParser.h"
+#include "host_test.h"
+
+#include <algorithm>
+#include <string>
+
+extern "C" void print_http_parser_benchmark(void);
+
+namespace {
+
+const size_t MAX_LINE = MBED_CONF_MY_HTTPS_MAX_HEADER_LINE;
+
+struct Sink {
+    std::string body;
+
+    void on_body(const char *data, size_t len)
+    {
+        body.append(data, len);
+    }
+};
+
+/* Bytes consumed, or -1. In pieces of piece bytes. */
+int parse(HttpResponseParser &parser, Sink &sink, const std::string &response, size_t piece)
+{
+    sink.body.clear();
+    parser.attach(nullptr, nullptr, callback(&sink, &Sink::on_body));
+    parser.reset();
+
+    size_t pos = 0;
+    while (pos < response.size() && ! parser.done()) {
+        int consumed = parser.feed(response.data() + pos, std::min(piece, response.size() - pos));
+        if (consumed < 0) {
+            return -1;
+        }
+        pos += consumed;
+    }
+
+    return (int) pos;
+}
+
+/* Response with one header line of line_len bytes before CRLF */
+std::string with_header_line(size_t line_len)
+{
+    std::string line = "x-amzn-RequestId: ";
+    line.append(line_len - line.size(), 'a');
+
+    return "HTTP/1.1 200 OK\r\n" + line + "\r\n" "Content-Length: 2\r\n" "\r\n" "{}";
+}
+
+void test_line_too_long()
+{
+    HttpResponseParser parser;
+    Sink sink;
+
+    /* Longest line with its CR and terminator */
+    std::string response = with_header_line(MAX_LINE - 2);
+    HOST_TEST_ASSERT_EQUAL(response.size(), parse(parser, sink, response, response.size()));
+    HOST_TEST_ASSERT(parser.done());
+    HOST_TEST_ASSERT(sink.body == "{}");
+
+    response = with_header_line(MAX_LINE - 1);
+    HOST_TEST_ASSERT_EQUAL(-1, parse(parser, sink, response, response.size()));
+    HOST_TEST_ASSERT(strcmp(parser.error(), "header line too long") == 0);
+}
+
+void test_chunk_data_end()
+{
+    const char *HEAD = "HTTP/1.1 200 OK\r\n" "Transfer-Encoding: chunked\r\n" "\r\n";
+    HttpResponseParser parser;
+    Sink sink;
+
+    for (size_t piece = 1; piece <= 64; piece += 63) {
+        std::string response = std::string(HEAD) + "5\r\nhello\r\n" "1\r\n!\n" "0\r\n" "\r\n";
+        HOST_TEST_ASSERT_EQUAL(response.size(), parse(parser, sink, response, piece));
+        HOST_TEST_ASSERT(parser.done());
+        HOST_TEST_ASSERT(sink.body == "hello!");
+
+        response = std::string(HEAD) + "5\r\nhello\r\r\n" "0\r\n" "\r\n";
+        HOST_TEST_ASSERT_EQUAL(-1, parse(parser, sink, response, piece));
+        HOST_TEST_ASSERT(strcmp(parser.error(), "chunk not followed by CRLF") == 0);
+
+        response = std::string(HEAD) + "5\r\nhello\rx\n" "0\r\n" "\r\n";
+        HOST_TEST_ASSERT_EQUAL(-1, parse(parser, sink, response, piece));
+    }
+}
+
+void test_throughput()
+{
+    /* kB/s */
+    uint32_t kbps = HttpResponseParser::benchmark(500);
+    HOST_TEST_ASSERT(kbps > 0);
+
+    print_http_parser_benchmark();
+}
+
+}
+
+int main()
+{
+    HOST_TEST_RUN(test_line_too_long);
+    HOST_TEST_RUN(test_chunk_data_end);
+    HOST_TEST_RUN(test_throughput);
+
+    return 0;
+}
@@ -0,0 +1,530 @@
+#include "loopback_broker.h"
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/ssl_ticket.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/net_sockets.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+const char LoopbackBroker::HOSTNAME[] = "localhost";
+
+namespace {
+
+/* MQTT control packet types */
+enum {
+    CONNECT = 1,
+    PUBLISH = 3,
+    PUBACK = 4,
+    SUBSCRIBE = 8,
+    UNSUBSCRIBE = 10,
+    PINGREQ = 12,
+    DISCONNECT = 14
+};
+
+int gen_key(mbedtls_pk_context *key, mbedtls_ctr_drbg_context *drbg)
+{
+    int rc = mbedtls_pk_setup(key, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY));
+    if (rc != 0) {
+        return rc;
+    }
+    return mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(*key), mbedtls_ctr_drbg_random, drbg);
+}
+
+int write_cert(char *pem, size_t size, mbedtls_pk_context *subject_key, const char *subject_name,
+               mbedtls_pk_context *issuer_key, const char *issuer_name, int serial, bool ca,
+               mbedtls_ctr_drbg_context *drbg)
+{
+    mbedtls_x509write_cert crt;
+    mbedtls_mpi sn;
+    int rc;
+
+    mbedtls_x509write_crt_init(&crt);
+    mbedtls_mpi_init(&sn);
+
+    mbedtls_x509write_crt_set_version(&crt, MBEDTLS_X509_CRT_VERSION_3);
+    mbedtls_x509write_crt_set_md_alg(&crt, MBEDTLS_MD_SHA256);
+    mbedtls_x509write_crt_set_subject_key(&crt, subject_key);
+    mbedtls_x509write_crt_set_issuer_key(&crt, issuer_key);
+
+    if ((rc = mbedtls_mpi_lset(&sn, serial)) != 0 ||
+            (rc = mbedtls_x509write_crt_set_serial(&crt, &sn)) != 0 ||
+            (rc = mbedtls_x509write_crt_set_subject_name(&crt, subject_name)) != 0 ||
+            (rc = mbedtls_x509write_crt_set_issuer_name(&crt, issuer_name)) != 0 ||
+            (rc = mbedtls_x509write_crt_set_validity(&crt, "20200101000000", "20491231235959")) != 0 ||
+            (rc = mbedtls_x509write_crt_set_basic_constraints(&crt, ca ? 1 : 0, -1)) != 0) {
+        goto cleanup;
+    }
+    if (ca && (rc = mbedtls_x509write_crt_set_key_usage(&crt, MBEDTLS_X509_KU_KEY_CERT_SIGN)) != 0) {
+        goto cleanup;
+    }
+
+    rc = mbedtls_x509write_crt_pem(&crt, (unsigned char *) pem, size, mbedtls_ctr_drbg_random, drbg);
+
+cleanup:
+    mbedtls_mpi_free(&sn);
+    mbedtls_x509write_crt_free(&crt);
+    return rc;
+}
+
+int bio_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    ssize_t n = ::send(*(int *) ctx, buf, len, MSG_NOSIGNAL);
+    if (n < 0) {
+        return errno == EINTR ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+    return (int) n;
+}
+
+int bio_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    ssize_t n = ::recv(*(int *) ctx, buf, len, 0);
+    if (n < 0) {
+        return errno == EINTR ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+    return (int) n;
+}
+
+bool read_full(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len)
+{
+    while (len) {
+        int rc = mbedtls_ssl_read(ssl, buf, len);
+        if (rc == MBEDTLS_ERR_SSL_WANT_READ || rc == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    return true;
+}
+
+bool write_full(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len)
+{
+    while (len) {
+        int rc = mbedtls_ssl_write(ssl, buf, len);
+        if (rc == MBEDTLS_ERR_SSL_WANT_READ || rc == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    return true;
+}
+
+/* Fixed header: type/flags and remaining length */
+size_t encode_fixed_header(unsigned char *buf, unsigned char type_flags, size_t rem_len)
+{
+    size_t n = 0;
+
+    buf[n ++] = type_flags;
+    do {
+        unsigned char c = rem_len % 128;
+        rem_len /= 128;
+        buf[n ++] = c | (rem_len ? 0x80 : 0);
+    } while (rem_len);
+
+    return n;
+}
+
+/* Topic filter with + and # wildcards against topic name */
+bool topic_matches(const std::string &filter, const std::string &topic)
+{
+    size_t f = 0;
+    size_t t = 0;
+
+    while (f < filter.size()) {
+        if (filter[f] == '#') {
+            return true;
+        }
+        if (filter[f] == '+') {
+            while (t < topic.size() && topic[t] != '/') {
+                t ++;
+            }
+            f ++;
+            continue;
+        }
+        if (t >= topic.size() || filter[f] != topic[t]) {
+            return false;
+        }
+        f ++;
+        t ++;
+    }
+
+    return t == topic.size();
+}
+
+/* Read topic filters of SUBSCRIBE (with QoS byte) or UNSUBSCRIBE after packet ID */
+bool parse_filters(const std::vector<unsigned char> &body, bool with_qos, std::vector<std::string> &filters)
+{
+    size_t pos = 2;
+
+    while (pos < body.size()) {
+        if (pos + 2 > body.size()) {
+            return false;
+        }
+        size_t len = (body[pos] << 8) | body[pos + 1];
+        pos += 2;
+        if (pos + len + (with_qos ? 1 : 0) > body.size()) {
+            return false;
+        }
+        filters.push_back(std::string((const char *) &body[pos], len));
+        pos += len + (with_qos ? 1 : 0);
+    }
+
+    return true;
+}
+
+/* MQTT session of one connection, till disconnect or error */
+void serve_mqtt(mbedtls_ssl_context *ssl)
+{
+    std::vector<std::string> subscriptions;
+    std::vector<unsigned char> body;
+
+    while (true) {
+        unsigned char header;
+        unsigned char c;
+        size_t rem_len = 0;
+        size_t mul = 1;
+
+        if (! read_full(ssl, &header, 1)) {
+            return;
+        }
+        do {
+            if (! read_full(ssl, &c, 1) || mul > 128 * 128 * 128) {
+                return;
+            }
+            rem_len += (c & 0x7F) * mul;
+            mul *= 128;
+        } while (c & 0x80);
+
+        body.resize(rem_len);
+        if (rem_len && ! read_full(ssl, body.data(), rem_len)) {
+            return;
+        }
+
+        switch (header >> 4) {
+            case CONNECT: {
+                static const unsigned char connack[] = { 0x20, 0x02, 0x00, 0x00 };
+                if (! write_full(ssl, connack, sizeof (connack))) {
+                    return;
+                }
+                break;
+            }
+
+            case PUBLISH: {
+                int qos = (header >> 1) & 0x03;
+                if (rem_len < 2) {
+                    return;
+                }
+                size_t topic_len = (body[0] << 8) | body[1];
+                size_t pos = 2 + topic_len;
+                if (pos + (qos ? 2 : 0) > rem_len) {
+                    return;
+                }
+                std::string topic((const char *) &body[2], topic_len);
+
+                if (qos) {
+                    unsigned char puback[] = { PUBACK << 4, 0x02, body[pos], body[pos + 1] };
+                    if (! write_full(ssl, puback, sizeof (puback))) {
+                        return;
+                    }
+                    pos += 2;
+                }
+
+                /* Deliver once at QoS0, however many subscriptions match */
+                for (size_t i = 0; i < subscriptions.size(); i ++) {
+                    if (! topic_matches(subscriptions[i], topic)) {
+                        continue;
+                    }
+                    std::vector<unsigned char> pkt(5 + 2 + topic_len + (rem_len - pos));
+                    size_t n = encode_fixed_header(pkt.data(), PUBLISH << 4, 2 + topic_len + (rem_len - pos));
+                    memcpy(&pkt[n], body.data(), 2 + topic_len);
+                    n += 2 + topic_len;
+                    memcpy(&pkt[n], body.data() + pos, rem_len - pos);
+                    n += rem_len - pos;
+                    if (! write_full(ssl, pkt.data(), n)) {
+                        return;
+                    }
+                    break;
+                }
+                break;
+            }
+
+            case SUBSCRIBE: {
+                std::vector<std::string> filters;
+                if (rem_len < 2 || ! parse_filters(body, true, filters)) {
+                    return;
+                }
+                std::vector<unsigned char> suback(5 + 2 + filters.size());
+                size_t n = encode_fixed_header(suback.data(), 0x90, 2 + filters.size());
+                suback[n ++] = body[0];
+                suback[n ++] = body[1];
+                for (size_t i = 0; i < filters.size(); i ++) {
+                    subscriptions.push_back(filters[i]);
+                    /* Granted QoS0 */
+                    suback[n ++] = 0x00;
+                }
+                if (! write_full(ssl, suback.data(), n)) {
+                    return;
+                }
+                break;
+            }
+
+            case UNSUBSCRIBE: {
+                std::vector<std::string> filters;
+                if (rem_len < 2 || ! parse_filters(body, false, filters)) {
+                    return;
+                }
+                for (size_t i = 0; i < filters.size(); i ++) {
+                    for (size_t j = 0; j < subscriptions.size(); j ++) {
+                        if (subscriptions[j] == filters[i]) {
+                            subscriptions.erase(subscriptions.begin() + j);
+                            break;
+                        }
+                    }
+                }
+                unsigned char unsuback[] = { 0xB0, 0x02, body[0], body[1] };
+                if (! write_full(ssl, unsuback, sizeof (unsuback))) {
+                    return;
+                }
+                break;
+            }
+
+            case PINGREQ: {
+                static const unsigned char pingresp[] = { 0xD0, 0x00 };
+                if (! write_full(ssl, pingresp, sizeof (pingresp))) {
+                    return;
+                }
+                break;
+            }
+
+            case DISCONNECT:
+                return;
+
+            default:
+                /* PUBACK of our QoS0 deliveries never comes. Others are not for a broker. */
+                break;
+        }
+    }
+}
+
+}
+
+LoopbackBroker::LoopbackBroker() :
+    _pid(-1),
+    _port(0)
+{
+    _ca_cert_pem[0] = _server_cert_pem[0] = _server_key_pem[0] = '\0';
+    _client_cert_pem[0] = _client_key_pem[0] = '\0';
+}
+
+LoopbackBroker::~LoopbackBroker()
+{
+    stop();
+}
+
+int LoopbackBroker::start(const Options &options)
+{
+    int rc = generate();
+    if (rc != 0) {
+        return rc;
+    }
+
+    struct sockaddr_in sin;
+    socklen_t sin_len = sizeof (sin);
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        return -1;
+    }
+    memset(&sin, 0, sizeof (sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr *) &sin, sizeof (sin)) != 0 ||
+            listen(listen_fd, 8) != 0 ||
+            getsockname(listen_fd, (struct sockaddr *) &sin, &sin_len) != 0) {
+        close(listen_fd);
+        return -1;
+    }
+    _port = ntohs(sin.sin_port);
+
+    /* Nothing buffered to be printed twice */
+    fflush(stdout);
+
+    _pid = fork();
+    if (_pid < 0) {
+        close(listen_fd);
+        return -1;
+    }
+    if (_pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        serve(listen_fd, options);
+        _exit(0);
+    }
+
+    close(listen_fd);
+    return 0;
+}
+
+void LoopbackBroker::stop()
+{
+    if (_pid > 0) {
+        kill(_pid, SIGTERM);
+        waitpid(_pid, NULL, 0);
+        _pid = -1;
+    }
+}
+
+int LoopbackBroker::generate()
+{
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_pk_context ca_key;
+    mbedtls_pk_context server_key;
+    mbedtls_pk_context client_key;
+    static const char CA_NAME[] = "CN=Loopback Root CA,O=Loopback";
+    int rc;
+
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_pk_init(&ca_key);
+    mbedtls_pk_init(&server_key);
+    mbedtls_pk_init(&client_key);
+
+    if ((rc = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                                    (const unsigned char *) "loopback broker", 15)) != 0 ||
+            (rc = gen_key(&ca_key, &drbg)) != 0 ||
+            (rc = gen_key(&server_key, &drbg)) != 0 ||
+            (rc = gen_key(&client_key, &drbg)) != 0 ||
+            (rc = write_cert(_ca_cert_pem, sizeof (_ca_cert_pem), &ca_key, CA_NAME, &ca_key, CA_NAME, 1, true, &drbg)) != 0 ||
+            (rc = write_cert(_server_cert_pem, sizeof (_server_cert_pem), &server_key, "CN=localhost,O=Loopback",
+                             &ca_key, CA_NAME, 2, false, &drbg)) != 0 ||
+            (rc = write_cert(_renewed_cert_pem, sizeof (_renewed_cert_pem), &server_key, "CN=localhost,O=Loopback",
+                             &ca_key, CA_NAME, 4, false, &drbg)) != 0 ||
+            (rc = write_cert(_client_cert_pem, sizeof (_client_cert_pem), &client_key, "CN=Loopback Thing,O=Loopback",
+                             &ca_key, CA_NAME, 3, false, &drbg)) != 0 ||
+            (rc = mbedtls_pk_write_key_pem(&server_key, (unsigned char *) _server_key_pem, sizeof (_server_key_pem))) != 0 ||
+            (rc = mbedtls_pk_write_key_pem(&client_key, (unsigned char *) _client_key_pem, sizeof (_client_key_pem))) != 0) {
+        printf("LoopbackBroker: generating credentials failed: -0x%04x\n", -rc);
+    }
+
+    mbedtls_pk_free(&client_key);
+    mbedtls_pk_free(&server_key);
+    mbedtls_pk_free(&ca_key);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+
+    return rc;
+}
+
+void LoopbackBroker::serve(int listen_fd, const Options &options)
+{
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_x509_crt ca_cert;
+    mbedtls_x509_crt server_cert;
+    mbedtls_pk_context server_key;
+    mbedtls_ssl_config conf;
+    mbedtls_ssl_cache_context cache;
+    mbedtls_ssl_ticket_context ticket;
+    mbedtls_ssl_context ssl;
+    int served = 0;
+    int rc;
+
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_x509_crt_init(&ca_cert);
+    mbedtls_x509_crt_init(&server_cert);
+    mbedtls_pk_init(&server_key);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ssl_cache_init(&cache);
+    mbedtls_ssl_ticket_init(&ticket);
+    mbedtls_ssl_init(&ssl);
+
+    if ((rc = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                                    (const unsigned char *) "loopback broker", 15)) != 0 ||
+            (rc = mbedtls_x509_crt_parse(&ca_cert, (const unsigned char *) _ca_cert_pem, strlen(_ca_cert_pem) + 1)) != 0 ||
+            (rc = mbedtls_x509_crt_parse(&server_cert, (const unsigned char *) _server_cert_pem, strlen(_server_cert_pem) + 1)) != 0 ||
+            (rc = mbedtls_pk_parse_key(&server_key, (const unsigned char *) _server_key_pem, strlen(_server_key_pem) + 1, NULL, 0)) != 0 ||
+            (rc = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                              MBEDTLS_SSL_PRESET_DEFAULT)) != 0 ||
+            (rc = mbedtls_ssl_conf_own_cert(&conf, &server_cert, &server_key)) != 0) {
+        printf("LoopbackBroker: setup failed: -0x%04x\n", -rc);
+        return;
+    }
+
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+    mbedtls_ssl_conf_ca_chain(&conf, &ca_cert, NULL);
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    if (options.session_cache) {
+        mbedtls_ssl_conf_session_cache(&conf, &cache, mbedtls_ssl_cache_get, mbedtls_ssl_cache_set);
+    }
+    if (options.session_tickets) {
+        if ((rc = mbedtls_ssl_ticket_setup(&ticket, mbedtls_ctr_drbg_random, &drbg, MBEDTLS_CIPHER_AES_256_GCM, 86400)) != 0) {
+            printf("LoopbackBroker: session ticket setup failed: -0x%04x\n", -rc);
+            return;
+        }
+        mbedtls_ssl_conf_session_tickets_cb(&conf, mbedtls_ssl_ticket_write, mbedtls_ssl_ticket_parse, &ticket);
+    }
+
+    if ((rc = mbedtls_ssl_setup(&ssl, &conf)) != 0) {
+        printf("LoopbackBroker: SSL setup failed: -0x%04x\n", -rc);
+        return;
+    }
+
+    while (true) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+        /* Replaced in place, where own cert of conf points */
+        if (options.renew_after && served ++ == options.renew_after) {
+            mbedtls_x509_crt_free(&server_cert);
+            mbedtls_x509_crt_init(&server_cert);
+            if ((rc = mbedtls_x509_crt_parse(&server_cert, (const unsigned char *) _renewed_cert_pem,
+                                             strlen(_renewed_cert_pem) + 1)) != 0) {
+                printf("LoopbackBroker: renewing server certificate failed: -0x%04x\n", -rc);
+                return;
+            }
+        }
+
+        mbedtls_ssl_set_bio(&ssl, &fd, bio_send, bio_recv, NULL);
+        while ((rc = mbedtls_ssl_handshake(&ssl)) == MBEDTLS_ERR_SSL_WANT_READ || rc == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        }
+        if (rc == 0) {
+            serve_mqtt(&ssl);
+            mbedtls_ssl_close_notify(&ssl);
+        }
+
+        close(fd);
+        mbedtls_ssl_session_reset(&ssl);
+    }
+}
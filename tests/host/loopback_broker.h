@@ -0,0 +1,94 @@
+#ifndef _LOOPBACK_BROKER_H_
+#define _LOOPBACK_BROKER_H_
+
+/* LoopbackBroker = AWS IoT MQTT broker stand-in on 127.0.0.1 over Mbed TLS, for host measurements
+ *
+ * Runs in a child process, so that its heap and CPU don't count in those of the client
+ * measured. Start it before the client creates any thread.
+ *
+ * Credentials are generated on start(): an EC P-256 root CA, a server certificate for
+ * "localhost" and a client certificate, both signed by the root CA. The client takes them
+ * as PEM, as it would take those of credentials/.
+ *
+ * One connection is served at a time, with client certificate required as AWS IoT does.
+ * MQTT handling is what the example needs: CONNECT, SUBSCRIBE/UNSUBSCRIBE granted QoS0,
+ * PUBLISH QoS0/QoS1 acknowledged and delivered at QoS0 to matching subscriptions of the same
+ * connection, PINGREQ and DISCONNECT.
+ *
+ * Sessions can be resumed from server session cache (session ID) and from session tickets,
+ * each to be turned off to compare. The server certificate can be renewed after a number of
+ * connections, i.e. another one for the same key from the same root CA.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+class LoopbackBroker
+{
+public:
+    struct Options {
+        bool    session_cache;      /**< Resume by session ID from server session cache */
+        bool    session_tickets;    /**< Issue and accept session tickets */
+        int     renew_after;        /**< Connections served before server certificate renewed. 0 for never. */
+    };
+
+    static const char HOSTNAME[];   /**< Common name of server certificate */
+
+    LoopbackBroker();
+    ~LoopbackBroker();
+
+    /**
+     * Generate credentials, listen on 127.0.0.1 and fork broker process
+     *
+     * @return  0 on success, or Mbed TLS error, or -1 on socket/fork failure
+     */
+    int start(const Options &options);
+
+    /**
+     * Terminate broker process
+     */
+    void stop();
+
+    uint16_t port() const
+    {
+        return _port;
+    }
+
+    const char *root_ca_pem() const
+    {
+        return _ca_cert_pem;
+    }
+
+    const char *client_cert_pem() const
+    {
+        return _client_cert_pem;
+    }
+
+    const char *client_key_pem() const
+    {
+        return _client_key_pem;
+    }
+
+private:
+    /**
+     * Generate CA, server and client credentials as PEM
+     */
+    int generate();
+
+    /**
+     * Broker process: accept connections one by one, till terminated
+     */
+    void serve(int listen_fd, const Options &options);
+
+    pid_t       _pid;
+    uint16_t    _port;
+    char        _ca_cert_pem[2048];
+    char        _server_cert_pem[2048];
+    char        _renewed_cert_pem[2048];
+    char        _server_key_pem[512];
+    char        _client_cert_pem[2048];
+    char        _client_key_pem[512];
+};
+
+#endif // _LOOPBACK_BROKER_H_
@@ -0,0 +1,167 @@
+/* MQTT benchmark of AWS_IoT_MQTT_Test on host, against the loopback broker
+ *
+ *   mqtt_benchmark [-p <payload bytes>] [-q <QoS 0|1>] [-n <messages>]
+ *
+ * Same path as run_benchmark() of main.cpp on target: MyTLSSocket connected by connect_async()
+ * on the handshake thread, MQTT::Client over MQTTPipelineNetwork, QoS1 publishes pipelined
+ * through MQTTAsyncPublisher, and MQTTBenchmark reporting msgs/s, p50/p99 latency (publish
+ * to PUBACK for QoS1) and heap peak. Heap is that of the whole process, as mbed heap stats
+ * on target; the broker runs in its own process. Payload and QoS default to the first
+ * benchmark-payload-sizes and benchmark-qos of my-mqtt.
+ */
+
+#include "mbed.h"
+#include "MyTLSSocket.h"
+#include "MQTTmbed.h"
+#include "MQTTClient.h"
+#include "MQTTPipelineNetwork.h"
+#include "MQTTAsyncPublisher.h"
+#include "MQTTBenchmark.h"
+#include "loopback_broker.h"
+#include "host_test.h"
+
+#include <unistd.h>
+
+namespace {
+
+/* As main.cpp */
+const char BENCHMARK_MQTT_TOPIC[] = "Nuvoton/Mbed/D001/bench";
+const int MAX_MQTT_PACKET_SIZE = 1000;
+const int MAX_MQTT_SUBSCRIPTIONS = MBED_CONF_MY_MQTT_MAX_SUBSCRIPTIONS;
+
+typedef MQTTPipelineNetwork<MyTLSSocket> MyMQTTNetwork;
+typedef MQTT::Client<MyMQTTNetwork, Countdown, MAX_MQTT_PACKET_SIZE, MAX_MQTT_SUBSCRIPTIONS> MyMQTTClient;
+typedef MQTTAsyncPublisher<MyTLSSocket, MAX_MQTT_PACKET_SIZE> MyMQTTPublisher;
+
+/* Messages by default, as benchmark-messages is 0 (off) on target by default */
+const size_t DEFAULT_MESSAGES = 1000;
+
+size_t benchmark_payload_len;
+
+int encode_benchmark_payload(char *buf, size_t size)
+{
+    for (size_t i = 0; i < benchmark_payload_len && i < size; i ++) {
+        buf[i] = 'A' + (i % 26);
+    }
+    return (int) benchmark_payload_len;
+}
+
+/* Connect on the handshake thread and wait, as connect_tls() of main.cpp */
+const std::chrono::milliseconds TLS_CONNECT_WAIT(MBED_CONF_MY_TLSSOCKET_ASYNC_CONNECT_TIMEOUT * 2);
+
+/* Outlives the wait, as a late callback may still come after it has timed out */
+struct Completion {
+    EventFlags      flags;
+    nsapi_error_t   rc;
+
+    void done(nsapi_error_t result)
+    {
+        rc = result;
+        flags.set(1);
+    }
+} completion;
+
+nsapi_error_t connect_tls(MyTLSSocket *tlssocket, const SocketAddress &sockaddr)
+{
+    completion.flags.clear(1);
+
+    nsapi_error_t rc = tlssocket->connect_async(sockaddr, callback(&completion, &Completion::done));
+    if (rc != NSAPI_ERROR_IN_PROGRESS) {
+        return rc;
+    }
+    if (completion.flags.wait_any_for(1, TLS_CONNECT_WAIT) & osFlagsError) {
+        return NSAPI_ERROR_TIMEOUT;
+    }
+
+    return completion.rc;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t payload_sizes[] = { MBED_CONF_MY_MQTT_BENCHMARK_PAYLOAD_SIZES };
+    size_t payload_len = payload_sizes[0];
+    int qos = MBED_CONF_MY_MQTT_BENCHMARK_QOS;
+    size_t messages = DEFAULT_MESSAGES;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:q:n:")) != -1) {
+        switch (opt) {
+            case 'p':
+                payload_len = strtoul(optarg, NULL, 0);
+                break;
+            case 'q':
+                qos = atoi(optarg);
+                break;
+            case 'n':
+                messages = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                printf("Usage: %s [-p <payload bytes>] [-q <QoS 0|1>] [-n <messages>]\n", argv[0]);
+                return 2;
+        }
+    }
+    /* Fixed header, topic, packet ID and payload in one MQTT packet */
+    if (payload_len == 0 || 5 + 2 + strlen(BENCHMARK_MQTT_TOPIC) + 2 + payload_len >= (size_t) MAX_MQTT_PACKET_SIZE ||
+            (qos != 0 && qos != 1) || messages == 0) {
+        printf("Payload must be 1..%d bytes, QoS 0 or 1, messages > 0\n",
+               (int) (MAX_MQTT_PACKET_SIZE - 5 - 2 - strlen(BENCHMARK_MQTT_TOPIC) - 2 - 1));
+        return 2;
+    }
+
+    /* Before any thread of ours */
+    LoopbackBroker broker;
+    LoopbackBroker::Options options = { true, true, 0 };
+    HOST_TEST_ASSERT_EQUAL(0, broker.start(options));
+
+    NetworkInterface *net = NetworkInterface::get_default_instance();
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, net->connect());
+    SocketAddress sockaddr;
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, net->gethostbyname(LoopbackBroker::HOSTNAME, &sockaddr));
+    sockaddr.set_port(broker.port());
+
+    MyTLSSocket *tlssocket = new MyTLSSocket;
+    MyMQTTNetwork *mqtt_network = new MyMQTTNetwork(*tlssocket);
+    MyMQTTClient *mqtt_client = new MyMQTTClient(*mqtt_network);
+    MyMQTTPublisher *publisher = new MyMQTTPublisher(*mqtt_network);
+
+    tlssocket->set_hostname(LoopbackBroker::HOSTNAME);
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_root_ca_cert(broker.root_ca_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_client_cert_key(broker.client_cert_pem(), broker.client_key_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->open(net));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, connect_tls(tlssocket, sockaddr));
+    tlssocket->set_blocking(true);
+
+    MQTTPacket_connectData conn_data = MQTTPacket_connectData_initializer;
+    conn_data.MQTTVersion = 4;
+    conn_data.clientID.cstring = (char *) "host-benchmark";
+    conn_data.cleansession = 1;
+    MQTT::connackData connack_data;
+    HOST_TEST_ASSERT_EQUAL(0, mqtt_client->connect(conn_data, connack_data));
+
+    MQTTBenchmark bench;
+    HOST_TEST_ASSERT_EQUAL(MBED_SUCCESS, bench.start(payload_len, qos ? MQTT::QOS1 : MQTT::QOS0, messages));
+    printf("Benchmarking %d publishes of %d bytes with QoS%d\n", (int) messages, (int) payload_len, qos);
+    benchmark_payload_len = payload_len;
+    if (qos) {
+        bench.run_qos1(*publisher, *mqtt_client, BENCHMARK_MQTT_TOPIC, encode_benchmark_payload);
+    } else {
+        bench.run_qos0(*mqtt_client, BENCHMARK_MQTT_TOPIC, encode_benchmark_payload);
+    }
+    const MQTTBenchmark::Report &report = bench.finish();
+    MQTTBenchmark::print_report(report);
+    MyTLSSocket::print_handshake_stats();
+
+    HOST_TEST_ASSERT_EQUAL(messages, report.acked);
+
+    mqtt_client->disconnect();
+    delete publisher;
+    delete mqtt_client;
+    delete mqtt_network;
+    tlssocket->close();
+    delete tlssocket;
+
+    broker.stop();
+    return 0;
+}
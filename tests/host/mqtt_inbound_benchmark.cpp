@@ -0,0 +1,160 @@
+/* Inbound MQTT message rate on host against the loopback broker, by tls-read-ahead-size
+ *
+ * As benchmark_inbound() of main.cpp on target: QoS0 publishes to a topic matching the user
+ * topic filter come back from the broker, and the rate is over first to last arrival. Built
+ * with read-ahead on (tls-read-ahead-size default) and off (0). MyTLSSocket read() calls of
+ * the MQTT packet decoder against the recv() calls they took show what read-ahead saves.
+ *
+ * Publishes go in windows of WINDOW, each received back before the next, so that the broker
+ * never blocks on writing to us while we write to it.
+ */
+
+#include "mbed.h"
+#include "MyTLSSocket.h"
+#include "MQTTmbed.h"
+#include "MQTTClient.h"
+#include "MQTTPipelineNetwork.h"
+#include "loopback_broker.h"
+#include "host_test.h"
+
+namespace {
+
+/* As main.cpp */
+const char *USER_MQTT_TOPIC_FILTER = "Nuvoton/Mbed/+";
+const char BENCHMARK_INBOUND_MQTT_TOPIC[] = "Nuvoton/Mbed/bench_in";
+const int MAX_MQTT_PACKET_SIZE = 1000;
+const int MAX_MQTT_SUBSCRIPTIONS = MBED_CONF_MY_MQTT_MAX_SUBSCRIPTIONS;
+
+typedef MQTTPipelineNetwork<MyTLSSocket> MyMQTTNetwork;
+typedef MQTT::Client<MyMQTTNetwork, Countdown, MAX_MQTT_PACKET_SIZE, MAX_MQTT_SUBSCRIPTIONS> MyMQTTClient;
+
+const int MESSAGES = 2000;
+const int WINDOW = 32;
+const int RECEIVE_TIMEOUT_MS = 5000;
+
+LoopbackBroker broker;
+
+int arrived;
+HighResClock::time_point first_arrival;
+HighResClock::time_point last_arrival;
+
+void message_arrived(MQTT::MessageData &md)
+{
+    (void) md;
+    last_arrival = HighResClock::now();
+    if (arrived == 0) {
+        first_arrival = last_arrival;
+    }
+    arrived ++;
+}
+
+/* Yield till count messages arrived */
+bool receive(MyMQTTClient &mqtt_client, int count)
+{
+    Timer timer;
+    timer.start();
+    while (arrived < count) {
+        if (mqtt_client.yield(1) != MQTT::SUCCESS ||
+                std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed_time()).count() > RECEIVE_TIMEOUT_MS) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void test_inbound_rate()
+{
+    static const size_t payload_sizes[] = { MBED_CONF_MY_MQTT_BENCHMARK_PAYLOAD_SIZES };
+    const size_t payload_len = payload_sizes[0];
+    char payload[MAX_MQTT_PACKET_SIZE];
+    HOST_TEST_ASSERT(payload_len < sizeof (payload));
+    for (size_t i = 0; i < payload_len; i ++) {
+        payload[i] = 'A' + (i % 26);
+    }
+
+    NetworkInterface *net = NetworkInterface::get_default_instance();
+    SocketAddress sockaddr;
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, net->gethostbyname(LoopbackBroker::HOSTNAME, &sockaddr));
+    sockaddr.set_port(broker.port());
+
+    MyTLSSocket *tlssocket = new MyTLSSocket;
+    MyMQTTNetwork *mqtt_network = new MyMQTTNetwork(*tlssocket);
+    MyMQTTClient *mqtt_client = new MyMQTTClient(*mqtt_network);
+
+    tlssocket->set_hostname(LoopbackBroker::HOSTNAME);
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_root_ca_cert(broker.root_ca_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_client_cert_key(broker.client_cert_pem(), broker.client_key_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->open(net));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->connect(sockaddr));
+
+    MQTTPacket_connectData conn_data = MQTTPacket_connectData_initializer;
+    conn_data.MQTTVersion = 4;
+    conn_data.clientID.cstring = (char *) "host-inbound-benchmark";
+    conn_data.cleansession = 1;
+    MQTT::connackData connack_data;
+    HOST_TEST_ASSERT_EQUAL(0, mqtt_client->connect(conn_data, connack_data));
+    HOST_TEST_ASSERT_EQUAL(MQTT::SUCCESS, mqtt_client->subscribe(USER_MQTT_TOPIC_FILTER, MQTT::QOS0, message_arrived));
+
+    MQTT::Message message;
+    message.retained = false;
+    message.dup = false;
+    message.qos = MQTT::QOS0;
+    message.payload = payload;
+    message.payloadlen = payload_len;
+
+    printf("Benchmarking %d inbound messages of %d bytes, read-ahead %d bytes\n", MESSAGES, (int) payload_len,
+           MBED_CONF_MY_TLSSOCKET_TLS_READ_AHEAD_SIZE);
+    MyTLSSocket::ReadAheadStats before = MyTLSSocket::read_ahead_stats();
+    arrived = 0;
+
+    int sent = 0;
+    while (sent < MESSAGES) {
+        for (int i = 0; i < WINDOW && sent < MESSAGES; i ++, sent ++) {
+            HOST_TEST_ASSERT_EQUAL(MQTT::SUCCESS, mqtt_client->publish(BENCHMARK_INBOUND_MQTT_TOPIC, message));
+        }
+        HOST_TEST_ASSERT(receive(*mqtt_client, sent));
+    }
+
+    MyTLSSocket::ReadAheadStats after = MyTLSSocket::read_ahead_stats();
+    uint32_t reads = after.reads - before.reads;
+    uint32_t recvs = after.recvs - before.recvs;
+    uint64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(last_arrival - first_arrival).count();
+
+    printf("** MQTT INBOUND BENCHMARK **\n");
+    printf("**** received       : %d/%d\n", arrived, sent);
+    printf("**** rate           : %u msgs/s\n", elapsed_us ? (unsigned) ((uint64_t) (arrived - 1) * 1000000 / elapsed_us) : 0);
+    printf("**** read()/recv()  : %u/%u, %u.%02u read() per message\n", (unsigned) reads, (unsigned) recvs,
+           (unsigned) (reads / arrived), (unsigned) (reads * 100 / arrived % 100));
+    printf("****************************\n\n");
+    MyTLSSocket::print_read_ahead_stats();
+
+    HOST_TEST_ASSERT_EQUAL(MESSAGES, arrived);
+#if MBED_CONF_MY_TLSSOCKET_TLS_READ_AHEAD_SIZE > 0
+    /* Fixed header, remaining length and body of a message from one recv() */
+    HOST_TEST_ASSERT(recvs < reads);
+#else
+    HOST_TEST_ASSERT_EQUAL(reads, recvs);
+#endif
+
+    mqtt_client->disconnect();
+    delete mqtt_client;
+    delete mqtt_network;
+    tlssocket->close();
+    delete tlssocket;
+}
+
+}
+
+int main()
+{
+    /* Before any thread of ours */
+    LoopbackBroker::Options options = { false, false, 0 };
+    HOST_TEST_ASSERT_EQUAL(0, broker.start(options));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, NetworkInterface::get_default_instance()->connect());
+
+    HOST_TEST_RUN(test_inbound_rate);
+
+    broker.stop();
+    return 0;
+}
@@ -0,0 +1,119 @@
+/* ShadowDeltaEngine: acknowledgements of updates in flight arriving out of order */
+
+#include "mbed.h"
+#include "ShadowDeltaEngine.h"
+#include "host_test.h"
+
+#include <string>
+
+namespace {
+
+const char CLIENT_NAME[] = "002E0051-013B87F3-00000021";
+
+TelemetryRecord make_record(float temperature, float humidity, float pressure)
+{
+    TelemetryRecord record;
+
+    record.timestamp = 1630637720;
+    record.temperature = temperature;
+    record.humidity = humidity;
+    record.pressure = pressure;
+
+    return record;
+}
+
+/* Encoded update, also serving as its /update/accepted document: it carries the clientToken */
+std::string encode(ShadowDeltaEngine &engine, const TelemetryRecord &record)
+{
+    char buf[512];
+
+    int len = engine.encode(buf, sizeof (buf), &record, 1);
+    HOST_TEST_ASSERT(len > 0 && (size_t) len < sizeof (buf));
+
+    return std::string(buf, len);
+}
+
+/* Attribute reported in "reported", before "samples" */
+bool reports(const std::string &update, const char *attribute)
+{
+    size_t samples = update.find("\"samples\"");
+    size_t found = update.find(std::string("\"") + attribute + "\":");
+
+    return found != std::string::npos && found < samples;
+}
+
+void accept(ShadowDeltaEngine &engine, const std::string &update)
+{
+    engine.accepted(update.data(), update.size());
+}
+
+void test_in_order()
+{
+    ShadowDeltaEngine engine(CLIENT_NAME);
+
+    std::string first = encode(engine, make_record(25.0f, 50.0f, 100000.0f));
+    HOST_TEST_ASSERT(reports(first, "temperature"));
+    accept(engine, first);
+
+    /* Unchanged within tolerance: nothing but samples */
+    std::string second = encode(engine, make_record(25.05f, 50.2f, 100005.0f));
+    HOST_TEST_ASSERT(! reports(second, "clientName"));
+    HOST_TEST_ASSERT(! reports(second, "temperature"));
+    HOST_TEST_ASSERT(! reports(second, "humidity"));
+    HOST_TEST_ASSERT(! reports(second, "pressure"));
+}
+
+void test_older_accepted_last_not_merged()
+{
+    ShadowDeltaEngine engine(CLIENT_NAME);
+    uint32_t stale = ShadowDeltaEngine::stats().stale;
+
+    /* Two updates in flight, temperature moved in between */
+    std::string older = encode(engine, make_record(25.0f, 50.0f, 100000.0f));
+    std::string newer = encode(engine, make_record(26.0f, 50.0f, 100000.0f));
+
+    /* Newer acknowledged first, e.g. older re-sent with DUP */
+    accept(engine, newer);
+    accept(engine, older);
+    HOST_TEST_ASSERT_EQUAL(stale + 4, ShadowDeltaEngine::stats().stale);
+
+    /* Cache holds 26.0 from newer, not 25.0 from older */
+    std::string next = encode(engine, make_record(26.0f, 50.0f, 100000.0f));
+    HOST_TEST_ASSERT(! reports(next, "temperature"));
+    next = encode(engine, make_record(25.0f, 50.0f, 100000.0f));
+    HOST_TEST_ASSERT(reports(next, "temperature"));
+}
+
+void test_older_attribute_not_in_newer_merged()
+{
+    ShadowDeltaEngine engine(CLIENT_NAME);
+
+    std::string base = encode(engine, make_record(25.0f, 50.0f, 100000.0f));
+    accept(engine, base);
+
+    /* Older reports temperature. Newer, back within tolerance of cache, reports humidity only. */
+    std::string older = encode(engine, make_record(27.0f, 50.0f, 100000.0f));
+    std::string newer = encode(engine, make_record(25.05f, 55.0f, 100000.0f));
+    HOST_TEST_ASSERT(reports(older, "temperature"));
+    HOST_TEST_ASSERT(! reports(newer, "temperature"));
+    HOST_TEST_ASSERT(reports(newer, "humidity"));
+
+    /* Shadow holds temperature of older, untouched by newer */
+    accept(engine, newer);
+    accept(engine, older);
+
+    std::string next = encode(engine, make_record(27.0f, 55.0f, 100000.0f));
+    HOST_TEST_ASSERT(! reports(next, "temperature"));
+    HOST_TEST_ASSERT(! reports(next, "humidity"));
+}
+
+}
+
+int main()
+{
+    HOST_TEST_RUN(test_in_order);
+    HOST_TEST_RUN(test_older_accepted_last_not_merged);
+    HOST_TEST_RUN(test_older_attribute_not_in_newer_merged);
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef _HOST_KVMAP_H_
+#define _HOST_KVMAP_H_
+
+/* Host KVMap.h = no kvstore internal storage. Tests pass their KVStore in. */
+
+#include "KVStore.h"
+
+namespace mbed {
+
+class KVMap
+{
+public:
+    static KVMap &get_instance()
+    {
+        static KVMap kv_map;
+        return kv_map;
+    }
+
+    KVStore *get_internal_kv_instance(const char *name)
+    {
+        (void) name;
+        return NULL;
+    }
+};
+
+}
+
+#endif // _HOST_KVMAP_H_
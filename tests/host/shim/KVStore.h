@@ -0,0 +1,26 @@
+#ifndef _HOST_KVSTORE_H_
+#define _HOST_KVSTORE_H_
+
+/* Host KVStore.h = the get/set part of mbed::KVStore, for RAM-backed stores of tests */
+
+#include "mbed.h"
+
+namespace mbed {
+
+class KVStore
+{
+public:
+    typedef uint32_t create_flags_t;
+
+    virtual ~KVStore()
+    {
+    }
+
+    virtual int set(const char *key, const void *buffer, size_t size, uint32_t create_flags) = 0;
+
+    virtual int get(const char *key, void *buffer, size_t buffer_size, size_t *actual_size = NULL, size_t offset = 0) = 0;
+};
+
+}
+
+#endif // _HOST_KVSTORE_H_
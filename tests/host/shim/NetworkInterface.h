@@ -0,0 +1,73 @@
+#ifndef _HOST_NETWORK_INTERFACE_H_
+#define _HOST_NETWORK_INTERFACE_H_
+
+/* Host NetworkInterface = the host network, always up once connected */
+
+#include "mbed.h"
+#include "nsapi_types.h"
+#include "NetworkStack.h"
+#include "SocketAddress.h"
+
+class NetworkInterface
+{
+public:
+    NetworkInterface() :
+        _status(NSAPI_STATUS_DISCONNECTED)
+    {
+    }
+
+    virtual ~NetworkInterface()
+    {
+    }
+
+    virtual nsapi_error_t connect()
+    {
+        _status = NSAPI_STATUS_GLOBAL_UP;
+        return NSAPI_ERROR_OK;
+    }
+
+    virtual nsapi_error_t disconnect()
+    {
+        _status = NSAPI_STATUS_DISCONNECTED;
+        return NSAPI_ERROR_OK;
+    }
+
+    virtual nsapi_connection_status_t get_connection_status() const
+    {
+        return _status;
+    }
+
+    virtual nsapi_error_t gethostbyname(const char *host, SocketAddress *address,
+                                        nsapi_version_t version = NSAPI_UNSPEC, const char *interface_name = NULL)
+    {
+        (void) interface_name;
+        return get_stack()->gethostbyname(host, address, version);
+    }
+
+    virtual NetworkStack *get_stack()
+    {
+        return NetworkStack::get_default_instance();
+    }
+
+    static NetworkInterface *get_default_instance()
+    {
+        static NetworkInterface host;
+        return &host;
+    }
+
+private:
+    nsapi_connection_status_t   _status;
+};
+
+inline NetworkStack *nsapi_create_stack(NetworkInterface *iface)
+{
+    return iface->get_stack();
+}
+
+template <typename IF>
+NetworkStack *nsapi_create_stack(IF *iface)
+{
+    return nsapi_create_stack(static_cast<NetworkInterface *>(iface));
+}
+
+#endif // _HOST_NETWORK_INTERFACE_H_
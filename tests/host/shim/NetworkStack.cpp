@@ -0,0 +1,41 @@
+#include "mbed.h"
+#include "NetworkStack.h"
+
+#include <netdb.h>
+
+nsapi_error_t NetworkStack::gethostbyname(const char *host, SocketAddress *address, nsapi_version_t version)
+{
+    /* Literal address */
+    if (address->set_ip_address(host)) {
+        return NSAPI_ERROR_OK;
+    }
+
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+
+    memset(&hints, 0, sizeof (hints));
+    hints.ai_family = (version == NSAPI_IPv6) ? AF_INET6 : AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &res) != 0 || res == NULL) {
+        if (version != NSAPI_UNSPEC) {
+            return NSAPI_ERROR_DNS_FAILURE;
+        }
+        hints.ai_family = AF_INET6;
+        if (getaddrinfo(host, NULL, &hints, &res) != 0 || res == NULL) {
+            return NSAPI_ERROR_DNS_FAILURE;
+        }
+    }
+
+    uint16_t port = address->get_port();
+    address->set_sockaddr(res->ai_addr);
+    address->set_port(port);
+    freeaddrinfo(res);
+
+    return NSAPI_ERROR_OK;
+}
+
+NetworkStack *NetworkStack::get_default_instance()
+{
+    static NetworkStack posix;
+    return &posix;
+}
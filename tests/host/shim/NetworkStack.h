@@ -0,0 +1,29 @@
+#ifndef _HOST_NETWORK_STACK_H_
+#define _HOST_NETWORK_STACK_H_
+
+/* Host NetworkStack = the POSIX socket stack of Linux */
+
+#include "nsapi_types.h"
+#include "SocketAddress.h"
+
+class NetworkStack
+{
+public:
+    virtual ~NetworkStack()
+    {
+    }
+
+    /**
+     * Resolve host name by getaddrinfo(), IPv4 first unless version says otherwise
+     */
+    virtual nsapi_error_t gethostbyname(const char *host, SocketAddress *address, nsapi_version_t version = NSAPI_UNSPEC);
+
+    static NetworkStack *get_default_instance();
+};
+
+inline NetworkStack *nsapi_create_stack(NetworkStack *stack)
+{
+    return stack;
+}
+
+#endif // _HOST_NETWORK_STACK_H_
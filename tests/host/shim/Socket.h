@@ -0,0 +1,34 @@
+#ifndef _HOST_SOCKET_H_
+#define _HOST_SOCKET_H_
+
+/* Host Socket = abstract socket of Mbed OS, the part TLSSocketWrapper drives its transport by */
+
+#include "mbed.h"
+#include "nsapi_types.h"
+#include "SocketAddress.h"
+
+class Socket
+{
+public:
+    virtual ~Socket()
+    {
+    }
+
+    virtual nsapi_error_t close() = 0;
+    virtual nsapi_error_t connect(const SocketAddress &address) = 0;
+    virtual nsapi_size_or_error_t send(const void *data, nsapi_size_t size) = 0;
+    virtual nsapi_size_or_error_t recv(void *data, nsapi_size_t size) = 0;
+
+    /**
+     * Blocking is timeout -1 (forever), non-blocking is timeout 0
+     */
+    virtual void set_blocking(bool blocking) = 0;
+    virtual void set_timeout(int timeout) = 0;
+
+    /**
+     * Called on state change: data in, room out, connect done, connection closed
+     */
+    virtual void sigio(mbed::Callback<void()> func) = 0;
+};
+
+#endif // _HOST_SOCKET_H_
@@ -0,0 +1,122 @@
+#ifndef _HOST_SOCKET_ADDRESS_H_
+#define _HOST_SOCKET_ADDRESS_H_
+
+/* Host SocketAddress = IPv4/IPv6 address and port, convertible to POSIX sockaddr */
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "nsapi_types.h"
+
+class SocketAddress
+{
+public:
+    SocketAddress() :
+        _version(NSAPI_UNSPEC),
+        _port(0)
+    {
+        memset(_bytes, 0, sizeof (_bytes));
+        _ip[0] = '\0';
+    }
+
+    SocketAddress(const char *addr, uint16_t port = 0) :
+        SocketAddress()
+    {
+        set_ip_address(addr);
+        set_port(port);
+    }
+
+    bool set_ip_address(const char *addr)
+    {
+        if (inet_pton(AF_INET, addr, _bytes) == 1) {
+            _version = NSAPI_IPv4;
+        } else if (inet_pton(AF_INET6, addr, _bytes) == 1) {
+            _version = NSAPI_IPv6;
+        } else {
+            _version = NSAPI_UNSPEC;
+            _ip[0] = '\0';
+            return false;
+        }
+        inet_ntop(_version == NSAPI_IPv4 ? AF_INET : AF_INET6, _bytes, _ip, sizeof (_ip));
+        return true;
+    }
+
+    const char *get_ip_address() const
+    {
+        return _version == NSAPI_UNSPEC ? NULL : _ip;
+    }
+
+    nsapi_version_t get_ip_version() const
+    {
+        return _version;
+    }
+
+    void set_port(uint16_t port)
+    {
+        _port = port;
+    }
+
+    uint16_t get_port() const
+    {
+        return _port;
+    }
+
+    explicit operator bool() const
+    {
+        return _version != NSAPI_UNSPEC;
+    }
+
+    /**
+     * Host only: address for POSIX socket calls
+     *
+     * @return  Length of address in ss, 0 if unspecified
+     */
+    socklen_t get_sockaddr(struct sockaddr_storage *ss) const
+    {
+        memset(ss, 0, sizeof (*ss));
+        if (_version == NSAPI_IPv4) {
+            struct sockaddr_in *sin = (struct sockaddr_in *) ss;
+            sin->sin_family = AF_INET;
+            sin->sin_port = htons(_port);
+            memcpy(&sin->sin_addr, _bytes, 4);
+            return sizeof (*sin);
+        } else if (_version == NSAPI_IPv6) {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) ss;
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = htons(_port);
+            memcpy(&sin6->sin6_addr, _bytes, 16);
+            return sizeof (*sin6);
+        }
+        return 0;
+    }
+
+    /**
+     * Host only: take address from POSIX socket address
+     */
+    void set_sockaddr(const struct sockaddr *sa)
+    {
+        char ip[INET6_ADDRSTRLEN];
+
+        if (sa->sa_family == AF_INET) {
+            const struct sockaddr_in *sin = (const struct sockaddr_in *) sa;
+            inet_ntop(AF_INET, &sin->sin_addr, ip, sizeof (ip));
+            set_ip_address(ip);
+            set_port(ntohs(sin->sin_port));
+        } else if (sa->sa_family == AF_INET6) {
+            const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) sa;
+            inet_ntop(AF_INET6, &sin6->sin6_addr, ip, sizeof (ip));
+            set_ip_address(ip);
+            set_port(ntohs(sin6->sin6_port));
+        }
+    }
+
+private:
+    nsapi_version_t     _version;
+    uint8_t             _bytes[16];
+    char                _ip[INET6_ADDRSTRLEN];
+    uint16_t            _port;
+};
+
+#endif // _HOST_SOCKET_ADDRESS_H_
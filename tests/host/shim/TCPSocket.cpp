@@ -0,0 +1,357 @@
+#include "mbed.h"
+#include "TCPSocket.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+
+TCPSocket::TCPSocket() :
+    _stack(NULL),
+    _fd(-1),
+    _timeout(-1),
+    _connecting(false),
+    _connected(false),
+    _read_armed(false),
+    _write_armed(false),
+    _stop(false)
+{
+    _wake[0] = _wake[1] = -1;
+}
+
+TCPSocket::~TCPSocket()
+{
+    close();
+}
+
+nsapi_error_t TCPSocket::open(NetworkStack *stack)
+{
+    if (stack == NULL) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    if (_stack) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    _stack = stack;
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t TCPSocket::close()
+{
+    if (_stack == NULL) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    if (_watcher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        char c = 0;
+        MBED_UNUSED ssize_t n = write(_wake[1], &c, 1);
+        _watcher.join();
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        ::close(_wake[0]);
+        ::close(_wake[1]);
+    }
+
+    _fd = _wake[0] = _wake[1] = -1;
+    _stack = NULL;
+    _connecting = _connected = false;
+    _read_armed = _write_armed = _stop = false;
+
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t TCPSocket::connect(const SocketAddress &address)
+{
+    if (_stack == NULL) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+    if (_connected) {
+        return NSAPI_ERROR_IS_CONNECTED;
+    }
+
+    /* Connect started in this call, for OK rather than IS_CONNECTED on completion */
+    bool started = false;
+
+    if (! _connecting) {
+        struct sockaddr_storage ss;
+        socklen_t ss_len = address.get_sockaddr(&ss);
+        if (ss_len == 0) {
+            return NSAPI_ERROR_PARAMETER;
+        }
+
+        if (_fd < 0) {
+            _fd = socket(ss.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (_fd < 0) {
+                return error_from_errno(errno);
+            }
+            if (pipe2(_wake, O_NONBLOCK | O_CLOEXEC) != 0) {
+                ::close(_fd);
+                _fd = -1;
+                return NSAPI_ERROR_NO_MEMORY;
+            }
+            int one = 1;
+            setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+            _watcher = std::thread(&TCPSocket::watch, this);
+        }
+
+        if (::connect(_fd, (struct sockaddr *) &ss, ss_len) == 0) {
+            _connected = true;
+            arm(true, false);
+            return NSAPI_ERROR_OK;
+        }
+        if (errno != EINPROGRESS) {
+            return error_from_errno(errno);
+        }
+        _connecting = true;
+        started = true;
+        arm(true, true);
+    }
+
+    Deadline until = deadline();
+    while (true) {
+        struct pollfd pfd = { _fd, POLLOUT, 0 };
+        if (poll(&pfd, 1, 0) == 1) {
+            int err = 0;
+            socklen_t err_len = sizeof (err);
+            getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+            _connecting = false;
+            if (err) {
+                return error_from_errno(err);
+            }
+            _connected = true;
+            return started ? NSAPI_ERROR_OK : NSAPI_ERROR_IS_CONNECTED;
+        }
+
+        if (_timeout == 0 || wait_ready(POLLOUT, until) != NSAPI_ERROR_OK) {
+            arm(false, true);
+            return started ? NSAPI_ERROR_IN_PROGRESS : NSAPI_ERROR_ALREADY;
+        }
+    }
+}
+
+nsapi_size_or_error_t TCPSocket::send(const void *data, nsapi_size_t size)
+{
+    if (_fd < 0) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+    if (! _connected) {
+        return NSAPI_ERROR_NO_CONNECTION;
+    }
+
+    /* Blocking send takes all, as Mbed OS does */
+    Deadline until = deadline();
+    nsapi_size_t sent = 0;
+    while (sent < size) {
+        ssize_t n = ::send(_fd, (const char *) data + sent, size - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return sent ? (nsapi_size_or_error_t) sent : error_from_errno(errno);
+        }
+
+        arm(false, true);
+        if (_timeout == 0 || wait_ready(POLLOUT, until) != NSAPI_ERROR_OK) {
+            break;
+        }
+    }
+
+    return sent ? (nsapi_size_or_error_t) sent : NSAPI_ERROR_WOULD_BLOCK;
+}
+
+nsapi_size_or_error_t TCPSocket::recv(void *data, nsapi_size_t size)
+{
+    if (_fd < 0) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+    if (! _connected) {
+        return NSAPI_ERROR_NO_CONNECTION;
+    }
+
+    Deadline until = deadline();
+    while (true) {
+        ssize_t n = ::recv(_fd, data, size, 0);
+        arm(true, false);
+        if (n >= 0) {
+            return (nsapi_size_or_error_t) n;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return error_from_errno(errno);
+        }
+
+        if (_timeout == 0 || wait_ready(POLLIN, until) != NSAPI_ERROR_OK) {
+            return NSAPI_ERROR_WOULD_BLOCK;
+        }
+    }
+}
+
+void TCPSocket::set_blocking(bool blocking)
+{
+    set_timeout(blocking ? -1 : 0);
+}
+
+void TCPSocket::set_timeout(int timeout)
+{
+    _timeout = timeout < 0 ? -1 : timeout;
+}
+
+void TCPSocket::sigio(mbed::Callback<void()> func)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _sigio = func;
+}
+
+TCPSocket::Deadline TCPSocket::deadline() const
+{
+    if (_timeout < 0) {
+        return Deadline::max();
+    }
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(_timeout);
+}
+
+nsapi_error_t TCPSocket::wait_ready(short events, Deadline until)
+{
+    while (true) {
+        int timeout_ms = -1;
+        if (until != Deadline::max()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(until - std::chrono::steady_clock::now()).count();
+            if (left <= 0) {
+                return NSAPI_ERROR_WOULD_BLOCK;
+            }
+            timeout_ms = (int) left;
+        }
+
+        struct pollfd pfd = { _fd, events, 0 };
+        int rc = poll(&pfd, 1, timeout_ms);
+        if (rc > 0) {
+            return NSAPI_ERROR_OK;
+        }
+        if (rc == 0) {
+            return NSAPI_ERROR_WOULD_BLOCK;
+        }
+        if (errno != EINTR) {
+            return error_from_errno(errno);
+        }
+    }
+}
+
+void TCPSocket::arm(bool read, bool write)
+{
+    bool wake = false;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (read && ! _read_armed) {
+            _read_armed = wake = true;
+        }
+        if (write && ! _write_armed) {
+            _write_armed = wake = true;
+        }
+    }
+
+    if (wake) {
+        char c = 0;
+        MBED_UNUSED ssize_t n = ::write(_wake[1], &c, 1);
+    }
+}
+
+void TCPSocket::watch()
+{
+    while (true) {
+        struct pollfd pfds[2];
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stop) {
+                return;
+            }
+            short events = (_read_armed ? POLLIN : 0) | (_write_armed ? POLLOUT : 0);
+            /* Nothing armed: ignore fd, or hangup would be reported over and over */
+            pfds[0].fd = events ? _fd : -1;
+            pfds[0].events = events;
+            pfds[0].revents = 0;
+        }
+        pfds[1].fd = _wake[0];
+        pfds[1].events = POLLIN;
+        pfds[1].revents = 0;
+
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        if (pfds[1].revents) {
+            char buf[16];
+            while (read(_wake[0], buf, sizeof (buf)) > 0) {
+            }
+        }
+
+        mbed::Callback<void()> func;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stop) {
+                return;
+            }
+            short revents = pfds[0].revents;
+            bool event = false;
+            if (_read_armed && (revents & (POLLIN | POLLHUP | POLLERR))) {
+                _read_armed = false;
+                event = true;
+            }
+            if (_write_armed && (revents & (POLLOUT | POLLHUP | POLLERR))) {
+                _write_armed = false;
+                event = true;
+            }
+            if (event) {
+                func = _sigio;
+            }
+        }
+
+        if (func) {
+            func();
+        }
+    }
+}
+
+nsapi_error_t TCPSocket::error_from_errno(int err)
+{
+    switch (err) {
+        case ECONNREFUSED:
+        case ECONNRESET:
+        case ECONNABORTED:
+        case ENOTCONN:
+        case EPIPE:
+        case ENETUNREACH:
+        case EHOSTUNREACH:
+            return NSAPI_ERROR_NO_CONNECTION;
+
+        case ETIMEDOUT:
+            return NSAPI_ERROR_CONNECTION_TIMEOUT;
+
+        case ENOMEM:
+        case ENOBUFS:
+            return NSAPI_ERROR_NO_MEMORY;
+
+        case EADDRINUSE:
+            return NSAPI_ERROR_ADDRESS_IN_USE;
+
+        default:
+            return NSAPI_ERROR_DEVICE_ERROR;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef _HOST_TCP_SOCKET_H_
+#define _HOST_TCP_SOCKET_H_
+
+/* Host TCPSocket = TCPSocket of Mbed OS on a non-blocking POSIX socket
+ *
+ * Blocking, timeout and connect return codes follow Mbed OS: non-blocking connect returns
+ * NSAPI_ERROR_IN_PROGRESS, then NSAPI_ERROR_ALREADY until NSAPI_ERROR_IS_CONNECTED; timed
+ * send/recv return NSAPI_ERROR_WOULD_BLOCK when nothing could be done in time.
+ *
+ * sigio() is called on a thread per connected socket, as a network stack calls it from its
+ * own context. Like lwIP, it fires on data in after each recv() call, and on room out after
+ * send() or connect() could not complete. Close or destroy the socket outside its sigio().
+ *
+ * Nagle is off, so that small MQTT packets on loopback don't wait for delayed ACK.
+ */
+
+#include "mbed.h"
+#include "Socket.h"
+#include "NetworkStack.h"
+#include "NetworkInterface.h"
+
+#include <mutex>
+#include <thread>
+
+class TCPSocket : public Socket
+{
+public:
+    TCPSocket();
+    ~TCPSocket() override;
+
+    /**
+     * Socket is created on connect(), by the family of the address
+     */
+    nsapi_error_t open(NetworkStack *stack);
+
+    template <typename S>
+    nsapi_error_t open(S *stack)
+    {
+        return open(nsapi_create_stack(stack));
+    }
+
+    nsapi_error_t close() override;
+    nsapi_error_t connect(const SocketAddress &address) override;
+    nsapi_size_or_error_t send(const void *data, nsapi_size_t size) override;
+    nsapi_size_or_error_t recv(void *data, nsapi_size_t size) override;
+    void set_blocking(bool blocking) override;
+    void set_timeout(int timeout) override;
+    void sigio(mbed::Callback<void()> func) override;
+
+private:
+    typedef std::chrono::steady_clock::time_point Deadline;
+
+    Deadline deadline() const;
+
+    /**
+     * Wait until fd is ready for events or deadline, per timeout
+     *
+     * @return  NSAPI_ERROR_OK if ready, NSAPI_ERROR_WOULD_BLOCK if not in time
+     */
+    nsapi_error_t wait_ready(short events, Deadline until);
+
+    /**
+     * Have sigio thread report readiness for read/write once more
+     */
+    void arm(bool read, bool write);
+
+    /**
+     * sigio thread: poll fd for armed events and call back
+     */
+    void watch();
+
+    static nsapi_error_t error_from_errno(int err);
+
+    NetworkStack *              _stack;
+    int                         _fd;
+    int                         _wake[2];       /**< Pipe waking sigio thread up */
+    int                         _timeout;       /**< -1 forever, 0 non-blocking, otherwise ms */
+    bool                        _connecting;
+    bool                        _connected;
+    std::thread                 _watcher;
+    std::mutex                  _mutex;         /**< Guards below for sigio thread */
+    mbed::Callback<void()>      _sigio;
+    bool                        _read_armed;
+    bool                        _write_armed;
+    bool                        _stop;
+};
+
+#endif // _HOST_TCP_SOCKET_H_
@@ -0,0 +1,463 @@
+#include "mbed.h"
+#include "TLSSocketWrapper.h"
+#include "mbedtls_utils.h"
+
+namespace {
+
+const char DRBG_PERS[] = "mbed TLS client";
+
+}
+
+TLSSocketWrapper::TLSSocketWrapper(Socket *transport, const char *hostname, control_transport control) :
+    _cacert(NULL),
+    _clicert(NULL),
+    _ssl_conf(NULL),
+    _cacert_allocated(false),
+    _clicert_allocated(false),
+    _ssl_conf_allocated(false),
+    _transport(transport),
+    _timeout(-1),
+    _connect_transport(control == TRANSPORT_CONNECT || control == TRANSPORT_CONNECT_AND_CLOSE),
+    _close_transport(control == TRANSPORT_CLOSE || control == TRANSPORT_CONNECT_AND_CLOSE),
+    _tls_initialized(false),
+    _handshake_completed(false)
+{
+    mbedtls_entropy_init(&_entropy);
+    mbedtls_ctr_drbg_init(&_ctr_drbg);
+    mbedtls_pk_init(&_pkctx);
+    mbedtls_ssl_init(&_ssl);
+
+    if (hostname) {
+        set_hostname(hostname);
+    }
+}
+
+TLSSocketWrapper::~TLSSocketWrapper()
+{
+    if (_transport) {
+        close();
+    }
+
+    mbedtls_entropy_free(&_entropy);
+    mbedtls_ctr_drbg_free(&_ctr_drbg);
+    mbedtls_pk_free(&_pkctx);
+    mbedtls_ssl_free(&_ssl);
+
+    set_own_cert(NULL);
+    set_ca_chain(NULL);
+    set_ssl_config(NULL);
+}
+
+void TLSSocketWrapper::set_hostname(const char *hostname)
+{
+    mbedtls_ssl_set_hostname(&_ssl, hostname);
+}
+
+nsapi_error_t TLSSocketWrapper::set_root_ca_cert(const void *root_ca, size_t len)
+{
+    mbedtls_x509_crt *crt = new mbedtls_x509_crt;
+    mbedtls_x509_crt_init(crt);
+
+    int ret = mbedtls_x509_crt_parse(crt, static_cast<const unsigned char *>(root_ca), len);
+    if (ret != 0) {
+        print_mbedtls_error("mbedtls_x509_crt_parse", ret);
+        mbedtls_x509_crt_free(crt);
+        delete crt;
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    set_ca_chain(crt);
+    _cacert_allocated = true;
+
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t TLSSocketWrapper::set_root_ca_cert(const char *root_ca_pem)
+{
+    return set_root_ca_cert(root_ca_pem, strlen(root_ca_pem) + 1);
+}
+
+nsapi_error_t TLSSocketWrapper::set_client_cert_key(const void *client_cert, size_t client_cert_len,
+                                                    const void *client_private_key, size_t client_private_key_len)
+{
+    mbedtls_x509_crt *crt = new mbedtls_x509_crt;
+    mbedtls_x509_crt_init(crt);
+
+    int ret = mbedtls_x509_crt_parse(crt, static_cast<const unsigned char *>(client_cert), client_cert_len);
+    if (ret == 0) {
+        ret = mbedtls_pk_parse_key(&_pkctx, static_cast<const unsigned char *>(client_private_key),
+                                   client_private_key_len, NULL, 0);
+    }
+    if (ret == 0) {
+        ret = mbedtls_ssl_conf_own_cert(get_ssl_config(), crt, &_pkctx);
+    }
+    if (ret != 0) {
+        print_mbedtls_error("mbedtls_x509_crt_parse/mbedtls_pk_parse_key", ret);
+        mbedtls_x509_crt_free(crt);
+        delete crt;
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    set_own_cert(crt);
+    _clicert_allocated = true;
+
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t TLSSocketWrapper::set_client_cert_key(const char *client_cert_pem, const char *client_private_key_pem)
+{
+    return set_client_cert_key(client_cert_pem, strlen(client_cert_pem) + 1,
+                               client_private_key_pem, strlen(client_private_key_pem) + 1);
+}
+
+nsapi_error_t TLSSocketWrapper::connect(const SocketAddress &address)
+{
+    nsapi_error_t ret = NSAPI_ERROR_OK;
+
+    if (! _transport) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    if (! is_handshake_started() && _connect_transport) {
+        ret = _transport->connect(address);
+        if (ret && ret != NSAPI_ERROR_IS_CONNECTED) {
+            return ret;
+        }
+    }
+
+    if (! is_handshake_started()) {
+        return start_handshake(ret == NSAPI_ERROR_OK);
+    }
+
+    return continue_handshake();
+}
+
+nsapi_error_t TLSSocketWrapper::start_handshake(bool first_call)
+{
+    int ret;
+
+    if (! _transport) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    ret = mbedtls_ctr_drbg_seed(&_ctr_drbg, mbedtls_entropy_func, &_entropy,
+                                (const unsigned char *) DRBG_PERS, sizeof (DRBG_PERS));
+    if (ret != 0) {
+        print_mbedtls_error("mbedtls_crt_drbg_init", ret);
+        return NSAPI_ERROR_AUTH_FAILURE;
+    }
+    mbedtls_ssl_conf_rng(get_ssl_config(), mbedtls_ctr_drbg_random, &_ctr_drbg);
+
+    ret = mbedtls_ssl_setup(&_ssl, get_ssl_config());
+    if (ret != 0) {
+        print_mbedtls_error("mbedtls_ssl_setup", ret);
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    _transport->set_blocking(false);
+    _transport->sigio(mbed::callback(this, &TLSSocketWrapper::event));
+    mbedtls_ssl_set_bio(&_ssl, this, ssl_send, ssl_recv, NULL);
+
+    _tls_initialized = true;
+
+    ret = continue_handshake();
+    if (first_call) {
+        if (ret == NSAPI_ERROR_ALREADY) {
+            ret = NSAPI_ERROR_IN_PROGRESS;
+        } else if (ret == NSAPI_ERROR_IS_CONNECTED) {
+            ret = NSAPI_ERROR_OK;
+        }
+    }
+
+    return ret;
+}
+
+nsapi_error_t TLSSocketWrapper::continue_handshake()
+{
+    int ret;
+
+    if (_handshake_completed) {
+        return NSAPI_ERROR_IS_CONNECTED;
+    }
+
+    while (true) {
+        ret = mbedtls_ssl_handshake(&_ssl);
+        if (_timeout && (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)) {
+            if (! wait_event()) {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (ret < 0) {
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            return NSAPI_ERROR_ALREADY;
+        }
+        print_mbedtls_error("mbedtls_ssl_handshake", ret);
+        return NSAPI_ERROR_AUTH_FAILURE;
+    }
+
+    _handshake_completed = true;
+    return NSAPI_ERROR_IS_CONNECTED;
+}
+
+nsapi_size_or_error_t TLSSocketWrapper::send(const void *data, nsapi_size_t size)
+{
+    int ret;
+
+    if (! _transport) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    while (true) {
+        if (! _handshake_completed) {
+            ret = continue_handshake();
+            if (ret != NSAPI_ERROR_IS_CONNECTED) {
+                if (ret == NSAPI_ERROR_ALREADY) {
+                    ret = NSAPI_ERROR_NO_CONNECTION;
+                }
+                return ret;
+            }
+        }
+
+        ret = mbedtls_ssl_write(&_ssl, (const unsigned char *) data, size);
+        if (_timeout == 0) {
+            break;
+        } else if (ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) {
+            if (! wait_event()) {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) {
+        return NSAPI_ERROR_WOULD_BLOCK;
+    } else if (ret < 0) {
+        print_mbedtls_error("mbedtls_ssl_write", ret);
+        return NSAPI_ERROR_DEVICE_ERROR;
+    }
+
+    return ret;
+}
+
+nsapi_size_or_error_t TLSSocketWrapper::recv(void *data, nsapi_size_t size)
+{
+    int ret;
+
+    if (! _transport) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    while (true) {
+        if (! _handshake_completed) {
+            ret = continue_handshake();
+            if (ret != NSAPI_ERROR_IS_CONNECTED) {
+                if (ret == NSAPI_ERROR_ALREADY) {
+                    ret = NSAPI_ERROR_NO_CONNECTION;
+                }
+                return ret;
+            }
+        }
+
+        ret = mbedtls_ssl_read(&_ssl, (unsigned char *) data, size);
+        if (_timeout == 0) {
+            break;
+        } else if (ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) {
+            if (! wait_event()) {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY || ret == MBEDTLS_ERR_NET_CONN_RESET) {
+        ret = 0;
+    } else if (ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) {
+        ret = NSAPI_ERROR_WOULD_BLOCK;
+    } else if (ret < 0) {
+        print_mbedtls_error("mbedtls_ssl_read", ret);
+        ret = NSAPI_ERROR_DEVICE_ERROR;
+    }
+
+    return ret;
+}
+
+nsapi_error_t TLSSocketWrapper::close()
+{
+    if (! _transport) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    int ret = 0;
+    if (_handshake_completed) {
+        _transport->set_blocking(true);
+        ret = mbedtls_ssl_close_notify(&_ssl);
+        if (ret) {
+            print_mbedtls_error("mbedtls_ssl_close_notify", ret);
+        }
+        _handshake_completed = false;
+    }
+
+    if (_close_transport) {
+        int ret2 = _transport->close();
+        if (! ret) {
+            ret = ret2;
+        }
+    } else {
+        _transport->sigio(nullptr);
+    }
+
+    _transport = NULL;
+
+    return ret;
+}
+
+void TLSSocketWrapper::set_blocking(bool blocking)
+{
+    set_timeout(blocking ? -1 : 0);
+}
+
+void TLSSocketWrapper::set_timeout(int timeout)
+{
+    _timeout = timeout;
+
+    /* Transport not connected yet follows. Once handshake starts, it stays non-blocking. */
+    if (! is_handshake_started() && timeout != -1 && _connect_transport && _transport) {
+        _transport->set_timeout(timeout);
+    }
+}
+
+void TLSSocketWrapper::sigio(mbed::Callback<void()> func)
+{
+    _sigio = func;
+}
+
+mbedtls_x509_crt *TLSSocketWrapper::get_ca_chain()
+{
+    return _cacert;
+}
+
+void TLSSocketWrapper::set_ca_chain(mbedtls_x509_crt *crt)
+{
+    if (_cacert && _cacert_allocated) {
+        mbedtls_x509_crt_free(_cacert);
+        delete _cacert;
+        _cacert_allocated = false;
+    }
+    _cacert = crt;
+
+    if (crt || _ssl_conf) {
+        mbedtls_ssl_conf_ca_chain(get_ssl_config(), _cacert, NULL);
+    }
+}
+
+mbedtls_x509_crt *TLSSocketWrapper::get_own_cert()
+{
+    return _clicert;
+}
+
+int TLSSocketWrapper::set_own_cert(mbedtls_x509_crt *crt)
+{
+    if (_clicert && _clicert_allocated) {
+        mbedtls_x509_crt_free(_clicert);
+        delete _clicert;
+        _clicert_allocated = false;
+    }
+    _clicert = crt;
+
+    return 0;
+}
+
+mbedtls_ssl_config *TLSSocketWrapper::get_ssl_config()
+{
+    if (! _ssl_conf) {
+        _ssl_conf = new mbedtls_ssl_config;
+        mbedtls_ssl_config_init(_ssl_conf);
+        _ssl_conf_allocated = true;
+
+        int ret = mbedtls_ssl_config_defaults(_ssl_conf, MBEDTLS_SSL_IS_CLIENT,
+                                              MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+        if (ret != 0) {
+            print_mbedtls_error("mbedtls_ssl_config_defaults", ret);
+            set_ssl_config(NULL);
+            MBED_ASSERT(false);
+            return NULL;
+        }
+
+        mbedtls_ssl_conf_authmode(_ssl_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+        mbedtls_ssl_conf_rng(_ssl_conf, mbedtls_ctr_drbg_random, &_ctr_drbg);
+    }
+
+    return _ssl_conf;
+}
+
+void TLSSocketWrapper::set_ssl_config(mbedtls_ssl_config *conf)
+{
+    if (_ssl_conf && _ssl_conf_allocated) {
+        mbedtls_ssl_config_free(_ssl_conf);
+        delete _ssl_conf;
+        _ssl_conf_allocated = false;
+    }
+    _ssl_conf = conf;
+}
+
+mbedtls_ssl_context *TLSSocketWrapper::get_ssl_context()
+{
+    return &_ssl;
+}
+
+void TLSSocketWrapper::event()
+{
+    _event_flag.set(1);
+    if (_sigio) {
+        _sigio();
+    }
+}
+
+bool TLSSocketWrapper::wait_event()
+{
+    uint32_t flag = _event_flag.wait_any(1, _timeout < 0 ? osWaitForever : (uint32_t) _timeout);
+
+    return (flag & osFlagsError) == 0;
+}
+
+int TLSSocketWrapper::ssl_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    TLSSocketWrapper *my = static_cast<TLSSocketWrapper *>(ctx);
+
+    if (! my->_transport) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    int recv = my->_transport->recv(buf, len);
+    if (recv == NSAPI_ERROR_WOULD_BLOCK) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    } else if (recv < 0) {
+        return -1;
+    }
+
+    return recv;
+}
+
+int TLSSocketWrapper::ssl_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    TLSSocketWrapper *my = static_cast<TLSSocketWrapper *>(ctx);
+
+    if (! my->_transport) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    int size = my->_transport->send(buf, len);
+    if (size == NSAPI_ERROR_WOULD_BLOCK) {
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    } else if (size < 0) {
+        return -1;
+    }
+
+    return size;
+}
@@ -0,0 +1,117 @@
+#ifndef _HOST_TLS_SOCKET_WRAPPER_H_
+#define _HOST_TLS_SOCKET_WRAPPER_H_
+
+/* Host TLSSocketWrapper = TLSSocketWrapper of Mbed OS, on Mbed TLS built for the host
+ *
+ * Same flow as Mbed OS, which MyTLSSocket depends on: the transport is connected first,
+ * then switched to non-blocking with sigio() attached right after mbedtls_ssl_setup() and
+ * before the first mbedtls_ssl_handshake(). Non-blocking handshake returns
+ * NSAPI_ERROR_IN_PROGRESS on the first call, NSAPI_ERROR_ALREADY on later ones, and
+ * NSAPI_ERROR_IS_CONNECTED when done. Blocking and timed calls wait on sigio of the
+ * transport. close() leaves the socket without transport, as in Mbed OS.
+ */
+
+#include "mbed.h"
+#include "Socket.h"
+#include "SocketAddress.h"
+
+#include "mbedtls/platform.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/error.h"
+#include "mbedtls/net_sockets.h"
+
+class TLSSocketWrapper : public Socket
+{
+public:
+    enum control_transport {
+        TRANSPORT_KEEP,
+        TRANSPORT_CONNECT_AND_CLOSE,
+        TRANSPORT_CONNECT,
+        TRANSPORT_CLOSE
+    };
+
+    TLSSocketWrapper(Socket *transport, const char *hostname = NULL, control_transport control = TRANSPORT_CONNECT_AND_CLOSE);
+    ~TLSSocketWrapper() override;
+
+    void set_hostname(const char *hostname);
+
+    nsapi_error_t set_root_ca_cert(const void *root_ca, size_t len);
+    nsapi_error_t set_root_ca_cert(const char *root_ca_pem);
+    nsapi_error_t set_client_cert_key(const void *client_cert, size_t client_cert_len,
+                                      const void *client_private_key, size_t client_private_key_len);
+    nsapi_error_t set_client_cert_key(const char *client_cert_pem, const char *client_private_key_pem);
+
+    nsapi_error_t close() override;
+    nsapi_error_t connect(const SocketAddress &address) override;
+    nsapi_size_or_error_t send(const void *data, nsapi_size_t size) override;
+    nsapi_size_or_error_t recv(void *data, nsapi_size_t size) override;
+    void set_blocking(bool blocking) override;
+    void set_timeout(int timeout) override;
+    void sigio(mbed::Callback<void()> func) override;
+
+    mbedtls_x509_crt *get_ca_chain();
+    void set_ca_chain(mbedtls_x509_crt *crt);
+    mbedtls_x509_crt *get_own_cert();
+    int set_own_cert(mbedtls_x509_crt *crt);
+    mbedtls_ssl_config *get_ssl_config();
+    void set_ssl_config(mbedtls_ssl_config *conf);
+    mbedtls_ssl_context *get_ssl_context();
+
+protected:
+    /**
+     * Set up SSL context, attach to transport and start handshake
+     *
+     * @param first_call    Transport connected in this call, i.e. blocking
+     */
+    nsapi_error_t start_handshake(bool first_call);
+
+    /**
+     * Run handshake on, waiting for transport per timeout
+     *
+     * @return  NSAPI_ERROR_IS_CONNECTED when done, NSAPI_ERROR_ALREADY if to be continued
+     */
+    nsapi_error_t continue_handshake();
+
+    bool is_handshake_started() const
+    {
+        return _tls_initialized;
+    }
+
+    void event();
+
+    static int ssl_recv(void *ctx, unsigned char *buf, size_t len);
+    static int ssl_send(void *ctx, const unsigned char *buf, size_t len);
+
+private:
+    /**
+     * Wait for sigio of transport per timeout
+     *
+     * @return  true on event, false on timeout
+     */
+    bool wait_event();
+
+    mbedtls_ssl_context         _ssl;
+    mbedtls_pk_context          _pkctx;
+    mbedtls_ctr_drbg_context    _ctr_drbg;
+    mbedtls_entropy_context     _entropy;
+    mbedtls_x509_crt *          _cacert;
+    mbedtls_x509_crt *          _clicert;
+    mbedtls_ssl_config *        _ssl_conf;
+    bool                        _cacert_allocated;
+    bool                        _clicert_allocated;
+    bool                        _ssl_conf_allocated;
+
+    Socket *                    _transport;
+    int                         _timeout;
+    mbed::Callback<void()>      _sigio;
+    rtos::EventFlags            _event_flag;
+    bool                        _connect_transport;
+    bool                        _close_transport;
+    bool                        _tls_initialized;
+    bool                        _handshake_completed;
+};
+
+#endif // _HOST_TLS_SOCKET_WRAPPER_H_
@@ -0,0 +1,175 @@
+#ifndef _HOST_MBED_EVENTS_H_
+#define _HOST_MBED_EVENTS_H_
+
+/* Host events = EventQueue of Mbed OS events, on std::condition_variable
+ *
+ * Same call()/call_in()/call_every()/cancel() contract: IDs are non-zero, 0 when the queue
+ * is out of its size in events, and cancel() doesn't wait for an event already dispatching.
+ */
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+#define EVENTS_EVENT_SIZE   64
+#define EVENTS_QUEUE_SIZE   (32 * EVENTS_EVENT_SIZE)
+
+namespace events {
+
+class EventQueue
+{
+public:
+    typedef std::chrono::steady_clock   clock;
+    typedef std::chrono::milliseconds   duration;
+
+    EventQueue(unsigned size = EVENTS_QUEUE_SIZE, unsigned char *buffer = NULL) :
+        _max_events(size / EVENTS_EVENT_SIZE),
+        _next_id(1),
+        _break(false),
+        _destroying(false),
+        _dispatching(0)
+    {
+        (void) buffer;
+    }
+
+    /* Let dispatch_forever() on another thread return before members go */
+    ~EventQueue()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _destroying = true;
+        _cond.notify_all();
+        _cond.wait(lock, [this] {
+            return _dispatching == 0;
+        });
+    }
+
+    template<typename F>
+    int call(F f)
+    {
+        return post(duration::zero(), duration::zero(), mbed::Callback<void()>(f));
+    }
+
+    template<typename F>
+    int call_in(duration ms, F f)
+    {
+        return post(ms, duration::zero(), mbed::Callback<void()>(f));
+    }
+
+    template<typename F>
+    int call_every(duration ms, F f)
+    {
+        return post(ms, ms, mbed::Callback<void()>(f));
+    }
+
+    bool cancel(int id)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _events.erase(id) != 0;
+    }
+
+    void dispatch_forever()
+    {
+        dispatch(clock::time_point::max());
+    }
+
+    void dispatch_for(duration ms)
+    {
+        dispatch(clock::now() + ms);
+    }
+
+    void break_dispatch()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _break = true;
+        _cond.notify_all();
+    }
+
+private:
+    struct Event {
+        clock::time_point       due;
+        duration                period;     /**< Zero for one-shot */
+        mbed::Callback<void()>  func;
+    };
+
+    int post(duration delay, duration period, mbed::Callback<void()> func)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (_events.size() >= _max_events) {
+            return 0;
+        }
+
+        int id = _next_id;
+        do {
+            id = (id == INT32_MAX) ? 1 : (id + 1);
+        } while (_events.count(id));
+        _next_id = id;
+
+        Event &event = _events[id];
+        event.due = clock::now() + delay;
+        event.period = period;
+        event.func = func;
+        _cond.notify_all();
+
+        return id;
+    }
+
+    void dispatch(clock::time_point until)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _dispatching ++;
+        _break = false;
+        while (! _break && ! _destroying) {
+            /* Earliest due */
+            auto next = _events.end();
+            for (auto it = _events.begin(); it != _events.end(); ++ it) {
+                if (next == _events.end() || it->second.due < next->second.due) {
+                    next = it;
+                }
+            }
+
+            auto now = clock::now();
+            if (next == _events.end() || next->second.due > now) {
+                auto wake = (next == _events.end()) ? until : std::min(until, next->second.due);
+                if (now >= until) {
+                    break;
+                }
+                if (wake == clock::time_point::max()) {
+                    _cond.wait(lock);
+                } else {
+                    _cond.wait_until(lock, wake);
+                }
+                continue;
+            }
+
+            mbed::Callback<void()> func = next->second.func;
+            if (next->second.period > duration::zero()) {
+                next->second.due += next->second.period;
+            } else {
+                _events.erase(next);
+            }
+
+            lock.unlock();
+            func();
+            lock.lock();
+        }
+        _dispatching --;
+        _cond.notify_all();
+    }
+
+    std::mutex                  _mutex;
+    std::condition_variable     _cond;
+    std::map<int, Event>        _events;
+    size_t                      _max_events;
+    int                         _next_id;
+    bool                        _break;
+    bool                        _destroying;
+    int                         _dispatching;
+};
+
+}
+
+#endif // _HOST_MBED_EVENTS_H_
@@ -0,0 +1,287 @@
+#ifndef _HOST_MBED_H_
+#define _HOST_MBED_H_
+
+/* Host mbed.h = the subset of Mbed OS API used by my-mqtt/my-https/my-tlssocket, on Linux
+ *
+ * Lets modules of this example build and run on the host for tests and measurement without
+ * Mbed OS. RTOS primitives map to std::thread/std::mutex/std::condition_variable, clocks
+ * to std::chrono::steady_clock. Only what the modules use is provided. Sockets are in
+ * TCPSocket.h and friends, on POSIX sockets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <chrono>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#define MBED_USED               __attribute__((used))
+#define MBED_WEAK               __attribute__((weak))
+#define MBED_UNUSED             __attribute__((unused))
+#define MBED_FORCEINLINE        inline __attribute__((always_inline))
+#define MBED_STATIC_ASSERT(expr, msg)   static_assert(expr, msg)
+#define MBED_ASSERT(expr)       assert(expr)
+#define __STATIC_INLINE         static inline
+
+/* Error codes of platform/mbed_error.h. Values differ from Mbed OS; compare by name only. */
+#define MBED_SUCCESS                    0
+#define MBED_ERROR_INVALID_ARGUMENT     (-0x101)
+#define MBED_ERROR_UNSUPPORTED          (-0x104)
+#define MBED_ERROR_INVALID_SIZE         (-0x105)
+#define MBED_ERROR_ITEM_NOT_FOUND       (-0x107)
+#define MBED_ERROR_NOT_READY            (-0x10C)
+#define MBED_ERROR_OPERATION_ABORTED    (-0x11B)
+#define MBED_ERROR_READ_FAILED          (-0x11E)
+#define MBED_ERROR_WRITE_FAILED         (-0x11F)
+#define MBED_ERROR_ENOMEM               (-0x1F4)
+
+/* Atomics of platform/mbed_atomic.h on GCC builtins */
+typedef enum {
+    mbed_memory_order_relaxed = __ATOMIC_RELAXED,
+    mbed_memory_order_consume = __ATOMIC_CONSUME,
+    mbed_memory_order_acquire = __ATOMIC_ACQUIRE,
+    mbed_memory_order_release = __ATOMIC_RELEASE,
+    mbed_memory_order_acq_rel = __ATOMIC_ACQ_REL,
+    mbed_memory_order_seq_cst = __ATOMIC_SEQ_CST
+} mbed_memory_order;
+
+inline uint32_t core_util_atomic_load_u32(const volatile uint32_t *valuePtr)
+{
+    return __atomic_load_n(valuePtr, __ATOMIC_SEQ_CST);
+}
+
+inline uint32_t core_util_atomic_load_explicit_u32(const volatile uint32_t *valuePtr, mbed_memory_order order)
+{
+    return __atomic_load_n(valuePtr, order);
+}
+
+inline void core_util_atomic_store_u32(volatile uint32_t *valuePtr, uint32_t desiredValue)
+{
+    __atomic_store_n(valuePtr, desiredValue, __ATOMIC_SEQ_CST);
+}
+
+inline void core_util_atomic_store_explicit_u32(volatile uint32_t *valuePtr, uint32_t desiredValue, mbed_memory_order order)
+{
+    __atomic_store_n(valuePtr, desiredValue, order);
+}
+
+inline uint32_t core_util_atomic_incr_u32(volatile uint32_t *valuePtr, uint32_t delta)
+{
+    return __atomic_add_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+inline uint32_t core_util_atomic_decr_u32(volatile uint32_t *valuePtr, uint32_t delta)
+{
+    return __atomic_sub_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+namespace mbed {
+
+/* Callback = mbed::Callback on std::function */
+template<typename F>
+class Callback;
+
+template<typename R, typename... ArgTs>
+class Callback<R(ArgTs...)>
+{
+public:
+    Callback()
+    {
+    }
+
+    Callback(std::nullptr_t)
+    {
+    }
+
+    Callback(R (*func)(ArgTs...))
+    {
+        if (func) {
+            _func = func;
+        }
+    }
+
+    template<typename T, typename U>
+    Callback(U *obj, R (T::*method)(ArgTs...)) :
+        _func([obj, method](ArgTs... args) -> R {
+            return (obj->*method)(std::forward<ArgTs>(args)...);
+        })
+    {
+    }
+
+    template<typename T, typename U>
+    Callback(const U *obj, R (T::*method)(ArgTs...) const) :
+        _func([obj, method](ArgTs... args) -> R {
+            return (obj->*method)(std::forward<ArgTs>(args)...);
+        })
+    {
+    }
+
+    template<typename F, typename = typename std::enable_if<
+                 ! std::is_same<typename std::decay<F>::type, Callback>::value &&
+                 ! std::is_pointer<typename std::decay<F>::type>::value>::type>
+    Callback(F f) :
+        _func(std::move(f))
+    {
+    }
+
+    R call(ArgTs... args) const
+    {
+        return _func(std::forward<ArgTs>(args)...);
+    }
+
+    R operator()(ArgTs... args) const
+    {
+        return _func(std::forward<ArgTs>(args)...);
+    }
+
+    explicit operator bool() const
+    {
+        return static_cast<bool>(_func);
+    }
+
+    friend bool operator==(const Callback &f, std::nullptr_t)
+    {
+        return ! f;
+    }
+
+    friend bool operator!=(const Callback &f, std::nullptr_t)
+    {
+        return static_cast<bool>(f);
+    }
+
+private:
+    std::function<R(ArgTs...)>  _func;
+};
+
+template<typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(R (*func)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(func);
+}
+
+template<typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(U *obj, R (T::*method)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(obj, method);
+}
+
+template<typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(const U *obj, R (T::*method)(ArgTs...) const)
+{
+    return Callback<R(ArgTs...)>(obj, method);
+}
+
+}
+
+namespace rtos {
+namespace Kernel {
+
+/* Kernel::Clock = RTOS tick clock in ms, on steady clock */
+struct Clock {
+    typedef std::chrono::milliseconds               duration;
+    typedef duration::rep                           rep;
+    typedef duration::period                        period;
+    typedef std::chrono::time_point<Clock>          time_point;
+    static const bool is_steady = true;
+
+    static time_point now()
+    {
+        return time_point(std::chrono::duration_cast<duration>(std::chrono::steady_clock::now().time_since_epoch()));
+    }
+};
+
+}
+}
+
+using namespace rtos;
+
+namespace mbed {
+
+/* HighResClock = us ticker clock, on steady clock */
+struct HighResClock {
+    typedef std::chrono::microseconds               duration;
+    typedef duration::rep                           rep;
+    typedef duration::period                        period;
+    typedef std::chrono::time_point<HighResClock>   time_point;
+    static const bool is_steady = true;
+
+    static time_point now()
+    {
+        return time_point(std::chrono::duration_cast<duration>(std::chrono::steady_clock::now().time_since_epoch()));
+    }
+};
+
+/* Timer = mbed::Timer on steady clock */
+class Timer
+{
+public:
+    Timer() :
+        _running(false), _elapsed(0)
+    {
+    }
+
+    void start()
+    {
+        if (! _running) {
+            _start = std::chrono::steady_clock::now();
+            _running = true;
+        }
+    }
+
+    void stop()
+    {
+        _elapsed = elapsed_time();
+        _running = false;
+    }
+
+    void reset()
+    {
+        _start = std::chrono::steady_clock::now();
+        _elapsed = std::chrono::microseconds(0);
+    }
+
+    std::chrono::microseconds elapsed_time() const
+    {
+        if (! _running) {
+            return _elapsed;
+        }
+        return _elapsed + std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start);
+    }
+
+    int read_ms() const
+    {
+        return (int) std::chrono::duration_cast<std::chrono::milliseconds>(elapsed_time()).count();
+    }
+
+    int read_us() const
+    {
+        return (int) elapsed_time().count();
+    }
+
+private:
+    bool                                    _running;
+    std::chrono::steady_clock::time_point   _start;
+    std::chrono::microseconds               _elapsed;
+};
+
+}
+
+#include "rtos/rtos.h"
+#include "events/mbed_events.h"
+#include "platform/PlatformMutex.h"
+#include "platform/SingletonPtr.h"
+#include "platform/CriticalSectionLock.h"
+
+using mbed::Callback;
+using mbed::callback;
+using mbed::Timer;
+using mbed::HighResClock;
+using mbed::CriticalSectionLock;
+using namespace events;
+
+#endif // _HOST_MBED_H_
@@ -0,0 +1,127 @@
+#include "mbed_stats.h"
+
+#include <atomic>
+#include <errno.h>
+#include <malloc.h>
+
+/* Heap stats by interposing malloc() and friends of glibc, for MBED_HEAP_STATS_ENABLED
+ *
+ * Covers C++ new/delete and allocation in libraries too, as Mbed OS heap stats do.
+ */
+
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t nmemb, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void *ptr);
+}
+
+namespace {
+
+std::atomic<size_t>     current_size(0);
+std::atomic<size_t>     max_size(0);
+std::atomic<size_t>     total_size(0);
+std::atomic<uint32_t>   alloc_cnt(0);
+std::atomic<uint32_t>   alloc_fail_cnt(0);
+
+void *allocated(void *ptr)
+{
+    if (ptr == NULL) {
+        alloc_fail_cnt ++;
+        return NULL;
+    }
+
+    size_t size = malloc_usable_size(ptr);
+    size_t current = current_size.fetch_add(size) + size;
+    size_t max = max_size.load();
+    while (current > max && ! max_size.compare_exchange_weak(max, current)) {
+    }
+    total_size += size;
+    alloc_cnt ++;
+
+    return ptr;
+}
+
+void freeing(void *ptr)
+{
+    if (ptr) {
+        current_size -= malloc_usable_size(ptr);
+        alloc_cnt --;
+    }
+}
+
+}
+
+extern "C" {
+
+void *malloc(size_t size)
+{
+    return allocated(__libc_malloc(size));
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    return allocated(__libc_calloc(nmemb, size));
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+
+    size_t old_size = malloc_usable_size(ptr);
+    void *new_ptr = __libc_realloc(ptr, size);
+    if (new_ptr == NULL) {
+        alloc_fail_cnt ++;
+        return NULL;
+    }
+
+    current_size -= old_size;
+    alloc_cnt --;
+    return allocated(new_ptr);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    return allocated(__libc_memalign(alignment, size));
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *ptr = memalign(alignment, size);
+    if (ptr == NULL) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void free(void *ptr)
+{
+    freeing(ptr);
+    __libc_free(ptr);
+}
+
+void mbed_stats_heap_get(mbed_stats_heap_t *stats)
+{
+    stats->current_size = (uint32_t) current_size.load();
+    stats->max_size = (uint32_t) max_size.load();
+    stats->total_size = (uint32_t) total_size.load();
+    stats->reserved_size = 0;
+    stats->alloc_cnt = alloc_cnt.load();
+    stats->alloc_fail_cnt = alloc_fail_cnt.load();
+    stats->overhead_size = 0;
+}
+
+}
@@ -0,0 +1,32 @@
+#ifndef _HOST_MBED_STATS_H_
+#define _HOST_MBED_STATS_H_
+
+/* Host mbed_stats.h = heap stats of Mbed OS, kept by malloc() interposed in mbed_stats.cpp
+ *
+ * Sizes are usable sizes of glibc chunks, so a little above the requested sizes.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    uint32_t current_size;      /**< Bytes allocated currently */
+    uint32_t max_size;          /**< Max bytes allocated at a given time */
+    uint32_t total_size;        /**< Cumulative sum of bytes ever allocated */
+    uint32_t reserved_size;     /**< Current number of bytes allocated for the heap */
+    uint32_t alloc_cnt;         /**< Current number of allocations */
+    uint32_t alloc_fail_cnt;    /**< Number of failed allocations */
+    uint32_t overhead_size;     /**< Overhead added to heap for stats */
+} mbed_stats_heap_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mbed_stats_heap_get(mbed_stats_heap_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HOST_MBED_STATS_H_
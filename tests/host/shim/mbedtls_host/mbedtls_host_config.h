@@ -0,0 +1,26 @@
+#ifndef _MBEDTLS_HOST_CONFIG_H_
+#define _MBEDTLS_HOST_CONFIG_H_
+
+/* Mbed TLS user config for the host = mbedtls_user_config.h of this example + host needs
+ *
+ * Set as MBEDTLS_USER_CONFIG_FILE instead of mbedtls_user_config.h, so record buffer and
+ * crypto profiles by my-tlssocket configuration are the same as on target.
+ */
+
+/* Entropy from getrandom(), see mbedtls_host_entropy.c. As with EADC on targets without TRNG. */
+#define MBEDTLS_ENTROPY_HARDWARE_ALT
+
+#include "mbedtls_user_config.h"
+
+/* Loopback broker: TLS server with session cache and tickets, and credentials it generates */
+#define MBEDTLS_SSL_SRV_C
+#define MBEDTLS_SSL_CACHE_C
+#define MBEDTLS_SSL_TICKET_C
+#define MBEDTLS_SSL_SESSION_TICKETS
+#define MBEDTLS_X509_CREATE_C
+#define MBEDTLS_X509_CRT_WRITE_C
+#define MBEDTLS_PK_WRITE_C
+#define MBEDTLS_PEM_WRITE_C
+#define MBEDTLS_ASN1_WRITE_C
+
+#endif // _MBEDTLS_HOST_CONFIG_H_
@@ -0,0 +1,42 @@
+#ifndef _HOST_CRITICAL_SECTION_LOCK_H_
+#define _HOST_CRITICAL_SECTION_LOCK_H_
+
+#include <mutex>
+
+namespace mbed {
+
+/* CriticalSectionLock = one process-wide recursive mutex, in place of interrupts disabled */
+class CriticalSectionLock
+{
+public:
+    CriticalSectionLock()
+    {
+        mutex().lock();
+    }
+
+    ~CriticalSectionLock()
+    {
+        mutex().unlock();
+    }
+
+    static void enable()
+    {
+        mutex().lock();
+    }
+
+    static void disable()
+    {
+        mutex().unlock();
+    }
+
+private:
+    static std::recursive_mutex &mutex()
+    {
+        static std::recursive_mutex critical;
+        return critical;
+    }
+};
+
+}
+
+#endif // _HOST_CRITICAL_SECTION_LOCK_H_
@@ -0,0 +1,8 @@
+#ifndef _HOST_PLATFORM_MUTEX_H_
+#define _HOST_PLATFORM_MUTEX_H_
+
+#include "rtos/rtos.h"
+
+typedef rtos::Mutex PlatformMutex;
+
+#endif // _HOST_PLATFORM_MUTEX_H_
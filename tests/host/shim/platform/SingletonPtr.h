@@ -0,0 +1,31 @@
+#ifndef _HOST_SINGLETON_PTR_H_
+#define _HOST_SINGLETON_PTR_H_
+
+#include <mutex>
+
+/* SingletonPtr = object constructed on first use, never destroyed */
+template <class T>
+struct SingletonPtr {
+    T *get() const
+    {
+        std::call_once(_once, [this] {
+            _ptr = new T();
+        });
+        return _ptr;
+    }
+
+    T *operator->() const
+    {
+        return get();
+    }
+
+    T &operator*() const
+    {
+        return *get();
+    }
+
+    mutable std::once_flag  _once;
+    mutable T *             _ptr = nullptr;
+};
+
+#endif // _HOST_SINGLETON_PTR_H_
@@ -0,0 +1,2 @@
+/* Atomics live in host mbed.h */
+#include "mbed.h"
@@ -0,0 +1,223 @@
+#ifndef _HOST_RTOS_H_
+#define _HOST_RTOS_H_
+
+/* Host rtos = Thread, Mutex, EventFlags and ThisThread of Mbed OS RTOS, on std::thread
+ *
+ * Thread priority has no effect on the host. Threads are scheduled by Linux.
+ */
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef enum {
+    osOK                = 0,
+    osError             = -1,
+    osErrorTimeout      = -2,
+    osErrorResource     = -3,
+    osErrorParameter    = -4,
+    osErrorNoMemory     = -5
+} osStatus;
+
+typedef enum {
+    osPriorityIdle          = 1,
+    osPriorityLow           = 8,
+    osPriorityBelowNormal   = 16,
+    osPriorityNormal        = 24,
+    osPriorityAboveNormal   = 32,
+    osPriorityHigh          = 40,
+    osPriorityRealtime      = 48
+} osPriority;
+
+#define osWaitForever           0xFFFFFFFFU
+#define osFlagsError            0x80000000U
+#define osFlagsErrorTimeout     0xFFFFFFFEU
+
+namespace rtos {
+
+/* Mutex = recursive mutex, as Mbed OS Mutex */
+class Mutex
+{
+public:
+    void lock()
+    {
+        _mutex.lock();
+    }
+
+    bool trylock()
+    {
+        return _mutex.try_lock();
+    }
+
+    void unlock()
+    {
+        _mutex.unlock();
+    }
+
+private:
+    std::recursive_mutex    _mutex;
+};
+
+/* EventFlags = 31 flags waited on with condition variable */
+class EventFlags
+{
+public:
+    EventFlags() :
+        _flags(0)
+    {
+    }
+
+    uint32_t set(uint32_t flags)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _flags |= flags;
+        _cond.notify_all();
+        return _flags;
+    }
+
+    uint32_t clear(uint32_t flags = 0x7FFFFFFF)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint32_t old = _flags;
+        _flags &= ~flags;
+        return old;
+    }
+
+    uint32_t get() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _flags;
+    }
+
+    uint32_t wait_any(uint32_t flags = 0, uint32_t millisec = osWaitForever, bool clear = true)
+    {
+        return wait(flags, false, millisec, clear);
+    }
+
+    uint32_t wait_all(uint32_t flags = 0, uint32_t millisec = osWaitForever, bool clear = true)
+    {
+        return wait(flags, true, millisec, clear);
+    }
+
+    uint32_t wait_any_for(uint32_t flags, std::chrono::milliseconds rel_time, bool clear = true)
+    {
+        return wait(flags, false, rel_time.count() < 0 ? 0 : (uint32_t) rel_time.count(), clear);
+    }
+
+    uint32_t wait_all_for(uint32_t flags, std::chrono::milliseconds rel_time, bool clear = true)
+    {
+        return wait(flags, true, rel_time.count() < 0 ? 0 : (uint32_t) rel_time.count(), clear);
+    }
+
+private:
+    uint32_t wait(uint32_t flags, bool all, uint32_t millisec, bool clear)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        if (flags == 0) {
+            flags = 0x7FFFFFFF;
+        }
+        auto satisfied = [this, flags, all] {
+            return all ? ((_flags & flags) == flags) : ((_flags & flags) != 0);
+        };
+
+        if (millisec == osWaitForever) {
+            _cond.wait(lock, satisfied);
+        } else if (! _cond.wait_for(lock, std::chrono::milliseconds(millisec), satisfied)) {
+            return osFlagsErrorTimeout;
+        }
+
+        uint32_t result = _flags;
+        if (clear) {
+            _flags &= ~flags;
+        }
+        return result;
+    }
+
+    mutable std::mutex          _mutex;
+    std::condition_variable     _cond;
+    uint32_t                    _flags;
+};
+
+/* Thread = std::thread started on start(). Stack size and priority are recorded only. */
+class Thread
+{
+public:
+    Thread(osPriority priority = osPriorityNormal, uint32_t stack_size = 0,
+           unsigned char *stack_mem = NULL, const char *name = NULL) :
+        _priority(priority),
+        _stack_size(stack_size),
+        _name(name)
+    {
+        (void) stack_mem;
+    }
+
+    ~Thread()
+    {
+        /* As terminate() of Mbed OS. Threads here run to completion or forever. */
+        if (_thread.joinable()) {
+            _thread.detach();
+        }
+    }
+
+    osStatus start(mbed::Callback<void()> task)
+    {
+        if (_thread.joinable()) {
+            return osErrorParameter;
+        }
+        _thread = std::thread([task] {
+            task();
+        });
+        return osOK;
+    }
+
+    osStatus join()
+    {
+        if (! _thread.joinable()) {
+            return osErrorResource;
+        }
+        _thread.join();
+        return osOK;
+    }
+
+    osPriority get_priority() const
+    {
+        return _priority;
+    }
+
+    uint32_t stack_size() const
+    {
+        return _stack_size;
+    }
+
+    const char *get_name() const
+    {
+        return _name;
+    }
+
+private:
+    std::thread     _thread;
+    osPriority      _priority;
+    uint32_t        _stack_size;
+    const char *    _name;
+};
+
+namespace ThisThread {
+
+inline void sleep_for(std::chrono::milliseconds rel_time)
+{
+    std::this_thread::sleep_for(rel_time);
+}
+
+inline void yield()
+{
+    std::this_thread::yield();
+}
+
+}
+
+}
+
+#endif // _HOST_RTOS_H_
@@ -0,0 +1,103 @@
+/* SPSCQueue under one producer thread and one consumer thread
+ *
+ * Sequence-numbered records go through a queue of the configured depth, so the two sides
+ * keep running into full and empty. The consumer checks that records arrive in order with
+ * no gap and no duplicate, and that no record is torn.
+ */
+
+#include "mbed.h"
+#include "SPSCQueue.h"
+#include "TelemetryRecord.h"
+#include "host_test.h"
+
+#include <thread>
+
+namespace {
+
+const uint32_t RECORDS = 10 * 1000 * 1000;
+
+typedef SPSCQueue<TelemetryRecord, MBED_CONF_MY_MQTT_TELEMETRY_QUEUE_DEPTH> TelemetryQueue;
+
+TelemetryRecord make_record(uint32_t seq)
+{
+    TelemetryRecord record;
+
+    record.timestamp = seq;
+    record.temperature = (float) (seq & 0xFFFF);
+    record.humidity = (float) ((seq >> 16) & 0xFFFF);
+    record.pressure = (float) ((~seq) & 0xFFFF);
+
+    return record;
+}
+
+void producer(TelemetryQueue *queue, uint32_t *full)
+{
+    for (uint32_t seq = 0; seq < RECORDS; seq ++) {
+        TelemetryRecord record = make_record(seq);
+        while (! queue->push(record)) {
+            (*full) ++;
+            std::this_thread::yield();
+        }
+    }
+}
+
+void consumer(TelemetryQueue *queue, uint32_t *empty)
+{
+    uint32_t expected = 0;
+
+    while (expected < RECORDS) {
+        TelemetryRecord record;
+        if (! queue->pop(record)) {
+            (*empty) ++;
+            std::this_thread::yield();
+            continue;
+        }
+
+        /* Gap, duplicate or out of order */
+        if (record.timestamp != expected) {
+            printf("Record %u received, expected %u\n", (unsigned) record.timestamp, (unsigned) expected);
+        }
+        HOST_TEST_ASSERT_EQUAL(expected, record.timestamp);
+
+        /* Torn */
+        TelemetryRecord ref = make_record(expected);
+        HOST_TEST_ASSERT(record.temperature == ref.temperature);
+        HOST_TEST_ASSERT(record.humidity == ref.humidity);
+        HOST_TEST_ASSERT(record.pressure == ref.pressure);
+
+        expected ++;
+    }
+}
+
+void test_one_producer_one_consumer()
+{
+    static TelemetryQueue queue;
+    uint32_t full = 0;
+    uint32_t empty = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread consumer_thread(consumer, &queue, &empty);
+    std::thread producer_thread(producer, &queue, &full);
+    producer_thread.join();
+    consumer_thread.join();
+
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    HOST_TEST_ASSERT(queue.empty());
+    /* Every push on full queue is counted */
+    HOST_TEST_ASSERT_EQUAL(full, queue.dropped());
+
+    printf("%u records through depth %u in %lld ms, full %u, empty %u\n",
+           (unsigned) RECORDS, (unsigned) TelemetryQueue::capacity(), (long long) elapsed_ms,
+           (unsigned) full, (unsigned) empty);
+}
+
+}
+
+int main()
+{
+    HOST_TEST_RUN(test_one_producer_one_consumer);
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef _HOST_STUB_MQTT_CLIENT_H_
+#define _HOST_STUB_MQTT_CLIENT_H_
+
+/* Host stub MQTTClient.h = MQTT lib types used by my-mqtt headers, without MQTT lib
+ *
+ * For unit tests which plug in a stub client. Layout follows MQTT lib, so code built
+ * against it builds against MQTT lib unchanged.
+ */
+
+#include "mbed.h"
+
+typedef struct {
+    int     len;
+    char *  data;
+} MQTTLenString;
+
+typedef struct {
+    char *          cstring;
+    MQTTLenString   lenstring;
+} MQTTString;
+
+namespace MQTT {
+
+enum QoS { QOS0, QOS1, QOS2 };
+
+enum returnCode { BUFFER_OVERFLOW = -2, FAILURE = -1, SUCCESS = 0 };
+
+struct Message {
+    enum QoS        qos;
+    bool            retained;
+    bool            dup;
+    unsigned short  id;
+    void *          payload;
+    size_t          payloadlen;
+};
+
+struct MessageData {
+    MessageData(MQTTString &aTopicName, struct Message &aMessage) :
+        message(aMessage), topicName(aTopicName)
+    {
+    }
+
+    struct Message &    message;
+    MQTTString &        topicName;
+};
+
+}
+
+#endif // _HOST_STUB_MQTT_CLIENT_H_
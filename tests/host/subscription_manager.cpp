@@ -0,0 +1,183 @@
+/* MQTTSubscriptionManager on a stub client: subscribe once per connection, resubscribe after loss */
+
+#include "mbed.h"
+#include "MQTTSubscriptionManager.h"
+#include "host_test.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+/* Client::subscribe() as MQTT::Client, recording calls. Topic filters in fail_filters get SUBACK failure. */
+class StubClient
+{
+public:
+    typedef void (*messageHandler)(MQTT::MessageData &);
+
+    int subscribe(const char *topic_filter, MQTT::QoS qos, messageHandler mh)
+    {
+        subscribed.push_back(topic_filter);
+        handler = mh;
+        for (size_t i = 0; i < fail_filters.size(); i ++) {
+            if (fail_filters[i] == topic_filter) {
+                return MQTT::FAILURE;
+            }
+        }
+        return MQTT::SUCCESS;
+    }
+
+    /* Deliver one message the way MQTT::Client does */
+    void deliver(const char *topic, const char *payload)
+    {
+        MQTTString topic_name;
+        topic_name.cstring = NULL;
+        topic_name.lenstring.data = const_cast<char *>(topic);
+        topic_name.lenstring.len = strlen(topic);
+
+        MQTT::Message message;
+        message.qos = MQTT::QOS1;
+        message.retained = false;
+        message.dup = false;
+        message.id = 1;
+        message.payload = const_cast<char *>(payload);
+        message.payloadlen = strlen(payload);
+
+        MQTT::MessageData md(topic_name, message);
+        handler(md);
+    }
+
+    std::vector<std::string>    subscribed;
+    std::vector<std::string>    fail_filters;
+    messageHandler              handler = NULL;
+};
+
+typedef MQTTSubscriptionManager<StubClient, 8> Subscriptions;
+
+const char *SHADOW_FILTERS[] = {
+    "$aws/things/thing/shadow/update/accepted",
+    "$aws/things/thing/shadow/update/rejected",
+    "$aws/things/thing/shadow/update/delta"
+};
+
+struct Received {
+    int             count = 0;
+    std::string     topic;
+
+    void on_message(const MQTTMessageView &view)
+    {
+        count ++;
+        topic.assign(view.topic, view.topic_len);
+    }
+};
+
+void test_subscribe_once_per_connection()
+{
+    StubClient client;
+    Subscriptions subs(client);
+    Received received;
+
+    HOST_TEST_ASSERT_EQUAL(MQTT::SUCCESS, subs.add(SHADOW_FILTERS, 3, MQTT::QOS1, callback(&received, &Received::on_message)));
+    HOST_TEST_ASSERT_EQUAL(0, subs.active_count());
+
+    HOST_TEST_ASSERT_EQUAL(0, subs.subscribe_all());
+    HOST_TEST_ASSERT_EQUAL(3, client.subscribed.size());
+    HOST_TEST_ASSERT_EQUAL(3, subs.active_count());
+
+    /* Still connected: nothing to subscribe */
+    HOST_TEST_ASSERT_EQUAL(0, subs.subscribe_all());
+    HOST_TEST_ASSERT_EQUAL(3, client.subscribed.size());
+}
+
+void test_resubscribe_after_connection_lost()
+{
+    StubClient client;
+    Subscriptions subs(client);
+    Received received;
+
+    subs.add(SHADOW_FILTERS, 3, MQTT::QOS1, callback(&received, &Received::on_message));
+    subs.subscribe_all();
+    client.subscribed.clear();
+
+    subs.connection_lost();
+    HOST_TEST_ASSERT_EQUAL(0, subs.active_count());
+
+    HOST_TEST_ASSERT_EQUAL(0, subs.subscribe_all());
+    HOST_TEST_ASSERT_EQUAL(3, client.subscribed.size());
+    for (int i = 0; i < 3; i ++) {
+        HOST_TEST_ASSERT(client.subscribed[i] == SHADOW_FILTERS[i]);
+    }
+    HOST_TEST_ASSERT_EQUAL(3, subs.active_count());
+
+    /* Routing survives reconnect */
+    client.deliver("$aws/things/thing/shadow/update/delta", "{}");
+    HOST_TEST_ASSERT_EQUAL(1, received.count);
+    HOST_TEST_ASSERT(received.topic == "$aws/things/thing/shadow/update/delta");
+}
+
+void test_retry_failed_only()
+{
+    StubClient client;
+    Subscriptions subs(client);
+    Received received;
+
+    subs.add(SHADOW_FILTERS, 3, MQTT::QOS1, callback(&received, &Received::on_message));
+
+    client.fail_filters.push_back(SHADOW_FILTERS[1]);
+    HOST_TEST_ASSERT_EQUAL(1, subs.subscribe_all());
+    HOST_TEST_ASSERT_EQUAL(2, subs.active_count());
+
+    /* Next call retries the failed one only */
+    client.fail_filters.clear();
+    client.subscribed.clear();
+    HOST_TEST_ASSERT_EQUAL(0, subs.subscribe_all());
+    HOST_TEST_ASSERT_EQUAL(1, client.subscribed.size());
+    HOST_TEST_ASSERT(client.subscribed[0] == SHADOW_FILTERS[1]);
+    HOST_TEST_ASSERT_EQUAL(3, subs.active_count());
+
+    /* Lost again before any message: all three again */
+    subs.connection_lost();
+    client.subscribed.clear();
+    HOST_TEST_ASSERT_EQUAL(0, subs.subscribe_all());
+    HOST_TEST_ASSERT_EQUAL(3, client.subscribed.size());
+}
+
+void test_instance_released_on_destroy()
+{
+    StubClient client;
+    Received first;
+    Received second;
+
+    /* One manager per client type at a time. Sequential ones are fine. */
+    {
+        Subscriptions subs(client);
+        subs.add(SHADOW_FILTERS[0], MQTT::QOS1, callback(&first, &Received::on_message));
+        subs.subscribe_all();
+        client.deliver(SHADOW_FILTERS[0], "{}");
+    }
+    {
+        Subscriptions subs(client);
+        subs.add(SHADOW_FILTERS[0], MQTT::QOS1, callback(&second, &Received::on_message));
+        subs.subscribe_all();
+        client.deliver(SHADOW_FILTERS[0], "{}");
+    }
+
+    HOST_TEST_ASSERT_EQUAL(1, first.count);
+    HOST_TEST_ASSERT_EQUAL(1, second.count);
+
+    /* Gone: stale handler held by client drops message */
+    client.deliver(SHADOW_FILTERS[0], "{}");
+    HOST_TEST_ASSERT_EQUAL(1, second.count);
+}
+
+}
+
+int main()
+{
+    HOST_TEST_RUN(test_subscribe_once_per_connection);
+    HOST_TEST_RUN(test_resubscribe_after_connection_lost);
+    HOST_TEST_RUN(test_retry_failed_only);
+    HOST_TEST_RUN(test_instance_released_on_destroy);
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+/* Host TCPSocket against a loopback echo server: return codes and sigio as TLSSocketWrapper
+ * and MyTLSSocket::connect_async() expect them from a Mbed OS network stack */
+
+#include "mbed.h"
+#include "TCPSocket.h"
+#include "NetworkInterface.h"
+#include "host_test.h"
+
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+/* Echo server on 127.0.0.1, for one connection */
+class EchoServer
+{
+public:
+    EchoServer()
+    {
+        struct sockaddr_in sin;
+        socklen_t sin_len = sizeof (sin);
+
+        _listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        HOST_TEST_ASSERT(_listen_fd >= 0);
+        memset(&sin, 0, sizeof (sin));
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        HOST_TEST_ASSERT_EQUAL(0, bind(_listen_fd, (struct sockaddr *) &sin, sizeof (sin)));
+        HOST_TEST_ASSERT_EQUAL(0, listen(_listen_fd, 1));
+        HOST_TEST_ASSERT_EQUAL(0, getsockname(_listen_fd, (struct sockaddr *) &sin, &sin_len));
+        _port = ntohs(sin.sin_port);
+
+        _thread = std::thread(&EchoServer::serve, this);
+    }
+
+    ~EchoServer()
+    {
+        shutdown(_listen_fd, SHUT_RDWR);
+        _thread.join();
+        ::close(_listen_fd);
+    }
+
+    SocketAddress address() const
+    {
+        return SocketAddress("127.0.0.1", _port);
+    }
+
+private:
+    void serve()
+    {
+        int fd = accept(_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+
+        char buf[1024];
+        ssize_t n;
+        while ((n = ::recv(fd, buf, sizeof (buf), 0)) > 0) {
+            ::send(fd, buf, n, MSG_NOSIGNAL);
+        }
+        ::close(fd);
+    }
+
+    int             _listen_fd;
+    uint16_t        _port;
+    std::thread     _thread;
+};
+
+void test_blocking_echo()
+{
+    EchoServer server;
+    TCPSocket socket;
+    char buf[16];
+
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, socket.open(NetworkInterface::get_default_instance()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, socket.connect(server.address()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_IS_CONNECTED, socket.connect(server.address()));
+
+    HOST_TEST_ASSERT_EQUAL(5, socket.send("hello", 5));
+    int n = 0;
+    while (n < 5) {
+        int rc = socket.recv(buf + n, sizeof (buf) - n);
+        HOST_TEST_ASSERT(rc > 0);
+        n += rc;
+    }
+    HOST_TEST_ASSERT(memcmp(buf, "hello", 5) == 0);
+
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, socket.close());
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_NO_SOCKET, socket.close());
+}
+
+void test_recv_timeout()
+{
+    EchoServer server;
+    TCPSocket socket;
+    char buf[16];
+
+    socket.open(NetworkInterface::get_default_instance());
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, socket.connect(server.address()));
+
+    socket.set_timeout(50);
+    Timer timer;
+    timer.start();
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_WOULD_BLOCK, socket.recv(buf, sizeof (buf)));
+    HOST_TEST_ASSERT(timer.read_ms() >= 40);
+
+    socket.set_blocking(false);
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_WOULD_BLOCK, socket.recv(buf, sizeof (buf)));
+}
+
+/* Non-blocking connect and recv driven by sigio, as connect_async() does on an event queue */
+void test_non_blocking_sigio()
+{
+    EchoServer server;
+    TCPSocket socket;
+    EventFlags flags;
+    char buf[16];
+
+    socket.open(NetworkInterface::get_default_instance());
+    socket.set_blocking(false);
+    socket.sigio([&flags] {
+        flags.set(1);
+    });
+
+    nsapi_error_t rc = socket.connect(server.address());
+    HOST_TEST_ASSERT(rc == NSAPI_ERROR_IN_PROGRESS || rc == NSAPI_ERROR_OK);
+    while (rc == NSAPI_ERROR_IN_PROGRESS || rc == NSAPI_ERROR_ALREADY) {
+        HOST_TEST_ASSERT((flags.wait_any(1, 1000) & osFlagsError) == 0);
+        rc = socket.connect(server.address());
+    }
+    HOST_TEST_ASSERT(rc == NSAPI_ERROR_IS_CONNECTED || rc == NSAPI_ERROR_OK);
+
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_WOULD_BLOCK, socket.recv(buf, sizeof (buf)));
+    flags.clear();
+    HOST_TEST_ASSERT_EQUAL(3, socket.send("abc", 3));
+
+    /* Echo comes in: sigio */
+    HOST_TEST_ASSERT((flags.wait_any(1, 1000) & osFlagsError) == 0);
+    int n = 0;
+    while (n < 3) {
+        rc = socket.recv(buf + n, sizeof (buf) - n);
+        if (rc == NSAPI_ERROR_WOULD_BLOCK) {
+            HOST_TEST_ASSERT((flags.wait_any(1, 1000) & osFlagsError) == 0);
+            continue;
+        }
+        HOST_TEST_ASSERT(rc > 0);
+        n += rc;
+    }
+    HOST_TEST_ASSERT(memcmp(buf, "abc", 3) == 0);
+}
+
+void test_connection_refused()
+{
+    TCPSocket socket;
+    SocketAddress address;
+
+    /* Port of a listener just gone */
+    {
+        EchoServer server;
+        address = server.address();
+    }
+
+    socket.open(NetworkInterface::get_default_instance());
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_NO_CONNECTION, socket.connect(address));
+}
+
+void test_event_queue()
+{
+    EventQueue queue(4 * EVENTS_EVENT_SIZE);
+    Thread thread(osPriorityNormal, 4096, NULL, "queue");
+    EventFlags flags;
+    int ticks = 0;
+
+    HOST_TEST_ASSERT_EQUAL(osOK, thread.start(callback(&queue, &EventQueue::dispatch_forever)));
+
+    int every = queue.call_every(std::chrono::milliseconds(10), [&ticks, &flags] {
+        if (++ ticks == 3) {
+            flags.set(1);
+        }
+    });
+    HOST_TEST_ASSERT(every != 0);
+    HOST_TEST_ASSERT((flags.wait_any(1, 1000) & osFlagsError) == 0);
+    HOST_TEST_ASSERT(queue.cancel(every));
+    HOST_TEST_ASSERT(! queue.cancel(every));
+
+    HOST_TEST_ASSERT(queue.call([&flags] {
+        flags.set(2);
+    }) != 0);
+    HOST_TEST_ASSERT((flags.wait_any(2, 1000) & osFlagsError) == 0);
+
+    /* Out of room: ID 0 */
+    int ids[4];
+    for (int i = 0; i < 4; i ++) {
+        ids[i] = queue.call_in(std::chrono::milliseconds(10000), [] {});
+        HOST_TEST_ASSERT(ids[i] != 0);
+    }
+    HOST_TEST_ASSERT_EQUAL(0, queue.call([] {}));
+    for (int i = 0; i < 4; i ++) {
+        queue.cancel(ids[i]);
+    }
+
+    queue.break_dispatch();
+    thread.join();
+}
+
+}
+
+int main()
+{
+    HOST_TEST_RUN(test_blocking_echo);
+    HOST_TEST_RUN(test_recv_timeout);
+    HOST_TEST_RUN(test_non_blocking_sigio);
+    HOST_TEST_RUN(test_connection_refused);
+    HOST_TEST_RUN(test_event_queue);
+
+    return 0;
+}
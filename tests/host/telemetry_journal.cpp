@@ -0,0 +1,174 @@
+/* TelemetryJournal on a RAM KVStore: replay batch commit while appends overwrite on full journal */
+
+#include "mbed.h"
+#include "TelemetryJournal.h"
+#include "host_test.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+/* KVStore in RAM. With fail_set, set() fails as kvstore full. */
+class RamKVStore : public mbed::KVStore
+{
+public:
+    int set(const char *key, const void *buffer, size_t size, uint32_t create_flags) override
+    {
+        (void) create_flags;
+        if (fail_set) {
+            return MBED_ERROR_ENOMEM;
+        }
+        const uint8_t *data = static_cast<const uint8_t *>(buffer);
+        _values[key].assign(data, data + size);
+        return MBED_SUCCESS;
+    }
+
+    int get(const char *key, void *buffer, size_t buffer_size, size_t *actual_size, size_t offset) override
+    {
+        (void) offset;
+        auto it = _values.find(key);
+        if (it == _values.end()) {
+            return MBED_ERROR_ITEM_NOT_FOUND;
+        }
+        size_t size = it->second.size() < buffer_size ? it->second.size() : buffer_size;
+        memcpy(buffer, it->second.data(), size);
+        if (actual_size) {
+            *actual_size = size;
+        }
+        return MBED_SUCCESS;
+    }
+
+    bool    fail_set = false;
+
+private:
+    std::map<std::string, std::vector<uint8_t> >  _values;
+};
+
+const uint32_t CAPACITY = MBED_CONF_MY_MQTT_JOURNAL_CAPACITY;
+
+TelemetryRecord make_record(uint32_t n)
+{
+    TelemetryRecord record;
+
+    record.timestamp = n;
+    record.temperature = 25.0f;
+    record.humidity = 50.0f;
+    record.pressure = 101325.0f;
+
+    return record;
+}
+
+void append_range(TelemetryJournal &journal, uint32_t first, uint32_t count)
+{
+    for (uint32_t i = first; i < first + count; i ++) {
+        HOST_TEST_ASSERT_EQUAL(MBED_SUCCESS, journal.append(make_record(i)));
+    }
+}
+
+/* Oldest pending record, by its timestamp */
+uint32_t oldest(TelemetryJournal &journal)
+{
+    TelemetryRecord record;
+
+    HOST_TEST_ASSERT_EQUAL(1, journal.peek(&record, 1));
+    return record.timestamp;
+}
+
+void test_consume_through_after_overwrite()
+{
+    RamKVStore kvstore;
+    TelemetryJournal journal(&kvstore);
+    TelemetryRecord batch[4];
+    uint32_t last_seq = 0;
+
+    HOST_TEST_ASSERT_EQUAL(MBED_SUCCESS, journal.init());
+    append_range(journal, 0, CAPACITY);
+
+    /* Replay batch of records 0..3 in flight */
+    HOST_TEST_ASSERT_EQUAL(4, journal.peek(batch, 4, &last_seq));
+    HOST_TEST_ASSERT_EQUAL(0, batch[0].timestamp);
+    HOST_TEST_ASSERT_EQUAL(3, batch[3].timestamp);
+
+    /* Live telemetry appended meanwhile overwrites 0 and 1 */
+    append_range(journal, CAPACITY, 2);
+    HOST_TEST_ASSERT_EQUAL(2, oldest(journal));
+
+    /* Batch acknowledged: 2 and 3 go, 4 on stays */
+    HOST_TEST_ASSERT_EQUAL(MBED_SUCCESS, journal.consume_through(last_seq));
+    HOST_TEST_ASSERT_EQUAL(4, oldest(journal));
+    HOST_TEST_ASSERT_EQUAL(CAPACITY - 2, journal.pending());
+}
+
+void test_consume_through_all_overwritten()
+{
+    RamKVStore kvstore;
+    TelemetryJournal journal(&kvstore);
+    TelemetryRecord batch[4];
+    uint32_t last_seq = 0;
+
+    journal.init();
+    append_range(journal, 0, CAPACITY);
+    HOST_TEST_ASSERT_EQUAL(4, journal.peek(batch, 4, &last_seq));
+
+    /* Whole batch overwritten and more */
+    append_range(journal, CAPACITY, 6);
+    HOST_TEST_ASSERT_EQUAL(6, oldest(journal));
+
+    HOST_TEST_ASSERT_EQUAL(MBED_SUCCESS, journal.consume_through(last_seq));
+    HOST_TEST_ASSERT_EQUAL(6, oldest(journal));
+    HOST_TEST_ASSERT_EQUAL(CAPACITY, journal.pending());
+}
+
+void test_consume_through_persisted()
+{
+    RamKVStore kvstore;
+    TelemetryRecord batch[4];
+    uint32_t last_seq = 0;
+
+    {
+        TelemetryJournal journal(&kvstore);
+        journal.init();
+        append_range(journal, 0, 6);
+        HOST_TEST_ASSERT_EQUAL(4, journal.peek(batch, 4, &last_seq));
+        journal.consume_through(last_seq);
+    }
+
+    /* Reboot */
+    TelemetryJournal journal(&kvstore);
+    HOST_TEST_ASSERT_EQUAL(MBED_SUCCESS, journal.init());
+    HOST_TEST_ASSERT_EQUAL(2, journal.pending());
+    HOST_TEST_ASSERT_EQUAL(4, oldest(journal));
+}
+
+void test_append_failure_counted()
+{
+    RamKVStore kvstore;
+    TelemetryJournal journal(&kvstore);
+    uint32_t failed = TelemetryJournal::stats().append_failed;
+
+    journal.init();
+    kvstore.fail_set = true;
+    HOST_TEST_ASSERT(journal.append(make_record(0)) != MBED_SUCCESS);
+    HOST_TEST_ASSERT(journal.append(make_record(1)) != MBED_SUCCESS);
+    HOST_TEST_ASSERT_EQUAL(failed + 2, TelemetryJournal::stats().append_failed);
+    HOST_TEST_ASSERT(journal.empty());
+
+    /* Not initialized */
+    TelemetryJournal uninitialized(&kvstore);
+    HOST_TEST_ASSERT_EQUAL(MBED_ERROR_NOT_READY, uninitialized.append(make_record(2)));
+    HOST_TEST_ASSERT_EQUAL(failed + 3, TelemetryJournal::stats().append_failed);
+}
+
+}
+
+int main()
+{
+    HOST_TEST_RUN(test_consume_through_after_overwrite);
+    HOST_TEST_RUN(test_consume_through_all_overwritten);
+    HOST_TEST_RUN(test_consume_through_persisted);
+    HOST_TEST_RUN(test_append_failure_counted);
+
+    return 0;
+}
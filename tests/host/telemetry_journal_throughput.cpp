@@ -0,0 +1,178 @@
+/* TelemetryJournal append and replay throughput on a file-backed kvstore
+ *
+ * The kvstore appends each set() to a log file and reads get() back from it, as TDBStore
+ * programs and reads a block device, with only an index of the latest value per key in RAM.
+ * ROUNDS times, CAPACITY records are appended while the link is down, then replayed on
+ * reconnect in batches of journal-replay-batch with peek() and consume_through(), as
+ * AWS_IoT_MQTT_Test does. Reports records/s of both, bytes written to the kvstore per record,
+ * by the journal and in the log file including its own headers, and the journal stats of
+ * host command 'j'.
+ */
+
+#include "mbed.h"
+#include "TelemetryJournal.h"
+#include "host_test.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+
+namespace {
+
+/* KVStore as a log file. Replaced values stay in the file, as in a TDBStore area until
+ * garbage collection. */
+class FileKVStore : public mbed::KVStore
+{
+public:
+    FileKVStore() : _fd(-1), _log_bytes(0)
+    {
+        char path[] = "/tmp/telemetry_journal_XXXXXX";
+        _fd = mkstemp(path);
+        HOST_TEST_ASSERT(_fd >= 0);
+        /* Gone on close */
+        unlink(path);
+    }
+
+    ~FileKVStore()
+    {
+        close(_fd);
+    }
+
+    int set(const char *key, const void *buffer, size_t size, uint32_t create_flags) override
+    {
+        (void) create_flags;
+        Header header = { (uint32_t) strlen(key), (uint32_t) size };
+
+        if (pwrite(_fd, &header, sizeof (header), _log_bytes) != (ssize_t) sizeof (header) ||
+            pwrite(_fd, key, header.key_size, _log_bytes + sizeof (header)) != (ssize_t) header.key_size ||
+            pwrite(_fd, buffer, size, _log_bytes + sizeof (header) + header.key_size) != (ssize_t) size) {
+            return MBED_ERROR_WRITE_FAILED;
+        }
+
+        Location &location = _index[key];
+        location.offset = _log_bytes + sizeof (header) + header.key_size;
+        location.size = size;
+        _log_bytes += sizeof (header) + header.key_size + size;
+
+        return MBED_SUCCESS;
+    }
+
+    int get(const char *key, void *buffer, size_t buffer_size, size_t *actual_size, size_t offset) override
+    {
+        auto it = _index.find(key);
+        if (it == _index.end()) {
+            return MBED_ERROR_ITEM_NOT_FOUND;
+        }
+        if (offset > it->second.size) {
+            return MBED_ERROR_INVALID_SIZE;
+        }
+
+        size_t size = std::min(buffer_size, it->second.size - offset);
+        if (pread(_fd, buffer, size, it->second.offset + offset) != (ssize_t) size) {
+            return MBED_ERROR_READ_FAILED;
+        }
+        if (actual_size) {
+            *actual_size = size;
+        }
+
+        return MBED_SUCCESS;
+    }
+
+    /* Bytes written to the log file */
+    uint64_t log_bytes() const
+    {
+        return _log_bytes;
+    }
+
+private:
+    struct Header {
+        uint32_t    key_size;
+        uint32_t    data_size;
+    };
+
+    struct Location {
+        off_t       offset;
+        size_t      size;
+    };
+
+    int                                 _fd;
+    uint64_t                            _log_bytes;
+    std::map<std::string, Location>     _index;
+};
+
+const uint32_t CAPACITY = MBED_CONF_MY_MQTT_JOURNAL_CAPACITY;
+const uint32_t REPLAY_BATCH = MBED_CONF_MY_MQTT_JOURNAL_REPLAY_BATCH;
+const int ROUNDS = 100;
+
+uint32_t per_s(uint64_t records, std::chrono::microseconds elapsed)
+{
+    return elapsed.count() ? (uint32_t) (records * 1000000 / elapsed.count()) : 0;
+}
+
+void test_append_replay_throughput()
+{
+    FileKVStore kvstore;
+    TelemetryJournal journal(&kvstore);
+    std::chrono::microseconds append_elapsed(0);
+    std::chrono::microseconds replay_elapsed(0);
+    uint64_t appended = 0;
+    uint64_t replayed = 0;
+
+    HOST_TEST_ASSERT_EQUAL(MBED_SUCCESS, journal.init());
+
+    for (int round = 0; round < ROUNDS; round ++) {
+        /* Link down */
+        HighResClock::time_point start = HighResClock::now();
+        for (uint32_t i = 0; i < CAPACITY; i ++) {
+            TelemetryRecord record = { (uint32_t) appended, 25.0f, 50.0f, 101325.0f };
+            HOST_TEST_ASSERT_EQUAL(MBED_SUCCESS, journal.append(record));
+            appended ++;
+        }
+        append_elapsed += std::chrono::duration_cast<std::chrono::microseconds>(HighResClock::now() - start);
+
+        /* Reconnected: replay all, in order */
+        start = HighResClock::now();
+        while (! journal.empty()) {
+            TelemetryRecord batch[REPLAY_BATCH];
+            uint32_t last_seq = 0;
+            int n = journal.peek(batch, REPLAY_BATCH, &last_seq);
+            HOST_TEST_ASSERT(n > 0);
+            HOST_TEST_ASSERT_EQUAL(replayed, batch[0].timestamp);
+            HOST_TEST_ASSERT_EQUAL(MBED_SUCCESS, journal.consume_through(last_seq));
+            replayed += n;
+        }
+        replay_elapsed += std::chrono::duration_cast<std::chrono::microseconds>(HighResClock::now() - start);
+    }
+
+    const TelemetryJournal::Stats &stats = TelemetryJournal::stats();
+    printf("capacity %u, replay batch %u, %d rounds\n", (unsigned) CAPACITY, (unsigned) REPLAY_BATCH, ROUNDS);
+    printf("append: %u records/s\n", (unsigned) per_s(appended, append_elapsed));
+    printf("replay: %u records/s, peek and consume\n", (unsigned) per_s(replayed, replay_elapsed));
+    printf("bytes/record: %u by journal, %u to log file\n\n", (unsigned) (stats.bytes_written / appended),
+           (unsigned) (kvstore.log_bytes() / appended));
+    TelemetryJournal::print_stats();
+
+    HOST_TEST_ASSERT_EQUAL(appended, replayed);
+    HOST_TEST_ASSERT_EQUAL(appended, stats.appended);
+    HOST_TEST_ASSERT_EQUAL(0, stats.overwritten);
+    HOST_TEST_ASSERT_EQUAL(0, stats.append_failed);
+    HOST_TEST_ASSERT_EQUAL(replayed, stats.consumed);
+
+    /* Position recovered from the file after reboot */
+    TelemetryJournal rebooted(&kvstore);
+    HOST_TEST_ASSERT_EQUAL(MBED_SUCCESS, rebooted.init());
+    HOST_TEST_ASSERT(rebooted.empty());
+}
+
+}
+
+int main()
+{
+    HOST_TEST_RUN(test_append_replay_throughput);
+
+    return 0;
+}
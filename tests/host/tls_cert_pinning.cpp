@@ -0,0 +1,163 @@
+/* Server certificate verification against pinned chain: time and heap churn per handshake
+ *
+ * Built with one pin (tls-cert-pins 1) and tls-heap-tracking enabled. Full handshakes
+ * alternating between two brokers evict each other's pin, so each verifies the chain in
+ * full. Then full handshakes with a third broker compare its chain with the pin after the
+ * first one. Per handshake, CPU time is that of this thread over a blocking connect(), and
+ * churn and peak are the blocks allocated and handshake peak of Mbed TLS TLSHeapTracker
+ * accounts. The third broker then renews its server certificate: the next handshake must
+ * fail at verification, and the one after verify the renewed chain in full and pin it.
+ */
+
+#include "mbed.h"
+#include "MyTLSSocket.h"
+#include "TLSCertPinning.h"
+#include "TLSHeapTracker.h"
+#include "loopback_broker.h"
+#include "host_test.h"
+
+#include <time.h>
+
+namespace {
+
+const int CONNECTS = 10;
+
+/* Two to evict each other's pin, and one pinned, renewing after CONNECTS + 1 connections */
+LoopbackBroker brokers[3];
+const LoopbackBroker::Options OPTIONS[3] = {
+    { false, false, 0 },
+    { false, false, 0 },
+    { false, false, CONNECTS + 1 }
+};
+
+struct Sample {
+    uint64_t    cpu_us;
+    uint32_t    allocs;
+    uint32_t    peak;
+};
+
+uint64_t thread_cpu_us()
+{
+    struct timespec ts;
+    HOST_TEST_ASSERT_EQUAL(0, clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts));
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+nsapi_error_t connect_once(LoopbackBroker &broker, Sample *sample)
+{
+    NetworkInterface *net = NetworkInterface::get_default_instance();
+    SocketAddress sockaddr;
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, net->gethostbyname(LoopbackBroker::HOSTNAME, &sockaddr));
+    sockaddr.set_port(broker.port());
+
+    MyTLSSocket *tlssocket = new MyTLSSocket;
+    tlssocket->set_hostname(LoopbackBroker::HOSTNAME);
+    /* All brokers generate their own root CA */
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_root_ca_cert(broker.root_ca_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_client_cert_key(broker.client_cert_pem(), broker.client_key_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->open(net));
+
+    uint64_t start = thread_cpu_us();
+    nsapi_error_t rc = tlssocket->connect(sockaddr);
+    sample->cpu_us = thread_cpu_us() - start;
+    sample->allocs = TLSHeapTracker::stats().handshake_allocs_last;
+    sample->peak = TLSHeapTracker::stats().handshake_peak_last;
+
+    tlssocket->close();
+    delete tlssocket;
+
+    return rc;
+}
+
+void print_row(const char *name, const Sample *samples, int count, Sample *avg)
+{
+    uint64_t cpu_total = 0;
+    uint64_t allocs_total = 0;
+    uint64_t peak_total = 0;
+
+    for (int i = 0; i < count; i ++) {
+        cpu_total += samples[i].cpu_us;
+        allocs_total += samples[i].allocs;
+        peak_total += samples[i].peak;
+    }
+    avg->cpu_us = cpu_total / count;
+    avg->allocs = (uint32_t) (allocs_total / count);
+    avg->peak = (uint32_t) (peak_total / count);
+
+    printf("%-9s  %10d  %10u  %10u  %8u\n", name, count, (unsigned) avg->cpu_us, (unsigned) avg->allocs, (unsigned) avg->peak);
+}
+
+void test_verified_against_pinned()
+{
+    Sample verified[CONNECTS];
+    Sample pinned[CONNECTS];
+    Sample first;
+    Sample verified_avg;
+    Sample pinned_avg;
+
+    for (int n = 0; n < CONNECTS; n ++) {
+        HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, connect_once(brokers[n % 2], &verified[n]));
+    }
+
+    /* Verified in full and pinned, then compared with pin */
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, connect_once(brokers[2], &first));
+    for (int n = 0; n < CONNECTS; n ++) {
+        HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, connect_once(brokers[2], &pinned[n]));
+    }
+
+    printf("chain      handshakes  CPU avg us  churn avg   peak avg\n");
+    print_row("verified", verified, CONNECTS, &verified_avg);
+    print_row("pinned", pinned, CONNECTS, &pinned_avg);
+    printf("\n");
+
+    const TLSCertPinning::Stats &stats = TLSCertPinning::stats();
+    HOST_TEST_ASSERT_EQUAL(CONNECTS + 1, stats.verified);
+    HOST_TEST_ASSERT_EQUAL(CONNECTS, stats.pinned);
+    HOST_TEST_ASSERT_EQUAL(0, stats.mismatches);
+    /* Root CA signature check and its bignum temporaries skipped */
+    HOST_TEST_ASSERT(pinned_avg.cpu_us < verified_avg.cpu_us);
+    HOST_TEST_ASSERT(pinned_avg.allocs < verified_avg.allocs);
+}
+
+void test_renewed_certificate()
+{
+    Sample sample;
+
+    /* Fails at depth 0 of verification, and the pin is dropped */
+    HOST_TEST_ASSERT(connect_once(brokers[2], &sample) != NSAPI_ERROR_OK);
+    HOST_TEST_ASSERT_EQUAL(1, TLSCertPinning::stats().mismatches);
+    HOST_TEST_ASSERT(! TLSCertPinning::get_instance().pinned(LoopbackBroker::HOSTNAME, brokers[2].port()));
+
+    /* Renewed chain verified in full and pinned */
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, connect_once(brokers[2], &sample));
+    HOST_TEST_ASSERT(TLSCertPinning::get_instance().pinned(LoopbackBroker::HOSTNAME, brokers[2].port()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, connect_once(brokers[2], &sample));
+
+    const TLSCertPinning::Stats &stats = TLSCertPinning::stats();
+    HOST_TEST_ASSERT_EQUAL(CONNECTS + 2, stats.verified);
+    HOST_TEST_ASSERT_EQUAL(CONNECTS + 1, stats.pinned);
+
+    TLSCertPinning::print_stats();
+    TLSHeapTracker::print_stats();
+}
+
+}
+
+int main()
+{
+    /* Before any thread of ours. Credentials are generated with the default allocator, and
+     * freed before the tracker is installed. */
+    for (int i = 0; i < 3; i ++) {
+        HOST_TEST_ASSERT_EQUAL(0, brokers[i].start(OPTIONS[i]));
+    }
+    TLSHeapTracker::install();
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, NetworkInterface::get_default_instance()->connect());
+
+    HOST_TEST_RUN(test_verified_against_pinned);
+    HOST_TEST_RUN(test_renewed_certificate);
+
+    for (int i = 0; i < 3; i ++) {
+        brokers[i].stop();
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+/* Credentials in DER against PEM: flash and parse time saved
+ *
+ * Converts PEM credentials to DER as credentials/pem2der.py does at build time: the root CA of
+ * credentials/aws_root_ca.pem (RSA 2048), and the root CA and client certificate/key of the
+ * loopback broker (EC P-256). Both forms are parsed through TLSCredentialStore as MyTLSSocket
+ * does. Flash is the size of the embedded array, PEM with null terminator as in main.cpp.
+ * Heap saved is that held less by the parsed objects, as DER certificates are referenced in
+ * place rather than copied. A connect with the DER credentials confirms they are usable.
+ */
+
+#include "mbed.h"
+#include "MyTLSSocket.h"
+#include "TLSCredentialStore.h"
+#include "mbed_stats.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+#include "loopback_broker.h"
+#include "host_test.h"
+
+namespace {
+
+const int PARSES = 500;
+
+/* Credential in both forms, DER to stay valid as referenced in place */
+struct Credential {
+    const char *        name;
+    const char *        pem;
+    size_t              pem_len;
+    const char *        key_pem;            /* Client private key, or NULL for root CA */
+    size_t              key_pem_len;
+    unsigned char       der[2048];
+    size_t              der_len;
+    unsigned char       key_der[256];
+    size_t              key_der_len;
+};
+
+LoopbackBroker broker;
+char aws_root_ca_pem[4096];
+Credential credentials[3];
+
+/* DER of all certificates of PEM chain, concatenated */
+void crt_pem_to_der(const char *pem, size_t pem_len, unsigned char *der, size_t size, size_t *der_len)
+{
+    mbedtls_x509_crt chain;
+    mbedtls_x509_crt_init(&chain);
+    HOST_TEST_ASSERT_EQUAL(0, mbedtls_x509_crt_parse(&chain, (const unsigned char *) pem, pem_len));
+
+    *der_len = 0;
+    for (mbedtls_x509_crt *crt = &chain; crt != NULL && crt->raw.p != NULL; crt = crt->next) {
+        HOST_TEST_ASSERT(*der_len + crt->raw.len <= size);
+        memcpy(der + *der_len, crt->raw.p, crt->raw.len);
+        *der_len += crt->raw.len;
+    }
+    mbedtls_x509_crt_free(&chain);
+}
+
+void key_pem_to_der(const char *pem, size_t pem_len, unsigned char *der, size_t size, size_t *der_len)
+{
+    mbedtls_pk_context key;
+    mbedtls_pk_init(&key);
+    HOST_TEST_ASSERT_EQUAL(0, mbedtls_pk_parse_key(&key, (const unsigned char *) pem, pem_len, NULL, 0));
+
+    /* Written at end of buffer */
+    int ret = mbedtls_pk_write_key_der(&key, der, size);
+    HOST_TEST_ASSERT(ret > 0);
+    memmove(der, der + size - ret, ret);
+    *der_len = ret;
+    mbedtls_pk_free(&key);
+}
+
+void add_credential(Credential &cred, const char *name, const char *pem, const char *key_pem)
+{
+    cred.name = name;
+    cred.pem = pem;
+    cred.pem_len = strlen(pem) + 1;
+    crt_pem_to_der(cred.pem, cred.pem_len, cred.der, sizeof (cred.der), &cred.der_len);
+
+    cred.key_pem = key_pem;
+    cred.key_pem_len = key_pem ? strlen(key_pem) + 1 : 0;
+    cred.key_der_len = 0;
+    if (key_pem) {
+        key_pem_to_der(cred.key_pem, cred.key_pem_len, cred.key_der, sizeof (cred.key_der), &cred.key_der_len);
+    }
+}
+
+void read_aws_root_ca()
+{
+    FILE *file = fopen(AWS_ROOT_CA_PEM_FILE, "r");
+    HOST_TEST_ASSERT(file != NULL);
+    size_t n = fread(aws_root_ca_pem, 1, sizeof (aws_root_ca_pem) - 1, file);
+    fclose(file);
+    HOST_TEST_ASSERT(n > 0 && n < sizeof (aws_root_ca_pem) - 1);
+    aws_root_ca_pem[n] = '\0';
+}
+
+uint32_t heap_current()
+{
+    mbed_stats_heap_t heap_stats;
+    mbed_stats_heap_get(&heap_stats);
+    return heap_stats.current_size;
+}
+
+/* Parse through TLSCredentialStore, timed. The previous objects are freed on replace. */
+int parse(const Credential &cred, bool der, std::chrono::nanoseconds *elapsed)
+{
+    TLSCredentialStore &store = TLSCredentialStore::get_instance();
+    const void *crt = der ? (const void *) cred.der : (const void *) cred.pem;
+    size_t crt_len = der ? cred.der_len : cred.pem_len;
+    int ret;
+
+    HighResClock::time_point start = HighResClock::now();
+    if (cred.key_pem) {
+        const void *key = der ? (const void *) cred.key_der : (const void *) cred.key_pem;
+        size_t key_len = der ? cred.key_der_len : cred.key_pem_len;
+        ret = store.set_client_cert_key(crt, crt_len, key, key_len);
+    } else {
+        ret = store.set_root_ca_cert(crt, crt_len);
+    }
+    *elapsed += HighResClock::now() - start;
+
+    return ret;
+}
+
+void test_pem_against_der()
+{
+    printf("credential        PEM bytes  DER bytes  flash saved  PEM parse us  DER parse us  parse saved us  heap saved\n");
+    for (size_t i = 0; i < sizeof (credentials) / sizeof (credentials[0]); i ++) {
+        const Credential &cred = credentials[i];
+        std::chrono::nanoseconds pem_elapsed(0);
+        std::chrono::nanoseconds der_elapsed(0);
+        uint32_t pem_heap = 0;
+        uint32_t der_heap = 0;
+
+        /* Interleaved, so that both forms see the same machine load. Each one replaces the other. */
+        for (int n = 0; n < PARSES; n ++) {
+            HOST_TEST_ASSERT_EQUAL(0, parse(cred, false, &pem_elapsed));
+            pem_heap = heap_current();
+            HOST_TEST_ASSERT_EQUAL(0, parse(cred, true, &der_elapsed));
+            der_heap = heap_current();
+        }
+
+        size_t pem_bytes = cred.pem_len + cred.key_pem_len;
+        size_t der_bytes = cred.der_len + cred.key_der_len;
+        uint32_t pem_us_x10 = (uint32_t) (pem_elapsed.count() / PARSES / 100);
+        uint32_t der_us_x10 = (uint32_t) (der_elapsed.count() / PARSES / 100);
+        int saved_us_x10 = (int) pem_us_x10 - (int) der_us_x10;
+
+        printf("%-16s  %9u  %9u  %11d  %10u.%u  %10u.%u  %11d.%d  %10d\n", cred.name, (unsigned) pem_bytes,
+               (unsigned) der_bytes, (int) pem_bytes - (int) der_bytes, (unsigned) pem_us_x10 / 10,
+               (unsigned) pem_us_x10 % 10, (unsigned) der_us_x10 / 10, (unsigned) der_us_x10 % 10,
+               saved_us_x10 / 10, abs(saved_us_x10 % 10), (int) pem_heap - (int) der_heap);
+
+        HOST_TEST_ASSERT(der_bytes < pem_bytes);
+        HOST_TEST_ASSERT(der_elapsed <= pem_elapsed);
+        HOST_TEST_ASSERT(der_heap < pem_heap);
+    }
+    printf("\n");
+
+    TLSCredentialStore::print_stats();
+}
+
+void test_connect_der()
+{
+    const Credential &root_ca = credentials[1];
+    const Credential &client = credentials[2];
+    NetworkInterface *net = NetworkInterface::get_default_instance();
+    SocketAddress sockaddr;
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, net->gethostbyname(LoopbackBroker::HOSTNAME, &sockaddr));
+    sockaddr.set_port(broker.port());
+
+    MyTLSSocket *tlssocket = new MyTLSSocket;
+    tlssocket->set_hostname(LoopbackBroker::HOSTNAME);
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_root_ca_cert(root_ca.der, root_ca.der_len));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_client_cert_key(client.der, client.der_len,
+                                                                          client.key_der, client.key_der_len));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->open(net));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->connect(sockaddr));
+    tlssocket->close();
+    delete tlssocket;
+}
+
+}
+
+int main()
+{
+    /* Before any thread of ours */
+    LoopbackBroker::Options options = { false, false, 0 };
+    HOST_TEST_ASSERT_EQUAL(0, broker.start(options));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, NetworkInterface::get_default_instance()->connect());
+
+    read_aws_root_ca();
+    add_credential(credentials[0], "Amazon Root CA 1", aws_root_ca_pem, NULL);
+    add_credential(credentials[1], "loopback root CA", broker.root_ca_pem(), NULL);
+    add_credential(credentials[2], "client cert+key", broker.client_cert_pem(), broker.client_key_pem());
+
+    HOST_TEST_RUN(test_pem_against_der);
+    HOST_TEST_RUN(test_connect_der);
+
+    broker.stop();
+    return 0;
+}
@@ -0,0 +1,103 @@
+/* Handshake CPU time and peak RAM, by my-tlssocket.tls-crypto-profile
+ *
+ * Built once per crypto profile with tls-heap-tracking enabled. Connects MyTLSSocket to the
+ * loopback broker CONNECTS times with full handshakes, blocking, so TCP connect and handshake
+ * run on this thread. CPU time is that of this thread over connect(), i.e. client crypto
+ * without waits on the network or on the broker, which runs in its own process. Peak RAM is
+ * the Mbed TLS handshake peak TLSHeapTracker accounts per session, as host command 'm'
+ * reports on target. The broker presents an EC P-256 certificate, as profile 1 needs.
+ */
+
+#include "mbed.h"
+#include "MyTLSSocket.h"
+#include "TLSHeapTracker.h"
+#include "mbedtls/ssl.h"
+#include "loopback_broker.h"
+#include "host_test.h"
+
+#include <time.h>
+
+namespace {
+
+const int CONNECTS = 10;
+
+LoopbackBroker broker;
+
+uint64_t thread_cpu_us()
+{
+    struct timespec ts;
+    HOST_TEST_ASSERT_EQUAL(0, clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts));
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Ciphersuite negotiated */
+const char *connect_once(uint64_t *cpu_us)
+{
+    NetworkInterface *net = NetworkInterface::get_default_instance();
+    SocketAddress sockaddr;
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, net->gethostbyname(LoopbackBroker::HOSTNAME, &sockaddr));
+    sockaddr.set_port(broker.port());
+
+    MyTLSSocket *tlssocket = new MyTLSSocket;
+    tlssocket->set_hostname(LoopbackBroker::HOSTNAME);
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_root_ca_cert(broker.root_ca_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_client_cert_key(broker.client_cert_pem(), broker.client_key_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->open(net));
+
+    uint64_t start = thread_cpu_us();
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->connect(sockaddr));
+    *cpu_us = thread_cpu_us() - start;
+
+    const char *ciphersuite = mbedtls_ssl_get_ciphersuite(tlssocket->get_ssl_context());
+    tlssocket->close();
+    delete tlssocket;
+
+    return ciphersuite;
+}
+
+void test_handshake_cpu_and_ram()
+{
+    uint64_t cpu_total = 0;
+    uint64_t cpu_min = UINT64_MAX;
+    const char *ciphersuite = NULL;
+
+    for (int n = 0; n < CONNECTS; n ++) {
+        uint64_t cpu_us;
+        ciphersuite = connect_once(&cpu_us);
+        cpu_total += cpu_us;
+        if (cpu_us < cpu_min) {
+            cpu_min = cpu_us;
+        }
+    }
+
+    const TLSHeapTracker::Stats &heap_stats = TLSHeapTracker::stats();
+    printf("crypto profile %d (%s): handshake CPU avg %u us, min %u us, peak RAM %u bytes\n\n",
+           MBED_CONF_MY_TLSSOCKET_TLS_CRYPTO_PROFILE, ciphersuite, (unsigned) (cpu_total / CONNECTS),
+           (unsigned) cpu_min, (unsigned) heap_stats.handshake_peak_max);
+    MyTLSSocket::print_handshake_stats();
+    TLSHeapTracker::print_stats();
+
+    HOST_TEST_ASSERT(cpu_min > 0);
+    HOST_TEST_ASSERT_EQUAL(CONNECTS, heap_stats.sessions);
+    HOST_TEST_ASSERT_EQUAL(0, heap_stats.failures);
+#if MBED_CONF_MY_TLSSOCKET_TLS_CRYPTO_PROFILE == 1
+    HOST_TEST_ASSERT(strstr(ciphersuite, "ECDHE-ECDSA") != NULL);
+#endif
+}
+
+}
+
+int main()
+{
+    /* Before any thread of ours. Credentials are generated with the default allocator, and
+     * freed before the tracker is installed. */
+    LoopbackBroker::Options options = { false, false, 0 };
+    HOST_TEST_ASSERT_EQUAL(0, broker.start(options));
+    TLSHeapTracker::install();
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, NetworkInterface::get_default_instance()->connect());
+
+    HOST_TEST_RUN(test_handshake_cpu_and_ram);
+
+    broker.stop();
+    return 0;
+}
@@ -0,0 +1,85 @@
+/* Peak heap per TLS session, by my-tlssocket.tls-memory-profile
+ *
+ * Built once per memory profile with tls-heap-tracking enabled. Connects MyTLSSocket to the
+ * loopback broker CONNECTS times with full handshakes, and reports what TLSHeapTracker
+ * accounts per session as host command 'm' does on target: handshake peak, steady heap held
+ * by the connection after handshake, and blocks allocated. Only Mbed TLS heap of the client
+ * counts; the broker runs in its own process. Built with tls-max-frag-len 4 too, as on all
+ * targets: the max_fragment_length extension must then be negotiated with the broker.
+ */
+
+#include "mbed.h"
+#include "MyTLSSocket.h"
+#include "TLSHeapTracker.h"
+#include "mbedtls/ssl.h"
+#include "loopback_broker.h"
+#include "host_test.h"
+
+namespace {
+
+const int CONNECTS = 5;
+
+LoopbackBroker broker;
+
+void connect_once()
+{
+    NetworkInterface *net = NetworkInterface::get_default_instance();
+    SocketAddress sockaddr;
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, net->gethostbyname(LoopbackBroker::HOSTNAME, &sockaddr));
+    sockaddr.set_port(broker.port());
+
+    MyTLSSocket *tlssocket = new MyTLSSocket;
+    tlssocket->set_hostname(LoopbackBroker::HOSTNAME);
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_root_ca_cert(broker.root_ca_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_client_cert_key(broker.client_cert_pem(), broker.client_key_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->open(net));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->connect(sockaddr));
+#if MBED_CONF_MY_TLSSOCKET_TLS_MAX_FRAG_LEN > 0
+    /* Not refused by mbedtls_ssl_conf_max_frag_len(), and accepted by the broker */
+    HOST_TEST_ASSERT_EQUAL(MBED_CONF_MY_TLSSOCKET_TLS_MAX_FRAG_LEN, tlssocket->get_ssl_context()->session->mfl_code);
+#endif
+    tlssocket->close();
+    delete tlssocket;
+}
+
+void test_heap_per_session()
+{
+    /* First one parses the credentials, which TLSCredentialStore keeps */
+    connect_once();
+    uint32_t in_use_first = TLSHeapTracker::stats().in_use;
+    for (int n = 1; n < CONNECTS; n ++) {
+        connect_once();
+    }
+
+    const TLSHeapTracker::Stats &stats = TLSHeapTracker::stats();
+    printf("memory profile %d (IN %d/OUT %d, max frag len %d): handshake peak %u, steady %u, churn %u blocks per session\n\n",
+           MBED_CONF_MY_TLSSOCKET_TLS_MEMORY_PROFILE, MBEDTLS_SSL_IN_CONTENT_LEN, MBEDTLS_SSL_OUT_CONTENT_LEN,
+           MBED_CONF_MY_TLSSOCKET_TLS_MAX_FRAG_LEN,
+           (unsigned) stats.handshake_peak_max, (unsigned) stats.steady_max, (unsigned) stats.handshake_allocs_max);
+    TLSHeapTracker::print_stats();
+
+    HOST_TEST_ASSERT_EQUAL(CONNECTS, stats.sessions);
+    HOST_TEST_ASSERT_EQUAL(0, stats.failures);
+    /* Record buffers are allocated in full for the handshake */
+    HOST_TEST_ASSERT(stats.handshake_peak_max >= MBEDTLS_SSL_IN_CONTENT_LEN + MBEDTLS_SSL_OUT_CONTENT_LEN);
+    HOST_TEST_ASSERT(stats.steady_max <= stats.handshake_peak_max);
+    /* Nothing of the sessions left behind after close */
+    HOST_TEST_ASSERT_EQUAL(in_use_first, stats.in_use);
+}
+
+}
+
+int main()
+{
+    /* Before any thread of ours. Credentials are generated with the default allocator, and
+     * freed before the tracker is installed. */
+    LoopbackBroker::Options options = { false, false, 0 };
+    HOST_TEST_ASSERT_EQUAL(0, broker.start(options));
+    TLSHeapTracker::install();
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, NetworkInterface::get_default_instance()->connect());
+
+    HOST_TEST_RUN(test_heap_per_session);
+
+    broker.stop();
+    return 0;
+}
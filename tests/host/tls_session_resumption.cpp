@@ -0,0 +1,102 @@
+/* TLS session resumption against the loopback broker: hit/miss and handshake time, full against resumed
+ *
+ * Connects MyTLSSocket CONNECTS times in a row to brokers resuming by session ticket, by
+ * session ID from server session cache, and not at all. TLSSessionCache offers the session
+ * of the previous connect, as on target, and accounts hit/miss and handshake time (TCP
+ * connect and handshake) as host command 's' reports it.
+ */
+
+#include "mbed.h"
+#include "MyTLSSocket.h"
+#include "loopback_broker.h"
+#include "host_test.h"
+
+namespace {
+
+const int CONNECTS = 10;
+
+struct Scenario {
+    const char *                name;
+    LoopbackBroker::Options     options;
+    bool                        resumable;
+};
+
+const Scenario SCENARIOS[] = {
+    { "session ticket",     { false, true, 0 },     true },
+    { "session ID",         { true, false, 0 },     true },
+    { "none",               { false, false, 0 },    false }
+};
+
+const size_t SCENARIO_COUNT = sizeof (SCENARIOS) / sizeof (SCENARIOS[0]);
+
+LoopbackBroker brokers[SCENARIO_COUNT];
+
+void connect_once(LoopbackBroker &broker)
+{
+    NetworkInterface *net = NetworkInterface::get_default_instance();
+    SocketAddress sockaddr;
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, net->gethostbyname(LoopbackBroker::HOSTNAME, &sockaddr));
+    sockaddr.set_port(broker.port());
+
+    MyTLSSocket *tlssocket = new MyTLSSocket;
+    tlssocket->set_hostname(LoopbackBroker::HOSTNAME);
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_root_ca_cert(broker.root_ca_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->set_client_cert_key(broker.client_cert_pem(), broker.client_key_pem()));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->open(net));
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, tlssocket->connect(sockaddr));
+    tlssocket->close();
+    delete tlssocket;
+}
+
+void test_resumption()
+{
+    printf("resumption      offered  hits  misses  full avg ms  resumed avg ms  saved ms\n");
+    for (size_t i = 0; i < SCENARIO_COUNT; i ++) {
+        const Scenario &scenario = SCENARIOS[i];
+        TLSSessionCache::Stats before = TLSSessionCache::stats();
+
+        for (int n = 0; n < CONNECTS; n ++) {
+            connect_once(brokers[i]);
+        }
+
+        const TLSSessionCache::Stats &after = TLSSessionCache::stats();
+        uint32_t offered = after.offered - before.offered;
+        uint32_t hits = after.hits - before.hits;
+        uint32_t misses = after.misses - before.misses;
+        uint32_t full_avg = misses ? (after.full_ms_total - before.full_ms_total) / misses : 0;
+        uint32_t resumed_avg = hits ? (after.resumed_ms_total - before.resumed_ms_total) / hits : 0;
+
+        printf("%-14s  %7u  %4u  %6u  %11u  %14u  %8d\n", scenario.name, (unsigned) offered, (unsigned) hits,
+               (unsigned) misses, (unsigned) full_avg, (unsigned) resumed_avg, hits ? (int) full_avg - (int) resumed_avg : 0);
+
+        /* Session of each connect offered on the next one */
+        HOST_TEST_ASSERT_EQUAL(CONNECTS - 1, offered);
+        HOST_TEST_ASSERT_EQUAL(0, after.failures - before.failures);
+        if (scenario.resumable) {
+            HOST_TEST_ASSERT_EQUAL(CONNECTS - 1, hits);
+            HOST_TEST_ASSERT_EQUAL(1, misses);
+            HOST_TEST_ASSERT(resumed_avg <= full_avg);
+        } else {
+            HOST_TEST_ASSERT_EQUAL(0, hits);
+            HOST_TEST_ASSERT_EQUAL(CONNECTS, misses);
+        }
+    }
+    printf("\n");
+
+    TLSSessionCache::print_stats();
+}
+
+}
+
+int main()
+{
+    /* Brokers before any thread of ours */
+    for (size_t i = 0; i < SCENARIO_COUNT; i ++) {
+        HOST_TEST_ASSERT_EQUAL(0, brokers[i].start(SCENARIOS[i].options));
+    }
+    HOST_TEST_ASSERT_EQUAL(NSAPI_ERROR_OK, NetworkInterface::get_default_instance()->connect());
+
+    HOST_TEST_RUN(test_resumption);
+
+    return 0;
+}
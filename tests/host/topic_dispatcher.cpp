@@ -0,0 +1,164 @@
+/* MQTTTopicDispatcher: which of overlapping literal, '+' and '#' filters each topic reaches */
+
+#include "mbed.h"
+#include "MQTTTopicDispatcher.h"
+#include "host_test.h"
+
+#include <stdio.h>
+
+namespace {
+
+const int NONE = -1;
+
+/* Index of filter whose handler was called last */
+int routed = NONE;
+
+/* Handler of filter with its index */
+struct Route {
+    int     index;
+
+    void on_message(const MQTTMessageView &view)
+    {
+        (void) view;
+        routed = index;
+    }
+};
+
+const char *FILTERS[] = {
+    "a/b/c",        /* 0 */
+    "a/+/c",        /* 1 */
+    "a/+/d",        /* 2 */
+    "a/#",          /* 3 */
+    "#",            /* 4 */
+    "+/x",          /* 5 */
+    "k",            /* 6 */
+    "k/#",          /* 7 */
+    "m/+/#",        /* 8 */
+    "$SYS/#",       /* 9, added after checking $SYS/x reaches no wildcard */
+};
+
+const int FILTER_COUNT = sizeof (FILTERS) / sizeof (FILTERS[0]);
+
+Route routes[FILTER_COUNT];
+
+/* Filter index the topic reaches, or NONE, checking the unmatched count along */
+template<typename Dispatcher>
+int route(Dispatcher &dispatcher, const char *topic)
+{
+    MQTTMessageView view = { topic, strlen(topic), "{}", 2, MQTT::QOS1, false, false, 1 };
+    uint32_t unmatched = dispatcher.unmatched();
+
+    routed = NONE;
+    bool dispatched = dispatcher.dispatch(view);
+
+    HOST_TEST_ASSERT_EQUAL(dispatched, routed != NONE);
+    HOST_TEST_ASSERT_EQUAL(unmatched + (dispatched ? 0 : 1), dispatcher.unmatched());
+
+    return routed;
+}
+
+void test_overlapping_filters()
+{
+    MQTTTopicDispatcher<FILTER_COUNT, 64> dispatcher;
+
+    for (int i = 0; i < FILTER_COUNT; i ++) {
+        routes[i].index = i;
+    }
+    for (int i = 0; i < FILTER_COUNT - 1; i ++) {
+        HOST_TEST_ASSERT_EQUAL(MQTT::SUCCESS, dispatcher.add(FILTERS[i], callback(&routes[i], &Route::on_message)));
+    }
+
+    /* Literal over '+' over '#' */
+    HOST_TEST_ASSERT_EQUAL(0, route(dispatcher, "a/b/c"));
+    HOST_TEST_ASSERT_EQUAL(1, route(dispatcher, "a/z/c"));
+    /* Backtracking: literal "b" has no "d" below, '+' has */
+    HOST_TEST_ASSERT_EQUAL(2, route(dispatcher, "a/b/d"));
+    /* Neither "b" nor '+' has "e" below: back to "a/#" */
+    HOST_TEST_ASSERT_EQUAL(3, route(dispatcher, "a/b/e"));
+    HOST_TEST_ASSERT_EQUAL(3, route(dispatcher, "a/b"));
+    HOST_TEST_ASSERT_EQUAL(3, route(dispatcher, "a/b/c/d"));
+    /* '+' matches an empty level */
+    HOST_TEST_ASSERT_EQUAL(1, route(dispatcher, "a//c"));
+
+    /* "a/#" matches parent level "a" */
+    HOST_TEST_ASSERT_EQUAL(3, route(dispatcher, "a"));
+    /* Unless "a" has a filter of its own */
+    HOST_TEST_ASSERT_EQUAL(6, route(dispatcher, "k"));
+    HOST_TEST_ASSERT_EQUAL(7, route(dispatcher, "k/z"));
+    /* Also below '+': "m/+/#" matches "m/z" */
+    HOST_TEST_ASSERT_EQUAL(8, route(dispatcher, "m/z"));
+    HOST_TEST_ASSERT_EQUAL(8, route(dispatcher, "m/z/y"));
+    HOST_TEST_ASSERT_EQUAL(4, route(dispatcher, "m"));
+
+    /* '+' matches exactly one level */
+    HOST_TEST_ASSERT_EQUAL(5, route(dispatcher, "q/x"));
+    HOST_TEST_ASSERT_EQUAL(4, route(dispatcher, "x"));
+    HOST_TEST_ASSERT_EQUAL(4, route(dispatcher, "q/x/y"));
+    HOST_TEST_ASSERT_EQUAL(4, route(dispatcher, "q"));
+
+    /* '$' topics don't match "#" or "+/x" at the first level */
+    HOST_TEST_ASSERT_EQUAL(NONE, route(dispatcher, "$SYS/x"));
+    HOST_TEST_ASSERT_EQUAL(NONE, route(dispatcher, "$SYS"));
+    HOST_TEST_ASSERT_EQUAL(NONE, route(dispatcher, "$aws/things/thing/shadow/update/delta"));
+
+    /* But do a literal '$' level */
+    HOST_TEST_ASSERT_EQUAL(MQTT::SUCCESS, dispatcher.add(FILTERS[9], callback(&routes[9], &Route::on_message)));
+    HOST_TEST_ASSERT_EQUAL(9, route(dispatcher, "$SYS/x"));
+    HOST_TEST_ASSERT_EQUAL(9, route(dispatcher, "$SYS"));
+    HOST_TEST_ASSERT_EQUAL(NONE, route(dispatcher, "$aws/x"));
+
+    /* Filter pool full */
+    HOST_TEST_ASSERT_EQUAL(MQTT::FAILURE, dispatcher.add("z", callback(&routes[0], &Route::on_message)));
+    HOST_TEST_ASSERT_EQUAL(4, route(dispatcher, "z"));
+}
+
+void test_node_pool_overflow()
+{
+    const int MAX_NODES = MBED_CONF_MY_MQTT_DISPATCHER_MAX_NODES;
+    static_assert(MAX_NODES % 2 == 0, "Last filter added half needs even node pool");
+    /* Filters not limiting: node pool runs out first */
+    MQTTTopicDispatcher<MAX_NODES + 1> dispatcher;
+    Route route_a = { 0 };
+    Route route_b = { 1 };
+    char filters[MAX_NODES][16];
+
+    /* Two levels per filter, so that the last one is added half */
+    int added = 0;
+    for (int i = 0; i < MAX_NODES; i ++) {
+        snprintf(filters[i], sizeof (filters[i]), "f%d/+", i);
+        if (dispatcher.add(filters[i], callback(&route_a, &Route::on_message)) != MQTT::SUCCESS) {
+            break;
+        }
+        added ++;
+    }
+
+    /* Root and two nodes per filter. The failed one took the last node for its first level. */
+    HOST_TEST_ASSERT_EQUAL((MAX_NODES - 1) / 2, added);
+    HOST_TEST_ASSERT_EQUAL(MAX_NODES, dispatcher.node_count());
+
+    /* Filters added before still route, the half-added one doesn't */
+    HOST_TEST_ASSERT_EQUAL(0, route(dispatcher, "f0/x"));
+    HOST_TEST_ASSERT_EQUAL(0, route(dispatcher, "f0/y"));
+    char topic[16];
+    snprintf(topic, sizeof (topic), "f%d/x", added - 1);
+    HOST_TEST_ASSERT_EQUAL(0, route(dispatcher, topic));
+    snprintf(topic, sizeof (topic), "f%d/x", added);
+    HOST_TEST_ASSERT_EQUAL(NONE, route(dispatcher, topic));
+
+    /* Nothing more fits, not even one level. A filter within existing nodes still does. */
+    HOST_TEST_ASSERT_EQUAL(MQTT::FAILURE, dispatcher.add("g", callback(&route_b, &Route::on_message)));
+    HOST_TEST_ASSERT_EQUAL(NONE, route(dispatcher, "g"));
+    HOST_TEST_ASSERT_EQUAL(MQTT::SUCCESS, dispatcher.add("f0", callback(&route_b, &Route::on_message)));
+    HOST_TEST_ASSERT_EQUAL(1, route(dispatcher, "f0"));
+    HOST_TEST_ASSERT_EQUAL(MAX_NODES, dispatcher.node_count());
+}
+
+}
+
+int main()
+{
+    HOST_TEST_RUN(test_overlapping_filters);
+    HOST_TEST_RUN(test_node_pool_overflow);
+
+    return 0;
+}